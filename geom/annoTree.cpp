@@ -0,0 +1,139 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <baseUtils.h>
+#include <annoTree.h>
+
+using namespace std;
+using namespace utils;
+
+annoTree::annoTree(){}
+
+void annoTree::formTreeOfAnnos(const std::vector<anno> & annotations){
+
+  m_labels.clear();
+  m_labelStarts.clear();
+
+  size_t numChars = 0;
+  for (size_t s = 0; s < annotations.size(); s++)
+    numChars += annotations[s].label.size() + 1;
+  m_labels.reserve(numChars);
+  m_labelStarts.reserve(annotations.size());
+
+  vector<PointWithId> Pts;
+  Pts.reserve(annotations.size());
+  for (size_t s = 0; s < annotations.size(); s++) {
+    const anno & A = annotations[s]; // alias
+    m_labelStarts.push_back(m_labels.size());
+    m_labels.insert(m_labels.end(), A.label.begin(), A.label.end());
+    m_labels.push_back('\0');
+
+    // Such annotations are never in a box nor closest to a point
+    if (std::isnan(A.x) || std::isnan(A.y)) continue;
+    Pts.push_back(PointWithId(A.x, A.y, (int)s));
+  }
+
+  m_tree.formTreeOfPoints(Pts);
+}
+
+void annoTree::getIdsInBox(const dRect & box, std::vector<int> & ids) const{
+
+  vector<PointWithId> Pts;
+  m_tree.getPointsInBox(box.xl, box.yl, box.xh, box.yh, Pts);
+
+  ids.resize(Pts.size());
+  for (size_t s = 0; s < Pts.size(); s++) ids[s] = Pts[s].id;
+  sort(ids.begin(), ids.end());
+}
+
+void annoTree::getAnnosInBox(const dRect & box, std::vector<annoView> & annos) const{
+
+  vector<PointWithId> Pts;
+  m_tree.getPointsInBox(box.xl, box.yl, box.xh, box.yh, Pts);
+  sort(Pts.begin(), Pts.end(),
+       [](PointWithId const& P, PointWithId const& Q){ return P.id < Q.id; });
+
+  annos.resize(Pts.size());
+  for (size_t s = 0; s < Pts.size(); s++) {
+    annoView & A = annos[s]; // alias
+    A.x     = Pts[s].x;
+    A.y     = Pts[s].y;
+    A.label = label(Pts[s].id);
+    A.id    = Pts[s].id;
+  }
+}
+
+void annoTree::findClosestAnno(// inputs
+                                double x0, double y0,
+                                // outputs
+                                int & id, double & dist) const{
+
+  id   = -1;
+  dist = DBL_MAX;
+
+  PointWithId P;
+  m_tree.findClosestVertexToPoint(x0, y0, P, dist);
+  if (dist == DBL_MAX) return;
+  id = P.id;
+
+  // Annotations are often put on top of each other. Of those equally
+  // close take the last one, as does a search through all of them.
+  double minDist2 = norm(x0, y0, P.x, P.y);
+  vector<PointWithId> Pts;
+  m_tree.findVerticesWithinRadius(x0, y0, nextafter(dist, DBL_MAX), Pts);
+  for (size_t s = 0; s < Pts.size(); s++) {
+    if (norm(x0, y0, Pts[s].x, Pts[s].y) == minDist2) id = max(id, Pts[s].id);
+  }
+}
+
+void annoBatch::clear(){
+  m_annos.clear();
+  m_labels.clear();
+  m_labelStarts.clear();
+}
+
+void annoBatch::add(double x, double y, int id, const char * label){
+  annoView A;
+  A.x     = x;
+  A.y     = y;
+  A.label = NULL; // set in annos(), as the buffer may move until then
+  A.id    = id;
+  m_annos.push_back(A);
+  m_labelStarts.push_back(m_labels.size());
+  for (const char * c = label; *c != '\0'; c++) m_labels.push_back(*c);
+  m_labels.push_back('\0');
+}
+
+void annoBatch::add(double x, double y, int id, int number){
+  char label[16];
+  snprintf(label, sizeof(label), "%d", number);
+  add(x, y, id, label);
+}
+
+const std::vector<annoView> & annoBatch::annos(){
+  for (size_t s = 0; s < m_annos.size(); s++)
+    m_annos[s].label = &m_labels[m_labelStarts[s]];
+  return m_annos;
+}
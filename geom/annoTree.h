@@ -0,0 +1,100 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef ANNO_TREE_H
+#define ANNO_TREE_H
+
+// A search tree of a set of annotations, for finding those in a box
+// or the one nearest to a point without looking at all of them. The
+// labels are copied into one buffer, so the annotations found are
+// returned as views into it rather than as copies of the strings.
+// The tree is not changed once formed, so copies of the polygons
+// having the annotations can share it. Annotations made just to be
+// drawn are kept the same way, see annoBatch.
+
+#include <vector>
+#include <kdTree.h>
+#include <geomUtils.h>
+
+namespace utils{
+
+  // An annotation found in an annoTree. The label points into the
+  // tree and is valid while the tree is.
+  struct annoView{
+    double       x, y;
+    const char * label;
+    int          id; // the index among the annotations the tree was formed from
+  };
+
+  // Annotations made only to be drawn, such as the index of each
+  // vertex in view. The labels are written one after another into one
+  // buffer rather than each into a string of its own.
+  class annoBatch{
+
+  public:
+    void clear();
+    void add(double x, double y, int id, const char * label);
+    void add(double x, double y, int id, int number);
+
+    int size() const { return (int)m_annos.size(); }
+
+    // The annotations added so far. Adding more may move the labels.
+    const std::vector<annoView> & annos();
+
+  private:
+    std::vector<annoView> m_annos;
+    std::vector<char>     m_labels; // each ending with a null
+    std::vector<size_t>   m_labelStarts;
+  };
+
+  class annoTree{
+
+  public:
+    annoTree();
+
+    void formTreeOfAnnos(const std::vector<anno> & annotations);
+
+    int size() const { return (int)m_labelStarts.size(); }
+
+    const char * label(int id) const { return &m_labels[m_labelStarts[id]]; }
+
+    // The annotations in the box, boundary included, in the order
+    // they were given
+    void getAnnosInBox(const dRect & box, std::vector<annoView> & annos) const;
+    void getIdsInBox  (const dRect & box, std::vector<int> & ids) const;
+
+    // The annotation closest to the point and the distance to it. If
+    // several are equally close, the last one. The id is -1 if there
+    // are none.
+    void findClosestAnno(// inputs
+                         double x0, double y0,
+                         // outputs
+                         int & id, double & dist) const;
+
+  private:
+    kdTree              m_tree;   // annotations at points which are not a number are left out
+    std::vector<char>   m_labels; // all labels, each ending with a null
+    std::vector<size_t> m_labelStarts;
+  };
+
+}
+
+#endif // ANNO_TREE_H
@@ -25,6 +25,10 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#ifdef POLYVIEW_USE_OPENMP
+#include <omp.h>
+#endif
 
 namespace utils{
 
@@ -77,7 +81,48 @@ namespace utils{
 
     vals.resize(n);
   }
-  
+
+  // Task size below which trees and sorts are formed on one thread.
+  // Smaller pieces of work cost more to hand over than to do.
+  const int minSizeForTask = 32768;
+
+  template<class T>
+  void parallelSortInternal(T * beg, T * end){
+
+    if (end - beg < minSizeForTask){
+      std::sort(beg, end);
+      return;
+    }
+
+    // Sort the halves on separate threads and merge them
+    T * mid = beg + (end - beg)/2;
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp task
+#endif
+    parallelSortInternal(beg, mid);
+    parallelSortInternal(mid, end);
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp taskwait
+#endif
+    std::inplace_merge(beg, mid, end);
+  }
+
+  // The same as std::sort, but on all threads if built with OpenMP.
+  // Equal elements may end up in a different order than with std::sort.
+  template<class T>
+  void parallelSort(std::vector<T> & vals){
+
+#ifdef POLYVIEW_USE_OPENMP
+    if ((int)vals.size() >= 2*minSizeForTask && omp_get_max_threads() > 1){
+      #pragma omp parallel
+      #pragma omp single
+      parallelSortInternal(&vals.front(), &vals.front() + vals.size());
+      return;
+    }
+#endif
+    std::sort(vals.begin(), vals.end());
+  }
+
 }
 
 #endif
@@ -32,6 +32,63 @@ using namespace utils;
 
 #define DEBUG_CUT_POLY 0 // Must be 0 in production code
 
+namespace cutPoly_local_functions{
+
+  // The cuts, in the order they are made. Cut c keeps the points with
+  // nx*x + ny*y < (nx + ny)*H, that is, those not on the side of the
+  // window which is bit c of the codes below.
+  struct cutLine{ double nx, ny; };
+  const cutLine cutLines[] = {
+    {-1,  0}, //  -- left cut
+    { 1,  0}, //  -- right cut
+    { 0, -1}, //  -- bottom cut
+    { 0,  1}  //  -- top cut
+  };
+
+  // For each side of the window, if any and if all of the given points
+  // are on it or beyond it. The loop has no branches, so that the
+  // compiler can vectorize it.
+  inline void windowCodes(int numV, const double * xv, const double * yv,
+                          double xll, double yll, double xur, double yur,
+                          unsigned & orCodes, unsigned & andCodes){
+    unsigned orC = 0, andC = 15;
+    for (int v = 0; v < numV; v++){
+      unsigned code =
+        (unsigned)(xv[v] <= xll)        | ((unsigned)(xv[v] >= xur) << 1) |
+        ((unsigned)(yv[v] <= yll) << 2) | ((unsigned)(yv[v] >= yur) << 3);
+      orC  |= code;
+      andC &= code;
+    }
+    orCodes  = orC;
+    andCodes = andC;
+  }
+
+  void processPointsOnCutline(std::vector<valIndex> & ptsOnCutline,
+                              std::vector<int> & outwardPositions,
+                              std::vector<int> & inwardPositions);
+
+  void cutPolyLineToHalfSpace(// inputs
+                              double nx, double ny, double dotH,
+                              int numV,
+                              const double * xv, const double * yv,
+                              // outputs -- the cut polygonal lines
+                              std::vector<double> & cutX,
+                              std::vector<double> & cutY,
+                              std::vector<int>    & cutNumPolys);
+
+  void cutPolysOrLines(// inputs -- the polygons or polygonal lines
+                       bool isPolyLine,
+                       int numPolys, const int * numVerts,
+                       const double * xv, const double * yv,
+                       // inputs -- the cutting window
+                       double xll, double yll, double xur, double yur,
+                       // outputs -- the cut pieces
+                       std::vector< double> & cutX,
+                       std::vector< double> & cutY,
+                       std::vector< int>    & cutNumPolys,
+                       cutPolyBuffers       & buf);
+}
+
 void utils::cutPolyLine(// inputs -- the polygonal line
                         int numVerts,
                         const double * xv, const double * yv,
@@ -42,52 +99,40 @@ void utils::cutPolyLine(// inputs -- the polygonal line
                         std::vector< double> & cutY,
                         std::vector< int>    & cutNumPolys){
 
-  // Cut a polygonal line. First make it into a polygon by traveling
-  // forward and then backward on the polygonal line, then cut the
-  // obtained polygon, then remove the backward portion from each
-  // obtained polygon.
-
-  vector<double> lXv, lYv, lCutX, lCutY;
-  vector<int> lCutNumPolys;
-  
-  lXv.clear(); lYv.clear();
-  for (int s = 0; s < numVerts; s++){
-    lXv.push_back(xv[s]);
-    lYv.push_back(yv[s]);
-  }
-  for (int s = numVerts - 1; s >= 0; s--){
-    lXv.push_back(xv[s]);
-    lYv.push_back(yv[s]);
-  }
-  int lNumVerts = lXv.size();
-  
-  cutPoly(// inputs -- the polygons
-          1, &lNumVerts,  
-          vecPtr(lXv), vecPtr(lYv),  
-          // inputs -- the cutting window
-          xll, yll, xur, yur,  
-          // outputs -- the cut polygons
-          lCutX, lCutY, lCutNumPolys
-          );
+  cutPolyBuffers buf;
+  cutPolyLine(numVerts, xv, yv, xll, yll, xur, yur, cutX, cutY, cutNumPolys, buf);
+}
 
-  cutX.clear(); cutY.clear(); cutNumPolys.clear();
-  
-  int start = 0;
-  for (int pIter = 0; pIter < (int)lCutNumPolys.size(); pIter++){
+void utils::cutPolyLine(// inputs -- the polygonal line
+                        int numVerts,
+                        const double * xv, const double * yv,
+                        // inputs -- the cutting window
+                        double xll, double yll, double xur, double yur,
+                        // outputs -- the cut polygons
+                        std::vector< double> & cutX,
+                        std::vector< double> & cutY,
+                        std::vector< int>    & cutNumPolys,
+                        cutPolyBuffers       & buf){
 
-    if (pIter > 0) start += lCutNumPolys[pIter - 1];
+  // Cut a polygonal line into the runs of it which are in the box
+  cutPoly_local_functions::cutPolysOrLines(true, 1, &numVerts, xv, yv,
+                                           xll, yll, xur, yur,
+                                           cutX, cutY, cutNumPolys, buf);
+}
 
-    // Keep only half of the points of the cut polygon
-    int half = lCutNumPolys[pIter]/2;
-    cutNumPolys.push_back(half);
-    for (int vIter = 0; vIter < half; vIter++){
-      cutX.push_back(lCutX[start + vIter]);
-      cutY.push_back(lCutY[start + vIter]);
-    }
-    
-  }
+void utils::cutPoly(// inputs -- the polygons
+                    int numPolys, const int * numVerts,
+                    const double * xv, const double * yv,
+                    // inputs -- the cutting window
+                    double xll, double yll, double xur, double yur,
+                    // outputs -- the cut polygons
+                    std::vector< double> & cutX,
+                    std::vector< double> & cutY,
+                    std::vector< int>    & cutNumPolys){
 
-  return;
+  cutPolyBuffers buf;
+  cutPoly(numPolys, numVerts, xv, yv, xll, yll, xur, yur,
+          cutX, cutY, cutNumPolys, buf);
 }
 
 void utils::cutPoly(// inputs -- the polygons
@@ -98,71 +143,224 @@ void utils::cutPoly(// inputs -- the polygons
                     // outputs -- the cut polygons
                     std::vector< double> & cutX,
                     std::vector< double> & cutY,
-                    std::vector< int>    & cutNumPolys){
+                    std::vector< int>    & cutNumPolys,
+                    cutPolyBuffers       & buf){
   
   // Cut a given polygon with a box.
-  
-  // Intersect the polygon with each of the the half-planes
-  // nx*x + ny*y <= (nx + ny)*H.
-  // There are four values for the triplet (nx, ny, H):
-  double cutParams[] = {
-   -1,  0, xll, //  -- left cut
-    1,  0, xur, //  -- right cut
-    0, -1, yll, //  -- bottom cut
-    0,  1, yur  //  -- top cut
-  };
+  cutPoly_local_functions::cutPolysOrLines(false, numPolys, numVerts, xv, yv,
+                                           xll, yll, xur, yur,
+                                           cutX, cutY, cutNumPolys, buf);
+}
 
-  int totalNumVerts = 0;
-  for (int s = 0; s < numPolys; s++) totalNumVerts += numVerts[s];
+void cutPoly_local_functions::cutPolysOrLines(// inputs -- the polygons or polygonal lines
+                                              bool isPolyLine,
+                                              int numPolys, const int * numVerts,
+                                              const double * xv, const double * yv,
+                                              // inputs -- the cutting window
+                                              double xll, double yll,
+                                              double xur, double yur,
+                                              // outputs -- the cut pieces
+                                              std::vector< double> & cutX,
+                                              std::vector< double> & cutY,
+                                              std::vector< int>    & cutNumPolys,
+                                              cutPolyBuffers       & buf){
+
+  // Intersect each polygon with each of the the half-planes
+  // nx*x + ny*y <= (nx + ny)*H, one at a time. Each polygon is cut on
+  // its own, and only by the sides of the box it reaches. A polygonal
+  // line is cut the same way, except that a piece of it is not closed
+  // up along the cutline, but stops where the line leaves the
+  // half-plane.
+
+  const double window[] = {xll, xur, yll, yur};
 
-  vector<double> Xin(xv, xv + totalNumVerts);        // A copy of xv as vector
-  vector<double> Yin(yv, yv + totalNumVerts);        // A copy of yv as vector
-  vector<int>    Pin(numVerts, numVerts + numPolys); // A copy of numVerts 
-  
-  vector<double> cutHalfX, cutHalfY, Xout, Yout;
-  vector<int>    cutHalfP, Pout;
+  cutX.clear(); cutY.clear(); cutNumPolys.clear();
 
-  for (int c = 0; c < 4; c++){
+  int start = 0;
+  for (int pIter = 0; pIter < numPolys; pIter++){
 
-    Pout.clear(); Xout.clear(); Yout.clear();
-    
-    double nx   = cutParams[3*c + 0];
-    double ny   = cutParams[3*c + 1];
-    double H    = cutParams[3*c + 2];
-    double dotH = (nx + ny)*H; // This formula works only for nx*ny == 0.
+    if (pIter > 0) start += numVerts[pIter - 1];
 
-    int start = 0;
-    for (int pIter = 0; pIter < (int)Pin.size(); pIter++){
-      
-      if (pIter > 0) start += Pin[pIter - 1];
-      
-      int numV = Pin[pIter];
-      if (numV == 0) continue;
-      
-      cutToHalfSpace(nx, ny, dotH,
-                     numV, vecPtr(Xin) + start, vecPtr(Yin) + start,
-                     cutHalfX, cutHalfY, cutHalfP);
-      
-      for (int pIterCut = 0; pIterCut < (int)cutHalfP.size(); pIterCut++){
-        if (cutHalfP[pIterCut] > 0){
-          // Append only non-empty polygons
-          Pout.push_back( cutHalfP[pIterCut] );
+    int numV = numVerts[pIter];
+    if (numV == 0) continue;
+
+    const double * pxv = xv + start;
+    const double * pyv = yv + start;
+
+    unsigned orCodes, andCodes;
+    windowCodes(numV, pxv, pyv, xll, yll, xur, yur, orCodes, andCodes);
+
+    if (orCodes == 0){
+      // The polygon is strictly inside the box, no cut changes it
+      cutX.insert(cutX.end(), pxv, pxv + numV);
+      cutY.insert(cutY.end(), pyv, pyv + numV);
+      cutNumPolys.push_back(numV);
+      continue;
+    }
+
+    // If all points are beyond some side of the box, the cut by that
+    // side leaves nothing. That is known in advance only if the cuts
+    // before it do not change the polygon.
+    unsigned firstAllOut = andCodes & (~andCodes + 1); // the lowest bit
+    if (andCodes != 0 && (orCodes & (firstAllOut - 1)) == 0) continue;
+
+    // The pieces to cut. At first, the polygon itself.
+    int curr = 0;
+    std::vector<double> & Xin = buf.X[curr], & Yin = buf.Y[curr];
+    std::vector<int>    & Pin = buf.P[curr];
+    Xin.assign(pxv, pxv + numV);
+    Yin.assign(pyv, pyv + numV);
+    Pin.assign(1, numV);
+
+    for (int c = 0; c < 4; c++){
+
+      std::vector<double> & X = buf.X[curr];
+      std::vector<double> & Y = buf.Y[curr];
+      std::vector<int>    & P = buf.P[curr];
+      if (P.empty()) break;
+
+      // A cut which all points are strictly inside of keeps them all,
+      // in the same order
+      if (c > 0) windowCodes(X.size(), vecPtr(X), vecPtr(Y), xll, yll, xur, yur,
+                             orCodes, andCodes);
+      if ( (orCodes & (1u << c)) == 0 ) continue;
+
+      double nx   = cutLines[c].nx;
+      double ny   = cutLines[c].ny;
+      double dotH = (nx + ny)*window[c]; // This formula works only for nx*ny == 0.
+
+      std::vector<double> & Xout = buf.X[1 - curr];
+      std::vector<double> & Yout = buf.Y[1 - curr];
+      std::vector<int>    & Pout = buf.P[1 - curr];
+      Pout.clear(); Xout.clear(); Yout.clear();
+
+      int pStart = 0;
+      for (int pieceIter = 0; pieceIter < (int)P.size(); pieceIter++){
+
+        if (pieceIter > 0) pStart += P[pieceIter - 1];
+
+        if (isPolyLine)
+          cutPolyLineToHalfSpace(nx, ny, dotH,
+                                 P[pieceIter], vecPtr(X) + pStart, vecPtr(Y) + pStart,
+                                 buf.halfX, buf.halfY, buf.halfP);
+        else
+          cutToHalfSpace(nx, ny, dotH,
+                         P[pieceIter], vecPtr(X) + pStart, vecPtr(Y) + pStart,
+                         buf.halfX, buf.halfY, buf.halfP, buf);
+
+        for (int pIterCut = 0; pIterCut < (int)buf.halfP.size(); pIterCut++){
+          if (buf.halfP[pIterCut] > 0){
+            // Append only non-empty polygons
+            Pout.push_back( buf.halfP[pIterCut] );
+          }
         }
+        Xout.insert(Xout.end(), buf.halfX.begin(), buf.halfX.end());
+        Yout.insert(Yout.end(), buf.halfY.begin(), buf.halfY.end());
       }
-      
-      for (int vIter = 0; vIter < (int)cutHalfX.size(); vIter++){
-        Xout.push_back( cutHalfX[vIter] );
-        Yout.push_back( cutHalfY[vIter] );
+
+      curr = 1 - curr;
+
+    } // End iterating over cutting lines
+
+    cutX.insert(cutX.end(), buf.X[curr].begin(), buf.X[curr].end());
+    cutY.insert(cutY.end(), buf.Y[curr].begin(), buf.Y[curr].end());
+    cutNumPolys.insert(cutNumPolys.end(), buf.P[curr].begin(), buf.P[curr].end());
+  }
+
+  return;
+}
+
+void cutPoly_local_functions::cutPolyLineToHalfSpace(// inputs
+                                                     double nx, double ny, double dotH,
+                                                     int numV,
+                                                     const double * xv, const double * yv,
+                                                     // outputs -- the cut polygonal lines
+                                                     std::vector<double> & cutX,
+                                                     std::vector<double> & cutY,
+                                                     std::vector<int>    & cutNumPolys){
+
+  // This gives the same pieces as cutting the polygon which goes
+  // forward and then back along the line and keeping the forward half
+  // of each piece, as was done before. So the ends of the line count as
+  // their own neighbors, and a point on the cutline is kept if it is
+  // next to a point strictly inside the half-plane.
+
+  cutX.clear(); cutY.clear(); cutNumPolys.clear();
+
+  int  runStart = 0;
+  bool inRun    = false;
+
+  for (int v = 0; v < numV; v++){
+
+    int vprev = (v == 0)        ? v : (v - 1);
+    int vnext = (v == numV - 1) ? v : (v + 1);
+
+    double xcurr = xv[v],     ycurr = yv[v];
+    double xnext = xv[vnext], ynext = yv[vnext];
+
+    double dotCurr = nx*xcurr + ny*ycurr;
+    double dotNext = nx*xnext + ny*ynext;
+    double cutx = 0.0, cuty = 0.0;
+
+    if (dotCurr < dotH){
+
+      // The current point is inside the half-plane
+
+      if (!inRun){
+        runStart = cutX.size();
+        inRun    = true;
       }
-      
+      cutX.push_back(xcurr);
+      cutY.push_back(ycurr);
+
+      if (dotNext <= dotH) continue;
+
+      // The line leaves the half-plane
+      cutEdge(xcurr, ycurr, xnext, ynext, nx, ny, dotH, cutx, cuty);
+      cutX.push_back(cutx);
+      cutY.push_back(cuty);
+      cutNumPolys.push_back(cutX.size() - runStart);
+      inRun = false;
+
+    }else if (dotCurr > dotH){
+
+      // The current point is outside the half-plane
+
+      if (dotNext >= dotH) continue;
+
+      // The line enters the half-plane
+      cutEdge(xcurr, ycurr, xnext, ynext, nx, ny, dotH, cutx, cuty);
+      runStart = cutX.size();
+      inRun    = true;
+      cutX.push_back(cutx);
+      cutY.push_back(cuty);
+
+    }else{
+
+      // The current point is at the edge of the half-plane
+
+      double dotPrev = nx*xv[vprev] + ny*yv[vprev];
+      if (dotPrev >= dotH && dotNext >= dotH) continue;
+
+      if (!inRun){
+        runStart = cutX.size();
+        inRun    = true;
+      }
+      cutX.push_back(xcurr);
+      cutY.push_back(ycurr);
+
+      if (dotNext >= dotH){
+        // The line goes on along the cutline or out of the half-plane
+        cutNumPolys.push_back(cutX.size() - runStart);
+        inRun = false;
+      }
+
     }
-    
-    Pin = Pout; Xin = Xout; Yin = Yout;
-    
-  } // End iterating over cutting lines
 
-  cutNumPolys = Pout; cutX = Xout; cutY = Yout;
-  
+  }
+
+  if (inRun) cutNumPolys.push_back(cutX.size() - runStart);
+
   return;
 }
 
@@ -175,8 +373,22 @@ void utils::cutToHalfSpace(// inputs
                            std::vector<double> & cutY,
                            std::vector<int>    & cutNumPolys){
 
+  cutPolyBuffers buf;
+  cutToHalfSpace(nx, ny, dotH, numV, xv, yv, cutX, cutY, cutNumPolys, buf);
+}
+
+void utils::cutToHalfSpace(// inputs 
+                           double nx, double ny, double dotH,
+                           int numV, 
+                           const double * xv, const double * yv,
+                           // outputs -- the cut polygons
+                           std::vector<double> & cutX,
+                           std::vector<double> & cutY,
+                           std::vector<int>    & cutNumPolys,
+                           cutPolyBuffers      & buf){
+
 
-  vector<valIndex> ptsOnCutline; ptsOnCutline.clear();
+  vector<valIndex> & ptsOnCutline = buf.ptsOnCutline; ptsOnCutline.clear();
   valIndex C;
   
   cutX.clear(); cutY.clear(); cutNumPolys.clear();
@@ -269,13 +481,14 @@ void utils::cutToHalfSpace(// inputs
     return;
   }
 
-  processPointsOnCutline(ptsOnCutline);
+  cutPoly_local_functions::processPointsOnCutline(ptsOnCutline, buf.outward, buf.inward);
   
   // Find the connected components in the cut polygons
   // To do: Move this to its own function.
   
-  vector<double> X, Y;
-  vector<int> P;
+  vector<double> & X = buf.compX;
+  vector<double> & Y = buf.compY;
+  vector<int>    & P = cutNumPolys;
   X.clear(); Y.clear(); P.clear();
 
 #if DEBUG_CUT_POLY
@@ -300,17 +513,25 @@ void utils::cutToHalfSpace(// inputs
   }
 #endif
 
-  vector<int> wasVisited;
+  vector<char> & wasVisited = buf.wasVisited;
   int numCutPts = cutX.size();
   wasVisited.assign(numCutPts, 0);
 
-  int ptIter = 0;
+  // Where each point is among the sorted cutline points, if it is there
+  vector<int> & cutlineIndex = buf.cutlineIndex;
+  cutlineIndex.assign(numCutPts, -1);
+  for (int s = 0; s < numPtsOnCutline; s++)
+    cutlineIndex[ptsOnCutline[s].index] = s;
+
+  int ptIter = 0, firstUnvisited = 0;
   while(1){
 
-    // Stop when all points are visited
+    // Stop when all points are visited. The points before
+    // firstUnvisited were visited earlier.
     bool success = false;
-    for (int v = 0; v < numCutPts; v++){
+    for (int v = firstUnvisited; v < numCutPts; v++){
       if (!wasVisited[v]){
+        firstUnvisited = v;
         ptIter  = v;
         success = true;
         break;
@@ -349,16 +570,8 @@ void utils::cutToHalfSpace(// inputs
       // cutline points, it means that the polygon only touches the
       // cutline at that point rather than crossing over to the other
       // side.
-      // To do: Use here some faster lookup, such as a map.
-      bool success = false;
-      int cutlineIter = 0;
-      for (cutlineIter = 0; cutlineIter < numPtsOnCutline; cutlineIter++){
-        if (ptsOnCutline[cutlineIter].index == ptIter){
-          success = true;
-          break;
-        }
-      }
-      if (!success){
+      int cutlineIter = cutlineIndex[ptIter];
+      if (cutlineIter < 0){
         ptIter = (ptIter + 1)%numCutPts;
         continue;
       }
@@ -383,9 +596,8 @@ void utils::cutToHalfSpace(// inputs
 
   } // End iterating over all points
   
-  cutX        = X;
-  cutY        = Y;
-  cutNumPolys = P;
+  cutX.swap(X);
+  cutY.swap(Y);
 
 #if DEBUG_CUT_POLY
   sprintf(file, "afterCleanup%d.xg", c);
@@ -402,13 +614,21 @@ void utils::cutToHalfSpace(// inputs
 
 void utils::processPointsOnCutline(std::vector<valIndex> & ptsOnCutline){
 
+  vector<int> outwardPositions, inwardPositions;
+  cutPoly_local_functions::processPointsOnCutline(ptsOnCutline,
+                                                  outwardPositions, inwardPositions);
+}
+
+void cutPoly_local_functions::processPointsOnCutline(std::vector<valIndex> & ptsOnCutline,
+                                                     std::vector<int> & outwardPositions,
+                                                     std::vector<int> & inwardPositions){
+
   
   // Sort the cutline points along the cutline (the sort direction
   // does not matter).
   sort( ptsOnCutline.begin(), ptsOnCutline.end(), lessThan );
 
   // Find the position of each outward and each inward point on the cutline
-  vector<int> outwardPositions, inwardPositions;
   outwardPositions.clear(); inwardPositions.clear();
   int numPtsOnCutline = ptsOnCutline.size();
   for (int s = 0; s < numPtsOnCutline; s++){
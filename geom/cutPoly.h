@@ -39,6 +39,20 @@ namespace utils{
     int    nextIndexInward; // Useful only when isOutward is true
   };
 
+  // Scratch space for cutPoly(). A caller which clips many polygons
+  // can keep one of these and pass it to each call, so that memory is
+  // allocated only for the first few polygons.
+  struct cutPolyBuffers{
+    std::vector<double>   X[2], Y[2];   // the pieces before and after a cut
+    std::vector<int>      P[2];
+    std::vector<double>   halfX, halfY; // the pieces of one polygon after a cut
+    std::vector<int>      halfP;
+    std::vector<valIndex> ptsOnCutline;
+    std::vector<int>      outward, inward, cutlineIndex;
+    std::vector<double>   compX, compY;
+    std::vector<char>     wasVisited;
+  };
+
   void cutPolyLine(// inputs -- the polygonal line
                    int numVerts,
                    const double * xv, const double * yv,
@@ -48,7 +62,19 @@ namespace utils{
                    std::vector< double> & cutX,
                    std::vector< double> & cutY,
                    std::vector< int>    & cutNumPolys);
-  
+
+  // The same, using the given scratch space
+  void cutPolyLine(// inputs -- the polygonal line
+                   int numVerts,
+                   const double * xv, const double * yv,
+                   // inputs -- the cutting window
+                   double xll, double yll, double xur, double yur,
+                   // outputs -- the cut polygons
+                   std::vector< double> & cutX,
+                   std::vector< double> & cutY,
+                   std::vector< int>    & cutNumPolys,
+                   cutPolyBuffers       & buf);
+
   void cutPoly(// inputs -- the polygons
                int numPolys, const int * numVerts,
                const double * xv, const double * yv,
@@ -59,6 +85,18 @@ namespace utils{
                std::vector< double> & cutY,
                std::vector< int>    & cutNumPolys);
 
+  // The same, using the given scratch space
+  void cutPoly(// inputs -- the polygons
+               int numPolys, const int * numVerts,
+               const double * xv, const double * yv,
+               // inputs -- the cutting window
+               double xll, double yll, double xur, double yur,
+               // outputs -- the cut polygons
+               std::vector< double> & cutX,
+               std::vector< double> & cutY,
+               std::vector< int>    & cutNumPolys,
+               cutPolyBuffers       & buf);
+
   inline bool lessThan (valIndex A, valIndex B){ return A.val < B.val; }
   
   void processPointsOnCutline(std::vector<valIndex> & ptsOnCutline);
@@ -72,6 +110,15 @@ namespace utils{
                       std::vector<double> & cutY,
                       std::vector<int>    & cutNumPolys);
 
-  
+  void cutToHalfSpace(// inputs
+                      double nx, double ny, double dotH,
+                      int numV,
+                      const double * xv, const double * yv,
+                      // outputs -- the cut polygons
+                      std::vector<double> & cutX,
+                      std::vector<double> & cutY,
+                      std::vector<int>    & cutNumPolys,
+                      cutPolyBuffers      & buf);
+
 }
 #endif
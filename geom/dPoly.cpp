@@ -25,6 +25,7 @@
 #define _USE_MATH_DEFINES 
 
 #include <cmath>
+#include <atomic>
 #include <vector>
 #include <algorithm>
 #include <iostream>
@@ -35,6 +36,9 @@
 #include <string>
 #include <map>
 #include <complex>
+#include <unordered_set>
+#include <cstdint>
+#include <limits>
 
 #ifdef POLYVIEW_USE_OPENMP
 #include <omp.h>
@@ -46,6 +50,10 @@
 #endif
 
 #include <cutPoly.h>
+#include <mappedFile.h>
+#include <polyReader.h>
+#include <polySnapshot.h>
+#include <polyIndexFile.h>
 #include <dPoly.h>
 using namespace std;
 
@@ -61,12 +69,15 @@ void dPoly::reset() {
   m_xv.clear();
   m_yv.clear();
   m_isPolyClosed.clear();
-  m_colors.clear();
-  m_layers.clear();
+  m_colorIds.clear();
+  m_layerIds.clear();
+  m_colorPalette.clear();
+  m_layerPalette.clear();
   m_annotations.clear();
-  m_layerAnno.clear();
   m_startingIndices.clear();
+  m_pointCloudChangeId = 0;
   img = NULL; 
+  clearAnnoTrees();
   clearExtraData();
 }
 
@@ -184,13 +195,41 @@ void dPoly::appendPolygon(int numVerts,
 
   if (numVerts <= 0) return;
 
+  appendPolygonWithIds(numVerts, xv, yv, isPolyClosed,
+                       m_colorPalette.intern(color), m_layerPalette.intern(layer));
+}
+
+void dPoly::copyPalettes(const dPoly & poly) {
+  m_colorPalette = poly.m_colorPalette;
+  m_layerPalette = poly.m_layerPalette;
+}
+
+std::vector<std::string> dPoly::get_colors() const {
+  std::vector<std::string> colors(m_colorIds.size());
+  for (size_t s = 0; s < m_colorIds.size(); s++)
+    colors[s] = m_colorPalette.name(m_colorIds[s]);
+  return colors;
+}
+
+std::vector<std::string> dPoly::get_layers() const {
+  std::vector<std::string> layers(m_layerIds.size());
+  for (size_t s = 0; s < m_layerIds.size(); s++)
+    layers[s] = m_layerPalette.name(m_layerIds[s]);
+  return layers;
+}
+
+void dPoly::appendPolygonWithIds(int numVerts, const double * xv, const double * yv,
+                                 bool isPolyClosed, int colorId, int layerId) {
+
+  if (numVerts <= 0) return;
+
   m_numPolys      += 1;
   m_totalNumVerts += numVerts;
 
   m_numVerts.push_back(numVerts);
   m_isPolyClosed.push_back(isPolyClosed);
-  m_colors.push_back(color);
-  m_layers.push_back(layer);
+  m_colorIds.push_back(colorId);
+  m_layerIds.push_back(layerId);
   for (int s = 0; s < numVerts; s++) {
     m_xv.push_back(xv[s]);
     m_yv.push_back(yv[s]);
@@ -279,12 +318,6 @@ std::vector<anno> & dPoly::get_annoByType(AnnoType annoType) {
 
   if (annoType == fileAnno) {
     return get_annotations();
-  }else if (annoType == vertAnno) {
-    return get_vertIndexAnno();
-  }else if (annoType == polyAnno) {
-    return get_polyIndexAnno();
-  }else if (annoType == layerAnno) {
-    return get_layerAnno();
   }else  if (annoType == angleAnno){
     return get_angleAnno();
   } else {
@@ -294,18 +327,49 @@ std::vector<anno> & dPoly::get_annoByType(AnnoType annoType) {
 
 }
 
+const std::vector<anno> & dPoly::get_annoByType(AnnoType annoType) const {
+
+  if (annoType == fileAnno) {
+    return get_annotations();
+  }else  if (annoType == angleAnno){
+    return get_angleAnno();
+  } else {
+    std::cout << "Unknown annotation type." << std::endl;
+    return get_annotations();
+  }
+
+}
+
+const annoTree & dPoly::getAnnoTree(AnnoType annoType) const {
+
+  // Annotations are searched only on the main thread, so unlike
+  // getPointCloud() this is not needed before clipping on others
+  std::shared_ptr<const annoTree> & T = m_annoTrees[annoType];
+  if (!T) {
+    std::shared_ptr<annoTree> newTree = std::make_shared<annoTree>();
+    newTree->formTreeOfAnnos(get_annoByType(annoType));
+    T = newTree;
+  }
+  return *T;
+}
+
+void dPoly::clearAnnoTrees() {
+  for (int annoType = fileAnno; annoType < lastAnno; annoType++)
+    m_annoTrees[annoType].reset();
+}
+
+void dPoly::annoChanged(AnnoType annoType) {
+  m_annoTrees[annoType].reset();
+  stampChange();
+}
+
 void dPoly::set_annoByType(const std::vector<anno> & annotations, AnnoType annoType) {
 
   if (annoType == fileAnno) {
     set_annotations(annotations);
-  }else if (annoType == vertAnno) {
-    set_vertIndexAnno(annotations);
-  }else if (annoType == polyAnno) {
-    set_polyIndexAnno(annotations);
-  }else if (annoType == layerAnno) {
-    set_layerAnno(annotations);
   }else if (annoType == angleAnno) {
     m_angleAnno = annotations;
+    annoChanged(angleAnno);
   } else {
     std::cout << "Unknown annotation type." << std::endl;
   }
@@ -314,7 +378,8 @@ void dPoly::set_annoByType(const std::vector<anno> & annotations, AnnoType annoT
 }
 
 // Clip point clouds, this is faster than clipping polygons when geometry is in point clouds
-// We use actual point tree instead of box tree for clipping
+// Point clouds are clipped with the grid of getPointCloud() rather than
+// with the box tree
 void  dPoly::clipPointCloud(const dRect &clip_box,
                         dPoly & clippedPoly, // output
                         const std::vector<int> *selected) {
@@ -324,38 +389,73 @@ void  dPoly::clipPointCloud(const dRect &clip_box,
 
   clippedPoly.reset();
   clippedPoly.set_isPointCloud(m_isPointCloud);
-
-
-  for (int i = 0; i < (int)m_xv.size(); i++){
-    if (selected && !(*selected)[i]) continue;
-    if (clip_box.isInSide(m_xv[i], m_yv[i])){
-      clippedPoly.appendPolygon(1, &m_xv[i], &m_yv[i], false, m_colors[i], m_layers[i]);
-    }
+  clippedPoly.copyPalettes(*this);
+
+  // Test the points as given rather than as kept in the grid, so that
+  // the result does not depend on rounding.
+  const pointCloud & C = getPointCloud();
+  vector<int> ids;
+  C.visitCellsInBox(clip_box, [&](int beg, int end, double, double){
+      for (int i = beg; i < end; i++) {
+        int id = C.id(i);
+        if (selected && !(*selected)[id]) continue;
+        if (clip_box.isInSide(m_xv[id], m_yv[id])) ids.push_back(id);
+      }
+    });
+
+  // Keep the order of the points. Write them all at once, as
+  // appendPolygon() clears the cached data each time.
+  std::sort(ids.begin(), ids.end());
+  int numPts = ids.size();
+  clippedPoly.m_numPolys      = numPts;
+  clippedPoly.m_totalNumVerts = numPts;
+  clippedPoly.m_numVerts.assign(numPts, 1);
+  clippedPoly.m_isPolyClosed.assign(numPts, false);
+  clippedPoly.m_xv.resize(numPts);
+  clippedPoly.m_yv.resize(numPts);
+  clippedPoly.m_colorIds.resize(numPts);
+  clippedPoly.m_layerIds.resize(numPts);
+  for (int s = 0; s < numPts; s++){
+    int i = ids[s];
+    clippedPoly.m_xv[s]       = m_xv[i];
+    clippedPoly.m_yv[s]       = m_yv[i];
+    clippedPoly.m_colorIds[s] = m_colorIds[i];
+    clippedPoly.m_layerIds[s] = m_layerIds[i];
   }
+  clippedPoly.clearExtraData();
 
 }
 
 // Cutting inherits the annotations at the vertices of the uncut
 // polygons which are in the cutting box.
 void dPoly::clipAnno(const dRect &clip_box,
-                     dPoly & clippedPoly){
+                     dPoly & clippedPoly) const{
 
   vector<anno> annoInBox;
+  vector<int> ids;
 
   for (int annoType = fileAnno; annoType < lastAnno; annoType++) {
 
     const auto &annotations = get_annoByType((AnnoType)annoType);
     annoInBox.clear();
-    for (int s = 0; s < (int)annotations.size(); s++) {
-      const anno & A = annotations[s];
-      if (clip_box.isInSide(A.x, A.y)) {
-        annoInBox.push_back(A);
-      }
+    // Polygons without annotations, such as those clipped by the tile
+    // workers, must not form a tree
+    if (!annotations.empty()) {
+      getAnnoTree((AnnoType)annoType).getIdsInBox(clip_box, ids);
+      annoInBox.reserve(ids.size());
+      for (size_t s = 0; s < ids.size(); s++) annoInBox.push_back(annotations[ids[s]]);
     }
     clippedPoly.set_annoByType(annoInBox, (AnnoType)annoType);
   }
 }
 
+void dPoly::getAnnosInBox(AnnoType annoType, const dRect & box,
+                          std::vector<annoView> & annos) const{
+  annos.clear();
+  if (get_annoByType(annoType).empty()) return;
+  getAnnoTree(annoType).getAnnosInBox(box, annos);
+}
+
 void dPoly::copyAnno(dPoly & clippedPoly){
 
   for (int annoType = fileAnno; annoType < lastAnno; annoType++) {
@@ -371,32 +471,29 @@ void dPoly::clipPolygons(const dRect &clip_box,
   const double * yv               = get_yv();
   const int    * numVerts         = get_numVerts();
 
-  const vector<char> isPolyClosed = get_isPolyClosed();
-  const vector<string> colors     = get_colors();
-  const vector<string> layers     = get_layers();
+  const vector<char> & isPolyClosed = get_isPolyClosed();
 
   const std::vector<int>& starting_ids = getStartingIndices();
   const auto *box_tree = getBoundingBoxTree();
 
   clippedPoly.reset();
   clippedPoly.set_isPointCloud(m_isPointCloud);
-
-  vector< dRectWithId> boxes;
-  box_tree->getBoxesInRegion(clip_box.xl, clip_box.yl, clip_box.xh, clip_box.yh, boxes);
+  clippedPoly.copyPalettes(*this);
 
   vector<double> cutXv, cutYv;
   vector<int> cutNumVerts;
+  cutPolyBuffers cutBuf; // reused for all polygons
 
-  for (auto &box : boxes) {
+  auto clipOnePoly = [&](const dRectWithId & box){
 
     int pIter = box.id;
-    if (selected && !(*selected)[pIter]) continue;
+    if (selected && !(*selected)[pIter]) return;
 
     int start = starting_ids[pIter];
 
-    int  isClosed = isPolyClosed [pIter];
-    string color  = colors       [pIter];
-    string layer  = layers       [pIter];
+    int isClosed = isPolyClosed[pIter];
+    int colorId  = m_colorIds  [pIter];
+    int layerId  = m_layerIds  [pIter];
 
     cutXv.clear(); cutYv.clear(); cutNumVerts.clear();
 
@@ -413,14 +510,16 @@ void dPoly::clipPolygons(const dRect &clip_box,
 
       cutPoly(1, numVerts + pIter, xv + start, yv + start,
               clip_box.xl, clip_box.yl, clip_box.xh, clip_box.yh,
-              cutXv, cutYv, cutNumVerts // outputs
+              cutXv, cutYv, cutNumVerts, // outputs
+              cutBuf
       );
 
     }else{
 
       cutPolyLine(numVerts[pIter], xv + start, yv + start,
                   clip_box.xl, clip_box.yl, clip_box.xh, clip_box.yh,
-                  cutXv, cutYv, cutNumVerts // outputs
+                  cutXv, cutYv, cutNumVerts, // outputs
+                  cutBuf
       );
 
     }
@@ -430,14 +529,17 @@ void dPoly::clipPolygons(const dRect &clip_box,
 
       if (cIter > 0) cstart += cutNumVerts[cIter - 1];
       int cSize = cutNumVerts[cIter];
-      clippedPoly.appendPolygon(cSize,
-                                vecPtr(cutXv) + cstart,
-                                vecPtr(cutYv) + cstart,
-                                isClosed, color, layer
+      clippedPoly.appendPolygonWithIds(cSize,
+                                       vecPtr(cutXv) + cstart,
+                                       vecPtr(cutYv) + cstart,
+                                       isClosed, colorId, layerId
       );
 
     }
-  }
+  };
+
+  box_tree->visitBoxesInRegion(clip_box.xl, clip_box.yl, clip_box.xh, clip_box.yh,
+                               clipOnePoly);
 }
 
 void dPoly::clipAll(// inputs
@@ -461,13 +563,15 @@ void dPoly::clipAll(// inputs
     if (!selected) {
       clippedPoly= *this;
     } else {
+      clippedPoly.copyPalettes(*this);
       for (int pIter = 0; pIter < m_numPolys; pIter++) {
         if (!(*selected)[pIter]) continue;
         int start = starting_ids[pIter];
-        clippedPoly.appendPolygon(m_numVerts[pIter],
-                                  vecPtr(m_xv) + start,
-                                  vecPtr(m_yv) + start,
-                                  m_isPolyClosed[pIter], m_colors[pIter], m_layers[pIter]);
+        clippedPoly.appendPolygonWithIds(m_numVerts[pIter],
+                                         vecPtr(m_xv) + start,
+                                         vecPtr(m_yv) + start,
+                                         m_isPolyClosed[pIter],
+                                         m_colorIds[pIter], m_layerIds[pIter]);
       }
     }
 
@@ -569,6 +673,7 @@ std::vector<dPoint> dPoly::getAcuteAngleLocs(double min_angle){
 
   std::vector<dPoint> res;
   m_angleAnno.clear();
+  annoChanged(angleAnno);
 
   for (int pIter = 0; pIter < m_numPolys; pIter++) {
     int start = start_ids[pIter];
@@ -606,6 +711,7 @@ void dPoly::shift(double shift_x, double shift_y) {
     m_xv[i] += shift_x;
     m_yv[i] += shift_y;
   }
+  clearExtraData();
 
   std::vector<anno> annotations;
   for (int annoType = fileAnno; annoType < lastAnno; annoType++) {
@@ -637,6 +743,7 @@ void dPoly::rotate(double angle) { // The angle is given in degrees
     m_xv[i] = tmpx;
     m_yv[i] = tmpy;
   }
+  clearExtraData();
 
   vector<anno> annotations;
   for (int annoType = fileAnno; annoType < lastAnno; annoType++) {
@@ -661,6 +768,7 @@ void dPoly::scale(double scale) {
     m_xv[i] *= scale;
     m_yv[i] *= scale;
   }
+  clearExtraData();
 
   vector<anno> annotations;
   for (int annoType = fileAnno; annoType < lastAnno; annoType++) {
@@ -699,6 +807,7 @@ void dPoly::transformMarkedPolys(std::vector<int> const& mark, const linTrans &
 }
 
 void dPoly::transformMarkedAnnos(std::vector<int> const& mark, const linTrans & T) {
+  annoChanged(fileAnno);
   for (size_t it = 0; it < m_annotations.size(); it++) {
 
     if (!mark[it]) continue;
@@ -740,6 +849,7 @@ void dPoly::applyTransform(double a11, double a12, double a21, double a22,
     m_xv[i] = x;
     m_yv[i] = y;
   }
+  clearExtraData();
 
   vector<anno> annotations;
   for (int annoType = fileAnno; annoType < lastAnno; annoType++) {
@@ -776,26 +886,36 @@ void dPoly::appendPolygons(const dPoly & poly) {
   const double * yv         = poly.get_yv();
   const int    * numVerts   = poly.get_numVerts();
   int numPolys              = poly.get_numPolys();
-  vector<char> isPolyClosed = poly.get_isPolyClosed();
-  vector<string> colors     = poly.get_colors();
-  vector<string> layers     = poly.get_layers();
+  const vector<char> & isPolyClosed = poly.get_isPolyClosed();
+  const vector<int>  & colorIds     = poly.get_colorIds();
+  const vector<int>  & layerIds     = poly.get_layerIds();
 
   const vector<anno> &annotations = poly.get_annotations();
 
+  // The ids of the names of the other polygons in the palettes here
+  const namePalette & colorPalette = poly.get_colorPalette();
+  const namePalette & layerPalette = poly.get_layerPalette();
+  vector<int> colorMap(colorPalette.size()), layerMap(layerPalette.size());
+  for (int c = 0; c < colorPalette.size(); c++)
+    colorMap[c] = m_colorPalette.intern(colorPalette.name(c));
+  for (int l = 0; l < layerPalette.size(); l++)
+    layerMap[l] = m_layerPalette.intern(layerPalette.name(l));
+
   int start = 0;
   for (int pIter = 0; pIter < numPolys; pIter++) {
 
     if (pIter > 0) start += numVerts[pIter - 1];
 
     bool isClosed = isPolyClosed [pIter];
-    string color  = colors       [pIter];
-    string layer  = layers       [pIter];
+    int colorId   = colorMap[colorIds[pIter]];
+    int layerId   = layerMap[layerIds[pIter]];
     int pSize     = numVerts     [pIter];
 
-    appendPolygon(pSize, xv + start, yv + start, isClosed, color, layer);
+    appendPolygonWithIds(pSize, xv + start, yv + start, isClosed, colorId, layerId);
 
   }
   m_annotations.insert(m_annotations.end(), annotations.begin(), annotations.end());
+  annoChanged(fileAnno);
 
 
   return;
@@ -803,26 +923,21 @@ void dPoly::appendPolygons(const dPoly & poly) {
 
 void dPoly::set_annotations(const std::vector<anno> & A) {
   m_annotations = A;
+  annoChanged(fileAnno);
 }
 
-void dPoly::set_vertIndexAnno(const std::vector<anno> & annotations) {
-  m_vertIndexAnno = annotations;
-}
-
-void dPoly::set_polyIndexAnno(const std::vector<anno> & annotations) {
-  m_polyIndexAnno = annotations;
-}
-
-void dPoly::set_layerAnno(const std::vector<anno> & annotations) {
-  m_layerAnno = annotations;
+void dPoly::clearAnnotationsKeepId() {
+  m_annotations.clear();
+  m_angleAnno.clear();
+  clearAnnoTrees();
 }
 
 void dPoly::set_color(std::string color) {
 
-  m_colors.resize(m_numPolys);
-  for (int s = 0; s < (int)m_colors.size(); s++) {
-    m_colors[s] = color;
-  }
+  m_colorPalette.clear();
+  m_colorIds.assign(m_numPolys, m_colorPalette.intern(color));
+  m_lodLevels.clear();
+  stampChange();
 
   return;
 }
@@ -833,119 +948,95 @@ void dPoly::set_isPolyClosed(bool isPolyClosed) {
   for (int s = 0; s < (int)m_isPolyClosed.size(); s++) {
     m_isPolyClosed[s] = isPolyClosed;
   }
+  m_lodLevels.clear();
+  m_indexFile.reset(); // the edges in the index are for the old setting
+  stampChange();
 
   return;
 }
 
-void dPoly::compVertFullIndexAnno() {
-
-  m_vertIndexAnno.clear();
-  m_vertIndexAnno.reserve(m_totalNumVerts);
-  const double * xv = get_xv();
-  const double * yv = get_yv();
-
-  int start = 0;
-  for (int pIter = 0; pIter < m_numPolys; pIter++) {
-
-    if (pIter > 0) start += m_numVerts[pIter - 1];
-
-    for (int v = 0; v < m_numVerts[pIter]; v++) {
-
-      anno A;
-      A.x     = xv[start + v];
-      A.y     = yv[start + v];
-      A.label = num2str(start +v);
-      m_vertIndexAnno.push_back(A);
-    }
+void dPoly::getPolysNearBox(const dRect & box, std::vector<int> & polyIds) const {
 
+  polyIds.clear();
+  if (m_isPointCloud && m_numPolys == m_totalNumVerts) {
+    // Each polygon is one vertex. Those are found with the grid of
+    // them, which point clouds have for clipping anyway.
+    const pointCloud & C = getPointCloud();
+    C.visitCellsInBox(box, [&](int beg, int end, double, double){
+        for (int i = beg; i < end; i++) polyIds.push_back(C.id(i));
+      });
+  } else {
+    getBoundingBoxTree()->visitBoxesInRegion(box.xl, box.yl, box.xh, box.yh,
+                                             [&](const dRectWithId & polyBox){
+        polyIds.push_back(polyBox.id);
+      });
   }
-
-  return;
+  std::sort(polyIds.begin(), polyIds.end());
 }
 
+void dPoly::getVertIndexAnnosInBox(const dRect & box, bool fullIndex,
+                                   annoBatch & annos) const {
 
-void dPoly::compVertIndexAnno() {
-
-  m_vertIndexAnno.clear();
-  m_vertIndexAnno.reserve(m_totalNumVerts);
-  const double * xv = get_xv();
-  const double * yv = get_yv();
-  
-  int start = 0;
-  for (int pIter = 0; pIter < m_numPolys; pIter++) {
-
-    if (pIter > 0) start += m_numVerts[pIter - 1];
+  const std::vector<int> & starting_ids = getStartingIndices();
+  std::vector<int> polyIds;
+  getPolysNearBox(box, polyIds);
 
+  for (size_t p = 0; p < polyIds.size(); p++) {
+    int pIter = polyIds[p];
+    int start = starting_ids[pIter];
     for (int v = 0; v < m_numVerts[pIter]; v++) {
-
-      anno A;
-      A.x     = xv[start + v];
-      A.y     = yv[start + v];
-      A.label = num2str(v);
-      m_vertIndexAnno.push_back(A);
+      double x = m_xv[start + v], y = m_yv[start + v];
+      if (box.isInSide(x, y))
+        annos.add(x, y, start + v, fullIndex ? start + v : v);
     }
-
   }
 
   return;
 }
 
-// Place the poly index annotation at the poly center of graviity
-void dPoly::compPolyIndexAnno() {
+// Place the poly index annotation at the poly center of gravity
+void dPoly::getPolyIndexAnnosInBox(const dRect & box, annoBatch & annos) const {
 
-  m_polyIndexAnno.clear();
-  m_polyIndexAnno.reserve(m_numPolys);
-  const double * xv = get_xv();
-  const double * yv = get_yv();
-  
-  int start = 0;
-  for (int pIter = 0; pIter < m_numPolys; pIter++) {
+  const std::vector<int> & starting_ids = getStartingIndices();
+  std::vector<int> polyIds;
+  getPolysNearBox(box, polyIds); // the center is in the bounding box
+
+  for (size_t p = 0; p < polyIds.size(); p++) {
+    int pIter = polyIds[p];
+    int start = starting_ids[pIter];
 
-    if (pIter > 0)
-      start += m_numVerts[pIter - 1];
-    
     double x = 0.0, y = 0.0, num = 0.0;
     for (int v = 0; v < m_numVerts[pIter]; v++) {
-      x   += xv[start + v];
-      y   += yv[start + v];
+      x   += m_xv[start + v];
+      y   += m_yv[start + v];
       num += 1.0;
     }
 
-    if (num > 0) {
-      anno A;
-      A.x     = x/num;
-      A.y     = y/num;
-      A.label = num2str(pIter);
-      m_polyIndexAnno.push_back(A);
-    }
+    if (num > 0 && box.isInSide(x/num, y/num))
+      annos.add(x/num, y/num, pIter, pIter);
   }
-  
+
   return;
 }
 
-void dPoly::compLayerAnno() {
-
-  m_layerAnno.clear();
+void dPoly::getLayerAnnosInBox(const dRect & box, annoBatch & annos) const {
 
-  const double * xv = get_xv();
-  const double * yv = get_yv();
+  const std::vector<int> & starting_ids = getStartingIndices();
+  std::vector<int> polyIds;
+  getPolysNearBox(box, polyIds);
 
-  int start = 0;
-  for (int pIter = 0; pIter < m_numPolys; pIter++) {
-
-    if (pIter > 0) start += m_numVerts[pIter - 1];
+  for (size_t p = 0; p < polyIds.size(); p++) {
+    int pIter = polyIds[p];
+    int start = starting_ids[pIter];
+    const char * layer = m_layerPalette.name(m_layerIds[pIter]).c_str();
 
     for (int v = 0; v < m_numVerts[pIter]; v++) {
-
-      anno A;
       int vn = (v+1)%m_numVerts[pIter];
-
-      A.x     = (xv[start + v] + xv[start + vn])/2.0; // put anno at midpt
-      A.y     = (yv[start + v] + yv[start + vn])/2.0; // put anno at midpt
-      A.label = m_layers[pIter];
-      m_layerAnno.push_back(A);
+      double x = (m_xv[start + v] + m_xv[start + vn])/2.0; // put anno at midpt
+      double y = (m_yv[start + v] + m_yv[start + vn])/2.0; // put anno at midpt
+      if (box.isInSide(x, y))
+        annos.add(x, y, start + v, layer);
     }
-
   }
 
   return;
@@ -957,6 +1048,7 @@ void dPoly::eraseAnno(int annoIndex) {
 
   m_annotations.erase(m_annotations.begin() + annoIndex,
                       m_annotations.begin() + annoIndex + 1);
+  annoChanged(fileAnno);
   return;
 }
 
@@ -974,15 +1066,10 @@ void dPoly::findClosestAnnotation(// inputs
 
   min_dist = DBL_MAX;
   annoIndex = -1;
+  if (m_annotations.empty()) return;
 
-  for (size_t aIter = 0; aIter < m_annotations.size(); aIter++) {
-    double dist = norm(x0, y0, m_annotations[aIter].x, m_annotations[aIter].y);
-    if (dist <= min_dist) {
-      annoIndex = aIter;
-      min_dist  = dist;
-    }
-  }
-  min_dist = sqrt(min_dist);
+  getAnnoTree(fileAnno).findClosestAnno(x0, y0, // inputs
+                                        annoIndex, min_dist); // outputs
 
   return;
 }
@@ -1105,6 +1192,7 @@ void dPoly::insertVertex(int polyIndex, int vertIndex,
   assert(0 <= vertIndex && vertIndex < m_numVerts[polyIndex] + 1);
 
   int start = getStartingIndices()[polyIndex];
+  syncedTrees T = getSyncedTrees();
 
   int iv = start + vertIndex;
   m_xv.insert(m_xv.begin() + iv, x);
@@ -1114,7 +1202,14 @@ void dPoly::insertVertex(int polyIndex, int vertIndex,
   m_numVerts[polyIndex]++;
 
   m_startingIndices.clear();
-  clearExtraData();
+  clearExtraDataButTrees();
+
+  // Vertices after the new one move up by one
+  std::vector<int> newIds(m_totalNumVerts - 1);
+  for (int i = 0; i < (int)newIds.size(); i++) newIds[i] = (i < iv) ? i : i + 1;
+  remapVertIdsInTrees(T, newIds);
+  updateVertsInTrees(T, polyIndex, vertIndex, vertIndex + 1);
+  dropUnbalancedTrees();
   return;
 }
 
@@ -1124,6 +1219,7 @@ void dPoly::eraseVertex(int polyIndex, int vertIndex) {
   assert(0 <= vertIndex && vertIndex < m_numVerts[polyIndex]);
 
   int start = getStartingIndices()[polyIndex];
+  syncedTrees T = getSyncedTrees();
 
   int iv = start + vertIndex;
   m_xv.erase(m_xv.begin() + iv, m_xv.begin() + iv + 1);
@@ -1132,7 +1228,17 @@ void dPoly::eraseVertex(int polyIndex, int vertIndex) {
   m_totalNumVerts--;
   m_numVerts[polyIndex]--;
   m_startingIndices.clear();
-  clearExtraData();
+  clearExtraDataButTrees();
+
+  // Vertices after the erased one move down by one
+  std::vector<int> newIds(m_totalNumVerts + 1);
+  for (int i = 0; i < (int)newIds.size(); i++)
+    newIds[i] = (i < iv) ? i : ((i == iv) ? -1 : i - 1);
+  remapVertIdsInTrees(T, newIds);
+
+  // The edge ending at the erased vertex now goes to the next one
+  updateVertsInTrees(T, polyIndex, vertIndex, vertIndex);
+  dropUnbalancedTrees();
   return;
 }
 
@@ -1142,11 +1248,14 @@ void dPoly::changeVertexValue(int polyIndex, int vertIndex, double x, double y)
   assert(0 <= vertIndex && vertIndex < m_numVerts[polyIndex]);
 
   int start = getStartingIndices()[polyIndex];
+  syncedTrees T = getSyncedTrees();
 
   m_xv[start + vertIndex] = x;
   m_yv[start + vertIndex] = y;
 
-  clearExtraData();
+  clearExtraDataButTrees();
+  updateVertsInTrees(T, polyIndex, vertIndex, vertIndex + 1);
+  dropUnbalancedTrees();
 
   return;
 }
@@ -1157,19 +1266,27 @@ void dPoly::shiftEdge(int polyIndex, int vertIndex, double shift_x, double shift
   assert(0 <= vertIndex && vertIndex < m_numVerts[polyIndex]);
 
   int start = getStartingIndices()[polyIndex];
+  syncedTrees T = getSyncedTrees();
 
   // Beginning point of the edge
   m_xv[start + vertIndex] += shift_x;
   m_yv[start + vertIndex] += shift_y;
 
-  clearExtraData();
+  clearExtraDataButTrees();
 
   // End point of the edge
-  if (m_numVerts[polyIndex] <= 1) return;
+  if (m_numVerts[polyIndex] <= 1) {
+    updateVertsInTrees(T, polyIndex, vertIndex, vertIndex + 1);
+    dropUnbalancedTrees();
+    return;
+  }
   int vertIndexEnd = (vertIndex + 1)%m_numVerts[polyIndex];
   m_xv[start + vertIndexEnd] += shift_x;
   m_yv[start + vertIndexEnd] += shift_y;
 
+  updateVertsInTrees(T, polyIndex, vertIndex, vertIndex + 1);
+  updateVertsInTrees(T, polyIndex, vertIndexEnd, vertIndexEnd + 1);
+  dropUnbalancedTrees();
   return;
 }
 
@@ -1178,13 +1295,16 @@ void dPoly::shiftOnePoly(int polyIndex, double shift_x, double shift_y) {
   assert(0 <= polyIndex && polyIndex < m_numPolys);
 
   int start = getStartingIndices()[polyIndex];
+  syncedTrees T = getSyncedTrees();
 
   for (int vIter = 0; vIter < m_numVerts[polyIndex]; vIter++) {
     m_xv[start + vIter] += shift_x;
     m_yv[start + vIter] += shift_y;
   }
 
-  clearExtraData();
+  clearExtraDataButTrees();
+  updateVertsInTrees(T, polyIndex, 0, m_numVerts[polyIndex]);
+  dropUnbalancedTrees();
   return;
 }
 
@@ -1195,7 +1315,7 @@ void dPoly::shiftOneAnno(int index, double shift_x, double shift_y) {
   m_annotations[index].x += shift_x;
   m_annotations[index].y += shift_y;
 
-  m_vertIndexAnno.clear();
+  annoChanged(fileAnno);
 
   return;
 }
@@ -1276,8 +1396,8 @@ void dPoly::extractOnePoly(int polyIndex, // input
   poly.setPolygon(m_numVerts[polyIndex],
                   vecPtr(m_xv) + start, vecPtr(m_yv) + start,
                   m_isPolyClosed[polyIndex],
-                  m_colors[polyIndex],
-                  m_layers[polyIndex]);
+                  get_color(polyIndex),
+                  get_layer(polyIndex));
 
   return;
 }
@@ -1382,26 +1502,27 @@ void dPoly::sortFromLargestToSmallest(bool counter_cc) {
   vector<double> l_yv           = m_yv;
   vector<int>    l_numVerts     = m_numVerts;
   vector<char>   l_isPolyClosed = m_isPolyClosed;
-  vector<string> l_colors       = m_colors;
-  vector<string> l_layers       = m_layers;
+  vector<int>    l_colorIds     = m_colorIds;
+  vector<int>    l_layerIds     = m_layerIds;
 
   for (int s = 0; s < numPolys; s++) {
     int index          = boxDims[s].index;
     m_numVerts     [s] = l_numVerts     [index];
     m_isPolyClosed [s] = l_isPolyClosed [index];
-    m_colors       [s] = l_colors       [index];
-    m_layers       [s] = l_layers       [index];
+    m_colorIds     [s] = l_colorIds     [index];
+    m_layerIds     [s] = l_layerIds     [index];
   }
 
+  vector<int> l_starts(numPolys, 0);
+  for (int s = 1; s < numPolys; s++)
+    l_starts[s] = l_starts[s - 1] + l_numVerts[s - 1];
+
   start = 0;
   for (int s = 0; s < numPolys; s++) {
 
     if (s > 0) start += m_numVerts[s - 1];
 
-    int index = boxDims[s].index;
-    int start2 = 0;
-    for (int t = 0; t < index; t++) start2 += l_numVerts[t];
-
+    int start2 = l_starts[boxDims[s].index];
     for (int t = 0; t < m_numVerts[s]; t++) {
       m_xv[start + t] = l_xv[start2 + t];
       m_yv[start + t] = l_yv[start2 + t];
@@ -1483,160 +1604,40 @@ void dPoly::enforce45() {
 bool dPoly::readPoly(std::string filename,
                      // If isPointCloud is true, treat each point as a
                      // singleton polygon
-                     bool isPointCloud) {
+                     bool isPointCloud,
+                     std::string const& defaultColor) {
+
+  if (isBinPolyFile(filename)) return readBinPoly(filename, isPointCloud);
 
   reset();
 
   m_isPointCloud = isPointCloud;
 
-  // To do: The test below will succeed if filename is a directory.
-  // This is probably not right.
-  ifstream fh(filename.c_str());
-  if (!fh) {
-    cerr << "Error: Could not open " << filename << endl;
+  polyFileData data;
+  if (!readXgFile(filename, isPointCloud,
+                  defaultColor.empty() ? getCurrentDefaultColor() : defaultColor,
+                  data))
     return false;
-  }
-
-  // The current polygon has vertices in the range [beg, end)
-  int beg = 0, end = 0;
-
-  anno annotation;
-  string layer, line;
-
-
-  string color = getCurrentDefaultColor(); // default color for polygons
-  string default_color = color;
-  m_has_color_in_file = false;
-
-  while( getline(fh, line) ) {
-
-    bool isLastLine = ( fh.peek() == EOF );
-
-
-    if (line[0] == ' ') {
-      // remove trailing space
-      line.erase(0, line.find_first_not_of(' '));
-    }
-
-    // Convert to lowercase
-    int num_chars = std::min((int)line.size(), 5);
-    for (int kk = 0; kk < num_chars; kk++){
-      // Only convert "NEXT", "COLOR", or "ANNO" to lower case, other annotations/labels should stay as is
-      line[kk] = tolower(line[kk]);
-    }
-
-    char * linePtr = (char*)line.c_str(); // To do: Avoid this casting hack.
-
-    // Replace comma with space, to be able to use comma as separator
-    int str_len = (int)strlen(linePtr);
-    for (int s = 0; s < str_len; s++) {
-      if (linePtr[s] == ',') linePtr[s] = ' ';
-    }
-
-    // Ignore any text after the comment character, which is '#' or '!'
-    for (int s = 0; s < str_len; s++) {
-      if (linePtr[s] == '#' || linePtr[s] == '!') {
-        for (int t = s; t < str_len; t++) {
-          linePtr[t] = '\0';
-        }
-        break;
-      }
-    }
-
-    // If the current line has a color, store it in 'color'.
-    // Else keep 'color' unchanged.
-    if (line[0] == 'c' ) {
-      searchForColor(line, color);
-      if (color != default_color) m_has_color_in_file = true;
-      if (!isLastLine) continue;
-
-    }
-
-    if (line[0] == 'a'){// search only if there is a match for performance.
-      if (searchForAnnotation(line, annotation)) {
-        m_annotations.push_back(annotation);
-      }
-      if (!isLastLine) continue;
-    }
-    // Extract the coordinates of the current vertex and the layer
-    // The format we expect is: x y ; layerNo (e.g., 2.3 -1.2 ; 5:16)
-
-    if (line[0] != 'n'){// if "next" skip this part
-      double x, y;
-      size_t sz;
-      try {
-        x = std::stod(line, &sz);
-        try {
-          y = std::stod(line.substr(sz), &sz);
-          m_xv.push_back(x);
-          m_yv.push_back(y);
-          end++;
-
-          if (end == beg + 1) {
-            // Find the layer for the current point only if this point
-            // is the first point in the polygon
-            searchForLayer(line, layer);
-          }
-          // Don't check the logic below in this case since we know we are not at the end
-          if (!isPointCloud && !isLastLine) continue;
-
-        }catch (...){}
-      } catch (...){}
-    }
-
-    // If this is the last line in the file, or if we encountered a
-    // "next" statement, or if we treat a polygon as just a set of
-    // points (point cloud) then close the current polygon and start a
-    // new one.
-    int is_next = strncmp(line.c_str(), "next", 4);// Efficient call
-
-    bool isLastVertexOfCurrPoly = ( isLastLine || (is_next == 0) || isPointCloud);
-
-    bool isCurrPolyNonEmpty = (beg < end);
-    if (isLastVertexOfCurrPoly && isCurrPolyNonEmpty) {
-
-      assert( end == (int)m_xv.size() && end == (int)m_yv.size() );
-
-      if (beg < end - 1              &&
-          m_xv[beg] == m_xv[end - 1] &&
-          m_yv[beg] == m_yv[end - 1]) {
-        // The first vertex equals to the last vertex in the current
-        // polygon. That means that this is a true polygon rather
-        // than a polygonal line. Don't store the last
-        // vertex.
-        end--;
-        m_xv.resize(end);
-        m_yv.resize(end);
-        m_isPolyClosed.push_back(true);
-      }else{
-        m_isPolyClosed.push_back(false);
-      }
-
-      m_layers.push_back(layer);
-      m_colors.push_back(color);
 
-      m_numPolys++;
-      m_numVerts.push_back(end - beg);
-      m_totalNumVerts = end;
-
-      // Start a new polygon
-      beg = end;
-
-    } // End processing the current polygon in the list of polygons
-
-  } // End reading the file and processing all polygons
-  m_startingIndices.clear();
-  clearExtraData();
+  setFileData(data);
+  openIndexFile(filename);
   return true; // success
 
 }
 
-void dPoly::writePoly(std::string filename, std::string defaultColor) {
+bool dPoly::writePoly(std::string filename, std::string defaultColor) {
+
+  std::string::size_type dot = filename.rfind('.');
+  if (dot != std::string::npos) {
+    std::string ext = filename.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == "pvb") return writeBinPoly(filename);
+  }
 
   ofstream out(filename.c_str());
   if (!out.is_open()) {
     cerr << "Error: Could not write to " << filename << endl;
-    return;
+    return false;
   }
 
   out.precision(16);
@@ -1650,17 +1651,17 @@ void dPoly::writePoly(std::string filename, std::string defaultColor) {
     if (pIter > 0) start += m_numVerts[pIter - 1];
 
     if (m_has_color_in_file){
-      if (pIter < (int)m_colors.size()) color = m_colors[pIter];
+      if (pIter < (int)m_colorIds.size()) color = get_color(pIter);
       if (color != prevColor || pIter == 0) out << "color = " << color << endl;
       prevColor = color;
     }
 
     string layer = "";
-    if (pIter < (int)m_layers.size()) layer = m_layers[pIter];
+    if (pIter < (int)m_layerIds.size()) layer = get_layer(pIter);
     if (!layer.empty()) layer = " ; " + layer;
 
     bool isPolyClosed = true;
-    if ( pIter < (int)m_colors.size() ) isPolyClosed = m_isPolyClosed[pIter];
+    if ( pIter < (int)m_isPolyClosed.size() ) isPolyClosed = m_isPolyClosed[pIter];
 
     for (int vIter = 0; vIter < m_numVerts[pIter]; vIter++) { // iterate over vertices
 
@@ -1690,32 +1691,415 @@ void dPoly::writePoly(std::string filename, std::string defaultColor) {
   }
 
   out.close();
+  if (out.fail()) {
+    cerr << "Error: Could not write to " << filename << endl;
+    return false;
+  }
 
-  return;
+  return true;
+}
+namespace dPoly_local_functions{
+
+  // The layout of a .pvb file. All numbers are in the byte order of
+  // the machine which wrote the file, and each section starts at a
+  // multiple of 8 bytes, so a mapped file can be read in place.
+  //
+  //   header
+  //   x coordinates          double   [numVerts]
+  //   y coordinates          double   [numVerts]
+  //   vertices per polygon   int32    [numPolys]
+  //   color index            uint32   [numPolys]
+  //   layer index            uint32   [numPolys]
+  //   is polygon closed      uint8    [numPolys]
+  //   annotation positions   double   [2*numAnnos]
+  //   string offsets         uint64   [numColors + numLayers + numAnnos + 1]
+  //   string bytes           char     [numStringBytes]
+  //
+  // The strings are the distinct colors, then the distinct layers,
+  // then the annotation labels.
+  const char     binPolyMagic[8]   = {'P', 'V', 'B', 'I', 'N', 'A', 'R', 'Y'};
+  const uint32_t binPolyByteOrder  = 0x01020304;
+  const uint32_t binPolyVersion    = 1;
+  const uint32_t binPolyPointCloud = 1;
+  const uint32_t binPolyHasColor   = 2;
+
+  struct binPolyHeader{
+    char     magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t numPolys;
+    uint64_t numVerts;
+    uint64_t numColors;
+    uint64_t numLayers;
+    uint64_t numAnnos;
+    uint64_t numStringBytes;
+  };
+
+  struct binPolyLayout{
+    uint64_t xv, yv, numVerts, colorIds, layerIds, isPolyClosed,
+      annoXY, strOffsets, strings, end;
+  };
+
+  inline uint64_t align8(uint64_t pos){ return (pos + 7) & ~uint64_t(7); }
+
+  // Return false if the sizes in the header cannot be right, as then
+  // the offsets below could overflow.
+  bool getBinPolyLayout(binPolyHeader const& H, binPolyLayout & L){
+
+    const uint64_t maxCount = uint64_t(1) << 40;
+    if (H.numPolys > maxCount || H.numVerts > maxCount || H.numColors > maxCount ||
+        H.numLayers > maxCount || H.numAnnos > maxCount || H.numStringBytes > maxCount)
+      return false;
+
+    uint64_t numStrings = H.numColors + H.numLayers + H.numAnnos;
+    L.xv           = align8(sizeof(binPolyHeader));
+    L.yv           = align8(L.xv           + sizeof(double)   * H.numVerts);
+    L.numVerts     = align8(L.yv           + sizeof(double)   * H.numVerts);
+    L.colorIds     = align8(L.numVerts     + sizeof(int32_t)  * H.numPolys);
+    L.layerIds     = align8(L.colorIds     + sizeof(uint32_t) * H.numPolys);
+    L.isPolyClosed = align8(L.layerIds     + sizeof(uint32_t) * H.numPolys);
+    L.annoXY       = align8(L.isPolyClosed + sizeof(uint8_t)  * H.numPolys);
+    L.strOffsets   = align8(L.annoXY       + 2 * sizeof(double) * H.numAnnos);
+    L.strings      = align8(L.strOffsets   + sizeof(uint64_t) * (numStrings + 1));
+    L.end          = L.strings + H.numStringBytes;
+    return true;
+  }
+
+  // Pad the file with zeros up to the next multiple of 8 bytes
+  void writePadding(std::ofstream & out){
+    const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    std::streamoff pos = out.tellp();
+    out.write(zeros, (std::streamsize)(align8(pos) - pos));
+  }
+
+  template<class T>
+  void writeArray(std::ofstream & out, const T * vals, size_t num){
+    if (num > 0) out.write((const char*)vals, (std::streamsize)(sizeof(T) * num));
+    writePadding(out);
+  }
+
+  // Copy a section of a mapped file. The file need not be aligned
+  // in memory for this to work.
+  template<class T>
+  void readArray(const char * data, uint64_t offset, size_t num, std::vector<T> & vals){
+    vals.resize(num);
+    if (num > 0) memcpy(&vals[0], data + offset, sizeof(T) * num);
+  }
 }
+
+bool dPoly::isBinPolyFile(std::string const& filename){
+
+  ifstream fh(filename.c_str(), ios::binary);
+  char magic[sizeof(dPoly_local_functions::binPolyMagic)];
+  if (!fh.read(magic, sizeof(magic))) return false;
+
+  return memcmp(magic, dPoly_local_functions::binPolyMagic, sizeof(magic)) == 0;
+}
+
+bool dPoly::readBinPoly(std::string const& filename, bool isPointCloud){
+
+  using namespace dPoly_local_functions;
+
+  reset();
+
+  mappedFile file;
+  if (!file.open(filename)) {
+    cerr << "Error: Could not open " << filename << endl;
+    return false;
+  }
+
+  binPolyHeader H;
+  binPolyLayout L;
+  const char * data = file.data();
+  if (file.size() < sizeof(H)) {
+    cerr << "Error: Invalid binary polygon file " << filename << endl;
+    return false;
+  }
+  memcpy(&H, data, sizeof(H));
+
+  if (memcmp(H.magic, binPolyMagic, sizeof(H.magic)) != 0 ||
+      H.byteOrder != binPolyByteOrder) {
+    cerr << "Error: " << filename << " is not a binary polygon file "
+         << "written on a machine of this type." << endl;
+    return false;
+  }
+  if (H.version > binPolyVersion) {
+    cerr << "Error: " << filename << " was written by a newer version of this program."
+         << endl;
+    return false;
+  }
+  if (!getBinPolyLayout(H, L) || L.end > file.size()) {
+    cerr << "Error: Truncated binary polygon file " << filename << endl;
+    return false;
+  }
+
+  // Validate the indices before using them
+  std::vector<int32_t>  numVerts;
+  std::vector<uint32_t> colorIds, layerIds;
+  std::vector<uint64_t> strOffsets;
+  readArray(data, L.numVerts,   H.numPolys, numVerts);
+  readArray(data, L.colorIds,   H.numPolys, colorIds);
+  readArray(data, L.layerIds,   H.numPolys, layerIds);
+  readArray(data, L.strOffsets, H.numColors + H.numLayers + H.numAnnos + 1, strOffsets);
+
+  bool isValid = (strOffsets[0] == 0 && strOffsets.back() == H.numStringBytes);
+  for (size_t s = 0; s + 1 < strOffsets.size(); s++)
+    isValid = isValid && (strOffsets[s] <= strOffsets[s + 1]);
+  uint64_t totalNumVerts = 0;
+  for (size_t p = 0; p < H.numPolys; p++) {
+    isValid = isValid && numVerts[p] >= 0 &&
+      colorIds[p] < H.numColors && layerIds[p] < H.numLayers;
+    totalNumVerts += (uint64_t)std::max(numVerts[p], 0);
+  }
+  isValid = isValid && (totalNumVerts == H.numVerts) &&
+    H.numVerts <= (uint64_t)std::numeric_limits<int>::max() &&
+    H.numPolys <= (uint64_t)std::numeric_limits<int>::max();
+  if (!isValid) {
+    cerr << "Error: Invalid binary polygon file " << filename << endl;
+    return false;
+  }
+
+  const char * strings = data + L.strings;
+  std::vector<std::string> table(strOffsets.size() - 1);
+  for (size_t s = 0; s < table.size(); s++)
+    table[s].assign(strings + strOffsets[s], strings + strOffsets[s + 1]);
+
+  readArray(data, L.xv, H.numVerts, m_xv);
+  readArray(data, L.yv, H.numVerts, m_yv);
+  readArray(data, L.isPolyClosed, H.numPolys, m_isPolyClosed);
+  m_numVerts.assign(numVerts.begin(), numVerts.end());
+
+  // The tables could in principle repeat a name, so map them to palettes
+  m_colorPalette.clear();
+  m_layerPalette.clear();
+  std::vector<int> colorMap(H.numColors), layerMap(H.numLayers);
+  for (size_t c = 0; c < H.numColors; c++)
+    colorMap[c] = m_colorPalette.intern(table[c]);
+  for (size_t l = 0; l < H.numLayers; l++)
+    layerMap[l] = m_layerPalette.intern(table[H.numColors + l]);
+  m_colorIds.resize(H.numPolys);
+  m_layerIds.resize(H.numPolys);
+  for (size_t p = 0; p < H.numPolys; p++) {
+    m_colorIds[p] = colorMap[colorIds[p]];
+    m_layerIds[p] = layerMap[layerIds[p]];
+  }
+
+  std::vector<double> annoXY;
+  readArray(data, L.annoXY, 2 * H.numAnnos, annoXY);
+  m_annotations.resize(H.numAnnos);
+  for (size_t a = 0; a < H.numAnnos; a++)
+    m_annotations[a] = anno(annoXY[2*a], annoXY[2*a + 1],
+                            table[H.numColors + H.numLayers + a]);
+
+  m_numPolys          = (int)H.numPolys;
+  m_totalNumVerts     = (int)H.numVerts;
+  m_has_color_in_file = ((H.flags & binPolyHasColor) != 0);
+  m_isPointCloud      = isPointCloud;
+
+  // As when reading a .xg file, a point cloud has each vertex as its own polygon
+  if (isPointCloud && (H.flags & binPolyPointCloud) == 0) {
+    std::vector<int> colorIds, layerIds;
+    colorIds.reserve(m_totalNumVerts);
+    layerIds.reserve(m_totalNumVerts);
+    for (int p = 0; p < m_numPolys; p++) {
+      colorIds.insert(colorIds.end(), m_numVerts[p], m_colorIds[p]);
+      layerIds.insert(layerIds.end(), m_numVerts[p], m_layerIds[p]);
+    }
+    m_colorIds.swap(colorIds);
+    m_layerIds.swap(layerIds);
+    m_numPolys = m_totalNumVerts;
+    m_numVerts.assign(m_numPolys, 1);
+    m_isPolyClosed.assign(m_numPolys, false);
+  }
+
+  clearExtraData();
+  openIndexFile(filename);
+  return true;
+}
+
+bool dPoly::writeBinPoly(std::string const& filename) const{
+
+  using namespace dPoly_local_functions;
+
+  ofstream out(filename.c_str(), ios::binary);
+  if (!out.is_open()) {
+    cerr << "Error: Could not write to " << filename << endl;
+    return false;
+  }
+
+  std::vector<std::string> const& colors = m_colorPalette.names();
+  std::vector<std::string> const& layers = m_layerPalette.names();
+  std::vector<uint32_t> colorIds(m_colorIds.begin(), m_colorIds.end());
+  std::vector<uint32_t> layerIds(m_layerIds.begin(), m_layerIds.end());
+
+  std::vector<const std::string*> strings;
+  for (size_t s = 0; s < colors.size(); s++) strings.push_back(&colors[s]);
+  for (size_t s = 0; s < layers.size(); s++) strings.push_back(&layers[s]);
+  for (size_t a = 0; a < m_annotations.size(); a++) strings.push_back(&m_annotations[a].label);
+
+  std::vector<uint64_t> strOffsets(1, 0);
+  for (size_t s = 0; s < strings.size(); s++)
+    strOffsets.push_back(strOffsets.back() + strings[s]->size());
+
+  std::vector<double> annoXY;
+  for (size_t a = 0; a < m_annotations.size(); a++) {
+    annoXY.push_back(m_annotations[a].x);
+    annoXY.push_back(m_annotations[a].y);
+  }
+
+  std::vector<int32_t> numVerts(m_numVerts.begin(), m_numVerts.end());
+  std::vector<uint8_t> isPolyClosed(m_numPolys, 0);
+  for (int p = 0; p < m_numPolys && p < (int)m_isPolyClosed.size(); p++)
+    isPolyClosed[p] = (m_isPolyClosed[p] != 0);
+
+  binPolyHeader H;
+  memset(&H, 0, sizeof(H));
+  memcpy(H.magic, binPolyMagic, sizeof(H.magic));
+  H.byteOrder      = binPolyByteOrder;
+  H.version        = binPolyVersion;
+  H.flags          = (m_isPointCloud ? binPolyPointCloud : 0) |
+                     (m_has_color_in_file ? binPolyHasColor : 0);
+  H.numPolys       = m_numPolys;
+  H.numVerts       = m_totalNumVerts;
+  H.numColors      = colors.size();
+  H.numLayers      = layers.size();
+  H.numAnnos       = m_annotations.size();
+  H.numStringBytes = strOffsets.back();
+
+  writeArray(out, &H, 1);
+  writeArray(out, vecPtr(m_xv), m_totalNumVerts);
+  writeArray(out, vecPtr(m_yv), m_totalNumVerts);
+  writeArray(out, vecPtr(numVerts), numVerts.size());
+  writeArray(out, vecPtr(colorIds), colorIds.size());
+  writeArray(out, vecPtr(layerIds), layerIds.size());
+  writeArray(out, vecPtr(isPolyClosed), isPolyClosed.size());
+  writeArray(out, vecPtr(annoXY), annoXY.size());
+  writeArray(out, vecPtr(strOffsets), strOffsets.size());
+  for (size_t s = 0; s < strings.size(); s++)
+    out.write(strings[s]->data(), (std::streamsize)strings[s]->size());
+
+  out.close();
+  if (!out) {
+    cerr << "Error: Could not write to " << filename << endl;
+    return false;
+  }
+
+  return true;
+}
+
 void dPoly::clearExtraData(){
 	m_boundingBoxTree.clear();
 	m_pointTree.clear();
 	m_edgeTree.clear();
-	m_vertIndexAnno.clear();
-	m_polyIndexAnno.clear();
+	clearExtraDataButTrees();
+}
+
+void dPoly::clearExtraDataButTrees(){
 	m_BoundingBox.setInvalid();
+	m_lodLevels.clear();
+	m_indexFile.reset();
+	m_pointCloud.reset();
+	stampChange();
+}
+
+void dPoly::stampChange(){
+  // Polygons may be read on several threads at once
+  static std::atomic<unsigned long long> ss_change_id(0);
+  m_changeId = ++ss_change_id;
+}
+
+dPoly::syncedTrees dPoly::getSyncedTrees() const{
+
+  // A tree which was formed and kept up to date has an entry for each
+  // polygon or vertex. One which was cleared is empty.
+  syncedTrees T;
+  T.boxes  = (m_boundingBoxTree.size() == m_numVerts.size());
+  T.points = (m_pointTree.size()       == m_xv.size());
+  T.edges  = (m_edgeTree.size()        == m_xv.size());
+  return T;
+}
+
+void dPoly::updateVertsInTrees(syncedTrees const& T, int polyIndex,
+                               int vBeg, int vEnd){
+
+  // The vertices in [vBeg, vEnd) of the given polygon moved or were
+  // inserted. Update them and the edges touching them. The vertices
+  // with other indices must be in the trees already.
+
+  int numV  = m_numVerts[polyIndex];
+  int start = getStartingIndices()[polyIndex];
+
+  if (T.boxes) {
+    m_boundingBoxTree.removeBox(polyIndex);
+    double xll = DBL_MAX/4.0, yll = DBL_MAX/4.0, xur = -DBL_MAX/4.0, yur = -DBL_MAX/4.0;
+    if (numV > 0) {
+      const double * px = vecPtr(m_xv) + start;
+      const double * py = vecPtr(m_yv) + start;
+      xll = *min_element(px, px + numV); xur = *max_element(px, px + numV);
+      yll = *min_element(py, py + numV); yur = *max_element(py, py + numV);
+    }
+    m_boundingBoxTree.insertBox(dRectWithId(xll, yll, xur, yur, polyIndex));
+  }
+
+  if (numV <= 0) return;
+
+  if (T.points) {
+    for (int v = vBeg; v < vEnd; v++) {
+      int id = start + v;
+      m_pointTree.removePoint(id);
+      m_pointTree.insertPoint(PointWithId(m_xv[id], m_yv[id], id));
+    }
+  }
+
+  if (T.edges) {
+    // The edges starting at the vertex before the range through the
+    // last vertex of the range
+    bool isOpen = !m_isPolyClosed[polyIndex] && numV > 1;
+    int numEdges = std::min(vEnd - vBeg + 1, numV);
+    for (int e = 0; e < numEdges; e++) {
+      int v  = ((vBeg - 1 + e) % numV + numV) % numV;
+      int v2 = (v + 1) % numV;
+      bool exists = !(isOpen && v == numV - 1);
+      m_edgeTree.setEdge(start + v, exists,
+                         seg(m_xv[start + v], m_yv[start + v],
+                             m_xv[start + v2], m_yv[start + v2]));
+    }
+  }
+}
+
+void dPoly::remapVertIdsInTrees(syncedTrees const& T, std::vector<int> const& newIds){
+  if (T.points) m_pointTree.remapIds(newIds);
+  if (T.edges)  m_edgeTree.remapIds(newIds, m_totalNumVerts);
+}
+
+void dPoly::dropUnbalancedTrees(){
+  // Such trees are formed again when next needed, which is cheaper
+  // than updating them further.
+  if (m_boundingBoxTree.needsRebuild()) m_boundingBoxTree.clear();
+  if (m_pointTree.needsRebuild())       m_pointTree.clear();
+  if (m_edgeTree.needsRebuild())        m_edgeTree.clear();
 }
 
 const kdTree * dPoly::getPointTree() const{
   // we need to check of tree is empty.
-  if ( m_pointTree.size() != m_xv.size()){
+  if ( m_pointTree.size() != m_xv.size() || m_pointTree.needsRebuild()){
     //utils::Timer my_clock("dPoly::getPointTree");
+    if (m_indexFile && m_indexFile->loadPointTree(m_pointTree)) return &m_pointTree;
     m_pointTree.formTreeOfPoints( m_xv.size(), vecPtr(m_xv), vecPtr(m_yv));
+    saveIndexFile();
   }
   return &m_pointTree;
 }
 
 const edgeTree * dPoly::getEdgeTree() const{
   // we need to check of tree is empty.
-  if ( m_edgeTree.size() != m_xv.size()){
+  if ( m_edgeTree.size() != m_xv.size() || m_edgeTree.needsRebuild()){
     //utils::Timer my_clock("dPoly::getPointTree");
+    if (m_indexFile && m_indexFile->loadEdgeTree(m_edgeTree)) return &m_edgeTree;
     m_edgeTree.putPolyEdgesInTree(*this);
+    saveIndexFile();
   }
   return &m_edgeTree;
 }
@@ -1726,7 +2110,9 @@ const boxTree< dRectWithId> * dPoly::getBoundingBoxTree() const{
 	// When polygons are changed m_boundingBoxTree must be updated,
 	// We check the size too as an extra caution to make sure tree size matches polygons size.
 	// Size check is not needed ideally.
-	if ( m_boundingBoxTree.size() != m_numVerts.size()){
+	if ( m_boundingBoxTree.size() != m_numVerts.size() || m_boundingBoxTree.needsRebuild()){
+
+		if (m_indexFile && m_indexFile->loadBoxTree(m_boundingBoxTree)) return &m_boundingBoxTree;
 
 		std::vector<double> xll,  yll, xur, yur;
 		bdBoxes(xll,  yll, xur, yur);
@@ -1735,29 +2121,204 @@ const boxTree< dRectWithId> * dPoly::getBoundingBoxTree() const{
 			rects.push_back(dRectWithId(xll[i],  yll[i], xur[i], yur[i], i));
 		}
 		m_boundingBoxTree.formTreeOfBoxes(rects);
+		saveIndexFile();
 
 	}
 	return &m_boundingBoxTree;
 }
 
-std::vector<int> dPoly::getPolyIdsInBox(const dRect &box) const{
-     return getBoundingBoxTree()->getIndicesInRegion(box);
- }
+void dPoly::openIndexFile(std::string const& filename){
 
-bool dPoly::getColorInCntFile(const std::string & line, std::string & color) {
+  // Small files form their trees fast enough
+  m_indexFile.reset();
+  if (m_totalNumVerts < polyIndexFile::minVertsForIndex) return;
 
-  // Minor function. Out of the line: "#Color = #ff00" return the string "#ff00"
-  // and append "00" to it to make it a valid color.
+  m_indexFile = std::make_shared<polyIndexFile>(filename, m_numPolys, m_totalNumVerts,
+                                                m_isPointCloud);
+}
 
-  istringstream iss(line);
-  string equal, colorTag;
-  if ( ! (iss >> colorTag >> equal >> color)        ) return false;
-  if ( colorTag != "#Color" && colorTag != "#color" ) return false;
-  while (color[0] == '#' && color.size() < 7 ) color += "0";
+void dPoly::saveIndexFile() const{
 
-  return true;
+  if (!m_indexFile) return;
+
+  // Save the trees which were formed from all the polygons, and keep
+  // the others from the existing index
+  bool boxes  = (m_boundingBoxTree.size() == m_numVerts.size() &&
+                 !m_boundingBoxTree.hasLocalUpdates());
+  bool points = (m_pointTree.size() == m_xv.size() && !m_pointTree.hasLocalUpdates());
+  bool edges  = (m_edgeTree.size()  == m_xv.size() && !m_edgeTree.hasLocalUpdates());
+  if (!polyIndexFile::write(*m_indexFile,
+                            boxes  ? &m_boundingBoxTree : NULL,
+                            points ? &m_pointTree       : NULL,
+                            edges  ? &m_edgeTree        : NULL)) {
+    m_indexFile.reset(); // do not try again for each tree
+    return;
+  }
+
+  m_indexFile = std::make_shared<polyIndexFile>(m_indexFile->polyFile(), m_numPolys,
+                                                m_totalNumVerts, m_isPointCloud);
+}
+
+void dPoly::buildClippingData() const{
+  bdBox();
+  getStartingIndices();
+  // Point clouds are clipped with their own grid, see clipPointCloud()
+  if (m_isPointCloud) getPointCloud();
+  else                getBoundingBoxTree();
 }
 
+const pointCloud & dPoly::getPointCloud() const{
+
+  if (!m_pointCloud || m_pointCloudChangeId != m_changeId) {
+    auto C = std::make_shared<pointCloud>();
+    bool hasColors = (m_colorIds.size() == m_xv.size());
+    C->formGrid(m_totalNumVerts, vecPtr(m_xv), vecPtr(m_yv),
+                hasColors ? vecPtr(m_colorIds) : NULL);
+    m_pointCloud         = C;
+    m_pointCloudChangeId = m_changeId;
+  }
+
+  return *m_pointCloud;
+}
+
+dPoly & dPoly::getLodLevel(double pixelSize){
+
+  // Level k of the pyramid snaps the vertices to a grid with cells of
+  // size baseCell*2^k. The level with cells no bigger than a pixel
+  // looks the same as the original, but its size is bounded by the
+  // screen resolution rather than by the number of vertices.
+
+  int minVertsForLod = 10000; // smaller polygons are fast enough to draw
+  int numLodCells    = 65536; // cells across the bounding box at the finest level
+  int maxLodLevel    = 16;    // everything is in one cell at this level
+
+  if (m_totalNumVerts < minVertsForLod || pixelSize <= 0) return *this;
+
+  const dRect & box = bdBox();
+  double extent = max(box.xh - box.xl, box.yh - box.yl);
+  if (extent <= 0) return *this;
+
+  double baseCell = extent/numLodCells;
+  if (pixelSize < baseCell) return *this;
+
+  int level = (int)floor(log2(pixelSize/baseCell));
+  level = min(level, maxLodLevel);
+
+  // Build each level from the previous one, as that is smaller
+  while ((int)m_lodLevels.size() <= level) {
+    int k = m_lodLevels.size();
+    const dPoly & finer = (k == 0) ? *this : *m_lodLevels.back();
+    std::shared_ptr<dPoly> coarser(new dPoly);
+    finer.simplifyForLod(baseCell*pow(2.0, k), *coarser);
+    m_lodLevels.push_back(coarser);
+  }
+
+  return *m_lodLevels[level];
+}
+
+namespace dPoly_local_functions{
+
+  struct cellHash{
+    size_t operator()(std::pair<long long, long long> const& c) const {
+      return std::hash<long long>()(c.first) ^ (std::hash<long long>()(c.second) << 1);
+    }
+  };
+
+  // If b is on the segment from a to c, so it can be removed. There is
+  // no rounding as the inputs are integers.
+  bool isCollinear(std::pair<long long, long long> const& a,
+                   std::pair<long long, long long> const& b,
+                   std::pair<long long, long long> const& c) {
+    long long abx = b.first - a.first, aby = b.second - a.second;
+    long long bcx = c.first - b.first, bcy = c.second - b.second;
+    return abx*bcy == aby*bcx && abx*bcx + aby*bcy > 0;
+  }
+}
+
+void dPoly::simplifyForLod(double cellSize, dPoly & simplePoly) const{
+
+  // Snap the vertices to a grid of given cell size, with the origin
+  // at (0, 0), and remove the repeated and collinear vertices. All
+  // polygons are snapped to the same grid, so an edge shared by two
+  // polygons stays shared, unlike with simplifying each polygon on its
+  // own, which would open cracks between them. A polygon smaller than
+  // a cell becomes a single vertex rather than disappear.
+
+  using namespace dPoly_local_functions;
+  typedef std::pair<long long, long long> cell;
+
+  simplePoly.reset();
+  simplePoly.set_isPointCloud(m_isPointCloud);
+  simplePoly.copyPalettes(*this);
+
+  if (m_isPointCloud) {
+    // Keep only the first point in each cell
+    std::unordered_set<cell, cellHash> usedCells;
+    for (int v = 0; v < m_totalNumVerts; v++) {
+      cell c(llround(m_xv[v]/cellSize), llround(m_yv[v]/cellSize));
+      if (!usedCells.insert(c).second) continue;
+      simplePoly.appendPolygonWithIds(1, &m_xv[v], &m_yv[v], false,
+                                      m_colorIds[v], m_layerIds[v]);
+    }
+    return;
+  }
+
+  // Write to the arrays directly, as appendPolygon() does not accept
+  // empty polygons, and the output must have the same polygons as the input.
+  simplePoly.m_numPolys     = m_numPolys;
+  simplePoly.m_numVerts.resize(m_numPolys);
+  simplePoly.m_isPolyClosed = m_isPolyClosed;
+  simplePoly.m_colorIds     = m_colorIds;
+  simplePoly.m_layerIds     = m_layerIds;
+
+  std::vector<cell> snapped, kept;
+  int start = 0;
+  for (int pIter = 0; pIter < m_numPolys; pIter++) {
+
+    if (pIter > 0) start += m_numVerts[pIter - 1];
+    int numV = m_numVerts[pIter];
+    bool isClosed = m_isPolyClosed[pIter];
+
+    snapped.clear();
+    for (int v = start; v < start + numV; v++) {
+      cell c(llround(m_xv[v]/cellSize), llround(m_yv[v]/cellSize));
+      if (snapped.empty() || snapped.back() != c) snapped.push_back(c);
+    }
+    // The last vertex of a closed polygon joins the first one
+    while (isClosed && snapped.size() > 1 && snapped.back() == snapped.front())
+      snapped.pop_back();
+
+    kept.clear();
+    for (size_t v = 0; v < snapped.size(); v++) {
+      if (kept.size() >= 2 && isCollinear(kept[kept.size() - 2], kept.back(), snapped[v]))
+        kept.back() = snapped[v];
+      else
+        kept.push_back(snapped[v]);
+    }
+    // For closed polygons also check the vertices where the polygon closes
+    if (isClosed) {
+      while (kept.size() >= 3 && isCollinear(kept[kept.size() - 2], kept.back(), kept[0]))
+        kept.pop_back();
+      while (kept.size() >= 3 && isCollinear(kept.back(), kept[0], kept[1]))
+        kept.erase(kept.begin());
+    }
+
+    simplePoly.m_numVerts[pIter] = kept.size();
+    for (size_t v = 0; v < kept.size(); v++) {
+      simplePoly.m_xv.push_back(kept[v].first*cellSize);
+      simplePoly.m_yv.push_back(kept[v].second*cellSize);
+    }
+  }
+
+  simplePoly.m_totalNumVerts = simplePoly.m_xv.size();
+
+  return;
+}
+
+std::vector<int> dPoly::getPolyIdsInBox(const dRect &box) const{
+     return getBoundingBoxTree()->getIndicesInRegion(box);
+ }
+
 bool dPoly::read_pol_or_cnt_format(std::string filename,
                                    std::string type,
                                    bool isPointCloud){
@@ -1766,88 +2327,94 @@ bool dPoly::read_pol_or_cnt_format(std::string filename,
 
   assert(type == "pol" || type == "cnt");
 
-  string color = "yellow";
-  string layer = "";
-
   reset();
   m_isPointCloud = isPointCloud;
 
-  ifstream fh(filename.c_str());
-  if( !fh ) {
-    cerr << "Could not open " << filename << endl;
-    return false;
-  }
+  polyFileData data;
+  bool success = readPolOrCntFile(filename, type, data);
+  setFileData(data);
+  if (success) openIndexFile(filename);
 
-  // Bypass the lines starting with comments. Extract the color.
-  while (1) {
-    char c = fh.peek();
-    if (c != '#' && c != '!') break;
-    string line;
-    getline(fh, line);
-    string lColor;
-    if (getColorInCntFile(line, lColor)) color = lColor;
-  }
+  return success;
+}
 
-  // Parse the header for pol files.
-  double tmp;
-  if (type == "pol" && !(fh >> tmp >> tmp >> tmp >> tmp) ) return false;
+void dPoly::setFileData(polyFileData & data){
 
-  while (1) {
+  m_xv.swap(data.xv);
+  m_yv.swap(data.yv);
+  m_numVerts.swap(data.numVerts);
+  m_isPolyClosed.swap(data.isPolyClosed);
+  m_colorIds.swap(data.colorIds);
+  m_layerIds.swap(data.layerIds);
+  std::swap(m_colorPalette, data.colorPalette);
+  std::swap(m_layerPalette, data.layerPalette);
+  m_annotations.swap(data.annotations);
+  m_has_color_in_file = data.hasColorInFile;
 
-    int numVerts = 0;
+  m_numPolys      = m_numVerts.size();
+  m_totalNumVerts = m_xv.size();
 
-    if (type == "pol") {
-      // Extract the number of vertices for pol files
-     if (! (fh >> tmp >> numVerts) ) return true;  // no more vertices
-     if (! (fh >> tmp >> tmp) )      return false; // invalid format
-    }else{
-      // Extract the number of vertices and/or color for cnt file.
-      // Skip lines with comments.
-      string line;
-      if (!getline(fh, line)) return true;
-      string lColor; if (getColorInCntFile(line, lColor)) color = lColor;
-      if (!line.empty() && line[0] == '#') continue;
-      numVerts = int(atof(line.c_str()));
-    }
+  m_startingIndices.clear();
+  clearExtraData();
+}
 
-    // Now that we know how many vertices to expect, try reading them
-    // from the file. Stop if we are unable to find the expected vertices.
+void dPoly::saveSnapshot(polySnapshot const* prev, snapshotPool const& pool,
+                         polySnapshot & snap) const{
 
-    m_numPolys++;
-    m_numVerts.push_back(numVerts);
-    m_totalNumVerts += numVerts;
-    m_colors.push_back(color);
-    m_layers.push_back(layer);
-
-    for (int s = 0; s < numVerts; s++) {
-      double x, y;
-      if (! (fh >> x >> y) ) return false;
-      m_xv.push_back(x);
-      m_yv.push_back(y);
-    }
+  snap.changeId       = m_changeId;
+  snap.isPointCloud   = m_isPointCloud;
+  snap.hasColorInFile = m_has_color_in_file;
+  snap.img            = img;
+  snap.lodLevels      = m_lodLevels;
+  snap.colorPalette   = m_colorPalette;
+  snap.layerPalette   = m_layerPalette;
 
-    int l = m_totalNumVerts;
-    if (l > 0 && numVerts >= 2            &&
-        m_xv[l - 1] == m_xv[l - numVerts] &&
-        m_yv[l - 1] == m_yv[l - numVerts]
-	) {
-	// Remove last repeated vertex
-	m_xv.pop_back();
-	m_yv.pop_back();
-	m_totalNumVerts--;
-        m_numVerts[m_numVerts.size() - 1]--;
-        m_isPolyClosed.push_back(true);
-    }else if (type == "pol") {
-      // pol files are always closed
-      m_isPolyClosed.push_back(true);
-    }else{
-      m_isPolyClosed.push_back(false);
-    }
+  static const polySnapshot noSnap;
+  polySnapshot const& P = (prev != NULL) ? *prev : noSnap;
+  splitIntoChunks(m_xv,            &P.xv,             pool.doubles, snap.xv);
+  splitIntoChunks(m_yv,            &P.yv,             pool.doubles, snap.yv);
+  splitIntoChunks(m_numVerts,      &P.numVerts,       pool.ints,    snap.numVerts);
+  splitIntoChunks(m_isPolyClosed,  &P.isPolyClosed,   pool.chars,   snap.isPolyClosed);
+  splitIntoChunks(m_colorIds,      &P.colorIds,       pool.ints,    snap.colorIds);
+  splitIntoChunks(m_layerIds,      &P.layerIds,       pool.ints,    snap.layerIds);
+  splitIntoChunks(m_annotations,   &P.annotations,    pool.annos,   snap.annotations);
+  splitIntoChunks(m_angleAnno,     &P.angleAnno,      pool.annos,   snap.angleAnno);
+}
+
+void dPoly::restoreSnapshot(polySnapshot const& snap){
 
+  if (m_changeId == snap.changeId) {
+    img = snap.img;
+    return; // nothing changed, keep the search trees
   }
 
+  m_startingIndices.clear();
   clearExtraData();
-   return true;
+  clearAnnoTrees();
+
+  m_isPointCloud      = snap.isPointCloud;
+  m_has_color_in_file = snap.hasColorInFile;
+  img                 = snap.img;
+  m_colorPalette      = snap.colorPalette;
+  m_layerPalette      = snap.layerPalette;
+
+  joinChunks(snap.xv,            m_xv);
+  joinChunks(snap.yv,            m_yv);
+  joinChunks(snap.numVerts,      m_numVerts);
+  joinChunks(snap.isPolyClosed,  m_isPolyClosed);
+  joinChunks(snap.colorIds,      m_colorIds);
+  joinChunks(snap.layerIds,      m_layerIds);
+  joinChunks(snap.annotations,   m_annotations);
+  joinChunks(snap.angleAnno,     m_angleAnno);
+
+  m_numPolys      = m_numVerts.size();
+  m_totalNumVerts = m_xv.size();
+
+  // The levels of detail depend only on the geometry restored above
+  m_lodLevels = snap.lodLevels;
+
+  // Drawings made of this state before are good again
+  m_changeId = snap.changeId;
 }
 
 void dPoly::set_pointCloud(const std::vector<dPoint> & P, std::string color,
@@ -1856,13 +2423,23 @@ void dPoly::set_pointCloud(const std::vector<dPoint> & P, std::string color,
   // Form a dPoly structure from a set of points
   reset();
   m_isPointCloud = true;
+  int colorId = m_colorPalette.intern(color);
+  int layerId = m_layerPalette.intern(layer);
+
+  // Clouds can be large, do not let the arrays grow past their size
+  m_numVerts.reserve(P.size());
+  m_layerIds.reserve(P.size());
+  m_isPolyClosed.reserve(P.size());
+  m_colorIds.reserve(P.size());
+  m_xv.reserve(P.size());
+  m_yv.reserve(P.size());
   for (int s = 0; s < (int)P.size(); s++) {
     m_totalNumVerts++;
     m_numPolys++;
     m_numVerts.push_back(1);
-    m_layers.push_back(layer);
+    m_layerIds.push_back(layerId);
     m_isPolyClosed.push_back(true);
-    m_colors.push_back(color);
+    m_colorIds.push_back(colorId);
     m_xv.push_back(P[s].x);
     m_yv.push_back(P[s].y);
   }
@@ -1950,36 +2527,27 @@ void dPoly::markPolysIntersectingBox(// Inputs
   dRect clip_box(xll, yll, xur, yur);
 
   //utils::Timer my_clock("markPolysIntersectingBox");
-  vector< dRectWithId> boxes;
-  box_tree->getBoxesInRegion(xll, yll, xur, yur, boxes);
+  // Polygons whose bounding box is in the region are marked right
+  // away, the others are looked at more closely below.
+  vector<int> toCheck;
+  box_tree->visitBoxesInRegion(xll, yll, xur, yur, [&](const dRectWithId & box){
+      if (m_numVerts[box.id] == 1 || clip_box.contains(box))
+        mark[box.id] = 1;
+      else
+        toCheck.push_back(box.id);
+    });
 
 #ifdef POLYVIEW_USE_OPENMP
-    #pragma omp parallel for
+    #pragma omp parallel for schedule(dynamic, 64)
 #endif
-  for (int i = 0; i < (int)boxes.size(); i++) {
-    const auto &box = boxes[i];
-    int polyIndex = box.id;
-
-    if (m_numVerts[polyIndex] == 1 || clip_box.contains(box)){
+  for (int i = 0; i < (int)toCheck.size(); i++) {
+    int polyIndex = toCheck[i];
+    int start = starting_ids[polyIndex];
+    if (polyIntersectsBox(m_numVerts[polyIndex], vecPtr(m_xv) + start,
+                          vecPtr(m_yv) + start, m_isPolyClosed[polyIndex] != 0,
+                          xll, yll, xur, yur)){
       mark[polyIndex] = 1;
-
-    } else {
-      dPoly onePoly, clippedPoly;
-
-      int beg_inex = starting_ids[polyIndex];
-      extractOnePoly(polyIndex, // input
-                     onePoly,
-                     beg_inex);  // output
-
-      // A polygon intersects a rectangle if cut to the rectangle
-      // it returns a non-empty polygon
-      onePoly.clipAll(xll, yll, xur, yur, // inputs
-                       clippedPoly);       // outputs
-      if (clippedPoly.get_totalNumVerts() != 0){
-        mark[polyIndex] = 1;
-      }
     }
-
   }
 
   return;
@@ -1991,17 +2559,12 @@ void dPoly::markAnnosIntersectingBox(// Inputs
                                      // Outputs
                                      std::vector<int> & mark) const {
   mark.assign(m_annotations.size(), 0);
+  if (m_annotations.empty()) return;
 
-#ifdef POLYVIEW_USE_OPENMP
-    #pragma omp parallel for
-#endif
-  for (size_t aIter = 0; aIter < m_annotations.size(); aIter++) {
-    double x = m_annotations[aIter].x;
-    double y = m_annotations[aIter].y;
-
-    if (x >= xll && x <= xur && y >= yll && y <= yur)
-      mark[aIter] = 1;
-  }  
+  std::vector<int> ids;
+  getAnnoTree(fileAnno).getIdsInBox(dRect(xll, yll, xur, yur), ids);
+  for (size_t s = 0; s < ids.size(); s++)
+    mark[ids[s]] = 1;
 }
 
 //void dPoly::replaceOnePoly(int polyIndex, int numV, const double* x, const double* y) {
@@ -2019,17 +2582,31 @@ void dPoly::markAnnosIntersectingBox(// Inputs
 //  m_numVerts[polyIndex] = numV;
 //  m_totalNumVerts = m_xv.size();
 //
-//  m_layerAnno.clear();
 //  clearExtraData();
 //  m_startingIndices.clear();
 //  return;
 //}
 
+namespace dPoly_local_functions{
+  // The index of each element once the marked ones are erased, or -1
+  // for the erased ones
+  void markToNewIds(std::vector<char> const& mark, std::vector<int> & newIds){
+    newIds.resize(mark.size());
+    int count = 0;
+    for (size_t i = 0; i < mark.size(); i++)
+      newIds[i] = mark[i] ? -1 : count++;
+  }
+}
+
 void dPoly::eraseMarkedPolys(std::vector<int> const& mark) {
 
+  using namespace dPoly_local_functions;
+
   // Erase the polygons matching the given mark.
   // See also the function named eraseOnePoly().
 
+  syncedTrees T = getSyncedTrees();
+
   vector<char> dmark, imark;
   dmark.assign(m_totalNumVerts, 0);
   imark.assign(m_numPolys, 0);
@@ -2047,16 +2624,28 @@ void dPoly::eraseMarkedPolys(std::vector<int> const& mark) {
   eraseMarkedElements(m_yv, dmark);
 
   eraseMarkedElements(m_isPolyClosed,  imark);
-  eraseMarkedElements(m_colors,        imark);
-  eraseMarkedElements(m_layers,        imark);
+  eraseMarkedElements(m_colorIds,      imark);
+  eraseMarkedElements(m_layerIds,      imark);
   eraseMarkedElements(m_numVerts,      imark);
 
   m_totalNumVerts = m_xv.size();
   m_numPolys      = m_numVerts.size();
 
-  m_layerAnno.clear();
-  clearExtraData();
+  clearExtraDataButTrees();
   m_startingIndices.clear();
+
+  // The trees keep what is left, under the new indices
+  std::vector<int> newIds;
+  if (T.boxes) {
+    markToNewIds(imark, newIds);
+    m_boundingBoxTree.remapIds(newIds);
+  }
+  if (T.points || T.edges) {
+    markToNewIds(dmark, newIds);
+    remapVertIdsInTrees(T, newIds);
+  }
+  dropUnbalancedTrees();
+
   return;
 }
 
@@ -2069,6 +2658,7 @@ void dPoly::eraseMarkedAnnos(std::vector<int> const& mark) {
   }
 
   eraseMarkedElements(m_annotations, amark);
+  annoChanged(fileAnno);
 }
 
 void dPoly::erasePolysIntersectingBox(double xll, double yll, double xur, double yur) {
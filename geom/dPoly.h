@@ -24,15 +24,26 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <baseUtils.h>
 #include <geomUtils.h>
 #include "dTree.h"
 #include "kdTree.h"
+#include "pointCloud.h"
+#include "annoTree.h"
 
 namespace utils {
+
+struct polyFileData;
+struct polySnapshot;
+struct snapshotPool;
+class polyIndexFile;
   
+// The annotations kept with the polygons. Those showing the index of
+// each vertex or polygon, or the layers, are made only when drawn, for
+// what is in view. See getVertIndexAnnosInBox() and the like.
 enum AnnoType {
-  fileAnno = 0, vertAnno, polyAnno, layerAnno, angleAnno, lastAnno
+  fileAnno = 0, angleAnno, lastAnno
 };
 
 // A class holding a set of polygons in double precision
@@ -50,11 +61,24 @@ public:
                               std::string type,
                               bool isPointCloud = false);
 
+  // Polygons with no color in the file get the given default color,
+  // or the next one from getCurrentDefaultColor() if none is given.
   bool readPoly(std::string filename,
-                bool isPointCloud = false
+                bool isPointCloud = false,
+                std::string const& defaultColor = ""
                 );
 
-  void writePoly(std::string filename, std::string defaultColor = "yellow");
+  // Write in the binary format if the file extension is .pvb, and in
+  // the .xg format otherwise. Return false if the file could not be written.
+  bool writePoly(std::string filename, std::string defaultColor = "yellow");
+
+  // The binary format holds the same data as the .xg format, laid out
+  // the way it is kept in memory, so it loads without any parsing.
+  // readPoly() recognizes it automatically.
+  static bool isBinPolyFile(std::string const& filename);
+  bool readBinPoly(std::string const& filename, bool isPointCloud = false);
+  bool writeBinPoly(std::string const& filename) const;
+
   void bdBoxCenter(double & mx, double & my) const;
 
   void appendPolygon(int numVerts,
@@ -96,7 +120,13 @@ public:
   );
 
   void clipAnno(const dRect &clip_box,
-                dPoly & clippedPoly);
+                dPoly & clippedPoly) const;
+
+  // The annotations of the given type in the box, in their order, with
+  // the labels pointing into the search tree of those annotations.
+  // These are valid until the annotations change.
+  void getAnnosInBox(AnnoType annoType, const dRect & box,
+                     std::vector<annoView> & annos) const;
 
   void copyAnno(dPoly & clippedPoly);
 
@@ -137,8 +167,21 @@ public:
   int get_numPolys                    () const { return m_numPolys;                }
   int get_totalNumVerts               () const { return m_totalNumVerts;           }
   const std::vector<char>& get_isPolyClosed  () const { return m_isPolyClosed;            }
-  std::vector<std::string> get_colors () const { return m_colors;                  }
-  std::vector<std::string> get_layers () const { return m_layers;                  }
+  std::vector<std::string> get_colors () const;
+  std::vector<std::string> get_layers () const;
+
+  // Each distinct color and layer name is kept once, in a palette, and
+  // a polygon (a point, for a point cloud) has only the ids of its own.
+  const std::string & get_color(int polyIndex) const {
+    return m_colorPalette.name(m_colorIds[polyIndex]);
+  }
+  const std::string & get_layer(int polyIndex) const {
+    return m_layerPalette.name(m_layerIds[polyIndex]);
+  }
+  const std::vector<int> & get_colorIds     () const { return m_colorIds;     }
+  const std::vector<int> & get_layerIds     () const { return m_layerIds;     }
+  const namePalette      & get_colorPalette () const { return m_colorPalette; }
+  const namePalette      & get_layerPalette () const { return m_layerPalette; }
 
   void set_color(std::string color);
 
@@ -153,7 +196,9 @@ public:
                                  std::vector<int> & mark,
                                  double shift_x, double shift_y
                                  );
-  void set_isPointCloud(bool isPointCloud){ m_isPointCloud = isPointCloud; }
+  void set_isPointCloud(bool isPointCloud){
+    m_isPointCloud = isPointCloud; m_indexFile.reset(); stampChange();
+  }
   bool isPointCloud() const { return m_isPointCloud;}
 
   void set_pointCloud(const std::vector<dPoint> & P, std::string color,
@@ -180,27 +225,29 @@ public:
                                 std::vector<int> & mark) const;
   
   //void replaceOnePoly(int polyIndex, int numV, const double* x, const double* y);
-  // Annotations
-  std::vector<anno>&  get_annotations()  { return m_annotations;}
-  std::vector<anno>&  get_vertIndexAnno(){ return m_vertIndexAnno;}
-  std::vector<anno>&  get_polyIndexAnno(){ return m_polyIndexAnno;}
-  std::vector<anno>&  get_layerAnno()    { return m_layerAnno;}
-  std::vector<anno>&  get_angleAnno()    { return m_angleAnno;}
+  // Annotations. Those which can be changed through the returned
+  // reference lose their search tree.
+  std::vector<anno>&  get_annotations()  { annoChanged(fileAnno);  return m_annotations;}
+  std::vector<anno>&  get_angleAnno()    { annoChanged(angleAnno); return m_angleAnno;}
 
   const std::vector<anno>&  get_annotations()  const { return m_annotations;}
-  const std::vector<anno>&  get_vertIndexAnno()const { return m_vertIndexAnno;}
-  const std::vector<anno>&  get_polyIndexAnno()const { return m_polyIndexAnno;}
-  const std::vector<anno>&  get_layerAnno()    const {return m_layerAnno;}
+  const std::vector<anno>&  get_angleAnno()    const {return m_angleAnno;}
 
   void set_annotations(const std::vector<anno> & A);
-  void set_layerAnno(const std::vector<anno> & annotations);
-  void set_vertIndexAnno(const std::vector<anno> & annotations);
-  void set_polyIndexAnno(const std::vector<anno> & annotations);
-
-  void compVertFullIndexAnno();
-  void compVertIndexAnno();
-  void compPolyIndexAnno();
-  void compLayerAnno();
+
+  // Remove all annotations but keep the change id, and with it the
+  // data built for the polygons, such as the grid of getPointCloud().
+  // For copies which are drawn without their annotations.
+  void clearAnnotationsKeepId();
+
+  // Labels with the index of each vertex in its polygon, or among all
+  // vertices if fullIndex is true, with the index of each polygon at
+  // the mean of its vertices, or with the layer of each edge at its
+  // midpoint. Only those in the box are made, in the order of the
+  // vertices or polygons, and added to 'annos'.
+  void getVertIndexAnnosInBox(const dRect & box, bool fullIndex, annoBatch & annos) const;
+  void getPolyIndexAnnosInBox(const dRect & box, annoBatch & annos) const;
+  void getLayerAnnosInBox    (const dRect & box, annoBatch & annos) const;
   void updateBoundingBox() const;
 
   const dRect& bdBox() const;
@@ -296,15 +343,74 @@ public:
   const boxTree< dRectWithId>  * getBoundingBoxTree() const;
   const kdTree * getPointTree() const;
   const edgeTree * getEdgeTree() const;
+
+  // The points of a point cloud, sorted into a grid for fast clipping
+  // and drawing. Formed on first use, and again after any change.
+  const pointCloud & getPointCloud() const;
+
+  // Build the lazily-computed data used by clipAll(), so that after
+  // this call several threads can clip the same polygons at once.
+  void buildClippingData() const;
+
+  // A simplified version of these polygons which looks the same when
+  // one screen pixel is pixelSize wide. It has the same polygons in
+  // the same order, but no annotations. Point clouds lose the points
+  // which fall on an already used pixel, so those must not be used with
+  // a selection. Return this object if simplifying would not help.
+  dPoly & getLodLevel(double pixelSize);
+
+  // A number which changes whenever these polygons change in a way
+  // that affects how they look. Copies share it until one of them is
+  // edited, so it tells if something drawn earlier is still current.
+  unsigned long long get_changeId() const { return m_changeId; }
+
+  // Save this object for undo, sharing the unchanged parts with its
+  // previous snapshot, if not NULL, and with those in 'pool'. See
+  // polySnapshot.h.
+  void saveSnapshot(polySnapshot const* prev, snapshotPool const& pool,
+                    polySnapshot & snap) const;
+  void restoreSnapshot(polySnapshot const& snap);
+
 private:
 
   // Clear pre-computed data if geometry changes
   void clearExtraData();
+  void clearExtraDataButTrees();
+  void stampChange();
+  // Annotations do not affect the trees of the polygons, but they do
+  // change how these look, so the change id moves on too.
+  void annoChanged(AnnoType annoType);
+
+  // The search trees of polygons read from a large file are kept in
+  // an index next to it, see polyIndexFile.h
+  void openIndexFile(std::string const& filename);
+  void saveIndexFile() const;
+
+  // Small edits update the search trees in place, if those are formed
+  // already, rather than clearing them. The trees form themselves
+  // again when needed once they drift too far from balanced.
+  struct syncedTrees{ bool boxes, points, edges; };
+  syncedTrees getSyncedTrees() const;
+  void updateVertsInTrees(syncedTrees const& T, int polyIndex, int vBeg, int vEnd);
+  void remapVertIdsInTrees(syncedTrees const& T, std::vector<int> const& newIds);
+  void dropUnbalancedTrees();
   void vertexIndexToPolyIndex(int vertexId, int &polId, int &pointInPolyId) const;
-  bool getColorInCntFile(const std::string & line, std::string & color);
+  void setFileData(polyFileData & data); // takes the data
+  // Same as appendPolygon(), with the color and layer given as ids in
+  // the palettes of this object
+  void appendPolygonWithIds(int numVerts, const double * xv, const double * yv,
+                            bool isPolyClosed, int colorId, int layerId);
+  void copyPalettes(const dPoly & poly);
   std::vector<anno> &  get_annoByType(AnnoType annoType);
+  const std::vector<anno> & get_annoByType(AnnoType annoType) const;
+  // Formed when first needed, see getAnnosInBox()
+  const annoTree & getAnnoTree(AnnoType annoType) const;
+  void clearAnnoTrees();
   void set_annoByType(const std::vector<anno> & annotations, AnnoType annoType);
   const std::vector<int> & getStartingIndices() const;
+  // The polygons whose bounding boxes meet the box, in order
+  void getPolysNearBox(const dRect & box, std::vector<int> & polyIds) const;
+  void simplifyForLod(double cellSize, dPoly & simplePoly) const;
   // If isPointCloud is true, treat each point as a set of unconnected points
   bool                     m_isPointCloud;
   bool                     m_has_color_in_file;
@@ -314,12 +420,11 @@ private:
   int                      m_numPolys;
   int                      m_totalNumVerts;
   std::vector<char>        m_isPolyClosed;
-  std::vector<std::string> m_colors;
-  std::vector<std::string> m_layers;
+  std::vector<int>         m_colorIds;
+  std::vector<int>         m_layerIds;
+  namePalette              m_colorPalette;
+  namePalette              m_layerPalette;
   std::vector<anno>        m_annotations;
-  std::vector<anno>        m_vertIndexAnno; // Anno showing vertex index
-  std::vector<anno>        m_polyIndexAnno; // Anno showing poly index in a set of polys
-  std::vector<anno>        m_layerAnno;     // Anno showing layer number
   std::vector<anno>        m_angleAnno;
   // The following items are used for performance.
   // They should be cleared if geometry changes by calling clearExtraData()
@@ -328,6 +433,18 @@ private:
   mutable edgeTree m_edgeTree;
   mutable std::vector<int>  m_startingIndices;
   mutable dRect m_BoundingBox;
+  // Level of detail pyramid, see getLodLevel(). The levels do not
+  // change once built, so copies of this polygon can share them.
+  std::vector<std::shared_ptr<dPoly>> m_lodLevels;
+  unsigned long long m_changeId;
+  // See getPointCloud(). Valid while m_changeId is the one saved with it.
+  mutable std::shared_ptr<const pointCloud> m_pointCloud;
+  mutable unsigned long long m_pointCloudChangeId;
+  // One for each AnnoType. Cleared whenever those annotations change.
+  mutable std::shared_ptr<const annoTree> m_annoTrees[lastAnno];
+  // Set while the polygons are as read from a large file, even if it
+  // has no index yet. An open index never changes, so copies share it.
+  mutable std::shared_ptr<const polyIndexFile> m_indexFile;
 };
 
 } // end namespace utils
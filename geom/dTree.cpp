@@ -26,6 +26,7 @@
 #include <vector>
 #include <cassert>
 #include <cstring>
+#include <queue>
 #include <edgeUtils.h>
 #include <dTree.h>
 #include <geomUtils.h>
@@ -45,7 +46,8 @@ void edgeTree::putPolyEdgesInTree(const dPoly & poly){
   const auto  &isclosed   = poly.get_isPolyClosed();
 
   std::vector<utils::dRectWithId>  allBoxes;
-  allBoxes.resize(totalNumVerts);
+  allBoxes.reserve(totalNumVerts);
+  m_allEdges.clear();
   m_allEdges.resize(totalNumVerts);
   //m_polyEdgeIds.resize(totalNumVerts);
   
@@ -68,7 +70,7 @@ void edgeTree::putPolyEdgesInTree(const dPoly & poly){
       dRectWithId R; 
       edgeToBox(bx, by, ex, ey, R );
       R.id = start + vIter;
-      allBoxes[start + vIter] = R;
+      allBoxes.push_back(R);
 
       m_allEdges[start + vIter] = segWidthId(bx, by, ex, ey, start + vIter);
 
@@ -88,37 +90,83 @@ void edgeTree::findPolyEdgesInBox(// inputs
                                   double xh, double yh,
                                   // outputs
                                   std::vector<utils::segWidthId> & edgesInBox
-                                  ){
+                                  ) const{
   
-  // Search the tree
-  m_boxTree.getBoxesInRegion(xl, yl, xh, yh, m_boxesInRegion);
-
-  // Save the edges in the box
+  // Search the tree, and save the edges in the box
   edgesInBox.clear();
-  for (int s = 0; s < (int)m_boxesInRegion.size(); s++){
+  m_boxTree.visitBoxesInRegion(xl, yl, xh, yh, [&](const dRectWithId & R){
 
-    const dRectWithId & R = m_boxesInRegion[s]; // alias
-    auto edge = m_allEdges[R.id];
+      const segWidthId & edge = m_allEdges[R.id];
 
-    bool res = edgeIntersectsBox(edge.begx, edge.begy, edge.endx, edge.endy,  // arbitrary edge (input)
-                                 xl, yl, xh, yh   // box to intersect (input)
-                                 );
-    if (res) edgesInBox.push_back(edge);
-  }
+      bool res = edgeIntersectsBox(edge.begx, edge.begy, edge.endx, edge.endy,  // arbitrary edge (input)
+                                   xl, yl, xh, yh   // box to intersect (input)
+                                   );
+      if (res) edgesInBox.push_back(edge);
+    });
 
   return;
 }
 
+void edgeTree::setEdge(int id, bool exists, utils::seg const& edge){
+
+  assert(0 <= id && id < (int)m_allEdges.size());
+
+  m_boxTree.removeBox(id);
+  m_allEdges[id] = segWidthId();
+  if (!exists) return;
+
+  dRectWithId R;
+  edgeToBox(edge.begx, edge.begy, edge.endx, edge.endy, R);
+  R.id = id;
+  m_boxTree.insertBox(R);
+  m_allEdges[id] = segWidthId(edge.begx, edge.begy, edge.endx, edge.endy, id);
+}
+
+void edgeTree::remapIds(std::vector<int> const& newIds, int newSize){
+
+  std::vector<segWidthId> allEdges(newSize);
+  for (int i = 0; i < (int)m_allEdges.size() && i < (int)newIds.size(); i++) {
+    int j = newIds[i];
+    if (j < 0) continue;
+    assert(j < newSize);
+    allEdges[j] = m_allEdges[i];
+    if (allEdges[j].id >= 0) allEdges[j].id = j;
+  }
+  m_allEdges.swap(allEdges);
+
+  m_boxTree.remapIds(newIds);
+}
+
+void edgeTree::checkEdge(double x0, double y0, int id,
+                         int &edge_id, utils::seg & closestEdge,
+                         double & closestDistSq) const{
+
+  double dist = DBL_MAX, xval, yval;
+  auto edge = m_allEdges[id];
+  utils::minDistSqFromPtToSeg(x0, y0, edge, xval, yval, dist);
+
+  if (dist < closestDistSq){
+    closestEdge   = edge;
+    closestDistSq = dist;
+    edge_id       = id;
+  }
+}
+
 int edgeTree::findClosestEdge( double x0, double y0, utils::seg &closestEdge, double &closestDist) const{
 
   closestDist = DBL_MAX;
 
-  int root = m_boxTree.getTreeRoot();
-  if (root == -1) return -1;
-  int edge_id;
-  findClosestEdgeToPointInternal(x0, y0, root,            // inputs
-                                 edge_id, closestEdge, closestDist);
+  int edge_id = -1;
+  findClosestEdgeToPointInternal(x0, y0,                            // inputs
+                                 edge_id, closestEdge, closestDist  // outputs
+                                 );
 
+  // The edges which changed since the tree was formed
+  const std::vector<dRectWithId> & extra = m_boxTree.getExtraBoxes();
+  for (size_t s = 0; s < extra.size(); s++)
+    checkEdge(x0, y0, extra[s].id, edge_id, closestEdge, closestDist);
+
+  if (edge_id == -1) return -1;
   closestDist = sqrt(closestDist);
   return edge_id;
 
@@ -161,72 +209,317 @@ void edgeTree::findClosestEdgeToPoint(// inputs
   return;
 }
 
+namespace{
+  // The square of the distance from a point to a box, 0 if inside
+  inline double distSqToBox(double x0, double y0, utils::dRect const& B){
+    double dx = std::max(std::max(B.xl - x0, x0 - B.xh), 0.0);
+    double dy = std::max(std::max(B.yl - y0, y0 - B.yh), 0.0);
+    return dx*dx + dy*dy;
+  }
+}
+
 void edgeTree::findClosestEdgeToPointInternal(// inputs
                                               double x0, double y0,
-                                              int root,
                                               // outputs
                                               int &edge_id,
                                               utils::seg & closestEdge,
                                               double     & closestDistSq
                                               ) const{
 
-  // Find the distance from the input point to the edge at the root
-  // node. Decide if first to visit the left or right subtree from the
-  // root depending on which looks more promising.
+  // Visit the children of each node closest to the point first, and
+  // skip those which are no closer than the closest edge found so
+  // far. At the level of the edges, the boxes are those of the edges.
+  // The nodes still to visit are kept in a stack, nearest on top. It
+  // holds at most boxTreeFanout nodes per level.
 
-  assert (root != -1);
-  const auto &bnode = m_boxTree.getBoxNode(root);
-  
-  const dRectWithId &R = bnode.Rect;
+  int numLevels = m_boxTree.getNumLevels();
+  if (numLevels == 0) return;
 
-  double dist = DBL_MAX, xval, yval;
-  auto edge = m_allEdges[R.id];
-  utils::minDistSqFromPtToSeg(x0, y0, edge, xval, yval, dist);
-  
-  if (dist < closestDistSq){
-    closestEdge =  edge;
-    closestDistSq = dist;
-    edge_id = R.id;
+  const int maxStack = 32*boxTreeFanout;
+  double stackDist [maxStack];
+  int    stackLevel[maxStack];
+  int    stackNode [maxStack];
+  int    numInStack = 0;
+
+  stackDist[0] = 0.0; stackLevel[0] = numLevels - 1; stackNode[0] = 0;
+  numInStack = 1;
+
+  std::pair<double, int> children[boxTreeFanout];
+  while (numInStack > 0){
+
+    numInStack--;
+    if (stackDist[numInStack] >= closestDistSq) continue; // no closer
+    int level = stackLevel[numInStack], node = stackNode[numInStack];
+
+    if (level == 0){
+      if (!m_boxTree.isBoxRemoved(node))
+        checkEdge(x0, y0, m_boxTree.getBox(node).id, edge_id, closestEdge, closestDistSq);
+      continue;
+    }
+
+    int childLevel = level - 1;
+    int beg = boxTreeFanout*node;
+    int num = std::min(boxTreeFanout, m_boxTree.getNumNodes(childLevel) - beg);
+    for (int c = 0; c < num; c++)
+      children[c] = std::make_pair(distSqToBox(x0, y0, m_boxTree.getNodeBox(childLevel, beg + c)),
+                                   beg + c);
+    std::sort(children, children + num);
+
+    assert(numInStack + num <= maxStack);
+    for (int c = num - 1; c >= 0; c--){
+      if (children[c].first >= closestDistSq) continue;
+      stackDist [numInStack] = children[c].first;
+      stackLevel[numInStack] = childLevel;
+      stackNode [numInStack] = children[c].second;
+      numInStack++;
+    }
   }
 
-  // Midpoint of the root edge 
-  double midx = (edge.begx + edge.endx)/2.0, midy = (edge.begy + edge.endy)/2.0;
+  return;
+}
+
+void edgeTree::findKNearestEdges(// inputs
+                                 double x0, double y0, int k,
+                                 // outputs
+                                 std::vector<utils::segWidthId> & edges,
+                                 std::vector<double> & dists
+                                 ) const{
+
+  // Best-first search. Nodes and edges wait in one queue ordered by
+  // their distance to the point, that of a node being a lower bound
+  // for the edges under it. An edge is among the nearest ones when it
+  // comes out of the queue before k others.
+
+  edges.clear();
+  dists.clear();
+  if (k <= 0) return;
+
+  struct Item{
+    double distSq;
+    int    level; // -1 for an edge, then 'index' is its id
+    int    index;
+    bool operator<(Item const& other) const { return distSq > other.distSq; }
+  };
+  std::priority_queue<Item> queue;
+
+  auto pushEdge = [&](int id){
+    double xval, yval, distSq = DBL_MAX;
+    minDistSqFromPtToSeg(x0, y0, m_allEdges[id], xval, yval, distSq);
+    queue.push(Item{distSq, -1, id});
+  };
+
+  int numLevels = m_boxTree.getNumLevels();
+  if (numLevels > 0) queue.push(Item{0.0, numLevels - 1, 0});
+
+  // The edges which changed since the tree was formed
+  const std::vector<dRectWithId> & extra = m_boxTree.getExtraBoxes();
+  for (size_t s = 0; s < extra.size(); s++) pushEdge(extra[s].id);
+
+  while (!queue.empty() && (int)edges.size() < k){
+
+    Item item = queue.top();
+    queue.pop();
+
+    if (item.level < 0){
+      edges.push_back(m_allEdges[item.index]);
+      dists.push_back(sqrt(item.distSq));
+      continue;
+    }
 
-  // Unify the left-right and down-up cases to avoid duplicating code.
-  double lx0 = x0, ly0 = y0, lmidx = midx, lmidy = midy;
-  if (!bnode.isLeftRightSplit){ // down-up split
-    swap(lx0,   ly0);
-    swap(lmidx, lmidy);
+    int childLevel = item.level - 1;
+    int beg = boxTreeFanout*item.index;
+    int num = std::min(boxTreeFanout, m_boxTree.getNumNodes(childLevel) - beg);
+    for (int c = beg; c < beg + num; c++){
+      if (childLevel > 0)
+        queue.push(Item{distSqToBox(x0, y0, m_boxTree.getNodeBox(childLevel, c)), childLevel, c});
+      else if (!m_boxTree.isBoxRemoved(c))
+        pushEdge(m_boxTree.getBox(c).id);
+    }
   }
-  
-  if (lx0 <= lmidx){
-    // Search the entire left subtree first
-    if (bnode.left != -1)
-      findClosestEdgeToPointInternal(x0, y0, bnode.left,      // inputs
-                                     edge_id, closestEdge, closestDistSq // outputs
-                                     );
-    // Don't go right unless there's any chance on improving what we already found
-    double dd = bnode.minInRightChild - lx0;
-    double dd2 = dd*dd;
-    bool bad = (bnode.right == -1 || (dd >= 0 && closestDistSq <= dd2));
-    if (!bad) findClosestEdgeToPointInternal(x0, y0, bnode.right,     // inputs
-                                             edge_id, closestEdge, closestDistSq // outputs
-                                             );
-  }else{
-    // Search the entire right subtree first
-    if (bnode.right != -1)
-      findClosestEdgeToPointInternal(x0, y0, bnode.right,     // inputs
-                                     edge_id, closestEdge, closestDistSq // outputs
-                                     );
-    // Don't go left unless there's any chance on improving what we already found
-    double dd = lx0 - bnode.maxInLeftChild;
-    double dd2 = dd*dd;
-    bool bad = (bnode.left == -1 || (dd >= 0 && closestDistSq <= dd2));
-    if (!bad) findClosestEdgeToPointInternal(x0, y0, bnode.left,      // inputs
-                                             edge_id, closestEdge, closestDistSq // outputs
-                                             );
-    
+
+  return;
+}
+
+void edgeTree::findEdgesWithinRadius(// inputs
+                                     double x0, double y0, double r,
+                                     // outputs
+                                     std::vector<utils::segWidthId> & edges
+                                     ) const{
+
+  // The edges whose boxes meet the square around the circle, then
+  // those of them close enough
+  edges.clear();
+  if (!(r >= 0)) return;
+
+  double r2 = r*r;
+  m_boxTree.visitBoxesInRegion(x0 - r, y0 - r, x0 + r, y0 + r, [&](const dRectWithId & R){
+      if (distSqToBox(x0, y0, R) > r2) return;
+      const segWidthId & edge = m_allEdges[R.id];
+      double xval, yval, distSq = DBL_MAX;
+      minDistSqFromPtToSeg(x0, y0, edge, xval, yval, distSq);
+      if (distSq <= r2) edges.push_back(edge);
+    });
+
+  return;
+}
+
+void edgeTree::findKNearestEdges(// inputs
+                                 int numPts, const double * xv, const double * yv, int k,
+                                 // outputs
+                                 std::vector<utils::segWidthId> & edges,
+                                 std::vector<double> & dists
+                                 ) const{
+
+  edges.clear();
+  dists.clear();
+  if (numPts <= 0 || k <= 0) return;
+  edges.resize((size_t)numPts*k);  // the id of a missing edge is -1
+  dists.resize((size_t)numPts*k, DBL_MAX);
+
+  std::vector<int> order;
+  hilbertOrder(numPts, xv, yv, order);
+
+  if (k == 1){
+    findClosestEdgesToPoints(numPts, xv, yv, order, // inputs
+                             edges, dists           // outputs
+                             );
+    return;
   }
-  
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel
+#endif
+  {
+    std::vector<segWidthId> nearest;
+    std::vector<double>     nearestDists;
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp for schedule(dynamic, 256)
+#endif
+    for (int s = 0; s < numPts; s++){
+
+      int i = order[s];
+      size_t start = (size_t)k*i;
+      findKNearestEdges(xv[i], yv[i], k, nearest, nearestDists);
+      for (size_t t = 0; t < nearest.size(); t++){
+        edges[start + t] = nearest[t];
+        dists[start + t] = nearestDists[t];
+      }
+    }
+  }
+
+  return;
+}
+
+void edgeTree::findClosestEdgesToPoints(// inputs
+                                        int numPts, const double * xv, const double * yv,
+                                        std::vector<int> const& order,
+                                        // outputs
+                                        std::vector<utils::segWidthId> & edges,
+                                        std::vector<double> & dists
+                                        ) const{
+
+  // A dual-tree search. The points, in Hilbert order, are taken
+  // numPtsInBlock at a time, and each block is searched for in the
+  // tree as a whole. A node is skipped when the box of the block is
+  // no closer to it than the farthest a point in the block is from
+  // its closest edge so far. Points of the two sets which coincide, as
+  // when comparing two versions of one layout, get to distance 0 at
+  // the first edge they are on, so the search of a block whose points
+  // all do so stops right there.
+
+  const int numPtsInBlock = 16;
+  int numBlocks = (numPts + numPtsInBlock - 1)/numPtsInBlock;
+  int numLevels = m_boxTree.getNumLevels();
+  const std::vector<dRectWithId> & extra = m_boxTree.getExtraBoxes();
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic, 16)
+#endif
+  for (int b = 0; b < numBlocks; b++){
+
+    int beg = b*numPtsInBlock;
+    int num = std::min(numPtsInBlock, numPts - beg);
+    double px[numPtsInBlock], py[numPtsInBlock], best[numPtsInBlock];
+    int bestId[numPtsInBlock];
+    dRect block(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
+    for (int p = 0; p < num; p++){
+      px[p] = xv[order[beg + p]]; py[p] = yv[order[beg + p]];
+      best[p] = DBL_MAX; bestId[p] = -1;
+      block.xl = std::min(block.xl, px[p]); block.xh = std::max(block.xh, px[p]);
+      block.yl = std::min(block.yl, py[p]); block.yh = std::max(block.yh, py[p]);
+    }
+    double bound = DBL_MAX; // the largest of best[]
+
+    auto checkEdgeBox = [&](dRectWithId const& R){
+      const segWidthId & edge = m_allEdges[R.id];
+      bool improved = false;
+      for (int p = 0; p < num; p++){
+        if (distSqToBox(px[p], py[p], R) >= best[p]) continue;
+        double xval, yval, distSq = DBL_MAX;
+        minDistSqFromPtToSeg(px[p], py[p], edge, xval, yval, distSq);
+        if (distSq < best[p]){
+          best[p]   = distSq;
+          bestId[p] = R.id;
+          improved  = true;
+        }
+      }
+      if (improved) bound = *std::max_element(best, best + num);
+    };
+
+    // The nodes still to visit, nearest to the block on top
+    const int maxStack = 32*boxTreeFanout;
+    double stackDist [maxStack];
+    int    stackLevel[maxStack];
+    int    stackNode [maxStack];
+    int    numInStack = 0;
+    if (numLevels > 0){
+      stackDist[0] = 0.0; stackLevel[0] = numLevels - 1; stackNode[0] = 0;
+      numInStack = 1;
+    }
+
+    std::pair<double, int> children[boxTreeFanout];
+    while (numInStack > 0){
+
+      numInStack--;
+      if (stackDist[numInStack] >= bound) continue; // no closer for any point
+      int level = stackLevel[numInStack], node = stackNode[numInStack];
+
+      if (level == 0){
+        if (!m_boxTree.isBoxRemoved(node)) checkEdgeBox(m_boxTree.getBox(node));
+        continue;
+      }
+
+      int childLevel = level - 1;
+      int first = boxTreeFanout*node;
+      int numChildren = std::min(boxTreeFanout, m_boxTree.getNumNodes(childLevel) - first);
+      for (int c = 0; c < numChildren; c++){
+        dRect B = m_boxTree.getNodeBox(childLevel, first + c);
+        double dx = std::max(std::max(B.xl - block.xh, block.xl - B.xh), 0.0);
+        double dy = std::max(std::max(B.yl - block.yh, block.yl - B.yh), 0.0);
+        children[c] = std::make_pair(dx*dx + dy*dy, first + c);
+      }
+      std::sort(children, children + numChildren);
+
+      assert(numInStack + numChildren <= maxStack);
+      for (int c = numChildren - 1; c >= 0; c--){
+        if (children[c].first >= bound) continue;
+        stackDist [numInStack] = children[c].first;
+        stackLevel[numInStack] = childLevel;
+        stackNode [numInStack] = children[c].second;
+        numInStack++;
+      }
+    }
+
+    // The edges which changed since the tree was formed
+    for (size_t s = 0; s < extra.size(); s++) checkEdgeBox(extra[s]);
+
+    for (int p = 0; p < num; p++){
+      if (bestId[p] < 0) continue;
+      int i = order[beg + p];
+      edges[i] = m_allEdges[bestId[p]];
+      dists[i] = sqrt(best[p]);
+    }
+  }
+
   return;
 }
@@ -25,6 +25,7 @@
 #include <vector>
 #include <algorithm>
 #include <cfloat> // defines DBL_MAX
+#include <baseUtils.h>
 #include <geomUtils.h>
 
 // Trees for storing double precision (as opposed to integer) geometry.
@@ -35,22 +36,48 @@
 // * Implemented as a template. The user defines the box class. Can be
 //   for example a plain box, or a box with id meant to store an
 //   edge (as in edgeTree below).
+// * The tree is a packed R-tree. The boxes are sorted along a Hilbert
+//   curve through their centers, so that boxes close in the sorted
+//   list are close in the plane. They are then grouped boxTreeFanout
+//   at a time into nodes, these nodes grouped the same way into the
+//   nodes above them, and so on up to a single root. The bounds of all
+//   boxes and nodes are stored coordinate by coordinate, so the
+//   children of a node are tested against a region in one loop which
+//   the compiler can vectorize.
+// * With OpenMP, a large tree is formed on all threads. The tree is the
+//   same whatever the number of threads.
 //
 // Usage:
 // -----
-//   void formTreeOfBoxes(std::vector<Box> & Boxes // This vector is reordered inside
+//   void formTreeOfBoxes(std::vector<Box> & Boxes // Copied, not changed
 //                        );
 //
 //   void getBoxesInRegion(double xl, double yl, double xh, double yh, // Inputs
 //                         vector<Box> & outBoxes                      // Outputs
 //                         );
 //
+//   // Call visit(Box const&) for each box in the region, without copying it
+//   void visitBoxesInRegion(double xl, double yl, double xh, double yh,
+//                           Visitor visit);
+//
+// * Boxes can be removed and inserted after the tree is formed, if
+//   Box has an 'id' field. A removed box stays in the tree, flagged,
+//   so the tree remains valid. Inserted boxes are kept in a list
+//   which is searched in full. Once this list gets long or many
+//   boxes are removed, needsRebuild() returns true and the tree
+//   should be formed again.
+//
+//   void removeBox(int id);
+//   void insertBox(Box const& B);
+//   void remapIds(std::vector<int> const& newIds); // -1 removes a box
+//
 
 // edgeTree
 // * Uses boxTree.
 // * Put the edges of a given set of polygons in a tree.
 // * Fast access to all edges intersecting a given rectangular region.
-// * Fast access to the closest edge to a given point.
+// * Fast access to the closest edge to a given point, the k closest
+//   ones, or those within a given distance.
 //
 // Usage:
 // -----
@@ -70,21 +97,20 @@
 //                             // edge where closestDist is achieved
 //                             double & closestX, double & closestY
 //                             );
+// void findKNearestEdges(double x0, double y0, int k,        // inputs
+//                        vector<segWidthId> & edges,         // outputs
+//                        vector<double> & dists);
+// void findEdgesWithinRadius(double x0, double y0, double r, // inputs
+//                            vector<segWidthId> & edges);    // outputs
+//
+// The k nearest edges to many points at once, on all threads:
+// void findKNearestEdges(int numPts, const double * xv, const double * yv, int k,
+//                        vector<segWidthId> & edges, vector<double> & dists);
 
 namespace utils {
   class dPoly;
 }
 
-template <typename Box>
-inline bool leftLessThan (Box P, Box Q){
-  return (P.xl + P.xh) < (Q.xl + Q.xh); // x midpoint comparison
-}
-
-template <typename Box>
-inline bool botLessThan (Box P, Box Q){
-  return (P.yl + P.yh) < (Q.yl + Q.yh); // y midpoint comparison
-}
-
 template <typename Box>
 inline bool lexLessThan(Box P, Box Q){
   if (P.xl < Q.xl) return true;
@@ -108,16 +134,9 @@ inline bool lexLessThan(Box P, Box Q){
 //   return (!(P == Q));
 // }
 
-template <typename Box>
-struct boxNode{
-  int left; // implement pointer as index into node pool vector, this makes copy of the tree trivial
-  int right;
-  Box       Rect;
-  bool      isLeftRightSplit;
-  double    maxInLeftChild, minInRightChild;
-  boxNode<Box>(): left(-1), right(-1), isLeftRightSplit(false),
-                  maxInLeftChild(-DBL_MAX), minInRightChild(DBL_MAX){}
-};
+// The number of children of a node of boxTree
+const int boxTreeFanout = 16;
+
 
 template <typename Box>
 class boxTree{
@@ -125,46 +144,85 @@ class boxTree{
 public:
   boxTree();
 
-  void formTreeOfBoxes(// Boxes will be reordered but otherwise
-                       // unchanged inside this function
+  void formTreeOfBoxes(// Boxes are copied into the tree and
+                       // left unchanged
                        std::vector<Box> & Boxes);
 
   void getBoxesInRegion(double xl, double yl, double xh, double yh, // Inputs
                           std::vector<Box> & outBoxes                 // Outputs
                           ) const;
 
+  // Call visit(Box const&) for each box intersecting the region
+  template <typename Visitor>
+  void visitBoxesInRegion(double xl, double yl, double xh, double yh,
+                          Visitor && visit) const;
+
+  // The ids of the boxes intersecting the region
+  void getIdsInRegion(double xl, double yl, double xh, double yh, // Inputs
+                      std::vector<int> & ids                      // Outputs
+                      ) const;
+
   std::vector<int> getIndicesInRegion(const utils::dRect &box) const;
 
+  void clear();
 
-  int getTreeRoot() const{
-    return m_root;
+  // The number of boxes in the tree, not counting the removed ones
+  size_t size() const { return m_boxes.size() - m_numRemoved + m_extraBoxes.size();}
+
+  // Local updates, see the notes at the top of this file
+  void removeBox(int id);
+  void insertBox(Box const& B);
+  void remapIds(std::vector<int> const& newIds);
+  bool needsRebuild() const;
+
+  // The boxes inserted after the tree was formed
+  const std::vector<Box> & getExtraBoxes() const { return m_extraBoxes; }
+
+  // The boxes of a formed tree, in the order they are kept. A tree is
+  // formed from these by setFormedTree() without sorting them again,
+  // so it can be saved and taken back later. See polyIndexFile.h.
+  bool hasLocalUpdates() const { return !m_extraBoxes.empty() || m_numRemoved > 0; }
+  const std::vector<Box> & getPackedBoxes() const { return m_boxes; }
+  void setFormedTree(const Box * boxes, int numBoxes);
+
+  // For searches other than by region, such as in edgeTree. Level 0
+  // holds the boxes. Node k of a level above has as children the
+  // nodes boxTreeFanout*k up to boxTreeFanout*(k + 1), not included,
+  // of the level below it. The top level has a single node, unless
+  // the tree is empty and has no levels at all.
+  int getNumLevels() const {
+    return m_levelStart.empty() ? 0 : (int)m_levelStart.size() - 1;
   }
-  void clear();
-  size_t size() const { return m_nodePool.size();}
+  int getNumNodes(int level) const {
+    return (int)(m_levelStart[level + 1] - m_levelStart[level]);
+  }
+  utils::dRect getNodeBox(int level, int node) const {
+    size_t n = m_levelStart[level] + node;
+    return utils::dRect(m_xl[n], m_yl[n], m_xh[n], m_yh[n]);
+  }
+  const Box & getBox(int index) const { return m_boxes[index]; }
+  bool isBoxRemoved(int index) const { return m_isRemoved[index] != 0; }
 
-  const boxNode<Box> & getBoxNode(int ind) const {return m_nodePool[ind];}
 private:
 
-  void formTreeOfBoxesInternal(Box * Boxes, int numBoxes,
-                               bool isLeftRightSplit,
-                               int&  root
-                               );
-
-
-  void getBoxesInRegionInternal(//Inputs
-                                double xl, double yl, double xh, double yh,
-                                int root,
-                                // Outputs
-                                std::vector<Box> & outBoxes) const;
-
   void reset();
-  int getNewboxNode();
+  void formLevels();
+  void indexBoxesById();
+
+  // The boxes, in the order of the tree leaves
+  std::vector<Box>  m_boxes;
+  std::vector<char> m_isRemoved;
 
-  // Will get nodes from this pool (for performance reasons)
-  std::vector< boxNode<Box> > m_nodePool;
+  // The bounds of the boxes, and then of the nodes one level up at a
+  // time. Level l starts at m_levelStart[l].
+  std::vector<double> m_xl, m_yl, m_xh, m_yh;
+  std::vector<size_t> m_levelStart;
 
-  int m_freeNodeIndex;
-  int m_root;
+  // For local updates. The map from ids to boxes is made on the
+  // first update, so a tree which is never changed does not pay for it.
+  std::vector<int> m_idToBox;
+  std::vector<Box> m_extraBoxes;
+  size_t           m_numRemoved;
 
 };
 
@@ -180,120 +238,252 @@ void boxTree<Box>::clear(){
 }
 template <typename Box>
 void boxTree<Box>::reset(){
-  m_freeNodeIndex = 0;
-  m_root          = -1;
-  m_nodePool.clear();
+  m_boxes.clear();
+  m_isRemoved.clear();
+  m_xl.clear(); m_yl.clear(); m_xh.clear(); m_yh.clear();
+  m_levelStart.clear();
+  m_idToBox.clear();
+  m_extraBoxes.clear();
+  m_numRemoved    = 0;
   return;
 }
 
 template <typename Box>
-int boxTree<Box>::getNewboxNode(){
-  // Get a node from the pool
-  assert( m_freeNodeIndex < (int)m_nodePool.size() );
-  int node_id = m_freeNodeIndex;
-  m_freeNodeIndex++;
-  return node_id;
+void boxTree<Box>::indexBoxesById(){
+
+  m_idToBox.clear();
+  for (int n = 0; n < (int)m_boxes.size(); n++) {
+    if (m_isRemoved[n]) continue;
+    int id = m_boxes[n].id;
+    if (id >= (int)m_idToBox.size()) m_idToBox.resize(id + 1, -1);
+    m_idToBox[id] = n;
+  }
 }
 
 template <typename Box>
-void boxTree<Box>::formTreeOfBoxes(// Boxes will be reordered but otherwise
-                                   // unchanged inside this function
-                                   std::vector<Box> & Boxes){
+void boxTree<Box>::removeBox(int id){
 
-  reset();
-  int numBoxes = Boxes.size();
-  m_nodePool.resize(numBoxes);
+  if (m_idToBox.empty()) indexBoxesById();
 
-  bool isLeftRightSplit = true;
-  formTreeOfBoxesInternal(vecPtr(Boxes), numBoxes, isLeftRightSplit, m_root);
-  return;
+  if (id >= 0 && id < (int)m_idToBox.size() && m_idToBox[id] >= 0) {
+    m_isRemoved[m_idToBox[id]] = 1;
+    m_idToBox[id] = -1;
+    m_numRemoved++;
+    return;
+  }
+
+  for (size_t s = 0; s < m_extraBoxes.size(); s++) {
+    if (m_extraBoxes[s].id != id) continue;
+    m_extraBoxes[s] = m_extraBoxes.back();
+    m_extraBoxes.pop_back();
+    return;
+  }
 }
 
 template <typename Box>
-void boxTree<Box>::formTreeOfBoxesInternal(Box * Boxes, int numBoxes,
-                                           bool isLeftRightSplit,
-                                           int &root
-                                           ){
+void boxTree<Box>::insertBox(Box const& B){
+  m_extraBoxes.push_back(B);
+}
 
+template <typename Box>
+void boxTree<Box>::setFormedTree(const Box * boxes, int numBoxes){
+  reset();
+  m_boxes.assign(boxes, boxes + numBoxes);
+  formLevels();
+}
 
-  // To do: Implement this without recursion.
+template <typename Box>
+void boxTree<Box>::remapIds(std::vector<int> const& newIds){
+
+  // Box with id i gets the id newIds[i], or is removed if that is -1
+  for (size_t n = 0; n < m_boxes.size(); n++) {
+    if (m_isRemoved[n]) continue;
+    int id = m_boxes[n].id;
+    if (id < 0 || id >= (int)newIds.size()) continue;
+    m_boxes[n].id = newIds[id];
+    if (m_boxes[n].id < 0) {
+      m_isRemoved[n] = 1;
+      m_numRemoved++;
+    }
+  }
 
-  // To do: No need to store the box B in the tree. Store just a
-  // pointer to B as sorting the left and right halves does not change
-  // the midpoint box B.
+  size_t numKept = 0;
+  for (size_t s = 0; s < m_extraBoxes.size(); s++) {
+    Box B = m_extraBoxes[s];
+    if (B.id >= 0 && B.id < (int)newIds.size()) B.id = newIds[B.id];
+    if (B.id >= 0) m_extraBoxes[numKept++] = B;
+  }
+  m_extraBoxes.resize(numKept);
 
-  // To do: No need even for the tree, it can be stored in-place in
-  // Boxes, in the same way as an in-place heap is stored.
+  indexBoxesById();
+}
 
-  assert(numBoxes >= 0);
+template <typename Box>
+bool boxTree<Box>::needsRebuild() const{
+  // Searching the extra boxes one by one must stay cheap compared to
+  // searching the tree.
+  return m_extraBoxes.size() > 256 + m_boxes.size()/64 ||
+    m_numRemoved > m_boxes.size()/4 + 256;
+}
 
-  if (numBoxes == 0){
-    root = -1;
-    return;
-  }
+template <typename Box>
+void boxTree<Box>::formTreeOfBoxes(// Boxes are copied into the tree and
+                                   // left unchanged
+                                   std::vector<Box> & Boxes){
 
-  root = getNewboxNode();
-  m_nodePool[root].isLeftRightSplit = isLeftRightSplit;
-  int mid = numBoxes/2;
+  reset();
+  int numBoxes = Boxes.size();
+  if (numBoxes == 0) return;
+
+  // Sort the boxes along the Hilbert curve through the grid which
+  // spans the box centers. Twice the centers will do. For many boxes
+  // this is done on all threads if built with OpenMP. The order does
+  // not depend on the number of threads.
+  double cxl = DBL_MAX, cyl = DBL_MAX, cxh = -DBL_MAX, cyh = -DBL_MAX;
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for if (numBoxes >= utils::minSizeForTask) \
+    reduction(min: cxl, cyl) reduction(max: cxh, cyh)
+#endif
+  for (int s = 0; s < numBoxes; s++){
+    double cx = Boxes[s].xl + Boxes[s].xh, cy = Boxes[s].yl + Boxes[s].yh;
+    cxl = std::min(cxl, cx); cxh = std::max(cxh, cx);
+    cyl = std::min(cyl, cy); cyh = std::max(cyh, cy);
+  }
+  double sx = (cxh > cxl) ? 65535.0/(cxh - cxl) : 0.0;
+  double sy = (cyh > cyl) ? 65535.0/(cyh - cyl) : 0.0;
 
-  if (isLeftRightSplit){ // Left-most boxes go in the left child
-    std::nth_element(Boxes, Boxes+mid, Boxes + numBoxes, leftLessThan<Box>);
-  }else{               // Bottom-most boxes go in the left child
-    std::nth_element(Boxes, Boxes+mid, Boxes + numBoxes, botLessThan<Box>);
+  std::vector< std::pair<unsigned, int> > order(numBoxes);
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for if (numBoxes >= utils::minSizeForTask)
+#endif
+  for (int s = 0; s < numBoxes; s++){
+    double gx = sx*(Boxes[s].xl + Boxes[s].xh - cxl);
+    double gy = sy*(Boxes[s].yl + Boxes[s].yh - cyl);
+    if (!(gx >= 0.0)) gx = 0.0; // also if not a number
+    if (!(gy >= 0.0)) gy = 0.0;
+    order[s] = std::make_pair(utils::hilbertIndex((unsigned)std::min(gx, 65535.0),
+                                                  (unsigned)std::min(gy, 65535.0)), s);
   }
+  utils::parallelSort(order); // the pairs are distinct, so the order is unique
 
+  m_boxes.resize(numBoxes);
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for if (numBoxes >= utils::minSizeForTask)
+#endif
+  for (int s = 0; s < numBoxes; s++) m_boxes[s] = Boxes[order[s].second];
 
-  assert( 0 <= mid && mid < numBoxes);
+  formLevels();
+  return;
+}
 
-  m_nodePool[root].Rect = Boxes[mid]; // Must happen after sorting
+template <typename Box>
+void boxTree<Box>::formLevels(){
 
-  // A box is not a point, it has non-zero width. A box whose midpoint
-  // is to the left of the root box midpoint, may still overlap with
-  // the region to the right of the root box midpoint. As such, when
-  // searching for boxes in the tree, we will need to consider how far
-  // to the right the left subtree goes, and how far to the left the
-  // right subtree goes.
+  // The bounds of the boxes, then of each level of nodes on top
 
-  double maxInLeftChild = -DBL_MAX, minInRightChild = DBL_MAX;
-  if (isLeftRightSplit){
+  size_t numBoxes = m_boxes.size();
+  m_isRemoved.assign(numBoxes, 0);
+  m_levelStart.clear();
+  if (numBoxes == 0) return;
 
-    for (int s = 0; s < mid; s++)
-      if (Boxes[s].xh >= maxInLeftChild) maxInLeftChild = Boxes[s].xh;
+  m_levelStart.push_back(0);
+  m_levelStart.push_back(numBoxes);
+  size_t num = numBoxes;
+  do{
+    num = (num + boxTreeFanout - 1)/boxTreeFanout;
+    m_levelStart.push_back(m_levelStart.back() + num);
+  }while (num > 1);
 
-    for (int s = mid + 1; s < numBoxes; s++)
-      if (Boxes[s].xl <= minInRightChild) minInRightChild = Boxes[s].xl;
+  size_t total = m_levelStart.back();
+  m_xl.resize(total); m_yl.resize(total); m_xh.resize(total); m_yh.resize(total);
 
-  }else{
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for if (numBoxes >= (size_t)utils::minSizeForTask)
+#endif
+  for (size_t s = 0; s < numBoxes; s++){
+    m_xl[s] = m_boxes[s].xl; m_yl[s] = m_boxes[s].yl;
+    m_xh[s] = m_boxes[s].xh; m_yh[s] = m_boxes[s].yh;
+  }
 
-    for (int s = 0; s < mid; s++)
-      if (Boxes[s].yh >= maxInLeftChild) maxInLeftChild = Boxes[s].yh;
+  for (int level = 1; level < getNumLevels(); level++){
+    size_t below = m_levelStart[level - 1], numBelow = m_levelStart[level] - below;
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp parallel for if (numBelow >= (size_t)utils::minSizeForTask)
+#endif
+    for (size_t k = m_levelStart[level]; k < m_levelStart[level + 1]; k++){
+      size_t beg = below + boxTreeFanout*(k - m_levelStart[level]);
+      size_t end = std::min(beg + boxTreeFanout, below + numBelow);
+      double xl = DBL_MAX, yl = DBL_MAX, xh = -DBL_MAX, yh = -DBL_MAX;
+      for (size_t c = beg; c < end; c++){
+        xl = std::min(xl, m_xl[c]); yl = std::min(yl, m_yl[c]);
+        xh = std::max(xh, m_xh[c]); yh = std::max(yh, m_yh[c]);
+      }
+      m_xl[k] = xl; m_yl[k] = yl; m_xh[k] = xh; m_yh[k] = yh;
+    }
+  }
 
-    for (int s = mid + 1; s < numBoxes; s++)
-      if (Boxes[s].yl <= minInRightChild) minInRightChild = Boxes[s].yl;
+  return;
+}
 
+template <typename Box>
+template <typename Visitor>
+void boxTree<Box>::visitBoxesInRegion(double xl, double yl, double xh, double yh,
+                                      Visitor && visit) const{
+
+  if (xl > xh || yl > yh) return;
+
+  // Depth first, without recursion. A node puts at most boxTreeFanout
+  // children on the stack, and there are far fewer than 32 levels.
+  const int maxStack = 32*boxTreeFanout;
+  int stackLevel[maxStack], stackNode[maxStack];
+  int numInStack = 0;
+
+  int numLevels = getNumLevels();
+  if (numLevels > 1){
+    stackLevel[numInStack] = numLevels - 1;
+    stackNode [numInStack] = 0;
+    numInStack++;
   }
 
-  m_nodePool[root].maxInLeftChild  = maxInLeftChild;
-  m_nodePool[root].minInRightChild = minInRightChild;
+  while (numInStack > 0){
+
+    numInStack--;
+    int level = stackLevel[numInStack] - 1; // the level of the children
+    int node  = stackNode [numInStack];
+
+    size_t first = m_levelStart[level];
+    int beg = boxTreeFanout*node;
+    int num = std::min(boxTreeFanout, getNumNodes(level) - beg);
+
+    // Test all children at once
+    const double * cxl = &m_xl[first + beg], * cyl = &m_yl[first + beg];
+    const double * cxh = &m_xh[first + beg], * cyh = &m_yh[first + beg];
+    char hit[boxTreeFanout];
+    for (int c = 0; c < num; c++)
+      hit[c] = (cxl[c] <= xh) & (cxh[c] >= xl) & (cyl[c] <= yh) & (cyh[c] >= yl);
+
+    if (level == 0){
+      for (int c = 0; c < num; c++)
+        if (hit[c] && !m_isRemoved[beg + c]) visit(m_boxes[beg + c]);
+    }else{
+      // In reverse, so that the children are visited in order
+      for (int c = num - 1; c >= 0; c--){
+        if (!hit[c]) continue;
+        stackLevel[numInStack] = level;
+        stackNode [numInStack] = beg + c;
+        numInStack++;
+      }
+    }
+  }
 
-  // At the next split we will split perpendicularly to the direction
-  // of the current split
-  formTreeOfBoxesInternal( Boxes,            mid,
-                           !isLeftRightSplit, m_nodePool[root].left  );
-  formTreeOfBoxesInternal( Boxes + mid + 1,  numBoxes - mid - 1,
-                           !isLeftRightSplit, m_nodePool[root].right );
+  for (size_t s = 0; s < m_extraBoxes.size(); s++) {
+    const Box & B = m_extraBoxes[s]; // alias
+    if (utils::boxesIntersect(B.xl, B.yl, B.xh, B.yh, xl, yl, xh, yh))
+      visit(B);
+  }
 
   return;
 }
-template <typename Box>
-std::vector<int> boxTree<Box>::getIndicesInRegion(const utils::dRect &box) const{
-  std::vector<Box>  outBoxes;
-  getBoxesInRegion(box.xl, box.yl, box.xh, box.yh, outBoxes);
-
-  std::vector<int>  indices; indices.reserve(outBoxes.size());
-  for (auto &bb : outBoxes) indices.push_back(bb.id);
-  return indices;
-}
 
 template <typename Box>
 void boxTree<Box>::getBoxesInRegion(// Inputs
@@ -303,48 +493,31 @@ void boxTree<Box>::getBoxesInRegion(// Inputs
                                     ) const{
 
   outBoxes.clear();
-  if (xl > xh || yl > yh || m_root == -1) return;
-  getBoxesInRegionInternal(xl, yl, xh, yh, m_root, // Inputs
-                           outBoxes                // Outputs
-                           );
+  visitBoxesInRegion(xl, yl, xh, yh,
+                     [&outBoxes](Box const& B){ outBoxes.push_back(B); });
   return;
 }
 
 template <typename Box>
-void boxTree<Box>::getBoxesInRegionInternal(// Inputs
-                                            double xl, double yl,
-                                            double xh, double yh,
-                                            int root,
-                                            // Outputs
-                                            std::vector<Box> & outBoxes
-                                            ) const{
-
-  assert (root != -1);
-
-  const Box & B = m_nodePool[root].Rect; // alias
-
-  if (utils::boxesIntersect(B.xl, B.yl, B.xh, B.yh, xl, yl, xh, yh))
-    outBoxes.push_back(B);
-
-  if (m_nodePool[root].isLeftRightSplit){
-
-    if (m_nodePool[root].left != -1  && xl <= m_nodePool[root].maxInLeftChild)
-      getBoxesInRegionInternal(xl, yl, xh, yh, m_nodePool[root].left,  outBoxes);
-    if (m_nodePool[root].right != -1 && xh >= m_nodePool[root].minInRightChild)
-      getBoxesInRegionInternal(xl, yl, xh, yh, m_nodePool[root].right, outBoxes);
-
-  }else{
-
-    if (m_nodePool[root].left != -1  && yl <= m_nodePool[root].maxInLeftChild)
-      getBoxesInRegionInternal(xl, yl, xh, yh, m_nodePool[root].left,  outBoxes);
-    if (m_nodePool[root].right != -1 && yh >= m_nodePool[root].minInRightChild)
-      getBoxesInRegionInternal(xl, yl, xh, yh, m_nodePool[root].right, outBoxes);
-
-  }
-
+void boxTree<Box>::getIdsInRegion(// Inputs
+                                  double xl, double yl, double xh, double yh,
+                                  // Output
+                                  std::vector<int> & ids
+                                  ) const{
+
+  ids.clear();
+  visitBoxesInRegion(xl, yl, xh, yh,
+                     [&ids](Box const& B){ ids.push_back(B.id); });
   return;
 }
 
+template <typename Box>
+std::vector<int> boxTree<Box>::getIndicesInRegion(const utils::dRect &box) const{
+  std::vector<int> indices;
+  getIdsInRegion(box.xl, box.yl, box.xh, box.yh, indices);
+  return indices;
+}
+
 class edgeTree{
 
 public:
@@ -355,7 +528,7 @@ public:
                           double xl, double yl,
                           double xh, double yh,
                           // outputs
-                          std::vector<utils::segWidthId> & edgesInBox);
+                          std::vector<utils::segWidthId> & edgesInBox) const;
 
   int findClosestEdge( double x0, double y0, utils::seg &closestEdge, double &closestDist) const;
 
@@ -369,12 +542,62 @@ public:
                               double & closestX, double & closestY
                               ) const;
 
+  // The k edges closest to the point, closest first. Fewer if there
+  // are fewer than k edges.
+  void findKNearestEdges(// inputs
+                         double x0, double y0, int k,
+                         // outputs
+                         std::vector<utils::segWidthId> & edges,
+                         std::vector<double> & dists
+                         ) const;
+
+  // The edges at distance at most r from the point, in no particular order
+  void findEdgesWithinRadius(// inputs
+                             double x0, double y0, double r,
+                             // outputs
+                             std::vector<utils::segWidthId> & edges
+                             ) const;
+
+  // The k nearest edges to each of the given points. Those of point i
+  // are edges[k*i] to edges[k*i + k - 1], closest first. Missing ones
+  // have id -1 and distance DBL_MAX. The points are searched in the
+  // order of the Hilbert curve through them, and on all threads if
+  // built with OpenMP. For k = 1, blocks of nearby points are searched
+  // for together, which is much faster when many of the points are on
+  // the edges, as for two versions of one layout.
+  void findKNearestEdges(// inputs
+                         int numPts, const double * xv, const double * yv, int k,
+                         // outputs
+                         std::vector<utils::segWidthId> & edges,
+                         std::vector<double> & dists
+                         ) const;
+
   size_t size() const {return m_allEdges.size();}
 
+  // Local updates. The edge with given id starts at the vertex with
+  // that index. If 'exists' is false there is no such edge, as for
+  // the last vertex of a polygonal line.
+  void setEdge(int id, bool exists, utils::seg const& edge);
+
+  // Edge with id i gets the id newIds[i], or is removed if that is
+  // -1. There are newSize ids afterward, the new ones with no edge.
+  void remapIds(std::vector<int> const& newIds, int newSize);
+
+  bool needsRebuild() const { return m_boxTree.needsRebuild(); }
+
+  // To save a formed tree and take it back later, see polyIndexFile.h
+  bool hasLocalUpdates() const { return m_boxTree.hasLocalUpdates(); }
+  const boxTree<utils::dRectWithId>    & getBoxTree () const { return m_boxTree;  }
+  const std::vector<utils::segWidthId> & getAllEdges() const { return m_allEdges; }
+  void setFormedTree(const utils::dRectWithId * boxes, int numBoxes,
+                     const utils::segWidthId * edges, int numEdges){
+    m_boxTree.setFormedTree(boxes, numBoxes);
+    m_allEdges.assign(edges, edges + numEdges);
+  }
+
   void clear(){
     m_boxTree.clear();
     m_allEdges.clear();
-    m_boxesInRegion.clear();
   }
 
 private:
@@ -392,16 +615,25 @@ private:
 
   void findClosestEdgeToPointInternal(// inputs
                                       double x0, double y0,
-                                      int root,
                                       // outputs
                                       int &edge_id,
                                       utils::seg & closestEdge,
                                       double     & closestDistSq) const;
+
+  void findClosestEdgesToPoints(// inputs
+                                int numPts, const double * xv, const double * yv,
+                                std::vector<int> const& order,
+                                // outputs
+                                std::vector<utils::segWidthId> & edges,
+                                std::vector<double> & dists) const;
+
+  void checkEdge(double x0, double y0, int id,
+                 int &edge_id, utils::seg & closestEdge, double & closestDistSq) const;
+
   // Internal data structures
   boxTree<utils::dRectWithId>      m_boxTree;
   std::vector<utils::segWidthId>  m_allEdges;
   //std::vector<std::pair<int,int>>  m_polyEdgeIds;
-  std::vector<utils::dRectWithId>  m_boxesInRegion;
 
 };
 
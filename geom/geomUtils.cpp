@@ -31,6 +31,7 @@
 #include <cstring>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
 #include <baseUtils.h>
 #include <geomUtils.h>
 #include <edgeUtils.h>
@@ -43,7 +44,9 @@
 using namespace std;
 using namespace utils;
 
-static int ss_default_color_ind = 0;
+// Files may be read on several threads at once, each taking the next
+// default color.
+static std::atomic<unsigned> ss_default_color_ind(0);
 static const char * ss_xgraph_colors[] =
 {   "black", "white", "red",  "green", "cyan", "magenta",
     "yellow", "pink", "teal", "aquamarine", "gold",
@@ -55,11 +58,10 @@ void setCurrentDefaultColor(int color){
 }
 
 std::string getCurrentDefaultColor() {
-  ss_default_color_ind++;
-  int numColors = sizeof(ss_xgraph_colors)/sizeof(char*);
-  ss_default_color_ind = ss_default_color_ind % numColors;
+  unsigned numColors = sizeof(ss_xgraph_colors)/sizeof(char*);
+  unsigned ind = ss_default_color_ind.fetch_add(1) + 1;
 
-  return ss_xgraph_colors[ss_default_color_ind];
+  return ss_xgraph_colors[ind % numColors];
 }
 
 utils::Timer::Timer(const std::string &prefix){
@@ -740,3 +742,63 @@ bool utils::isPointInPolyOrOnEdges(double x, double y,
 
   return isInsideOrOnEdges;
 }
+
+bool utils::polyIntersectsBox(int n, const double* xv, const double* yv, bool isClosed,
+                              double xl, double yl, double xh, double yh){
+
+  if (n <= 0) return false;
+
+  // A vertex in the box, the cheapest test
+  for (int i = 0; i < n; i++){
+    if (xl <= xv[i] && xv[i] <= xh && yl <= yv[i] && yv[i] <= yh) return true;
+  }
+
+  // An edge crossing the box
+  int numEdges = (isClosed && n > 1) ? n : (n - 1);
+  for (int i = 0; i < numEdges; i++){
+    int j = (i + 1)%n;
+    if (edgeIntersectsBox(xv[i], yv[i], xv[j], yv[j], xl, yl, xh, yh)) return true;
+  }
+
+  // Otherwise a polygon can meet the box only if it contains all of
+  // it, and then it contains any of its corners.
+  return isClosed && isPointInPolyOrOnEdges(xl, yl, n, xv, yv);
+}
+
+void utils::hilbertOrder(int numPts, const double * xv, const double * yv,
+                         std::vector<int> & order){
+
+  double xl = DBL_MAX, yl = DBL_MAX, xh = -DBL_MAX, yh = -DBL_MAX;
+  for (int s = 0; s < numPts; s++){
+    xl = min(xl, xv[s]); xh = max(xh, xv[s]);
+    yl = min(yl, yv[s]); yh = max(yh, yv[s]);
+  }
+  double sx = (xh > xl) ? 65535.0/(xh - xl) : 0.0;
+  double sy = (yh > yl) ? 65535.0/(yh - yl) : 0.0;
+
+  vector< pair<unsigned, int> > keys(numPts);
+  for (int s = 0; s < numPts; s++){
+    double gx = sx*(xv[s] - xl), gy = sy*(yv[s] - yl);
+    if (!(gx >= 0.0)) gx = 0.0; // also if not a number
+    if (!(gy >= 0.0)) gy = 0.0;
+    keys[s] = make_pair(hilbertIndex((unsigned)min(gx, 65535.0),
+                                     (unsigned)min(gy, 65535.0)), s);
+  }
+  parallelSort(keys);
+
+  order.resize(numPts);
+  for (int s = 0; s < numPts; s++) order[s] = keys[s].second;
+}
+
+int utils::namePalette::intern(const std::string & name){
+
+  if (m_lastId >= 0 && m_names[m_lastId] == name) return m_lastId;
+
+  auto it = m_ids.find(name);
+  if (it == m_ids.end()) {
+    it = m_ids.insert(std::make_pair(name, (int)m_names.size())).first;
+    m_names.push_back(name);
+  }
+  m_lastId = it->second;
+  return m_lastId;
+}
@@ -30,6 +30,8 @@
 #include <cfloat>
 #include <chrono>
 #include <complex>
+#include <string>
+#include <unordered_map>
 
 std::string getCurrentDefaultColor();
 void setCurrentDefaultColor(int color);
@@ -60,6 +62,10 @@ struct anno {
   }
   anno(double xi, double yi, const std::string &labeli): x(xi), y(yi), label(labeli){;}
 
+  bool operator==(const anno & A) const{
+    return x == A.x && y == A.y && label == A.label;
+  }
+
   void appendTo(std::ofstream & outfile) const{
     outfile << "anno " << x << ' ' << y << ' ' << label << std::endl;
   }
@@ -218,6 +224,11 @@ private:
   bool isPointInPolyOrOnEdges(double x, double y,
                               int n, const double* xv, const double*  yv);
 
+  // Does the given polygon, or polygonal line if isClosed is false,
+  // have any point in the box, boundary included. Allocates no memory.
+  bool polyIntersectsBox(int n, const double* xv, const double* yv, bool isClosed,
+                         double xl, double yl, double xh, double yh);
+
   struct linTrans{
     // Linear transform
     double a11, a12, a21, a22, sx, sy;
@@ -290,6 +301,54 @@ private:
     minDistFromSeg2Seg(const utils::seg &seg1,
                        const utils::seg &seg2);
 
+  // The position of the point (x, y), with 0 <= x, y < 2^16, along the
+  // Hilbert curve through the 2^16 x 2^16 grid
+  inline unsigned hilbertIndex(unsigned x, unsigned y){
+    const unsigned n = 1u << 16;
+    unsigned d = 0;
+    for (unsigned s = n/2; s > 0; s /= 2){
+      unsigned rx = (x & s) > 0;
+      unsigned ry = (y & s) > 0;
+      d += s * s * ((3 * rx) ^ ry);
+      if (ry == 0){ // rotate the quadrant
+        if (rx == 1){
+          x = n - 1 - x;
+          y = n - 1 - y;
+        }
+        std::swap(x, y);
+      }
+    }
+    return d;
+  }
+
+  // The order of the points along the Hilbert curve through the grid
+  // spanning them. Points close in this order are close in the plane,
+  // so queries done in it touch the same parts of a tree one after
+  // another.
+  void hilbertOrder(int numPts, const double * xv, const double * yv,
+                    std::vector<int> & order);
+
+  // The distinct names, such as colors or layers, used by a set of
+  // polygons. Each polygon keeps only the small id of its name here.
+  // Ids never change once given out.
+  class namePalette{
+  public:
+    namePalette(): m_lastId(-1){}
+
+    // The id of this name, adding it if new
+    int intern(const std::string & name);
+
+    const std::string & name(int id) const { return m_names[id]; }
+    const std::vector<std::string> & names() const { return m_names; }
+    int size() const { return (int)m_names.size(); }
+    void clear(){ m_names.clear(); m_ids.clear(); m_lastId = -1; }
+
+  private:
+    std::vector<std::string>             m_names;
+    std::unordered_map<std::string, int> m_ids;
+    int                                  m_lastId; // names come in runs, check it first
+  };
+
 }
 
 
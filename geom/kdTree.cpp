@@ -42,16 +42,85 @@ void kdTree::reset(){
   m_freeNodeIndex = 0;
   m_root          = -1;
   m_nodePool.clear();
+  m_idToNode.clear();
+  m_extraPts.clear();
+  m_numRemoved    = 0;
   return;
 }
 
+void kdTree::indexNodesById(){
 
-int kdTree::getNewNode(){
-  // Get a node from the pool
-  assert( m_freeNodeIndex < (int)m_nodePool.size() );
-  int new_ind = m_freeNodeIndex;
-  m_freeNodeIndex++;
-  return new_ind;
+  m_idToNode.clear();
+  for (int n = 0; n < (int)m_nodePool.size(); n++) {
+    if (m_nodePool[n].isRemoved) continue;
+    int id = m_nodePool[n].P.id;
+    if (id >= (int)m_idToNode.size()) m_idToNode.resize(id + 1, -1);
+    m_idToNode[id] = n;
+  }
+}
+
+void kdTree::removePoint(int id){
+
+  if (m_idToNode.empty()) indexNodesById();
+
+  if (id >= 0 && id < (int)m_idToNode.size() && m_idToNode[id] >= 0) {
+    m_nodePool[m_idToNode[id]].isRemoved = true;
+    m_idToNode[id] = -1;
+    m_numRemoved++;
+    return;
+  }
+
+  for (size_t s = 0; s < m_extraPts.size(); s++) {
+    if (m_extraPts[s].id != id) continue;
+    m_extraPts[s] = m_extraPts.back();
+    m_extraPts.pop_back();
+    return;
+  }
+}
+
+void kdTree::insertPoint(utils::PointWithId const& P){
+  m_extraPts.push_back(P);
+}
+
+void kdTree::remapIds(std::vector<int> const& newIds){
+
+  // Point with id i gets the id newIds[i], or is removed if that is -1
+  for (size_t n = 0; n < m_nodePool.size(); n++) {
+    Node & node = m_nodePool[n];
+    if (node.isRemoved) continue;
+    int id = node.P.id;
+    if (id < 0 || id >= (int)newIds.size()) continue;
+    node.P.id = newIds[id];
+    if (node.P.id < 0) {
+      node.isRemoved = true;
+      m_numRemoved++;
+    }
+  }
+
+  size_t numKept = 0;
+  for (size_t s = 0; s < m_extraPts.size(); s++) {
+    PointWithId P = m_extraPts[s];
+    if (P.id >= 0 && P.id < (int)newIds.size()) P.id = newIds[P.id];
+    if (P.id >= 0) m_extraPts[numKept++] = P;
+  }
+  m_extraPts.resize(numKept);
+
+  indexNodesById();
+}
+
+bool kdTree::needsRebuild() const{
+  // Searching the extra points one by one must stay cheap compared to
+  // searching the tree.
+  return m_extraPts.size() > 256 + m_nodePool.size()/64 ||
+    m_numRemoved > m_nodePool.size()/4 + 256;
+}
+
+
+void kdTree::setFormedTree(const utils::Node * nodes, int numNodes, int root){
+  reset();
+  m_nodePool.assign(nodes, nodes + numNodes);
+  m_freeNodeIndex = numNodes;
+  m_root          = root;
 }
 
 void kdTree::formTreeOfPoints(int numPts, const double * xv, const double * yv){
@@ -77,17 +146,31 @@ void kdTree::formTreeOfPoints(// Pts will be reordered but otherwise
   reset();
   int numPts = Pts.size();
   m_nodePool.resize(numPts);
+  m_freeNodeIndex = numPts;
+  m_root          = (numPts > 0) ? 0 : -1;
 
+  // With OpenMP the subtrees of large enough nodes are formed as
+  // separate tasks, which idle threads pick up.
   bool isLeftRightSplit = true;
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel if (numPts >= 2*minSizeForTask)
+  #pragma omp single
+#endif
   formTreeOfPointsInternal(vecPtr(Pts), numPts, isLeftRightSplit, m_root);
   return;
 }
 
 
 void kdTree::formTreeOfPointsInternal(utils::PointWithId * Pts, int numPts, bool isLeftRightSplit,
-                                      int &root){
+                                      int root){
 
-  // To do: Implement this without recursion.
+  // The nodes are laid out in the pool in pre-order. A subtree of n
+  // points takes n nodes, so the subtree of Pts goes into the nodes
+  // starting at 'root', its left subtree right after, and its right
+  // subtree after that. The two subtrees can then be formed
+  // independently, and the tree does not depend on which thread
+  // formed which part of it.
+  
   // To do: No need to store the point P in the tree. Store just a pointer to P
   // as sorting the left and right halves does not change the midpoint P.
   // To do: No need even for the tree, it can be stored in-place in Pts,
@@ -95,12 +178,8 @@ void kdTree::formTreeOfPointsInternal(utils::PointWithId * Pts, int numPts, bool
   
   assert(numPts >= 0);
   
-  if (numPts == 0){
-    root = -1;
-    return; 
-  }
+  if (numPts == 0) return;
   
-  root = getNewNode();
   utils::Node &node = getNode(root);
   node.isLeftRightSplit = isLeftRightSplit;
   int mid = numPts/2;
@@ -113,15 +192,20 @@ void kdTree::formTreeOfPointsInternal(utils::PointWithId * Pts, int numPts, bool
 
   assert( 0 <= mid && mid < numPts);
   
-  node.P = Pts[mid]; // Must happen after sorting
+  node.P     = Pts[mid]; // Must happen after sorting
+  node.left  = (mid > 0)              ? root + 1       : -1;
+  node.right = (numPts - mid - 1 > 0) ? root + 1 + mid : -1;
 
   // At the next split we will split perpendicularly to the direction
   // of the current split.
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp task if (mid >= minSizeForTask)
+#endif
   formTreeOfPointsInternal( Pts,            mid,
-                            !isLeftRightSplit, node.left
+                            !isLeftRightSplit, root + 1
                             );
   formTreeOfPointsInternal( Pts + mid + 1,  numPts - mid - 1,
-                            !isLeftRightSplit, node.right
+                            !isLeftRightSplit, root + 1 + mid
                             );
 
 }
@@ -134,6 +218,12 @@ void kdTree::getPointsInBox(double xl, double yl, double xh, double yh, // input
   getPointsInBoxInternal(xl, yl, xh, yh, m_root, // inputs
                          outPts                  // outputs
                          );
+
+  for (size_t s = 0; s < m_extraPts.size(); s++) {
+    const PointWithId & P = m_extraPts[s]; // alias
+    if (xl <= P.x && P.x <= xh && yl <= P.y && P.y <= yh) outPts.push_back(P);
+  }
+
   return;
 }
 
@@ -151,7 +241,8 @@ void kdTree::getPointsInBoxInternal(//Inputs
 
   const PointWithId & P = node.P; // alias
   
-  if (xl <= P.x && P.x <= xh && yl <= P.y && P.y <= yh) outPts.push_back(P);
+  if (!node.isRemoved && xl <= P.x && P.x <= xh && yl <= P.y && P.y <= yh)
+    outPts.push_back(P);
   
   if (node.isLeftRightSplit){
     if (xl <= P.x) getPointsInBoxInternal(xl, yl, xh, yh, node.left,  outPts);
@@ -164,6 +255,61 @@ void kdTree::getPointsInBoxInternal(//Inputs
   return;
 }
 
+namespace kdTree_local_functions{
+
+  // Visit the nodes of the tree the way the closest vertex is searched
+  // for: first the side of each split the point (x0, y0) is on, then
+  // the other side, unless the square of the distance to the split is
+  // at least limit(). This is done with a stack rather than recursion.
+  // visit(P, distSq) is called for each point not removed.
+  template<class Visit, class Limit>
+  void searchTree(const utils::Node * nodes, int root, double x0, double y0,
+                  Visit visit, Limit limit){
+
+    if (root == -1) return;
+
+    // The far sides still to visit, with their distance to the split.
+    // A side in the stack is at most as deep as the tree.
+    const int maxDepth = 128;
+    int    stackNode[maxDepth];
+    double stackDist[maxDepth];
+    int    numInStack = 0;
+
+    stackNode[numInStack] = root; stackDist[numInStack] = -1.0; numInStack++;
+    while (numInStack > 0){
+
+      numInStack--;
+      int    curr  = stackNode[numInStack];
+      double bound = stackDist[numInStack];
+      if (bound >= limit()) continue; // no chance of improving
+
+      const utils::Node & node = nodes[curr];
+      const PointWithId & P    = node.P; // alias
+
+      // A removed point still splits the plane
+      if (!node.isRemoved) visit(P, norm(x0, y0, P.x, P.y));
+
+      double dd = node.isLeftRightSplit ? (x0 - P.x) : (y0 - P.y);
+      int near = (dd <= 0) ? node.left  : node.right;
+      int far  = (dd <= 0) ? node.right : node.left;
+
+      assert(numInStack + 2 <= maxDepth);
+      if (far != -1){
+        stackNode[numInStack] = far; stackDist[numInStack] = dd*dd; numInStack++;
+      }
+      if (near != -1){
+        stackNode[numInStack] = near; stackDist[numInStack] = -1.0; numInStack++;
+      }
+    }
+  }
+
+  inline bool closerThan(std::pair<double, PointWithId> const& a,
+                         std::pair<double, PointWithId> const& b){
+    return a.first < b.first;
+  }
+}
+using namespace kdTree_local_functions;
+
 void kdTree::findClosestVertexToPoint(// inputs
                                       double x0, double y0,
                                       // outputs
@@ -184,75 +330,140 @@ void kdTree::findClosestVertexToPoint(// inputs
   
   closestDist = DBL_MAX;
 
-  if (m_root == -1) return;
-    
-  findClosestVertexToPointInternal(x0, y0, m_root,            // inputs 
-                                   closestVertex, closestDist // outputs
-                                   );
+  searchTree(vecPtr(m_nodePool), m_root, x0, y0,
+             [&](PointWithId const& P, double dist){
+               if (dist < closestDist){
+                 closestVertex = P;
+                 closestDist   = dist;
+               }
+             },
+             [&](){ return closestDist; });
 
+  // The points inserted since the tree was formed
+  for (size_t s = 0; s < m_extraPts.size(); s++) {
+    const PointWithId & P = m_extraPts[s]; // alias
+    double dist = norm(x0, y0, P.x, P.y);
+    if (dist < closestDist){
+      closestVertex = P;
+      closestDist   = dist;
+    }
+  }
+
+  if (closestDist == DBL_MAX) return;
   closestDist = sqrt(closestDist);
   return;
 }
 
-void kdTree::findClosestVertexToPointInternal(// inputs
-                                              double x0, double y0,
-                                              int root,
-                                              // outputs
-                                              utils::PointWithId & closestVertex,
-                                              double & closestDist
-                                              ) const{
-
-  // Find the distance from the input point to the vertex at the root
-  // node. Decide if first to visit the left or right subtree from the
-  // root depending on which looks more promising.
-  
-  assert (root != -1);
-  
-  const utils::Node &node = getNode(root);
-  const PointWithId & P = node.P; // alias
+void kdTree::findKNearestVertices(// inputs
+                                  double x0, double y0, int k,
+                                  // outputs
+                                  std::vector<utils::PointWithId> & vertices,
+                                  std::vector<double> & dists
+                                  ) const{
 
-  double dist = norm(x0, y0, P.x, P.y);
-  
-  if (dist < closestDist){
-    closestVertex = P;
-    closestDist   = dist;
+  // The k closest so far are kept in a heap with the farthest of
+  // them on top. Once there are k of them, it bounds the search.
+  vertices.clear();
+  dists.clear();
+  if (k <= 0) return;
+
+  std::vector< std::pair<double, PointWithId> > heap;
+  heap.reserve(k + 1);
+  auto keep = [&](PointWithId const& P, double dist){
+    if ((int)heap.size() == k && dist >= heap.front().first) return;
+    heap.push_back(std::make_pair(dist, P));
+    std::push_heap(heap.begin(), heap.end(), closerThan);
+    if ((int)heap.size() > k){
+      std::pop_heap(heap.begin(), heap.end(), closerThan);
+      heap.pop_back();
+    }
+  };
+
+  searchTree(vecPtr(m_nodePool), m_root, x0, y0, keep,
+             [&](){ return ((int)heap.size() < k) ? DBL_MAX : heap.front().first; });
+
+  for (size_t s = 0; s < m_extraPts.size(); s++) {
+    const PointWithId & P = m_extraPts[s]; // alias
+    keep(P, norm(x0, y0, P.x, P.y));
   }
 
-  // Unify the left-right and down-up cases to avoid duplicating code.
-  double lx0 = x0, ly0 = y0, rootX = P.x, rootY = P.y;
-  if (!node.isLeftRightSplit){ // down-up split
-    swap(lx0,   ly0);
-    swap(rootX, rootY);
+  std::sort_heap(heap.begin(), heap.end(), closerThan);
+  vertices.resize(heap.size());
+  dists.resize(heap.size());
+  for (size_t s = 0; s < heap.size(); s++){
+    vertices[s] = heap[s].second;
+    dists[s]    = sqrt(heap[s].first);
   }
-  
-  if (lx0 <= rootX){
-    // Search the entire left subtree first
-    if (node.left != -1)
-      findClosestVertexToPointInternal(x0, y0, node.left,        // inputs
-                                       closestVertex, closestDist // outputs
-                                       );
-    // Don't go right unless there's any chance on improving what we already found
-    double dd  = rootX - lx0;
-    double dd2 = dd*dd;
-    bool bad = (node.right == -1 || (dd >= 0 && closestDist <= dd2));
-    if (!bad) findClosestVertexToPointInternal(x0, y0, node.right,       // inputs
-                                               closestVertex, closestDist // outputs
-                                               );
-  }else{
-    // Search the entire right subtree first
-    if (node.right != -1)
-      findClosestVertexToPointInternal(x0, y0, node.right,       // inputs
-                                       closestVertex, closestDist // outputs
-                                       );
-    // Don't go left unless there's any chance on improving what we already found
-    double dd  = lx0 - rootX;
-    double dd2 = dd*dd;
-    bool bad = (node.left == -1 || (dd >= 0 && closestDist <= dd2));
-    if (!bad) findClosestVertexToPointInternal(x0, y0, node.left,        // inputs
-                                               closestVertex, closestDist // outputs
-                                               );
-    
+  return;
+}
+
+void kdTree::findVerticesWithinRadius(// inputs
+                                      double x0, double y0, double r,
+                                      // outputs
+                                      std::vector<utils::PointWithId> & vertices
+                                      ) const{
+
+  vertices.clear();
+  if (!(r >= 0)) return;
+
+  // Skip the sides of splits farther than r, keep those at r exactly
+  double r2    = r*r;
+  double limit = nextafter(r2, DBL_MAX);
+  auto keep = [&](PointWithId const& P, double dist){
+    if (dist <= r2) vertices.push_back(P);
+  };
+
+  searchTree(vecPtr(m_nodePool), m_root, x0, y0, keep,
+             [limit](){ return limit; });
+
+  for (size_t s = 0; s < m_extraPts.size(); s++) {
+    const PointWithId & P = m_extraPts[s]; // alias
+    keep(P, norm(x0, y0, P.x, P.y));
   }
-  
+  return;
+}
+
+void kdTree::findKNearestVertices(// inputs
+                                  int numPts, const double * xv, const double * yv, int k,
+                                  // outputs
+                                  std::vector<utils::PointWithId> & vertices,
+                                  std::vector<double> & dists
+                                  ) const{
+
+  vertices.clear();
+  dists.clear();
+  if (numPts <= 0 || k <= 0) return;
+  vertices.resize((size_t)numPts*k, PointWithId(0, 0, -1));
+  dists.resize((size_t)numPts*k, DBL_MAX);
+
+  std::vector<int> order;
+  hilbertOrder(numPts, xv, yv, order);
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel
+#endif
+  {
+    std::vector<PointWithId> nearest;
+    std::vector<double>      nearestDists;
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp for schedule(dynamic, 256)
+#endif
+    for (int s = 0; s < numPts; s++){
+
+      int i = order[s];
+      size_t start = (size_t)k*i;
+      if (k == 1){
+        findClosestVertexToPoint(xv[i], yv[i], vertices[start], dists[start]);
+        continue;
+      }
+
+      findKNearestVertices(xv[i], yv[i], k, nearest, nearestDists);
+      for (size_t t = 0; t < nearest.size(); t++){
+        vertices[start + t] = nearest[t];
+        dists   [start + t] = nearestDists[t];
+      }
+    }
+  }
+
   return;
 }
@@ -46,7 +46,8 @@ namespace utils{
     int right = -1; // This makes tree copying trivial
     utils::PointWithId  P;
     bool   isLeftRightSplit;
-    Node(): left(-1), right(-1), isLeftRightSplit(false){}
+    bool   isRemoved; // the point was removed, the node is kept for the search
+    Node(): left(-1), right(-1), isLeftRightSplit(false), isRemoved(false){}
   };
   
 }
@@ -71,20 +72,61 @@ public:
                                 utils::PointWithId & closestVertex,
                                 double & closestDist
                                 ) const;
+
+  // The k vertices closest to the point, closest first. Fewer if the
+  // tree has fewer than k points.
+  void findKNearestVertices(// inputs
+                            double x0, double y0, int k,
+                            // outputs
+                            std::vector<utils::PointWithId> & vertices,
+                            std::vector<double> & dists
+                            ) const;
+
+  // The vertices at distance at most r from the point, in no
+  // particular order
+  void findVerticesWithinRadius(// inputs
+                                double x0, double y0, double r,
+                                // outputs
+                                std::vector<utils::PointWithId> & vertices
+                                ) const;
+
+  // The k nearest vertices to each of the given points. Those of
+  // point i are vertices[k*i] to vertices[k*i + k - 1], closest first.
+  // Missing ones have id -1 and distance DBL_MAX. The points are
+  // searched in the order of the Hilbert curve through them, and on
+  // all threads if built with OpenMP.
+  void findKNearestVertices(// inputs
+                            int numPts, const double * xv, const double * yv, int k,
+                            // outputs
+                            std::vector<utils::PointWithId> & vertices,
+                            std::vector<double> & dists
+                            ) const;
+
 void clear() {reset();}
-size_t size() const { return m_nodePool.size();}
 
-private:
-  void findClosestVertexToPointInternal(// inputs
-                                        double x0, double y0,
-                                        int root,
-                                        // outputs
-                                        utils::PointWithId & closestVertex,
-                                        double & closestDist
-                                        ) const;
+// The number of points in the tree, not counting the removed ones
+size_t size() const { return m_nodePool.size() - m_numRemoved + m_extraPts.size();}
+
+  // Local updates. A removed point stays in its node, flagged, so the
+  // tree remains valid. Inserted points are kept in a list which is
+  // searched in full. Once that list gets long or many points are
+  // removed, needsRebuild() returns true and the tree should be formed
+  // again.
+  void removePoint(int id);
+  void insertPoint(utils::PointWithId const& P);
+  void remapIds(std::vector<int> const& newIds); // -1 removes a point
+  bool needsRebuild() const;
+
+  // The nodes of a formed tree, so that it can be saved and taken back
+  // later without forming it again. See polyIndexFile.h.
+  bool hasLocalUpdates() const { return !m_extraPts.empty() || m_numRemoved > 0; }
+  int  getTreeRoot() const { return m_root; }
+  const std::vector<utils::Node> & getNodePool() const { return m_nodePool; }
+  void setFormedTree(const utils::Node * nodes, int numNodes, int root);
 
+private:
   void formTreeOfPointsInternal(utils::PointWithId * Pts, int numPts, bool isLeftRightSplit,
-                                int  &root);
+                                int root);
 
   void getPointsInBoxInternal(//Inputs
                               double xl, double yl, double xh, double yh,
@@ -92,7 +134,7 @@ private:
                               // Outputs
                               std::vector<utils::PointWithId> & outPts) const;
   void reset();
-  int getNewNode();
+  void indexNodesById();
   
   utils::Node & getNode(int ind) {return m_nodePool[ind];}
   const utils::Node & getNode(int ind) const {return m_nodePool[ind];}
@@ -102,6 +144,12 @@ private:
 
   int m_freeNodeIndex;
   int m_root;
+
+  // For local updates. The map from ids to nodes is made on the
+  // first update.
+  std::vector<int>                m_idToNode;
+  std::vector<utils::PointWithId> m_extraPts;
+  size_t                          m_numRemoved;
     
 };
   
@@ -0,0 +1,136 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <mappedFile.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace utils;
+
+mappedFile::mappedFile(): m_isOpen(false), m_data(NULL), m_size(0){
+#ifdef _WIN32
+  m_file    = NULL;
+  m_mapping = NULL;
+#endif
+}
+
+mappedFile::~mappedFile(){
+  close();
+}
+
+#ifdef _WIN32
+
+bool mappedFile::open(std::string const& filename){
+
+  close();
+
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file   = file;
+  m_size   = (size_t)size.QuadPart;
+  m_isOpen = true;
+  if (m_size == 0) return true; // An empty file cannot be mapped
+
+  m_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (m_mapping != NULL)
+    m_data = (char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+
+  if (m_data == NULL) {
+    cerr << "Error: Could not map " << filename << " into memory." << endl;
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void mappedFile::close(){
+  if (m_data    != NULL) UnmapViewOfFile(m_data);
+  if (m_mapping != NULL) CloseHandle((HANDLE)m_mapping);
+  if (m_file    != NULL) CloseHandle((HANDLE)m_file);
+  m_data    = NULL;
+  m_mapping = NULL;
+  m_file    = NULL;
+  m_size    = 0;
+  m_isOpen  = false;
+}
+
+#else
+
+bool mappedFile::open(std::string const& filename){
+
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  m_size   = (size_t)st.st_size;
+  m_isOpen = true;
+  if (m_size > 0) {
+    void * ptr = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+      cerr << "Error: Could not map " << filename << " into memory." << endl;
+      m_size   = 0;
+      m_isOpen = false;
+    }else{
+      m_data = (char*)ptr;
+      // The data will be read front to back
+      madvise(ptr, m_size, MADV_SEQUENTIAL);
+    }
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  ::close(fd);
+
+  return m_isOpen;
+}
+
+void mappedFile::close(){
+  if (m_data != NULL) munmap(m_data, m_size);
+  m_data   = NULL;
+  m_size   = 0;
+  m_isOpen = false;
+}
+
+#endif
@@ -0,0 +1,63 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+// A read-only view of a whole file in memory. The operating system
+// pages the file in on demand, so nothing is read until it is used.
+
+#include <string>
+#include <cstddef>
+
+namespace utils{
+
+  class mappedFile{
+
+  public:
+    mappedFile();
+    ~mappedFile();
+
+    // Return false if the file could not be opened or mapped
+    bool open(std::string const& filename);
+    void close();
+
+    bool         isOpen() const { return m_isOpen; }
+    const char * data  () const { return m_data;   }
+    size_t       size  () const { return m_size;   }
+
+  private:
+    // The mapping is owned by this object
+    mappedFile(mappedFile const&);
+    mappedFile & operator=(mappedFile const&);
+
+    bool   m_isOpen;
+    char * m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void * m_file;
+    void * m_mapping;
+#endif
+  };
+
+}
+
+#endif
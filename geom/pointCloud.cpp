@@ -0,0 +1,143 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <cmath>
+#include <iostream>
+#include <pointCloud.h>
+#ifdef POLYVIEW_USE_OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace utils;
+
+pointCloud::pointCloud(): m_xl(0.0), m_yl(0.0), m_cellWidth(1.0), m_cellHeight(1.0),
+                          m_numCellsX(1), m_numCellsY(1), m_cellStart(2, 0),
+                          m_colorId(0), m_typicalDensity(0.0){}
+
+void pointCloud::formGrid(int numPts, const double * xv, const double * yv,
+                          const int * colorIds){
+
+  *this = pointCloud();
+
+  // Points which are not finite numbers are never drawn, so they are
+  // left out. They would also make the size of the grid not a number.
+  double xl = DBL_MAX, yl = DBL_MAX, xh = -DBL_MAX, yh = -DBL_MAX;
+  int numValid = 0;
+  for (int s = 0; s < numPts; s++){
+    if (!std::isfinite(xv[s]) || !std::isfinite(yv[s])) continue;
+    xl = min(xl, xv[s]); xh = max(xh, xv[s]);
+    yl = min(yl, yv[s]); yh = max(yh, yv[s]);
+    numValid++;
+  }
+  if (numValid == 0) return;
+
+  // Make the cells about square, with a few points in each
+  const double ptsPerCell = 8.0;
+  double numCells = max(1.0, numValid/ptsPerCell);
+  double w = xh - xl, h = yh - yl;
+  if (!std::isfinite(w) || !std::isfinite(h)) {
+    // The points span more than a double can hold, use one cell
+    w = h = 0.0;
+  }
+  double nx = 1.0, ny = 1.0;
+  if (w > 0.0 && h > 0.0) {
+    // Written so that w*h cannot overflow
+    double side = sqrt(w)*sqrt(h/numCells);
+    nx = max(1.0, ceil(w/side));
+    ny = max(1.0, ceil(h/side));
+  } else if (w > 0.0) {
+    nx = numCells;
+  } else if (h > 0.0) {
+    ny = numCells;
+  }
+  m_numCellsX  = (int)min(nx, numCells);
+  m_numCellsY  = (int)min(ny, numCells);
+  m_xl         = xl;
+  m_yl         = yl;
+  m_cellWidth  = (w > 0.0) ? w/m_numCellsX : 1.0;
+  m_cellHeight = (h > 0.0) ? h/m_numCellsY : 1.0;
+
+  // Sort the points by cell, keeping their order within a cell
+  vector<int> cells(numPts);
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int s = 0; s < numPts; s++){
+    if (!std::isfinite(xv[s]) || !std::isfinite(yv[s])) { cells[s] = -1; continue; }
+    int cx, cy;
+    cellOf(xv[s], yv[s], cx, cy);
+    cells[s] = cy*m_numCellsX + cx;
+  }
+
+  m_cellStart.assign((size_t)m_numCellsX*m_numCellsY + 1, 0);
+  for (int s = 0; s < numPts; s++)
+    if (cells[s] >= 0) m_cellStart[cells[s] + 1]++;
+  for (size_t c = 1; c < m_cellStart.size(); c++)
+    m_cellStart[c] += m_cellStart[c - 1];
+
+  bool sameColor = true;
+  if (colorIds != NULL) {
+    m_colorId = colorIds[0];
+    for (int s = 1; s < numPts && sameColor; s++)
+      sameColor = (colorIds[s] == m_colorId);
+  }
+  if (!sameColor) m_colorIds.resize(numValid);
+
+  m_dx.resize(numValid);
+  m_dy.resize(numValid);
+  m_ids.resize(numValid);
+  vector<int> pos(m_cellStart.begin(), m_cellStart.end() - 1);
+  for (int s = 0; s < numPts; s++){
+    int c = cells[s];
+    if (c < 0) continue;
+    int i = pos[c]++;
+    m_dx[i]  = (float)(xv[s] - (m_xl + (c % m_numCellsX)*m_cellWidth));
+    m_dy[i]  = (float)(yv[s] - (m_yl + (c / m_numCellsX)*m_cellHeight));
+    m_ids[i] = s;
+    if (!sameColor) m_colorIds[i] = colorIds[s];
+  }
+
+  vector<int> counts;
+  for (size_t c = 0; c + 1 < m_cellStart.size(); c++) {
+    int count = m_cellStart[c + 1] - m_cellStart[c];
+    if (count > 0) counts.push_back(count);
+  }
+  size_t k = (9*counts.size())/10;
+  std::nth_element(counts.begin(), counts.begin() + k, counts.end());
+  m_typicalDensity = counts[k]/(m_cellWidth*m_cellHeight);
+}
+
+int pointCloud::numPointsInBox(dRect const& box) const{
+
+  int count = 0;
+  visitCellsInBox(box, [&](int beg, int end, double x0, double y0){
+      // All points of a cell inside the box are counted without a test
+      if (box.contains(dRect(x0, y0, x0 + m_cellWidth, y0 + m_cellHeight))) {
+        count += end - beg;
+        return;
+      }
+      for (int i = beg; i < end; i++)
+        if (box.isInSide(x0 + m_dx[i], y0 + m_dy[i])) count++;
+    });
+
+  return count;
+}
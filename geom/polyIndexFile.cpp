@@ -0,0 +1,389 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <polyIndexFile.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace utils;
+
+namespace polyIndexFile_local_functions{
+
+  // The layout of a .pvi file. As for a .pvb file, all numbers are in
+  // the byte order of the machine which wrote it, and each section
+  // starts at a multiple of 8 bytes.
+  //
+  //   header
+  //   bounding boxes, packed    dRectWithId           [numPolys]
+  //   point tree nodes          kdTree node           [numVerts]
+  //   edge boxes, packed        dRectWithId           [numEdges]
+  //   edges                     segWidthId            [numVerts]
+  //
+  // The boxes are in the order of the leaves of their boxTree, which
+  // is formed from them again quickly. A tree which was not saved has
+  // no nodes and a root of -2. The box trees have a root of 0.
+  const char     indexMagic[8]   = {'P', 'V', 'I', 'N', 'D', 'E', 'X', '1'};
+  const uint32_t indexByteOrder  = 0x01020304;
+  const uint32_t indexVersion    = 3;
+  const int64_t  noTree          = -2;
+
+  enum {BOXES = 0, POINT_NODES, EDGE_BOXES, EDGES, NUM_SECTIONS};
+
+  struct indexSection{
+    uint64_t offset;
+    uint64_t count;
+    int64_t  root;
+  };
+
+  struct indexHeader{
+    char     magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint64_t polyFileSize;
+    int64_t  polyFileTime;     // seconds
+    int64_t  polyFileTimeNsec; // and nanoseconds, where the system has them
+    uint64_t numPolys;
+    uint64_t numVerts;
+    uint32_t isPointCloud;
+    uint32_t sizeOfBox;
+    uint32_t sizeOfPointNode;
+    uint32_t sizeOfEdge;
+    indexSection sections[NUM_SECTIONS];
+  };
+
+  inline uint64_t align8(uint64_t pos){ return (pos + 7) & ~uint64_t(7); }
+
+  // The size and modification time of a file. Whole seconds are not
+  // enough, as a file may be rewritten with the same size within one.
+  bool getFileStamp(std::string const& filename, uint64_t & size,
+                    int64_t & time, int64_t & timeNsec){
+    timeNsec = 0;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(filename.c_str(), &st) != 0) return false;
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attr)) {
+      uint64_t ticks = ((uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32)
+        | attr.ftLastWriteTime.dwLowDateTime; // in units of 100 ns
+      timeNsec = (int64_t)(ticks % 10000000)*100;
+    }
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) return false;
+#if defined(__APPLE__)
+    timeNsec = (int64_t)st.st_mtimespec.tv_nsec;
+#else
+    timeNsec = (int64_t)st.st_mtim.tv_nsec;
+#endif
+#endif
+    size = (uint64_t)st.st_size;
+    time = (int64_t)st.st_mtime;
+    return true;
+  }
+
+  void fillHeader(std::string const& polyFile, int numPolys, int numVerts,
+                  bool isPointCloud, indexHeader & H){
+    memset(&H, 0, sizeof(H));
+    memcpy(H.magic, indexMagic, sizeof(H.magic));
+    H.byteOrder       = indexByteOrder;
+    H.version         = indexVersion;
+    H.numPolys        = numPolys;
+    H.numVerts        = numVerts;
+    H.isPointCloud    = isPointCloud;
+    H.sizeOfBox       = sizeof(dRectWithId);
+    H.sizeOfPointNode = sizeof(utils::Node);
+    H.sizeOfEdge      = sizeof(segWidthId);
+    getFileStamp(polyFile, H.polyFileSize, H.polyFileTime, H.polyFileTimeNsec);
+  }
+
+  // A corrupt index must not make a search loop or read out of bounds,
+  // so check that the nodes form a tree whose ids are in range.
+  template<class NodeT, class GetId>
+  bool isValidTree(const NodeT * nodes, uint64_t numNodes, int64_t root,
+                   int64_t minId, int64_t maxId, GetId getId){
+
+    int64_t n = (int64_t)numNodes;
+    if (root < -1 || root >= n || (root == -1) != (n == 0)) return false;
+
+    std::vector<char> isChild(numNodes, 0);
+    for (int64_t i = 0; i < n; i++) {
+      const NodeT & N = nodes[i];
+      if (N.isRemoved) return false;
+      int64_t id = getId(N);
+      if (id < minId || id >= maxId) return false;
+      int children[] = {N.left, N.right};
+      for (int c = 0; c < 2; c++) {
+        int64_t k = children[c];
+        if (k == -1) continue;
+        if (k < 0 || k >= n || k == root || isChild[k]) return false;
+        isChild[k] = 1;
+      }
+    }
+
+    // Each node other than the root is the child of exactly one node
+    for (int64_t i = 0; i < n; i++)
+      if (i != root && !isChild[i]) return false;
+
+    return true;
+  }
+
+  int pointId(utils::Node const& N){ return N.P.id; }
+
+  bool areValidBoxes(std::vector<dRectWithId> const& boxes, int numIds){
+    for (size_t s = 0; s < boxes.size(); s++)
+      if (boxes[s].id < 0 || boxes[s].id >= numIds) return false;
+    return true;
+  }
+
+  // The nodes of a section. They are copied from the mapped file as
+  // it need not be aligned in memory.
+  template<class T>
+  void readSection(const char * data, indexSection const& S, std::vector<T> & vals){
+    vals.resize(S.count);
+    if (S.count > 0) memcpy((void*)&vals[0], data + S.offset, sizeof(T) * S.count);
+  }
+
+  void writePadding(std::ofstream & out){
+    const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    std::streamoff pos = out.tellp();
+    out.write(zeros, (std::streamsize)(align8(pos) - pos));
+  }
+
+  void writeBytes(std::ofstream & out, const void * bytes, uint64_t num){
+    if (num > 0) out.write((const char*)bytes, (std::streamsize)num);
+    writePadding(out);
+  }
+
+  bool replaceFile(std::string const& from, std::string const& to){
+#ifdef _WIN32
+    // This fails while another program has the old index mapped
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+  }
+
+  int processId(){
+#ifdef _WIN32
+    return _getpid();
+#else
+    return (int)getpid();
+#endif
+  }
+}
+
+polyIndexFile::polyIndexFile(std::string const& polyFile, int numPolys, int numVerts,
+                             bool isPointCloud):
+  m_isValid(false), m_polyFile(polyFile), m_numPolys(numPolys),
+  m_numVerts(numVerts), m_isPointCloud(isPointCloud){
+
+  using namespace polyIndexFile_local_functions;
+
+  if (!m_file.open(indexFile())) return;
+
+  indexHeader Expected, H;
+  fillHeader(m_polyFile, m_numPolys, m_numVerts, m_isPointCloud, Expected);
+  if (m_file.size() < sizeof(H)) {
+    m_file.close();
+    return;
+  }
+  memcpy(&H, m_file.data(), sizeof(H));
+
+  // Everything before the sections must be as for the current file
+  size_t stampSize = (const char*)&H.sections[0] - (const char*)&H;
+  bool isValid = (memcmp(&H, &Expected, stampSize) == 0);
+
+  const uint64_t sizes[NUM_SECTIONS] = {sizeof(dRectWithId), sizeof(utils::Node),
+                                        sizeof(dRectWithId), sizeof(segWidthId)};
+  for (int s = 0; s < NUM_SECTIONS && isValid; s++) {
+    indexSection const& S = H.sections[s];
+    isValid = (S.count <= H.numVerts && S.offset % 8 == 0 &&
+               S.offset >= sizeof(H) && S.offset <= m_file.size() &&
+               S.count * sizes[s] <= m_file.size() - S.offset);
+  }
+
+  if (!isValid) {
+    m_file.close();
+    return;
+  }
+
+  m_isValid = true;
+}
+
+bool polyIndexFile::loadBoxTree(boxTree<dRectWithId> & T) const{
+
+  using namespace polyIndexFile_local_functions;
+
+  if (!m_isValid) return false;
+
+  indexHeader H;
+  memcpy(&H, m_file.data(), sizeof(H));
+  indexSection const& S = H.sections[BOXES];
+  if (S.root == noTree || S.count != (uint64_t)m_numPolys) return false;
+
+  std::vector<dRectWithId> boxes;
+  readSection(m_file.data(), S, boxes);
+  if (!areValidBoxes(boxes, m_numPolys)) return false;
+
+  T.setFormedTree(vecPtr(boxes), (int)S.count);
+  return true;
+}
+
+bool polyIndexFile::loadPointTree(kdTree & T) const{
+
+  using namespace polyIndexFile_local_functions;
+
+  if (!m_isValid) return false;
+
+  indexHeader H;
+  memcpy(&H, m_file.data(), sizeof(H));
+  indexSection const& S = H.sections[POINT_NODES];
+  if (S.root == noTree || S.count != (uint64_t)m_numVerts) return false;
+
+  std::vector<utils::Node> nodes;
+  readSection(m_file.data(), S, nodes);
+  if (!isValidTree(vecPtr(nodes), S.count, S.root, 0, m_numVerts, pointId)) return false;
+
+  T.setFormedTree(vecPtr(nodes), (int)S.count, (int)S.root);
+  return true;
+}
+
+bool polyIndexFile::loadEdgeTree(edgeTree & T) const{
+
+  using namespace polyIndexFile_local_functions;
+
+  if (!m_isValid) return false;
+
+  indexHeader H;
+  memcpy(&H, m_file.data(), sizeof(H));
+  indexSection const& B = H.sections[EDGE_BOXES];
+  indexSection const& E = H.sections[EDGES];
+  if (B.root == noTree || E.count != (uint64_t)m_numVerts) return false;
+
+  std::vector<dRectWithId> boxes;
+  std::vector<segWidthId> edges;
+  readSection(m_file.data(), B, boxes);
+  readSection(m_file.data(), E, edges);
+  if (!areValidBoxes(boxes, m_numVerts)) return false;
+
+  // The edges which are not in the tree, such as after the last
+  // vertex of an open polygon, have an id of -1
+  for (size_t e = 0; e < edges.size(); e++)
+    if (edges[e].id < -1 || edges[e].id >= m_numVerts) return false;
+
+  T.setFormedTree(vecPtr(boxes), (int)B.count, vecPtr(edges), (int)E.count);
+  return true;
+}
+
+bool polyIndexFile::write(polyIndexFile        const& prev,
+                          boxTree<dRectWithId> const* boxes,
+                          kdTree               const* points,
+                          edgeTree             const* edges){
+
+  using namespace polyIndexFile_local_functions;
+
+  indexHeader H;
+  fillHeader(prev.m_polyFile, prev.m_numPolys, prev.m_numVerts, prev.m_isPointCloud, H);
+
+  // What to write in each section
+  const void * bytes[NUM_SECTIONS] = {NULL, NULL, NULL, NULL};
+  const uint64_t sizes[NUM_SECTIONS] = {sizeof(dRectWithId), sizeof(utils::Node),
+                                        sizeof(dRectWithId), sizeof(segWidthId)};
+  for (int s = 0; s < NUM_SECTIONS; s++) {
+    H.sections[s].count = 0;
+    H.sections[s].root  = noTree;
+  }
+
+  // Keep the trees the previous index has
+  if (prev.m_isValid) {
+    indexHeader P;
+    memcpy(&P, prev.m_file.data(), sizeof(P));
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+      H.sections[s] = P.sections[s];
+      bytes[s]      = prev.m_file.data() + P.sections[s].offset;
+    }
+  }
+
+  if (boxes != NULL) {
+    H.sections[BOXES].count = boxes->getPackedBoxes().size();
+    H.sections[BOXES].root  = 0;
+    bytes[BOXES]            = vecPtr(boxes->getPackedBoxes());
+  }
+  if (points != NULL) {
+    H.sections[POINT_NODES].count = points->getNodePool().size();
+    H.sections[POINT_NODES].root  = points->getTreeRoot();
+    bytes[POINT_NODES]            = vecPtr(points->getNodePool());
+  }
+  if (edges != NULL) {
+    H.sections[EDGE_BOXES].count = edges->getBoxTree().getPackedBoxes().size();
+    H.sections[EDGE_BOXES].root  = 0;
+    bytes[EDGE_BOXES]            = vecPtr(edges->getBoxTree().getPackedBoxes());
+    H.sections[EDGES].count      = edges->getAllEdges().size();
+    H.sections[EDGES].root       = 0;
+    bytes[EDGES]                 = vecPtr(edges->getAllEdges());
+  }
+
+  uint64_t pos = align8(sizeof(H));
+  for (int s = 0; s < NUM_SECTIONS; s++) {
+    H.sections[s].offset = pos;
+    pos = align8(pos + sizes[s] * H.sections[s].count);
+  }
+
+  // Write to a file of our own and then put it in place, so that a
+  // program reading the index never sees it half written
+  static std::atomic<int> ss_tmp_count(0);
+  std::ostringstream tmpName;
+  tmpName << prev.indexFile() << ".tmp" << processId() << "_" << ss_tmp_count++;
+  std::string tmpFile = tmpName.str();
+
+  ofstream out(tmpFile.c_str(), ios::binary);
+  if (!out.is_open()) return false; // Likely a read-only directory, not an error
+
+  writeBytes(out, &H, sizeof(H));
+  for (int s = 0; s < NUM_SECTIONS; s++)
+    writeBytes(out, bytes[s], sizes[s] * H.sections[s].count);
+  out.close();
+
+  if (!out || !replaceFile(tmpFile, prev.indexFile())) {
+    remove(tmpFile.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,90 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef POLY_INDEX_FILE_H
+#define POLY_INDEX_FILE_H
+
+// The search trees of the polygons read from a large file are saved
+// next to it, in <file>.pvi. The next time the file is read the index
+// is mapped into memory, and the trees are taken from it when first
+// needed rather than formed again, which for big files takes seconds.
+//
+// An index is used only if the polygon file has the same size and
+// modification time as when the index was written, and the same
+// number of polygons and vertices. The trees are kept in flat arrays
+// which do not point into memory, so they are saved as they are, in
+// the byte order of the machine. An open index is never changed, so copies
+// of a dPoly can share it.
+
+#include <string>
+#include <cstdint>
+#include <baseUtils.h>
+#include <geomUtils.h>
+#include <mappedFile.h>
+#include "dTree.h"
+#include "kdTree.h"
+
+namespace utils{
+
+  class polyIndexFile{
+
+  public:
+
+    // Files with fewer vertices get no index, as their trees form fast
+    static const int minVertsForIndex = 1000000;
+
+    // Map the index of the given polygon file, if there is a valid one
+    polyIndexFile(std::string const& polyFile, int numPolys, int numVerts,
+                  bool isPointCloud);
+
+    bool isOpen() const { return m_isValid; }
+    std::string const& polyFile() const { return m_polyFile; }
+    std::string indexFile() const { return m_polyFile + ".pvi"; }
+
+    // Each returns false if the index does not have the tree
+    bool loadBoxTree  (boxTree<dRectWithId> & T) const;
+    bool loadPointTree(kdTree               & T) const;
+    bool loadEdgeTree (edgeTree             & T) const;
+
+    // Write a new index for the polygon file of 'prev', with the given
+    // trees, any of which can be NULL. A tree not given is kept from
+    // 'prev' if it has it. Return false if the index could not be
+    // written. 'prev' stays valid, it maps the old index.
+    static bool write(polyIndexFile        const& prev,
+                      boxTree<dRectWithId> const* boxes,
+                      kdTree               const* points,
+                      edgeTree             const* edges);
+
+  private:
+    // The mapping is owned by this object
+    polyIndexFile(polyIndexFile const&);
+    polyIndexFile & operator=(polyIndexFile const&);
+
+    bool        m_isValid;
+    std::string m_polyFile;
+    int         m_numPolys, m_numVerts;
+    bool        m_isPointCloud;
+    mappedFile  m_file;
+  };
+
+}
+
+#endif
@@ -0,0 +1,616 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <polyReader.h>
+#include <mappedFile.h>
+
+#ifdef POLYVIEW_USE_OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace utils;
+
+namespace{
+
+  // Powers of ten which are exact in double precision
+  const double exactPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  inline bool isSpace(char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+  }
+
+  inline bool isDigit(char c){ return '0' <= c && c <= '9'; }
+
+  // The result of scanning a number of the form [sign]digits[.digits][e[sign]digits]
+  struct decimalScan{
+    const char * end;        // one past the last character of the number
+    bool         hasDigits;  // false if this is not a number
+    bool         badExponent;// an 'e' not followed by exponent digits
+    bool         isExact;    // if false, val must be found with strtod
+    double       val;
+  };
+
+  // Scan a decimal number starting at s, not reading past end. Most
+  // numbers in polygon files have few digits and a small exponent, and
+  // then the value is a product or quotient of two doubles which are
+  // exact, so it is correctly rounded, just as with strtod.
+  decimalScan scanDecimal(const char * s, const char * end){
+
+    decimalScan D;
+    D.hasDigits = false; D.badExponent = false; D.isExact = false; D.val = 0.0;
+
+    const char * p = s;
+    bool isNeg = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+      isNeg = (*p == '-');
+      p++;
+    }
+
+    const int maxNumSig = 19; // the most digits which fit in 64 bits
+    uint64_t mantissa = 0;
+    int numSig = 0, exp10 = 0;
+    bool isTruncated = false;
+    for (; p < end && isDigit(*p); p++) {
+      D.hasDigits = true;
+      if (mantissa == 0 && *p == '0') continue;
+      if (numSig < maxNumSig) { mantissa = 10*mantissa + (*p - '0'); numSig++; }
+      else                    { isTruncated = true; exp10++; }
+    }
+    if (p < end && *p == '.') {
+      for (p++; p < end && isDigit(*p); p++) {
+        D.hasDigits = true;
+        if (mantissa == 0 && *p == '0') { exp10--; continue; }
+        if (numSig < maxNumSig) { mantissa = 10*mantissa + (*p - '0'); numSig++; exp10--; }
+        else                    isTruncated = true;
+      }
+    }
+    D.end = p;
+    if (!D.hasDigits) return D;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      const char * q = p + 1;
+      bool isNegExp = false;
+      if (q < end && (*q == '+' || *q == '-')) {
+        isNegExp = (*q == '-');
+        q++;
+      }
+      if (q < end && isDigit(*q)) {
+        int e = 0;
+        for (; q < end && isDigit(*q); q++)
+          if (e < 100000) e = 10*e + (*q - '0'); // larger values are just as out of range
+        exp10 += isNegExp ? -e : e;
+        D.end = q;
+      }else{
+        D.badExponent = true;
+      }
+    }
+
+    if (mantissa == 0) {
+      D.isExact = true;
+      D.val     = 0.0;
+    }else if (!isTruncated && mantissa <= (uint64_t(1) << 53) &&
+              -22 <= exp10 && exp10 <= 22) {
+      D.isExact = true;
+      D.val = (exp10 >= 0) ? double(mantissa) * exactPow10[exp10] :
+        double(mantissa) / exactPow10[-exp10];
+    }
+    if (isNeg) D.val = -D.val;
+
+    return D;
+  }
+
+  // Same as std::stod(s) without the exceptions. Set ok to false where
+  // std::stod would throw. The string must be null-terminated.
+  double parseDouble(const char * s, const char * & end, bool & ok){
+
+    const char * p = s;
+    while (isSpace(*p)) p++;
+
+    // Leave hexadecimal numbers, infinity, and nan to strtod
+    const char * q = p;
+    if (*q == '+' || *q == '-') q++;
+    char c = (char)tolower(*q);
+    bool isSpecial = (c == 'i' || c == 'n' ||
+                      (c == '0' && (q[1] == 'x' || q[1] == 'X')));
+
+    if (!isSpecial) {
+      decimalScan D = scanDecimal(p, p + strlen(p));
+      if (!D.hasDigits) {
+        ok = false;
+        end = s;
+        return 0.0;
+      }
+      if (D.isExact) {
+        ok = true;
+        end = D.end;
+        return D.val;
+      }
+    }
+
+    char * strEnd;
+    errno = 0;
+    double val = strtod(s, &strEnd);
+    ok  = (strEnd != s && errno != ERANGE);
+    end = strEnd;
+    return val;
+  }
+
+  // The same changes to a line which dPoly::readPoly makes before
+  // parsing it, so that the results are the same.
+  void prepareXgLine(std::string & line){
+
+    if (line[0] == ' ') {
+      // remove trailing space
+      line.erase(0, line.find_first_not_of(' '));
+    }
+
+    // Convert to lowercase only "NEXT", "COLOR", or "ANNO", other
+    // annotations/labels should stay as is
+    int num_chars = std::min((int)line.size(), 5);
+    for (int kk = 0; kk < num_chars; kk++)
+      line[kk] = tolower(line[kk]);
+
+    // Replace comma with space, to be able to use comma as separator
+    char * linePtr = &line[0];
+    int str_len = (int)strlen(linePtr);
+    for (int s = 0; s < str_len; s++) {
+      if (linePtr[s] == ',') linePtr[s] = ' ';
+    }
+
+    // Ignore any text after the comment character, which is '#' or '!'
+    for (int s = 0; s < str_len; s++) {
+      if (linePtr[s] == '#' || linePtr[s] == '!') {
+        for (int t = s; t < str_len; t++) linePtr[t] = '\0';
+        break;
+      }
+    }
+  }
+
+  // Same as utils::searchForLayer(), but without allocating memory for
+  // each call, as it is called once per polygon.
+  void findLayer(const std::string & line, std::string & layer){
+
+    layer.clear();
+
+    const char * start1 = strchr(line.c_str(), ';');
+    if (start1 == NULL) return;
+    start1++; // Move beyond ";"
+    if (*start1 == '\0') return;
+    int l1 = atoi(start1);
+
+    const char * start2 = strchr(start1, ':');
+    if (start2 == NULL) return;
+    start2++; // Move beyond ":"
+    if (*start2 == '\0') return;
+    int l2 = atoi(start2);
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%d:%d", l1, l2);
+    layer = buf;
+  }
+
+  bool isNextLine(const char * p, const char * end){
+    if (p < end && *p == ' ') {
+      while (p < end && *p == ' ') p++;
+    }
+    const char * next = "next";
+    for (int i = 0; i < 4; i++) {
+      if (p + i >= end || tolower(p[i]) != next[i]) return false;
+    }
+    return true;
+  }
+
+  // The first position at or after pos where a new chunk can start. No
+  // polygon may be open there, which is the case after a "NEXT" line, or
+  // after any line for point clouds.
+  size_t findChunkStart(const char * data, size_t size, size_t pos, bool isPointCloud){
+
+    // Move to the start of a line
+    if (pos > 0 && pos < size && data[pos - 1] != '\n') {
+      const char * nl = (const char*)memchr(data + pos, '\n', size - pos);
+      pos = (nl == NULL) ? size : (nl - data) + 1;
+    }
+    if (isPointCloud) return std::min(pos, size);
+
+    while (pos < size) {
+      const char * nl = (const char*)memchr(data + pos, '\n', size - pos);
+      const char * lineEnd = (nl == NULL) ? data + size : nl;
+      size_t nextPos = (nl == NULL) ? size : (nl - data) + 1;
+      if (isNextLine(data + pos, lineEnd)) return nextPos;
+      pos = nextPos;
+    }
+
+    return size;
+  }
+
+  // The polygons in one chunk of a .xg file
+  struct xgChunk{
+    std::vector<double>      xv, yv;
+    std::vector<int>         numVerts;
+    std::vector<char>        isPolyClosed;
+    std::vector<anno>        annotations;
+    // The color and layer of each polygon, as ids in the palettes of
+    // this chunk. A color set in an earlier chunk has the id -1.
+    std::vector<int>         colorIds, layerIds;
+    namePalette              colorPalette, layerPalette;
+    int                      lastColorId;
+    bool                     hasColorInFile;
+    xgChunk(): lastColorId(-1), hasColorInFile(false){}
+  };
+
+  // Parse the lines in [beg, end) exactly as dPoly::readPoly does
+  void parseXgChunk(const char * beg, const char * end, bool isLastChunk,
+                    bool isPointCloud, std::string const& defaultColor,
+                    xgChunk & C){
+
+    std::string line, color, layer;
+    anno annotation;
+    int colorId = -1, numVertsInPoly = 0;
+
+    const char * p = beg;
+    while (p < end) {
+
+      const char * nl = (const char*)memchr(p, '\n', end - p);
+      const char * lineEnd = (nl == NULL) ? end : nl;
+      line.assign(p, lineEnd);
+      p = (nl == NULL) ? end : nl + 1;
+
+      bool isLastLine = (isLastChunk && p == end);
+      prepareXgLine(line);
+
+      // If the current line has a color, use it from now on
+      if (line[0] == 'c') {
+        color.clear();
+        searchForColor(line, color);
+        if (!color.empty()) colorId = C.colorPalette.intern(color);
+        // If colorId < 0 this was decided when the color was set
+        if (colorId >= 0 && C.colorPalette.name(colorId) != defaultColor)
+          C.hasColorInFile = true;
+        if (!isLastLine) continue;
+      }
+
+      if (line[0] == 'a') {
+        if (searchForAnnotation(line, annotation))
+          C.annotations.push_back(annotation);
+        if (!isLastLine) continue;
+      }
+
+      // Extract the coordinates of the current vertex and the layer
+      // The format we expect is: x y ; layerNo (e.g., 2.3 -1.2 ; 5:16)
+      if (line[0] != 'n') {
+        bool okX, okY;
+        const char * xEnd, * yEnd;
+        double x = parseDouble(line.c_str(), xEnd, okX);
+        if (okX) {
+          double y = parseDouble(xEnd, yEnd, okY);
+          if (okY) {
+            C.xv.push_back(x);
+            C.yv.push_back(y);
+            numVertsInPoly++;
+            // Find the layer only for the first point in the polygon
+            if (numVertsInPoly == 1) findLayer(line, layer);
+            if (!isPointCloud && !isLastLine) continue;
+          }
+        }
+      }
+
+      bool isNext = (strncmp(line.c_str(), "next", 4) == 0);
+      if (!(isLastLine || isNext || isPointCloud) || numVertsInPoly == 0) continue;
+
+      // Close the current polygon. If the first vertex equals to the
+      // last one, this is a true polygon rather than a polygonal line,
+      // and the last vertex is not stored.
+      size_t last = C.xv.size() - 1, first = C.xv.size() - numVertsInPoly;
+      if (numVertsInPoly > 1 && C.xv[first] == C.xv[last] && C.yv[first] == C.yv[last]) {
+        C.xv.pop_back();
+        C.yv.pop_back();
+        numVertsInPoly--;
+        C.isPolyClosed.push_back(true);
+      }else{
+        C.isPolyClosed.push_back(false);
+      }
+      C.numVerts.push_back(numVertsInPoly);
+      C.layerIds.push_back(C.layerPalette.intern(layer));
+      C.colorIds.push_back(colorId);
+      numVertsInPoly = 0;
+    }
+
+    C.lastColorId = colorId;
+  }
+
+  // Reads from a mapped file the way std::istream does, for the .pol
+  // and .cnt formats, which mix reading numbers and whole lines.
+  class textCursor{
+  public:
+    textCursor(const char * data, size_t size):
+      m_pos(data), m_end(data + size), m_failed(false){}
+
+    int peek() const {
+      if (m_failed || m_pos >= m_end) return EOF;
+      return *m_pos;
+    }
+
+    bool getline(std::string & line){
+      if (m_failed || m_pos >= m_end) return fail();
+      const char * nl = (const char*)memchr(m_pos, '\n', m_end - m_pos);
+      const char * lineEnd = (nl == NULL) ? m_end : nl;
+      line.assign(m_pos, lineEnd);
+      m_pos = (nl == NULL) ? m_end : nl + 1;
+      return true;
+    }
+
+    bool read(double & val){
+      if (!skipSpace()) return fail();
+      decimalScan D = scanDecimal(m_pos, m_end);
+      if (!D.hasDigits || D.badExponent) return fail();
+      if (D.isExact) {
+        val = D.val;
+      }else{
+        std::string token(m_pos, D.end);
+        char * strEnd;
+        val = strtod(token.c_str(), &strEnd);
+        if (*strEnd != '\0' || std::isinf(val)) return fail();
+      }
+      m_pos = D.end;
+      return true;
+    }
+
+    bool read(int & val){
+      if (!skipSpace()) return fail();
+      const char * p = m_pos;
+      bool isNeg = false;
+      if (p < m_end && (*p == '+' || *p == '-')) {
+        isNeg = (*p == '-');
+        p++;
+      }
+      if (p >= m_end || !isDigit(*p)) return fail();
+      long long v = 0;
+      for (; p < m_end && isDigit(*p); p++) {
+        v = 10*v + (*p - '0');
+        if (v > (long long)INT_MAX + 1) return fail();
+      }
+      if (isNeg) v = -v;
+      if (v < INT_MIN || v > INT_MAX) return fail();
+      val = (int)v;
+      m_pos = p;
+      return true;
+    }
+
+  private:
+    bool skipSpace(){
+      if (m_failed) return false;
+      while (m_pos < m_end && isSpace(*m_pos)) m_pos++;
+      return m_pos < m_end;
+    }
+    bool fail(){ m_failed = true; return false; }
+
+    const char * m_pos;
+    const char * m_end;
+    bool         m_failed;
+  };
+
+  bool getColorInCntFile(const std::string & line, std::string & color) {
+
+    // Minor function. Out of the line: "#Color = #ff00" return the string "#ff00"
+    // and append "00" to it to make it a valid color.
+
+    istringstream iss(line);
+    string equal, colorTag;
+    if ( ! (iss >> colorTag >> equal >> color)        ) return false;
+    if ( colorTag != "#Color" && colorTag != "#color" ) return false;
+    while (color[0] == '#' && color.size() < 7 ) color += "0";
+
+    return true;
+  }
+
+}
+
+bool utils::readXgFile(// inputs
+                       std::string const& filename,
+                       bool isPointCloud,
+                       std::string const& defaultColor,
+                       // output
+                       polyFileData & data){
+
+  data = polyFileData();
+
+  mappedFile file;
+  if (!file.open(filename)) {
+    cerr << "Error: Could not open " << filename << endl;
+    return false;
+  }
+
+  const char * text = file.data();
+  size_t size = file.size();
+
+  // Split the file into chunks of at least a few megabytes, with
+  // several chunks per thread to even out the load.
+  int numChunks = 1;
+#ifdef POLYVIEW_USE_OPENMP
+  const size_t minChunkSize = 4 << 20;
+  numChunks = (int)std::max(size_t(1), std::min(size_t(4*omp_get_max_threads()),
+                                                size/minChunkSize));
+#endif
+  std::vector<size_t> chunkStart(1, 0);
+  for (int k = 1; k < numChunks; k++) {
+    size_t pos = findChunkStart(text, size, size*k/numChunks, isPointCloud);
+    if (pos > chunkStart.back() && pos < size) chunkStart.push_back(pos);
+  }
+  chunkStart.push_back(size);
+  numChunks = (int)chunkStart.size() - 1;
+
+  std::vector<xgChunk> chunks(numChunks);
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int k = 0; k < numChunks; k++) {
+    parseXgChunk(text + chunkStart[k], text + chunkStart[k + 1], (k == numChunks - 1),
+                 isPointCloud, defaultColor, chunks[k]);
+  }
+
+  // A chunk starts with the last color of the chunks before it. The
+  // palettes of the chunks are merged, with the ids of each chunk
+  // mapped to the merged ones.
+  std::vector<int> startColor(numChunks);
+  std::vector<std::vector<int>> colorMap(numChunks), layerMap(numChunks);
+  std::vector<size_t> vertStart(numChunks + 1, 0), polyStart(numChunks + 1, 0);
+  std::string color = defaultColor;
+  size_t numAnno = 0;
+  for (int k = 0; k < numChunks; k++) {
+    xgChunk const& C = chunks[k];
+    startColor[k] = data.colorPalette.intern(color);
+    if (C.lastColorId >= 0) color = C.colorPalette.name(C.lastColorId);
+    for (int c = 0; c < C.colorPalette.size(); c++)
+      colorMap[k].push_back(data.colorPalette.intern(C.colorPalette.name(c)));
+    for (int l = 0; l < C.layerPalette.size(); l++)
+      layerMap[k].push_back(data.layerPalette.intern(C.layerPalette.name(l)));
+    vertStart[k + 1] = vertStart[k] + C.xv.size();
+    polyStart[k + 1] = polyStart[k] + C.numVerts.size();
+    numAnno += C.annotations.size();
+    data.hasColorInFile = data.hasColorInFile || C.hasColorInFile;
+  }
+
+  data.xv.resize(vertStart[numChunks]);
+  data.yv.resize(vertStart[numChunks]);
+  data.numVerts.resize(polyStart[numChunks]);
+  data.isPolyClosed.resize(polyStart[numChunks]);
+  data.colorIds.resize(polyStart[numChunks]);
+  data.layerIds.resize(polyStart[numChunks]);
+  data.annotations.reserve(numAnno);
+  for (int k = 0; k < numChunks; k++)
+    data.annotations.insert(data.annotations.end(),
+                            chunks[k].annotations.begin(), chunks[k].annotations.end());
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int k = 0; k < numChunks; k++) {
+    xgChunk & C = chunks[k];
+    std::copy(C.xv.begin(), C.xv.end(), data.xv.begin() + vertStart[k]);
+    std::copy(C.yv.begin(), C.yv.end(), data.yv.begin() + vertStart[k]);
+    std::copy(C.numVerts.begin(), C.numVerts.end(), data.numVerts.begin() + polyStart[k]);
+    std::copy(C.isPolyClosed.begin(), C.isPolyClosed.end(),
+              data.isPolyClosed.begin() + polyStart[k]);
+    for (size_t p = 0; p < C.numVerts.size(); p++) {
+      size_t pos = polyStart[k] + p;
+      data.layerIds[pos] = layerMap[k][C.layerIds[p]];
+      data.colorIds[pos] = (C.colorIds[p] < 0) ? startColor[k] : colorMap[k][C.colorIds[p]];
+    }
+    C = xgChunk(); // free the memory early
+  }
+
+  return true;
+}
+
+bool utils::readPolOrCntFile(// inputs
+                             std::string const& filename,
+                             std::string const& type,
+                             // output
+                             polyFileData & data){
+
+  data = polyFileData();
+
+  string color = "yellow";
+  string layer = "";
+
+  mappedFile file;
+  if (!file.open(filename)) {
+    cerr << "Could not open " << filename << endl;
+    return false;
+  }
+  textCursor in(file.data(), file.size());
+
+  // Bypass the lines starting with comments. Extract the color.
+  string line, lColor;
+  while (1) {
+    int c = in.peek();
+    if (c != '#' && c != '!') break;
+    in.getline(line);
+    if (getColorInCntFile(line, lColor)) color = lColor;
+  }
+
+  // Parse the header for pol files.
+  double tmp;
+  if (type == "pol" && !(in.read(tmp) && in.read(tmp) && in.read(tmp) && in.read(tmp)))
+    return false;
+
+  while (1) {
+
+    int numVerts = 0;
+
+    if (type == "pol") {
+      // Extract the number of vertices for pol files
+      if (! (in.read(tmp) && in.read(numVerts)) ) return true;  // no more vertices
+      if (! (in.read(tmp) && in.read(tmp)) )      return false; // invalid format
+    }else{
+      // Extract the number of vertices and/or color for cnt file.
+      // Skip lines with comments.
+      if (!in.getline(line)) return true;
+      if (getColorInCntFile(line, lColor)) color = lColor;
+      if (!line.empty() && line[0] == '#') continue;
+      numVerts = int(atof(line.c_str()));
+    }
+
+    // Now that we know how many vertices to expect, try reading them
+    // from the file. Stop if we are unable to find the expected vertices.
+    data.numVerts.push_back(numVerts);
+    data.colorIds.push_back(data.colorPalette.intern(color));
+    data.layerIds.push_back(data.layerPalette.intern(layer));
+
+    for (int s = 0; s < numVerts; s++) {
+      double x, y;
+      if (! (in.read(x) && in.read(y)) ) return false;
+      data.xv.push_back(x);
+      data.yv.push_back(y);
+    }
+
+    size_t l = data.xv.size();
+    if (l > 0 && numVerts >= 2            &&
+        data.xv[l - 1] == data.xv[l - numVerts] &&
+        data.yv[l - 1] == data.yv[l - numVerts]) {
+      // Remove last repeated vertex
+      data.xv.pop_back();
+      data.yv.pop_back();
+      data.numVerts.back()--;
+      data.isPolyClosed.push_back(true);
+    }else if (type == "pol") {
+      // pol files are always closed
+      data.isPolyClosed.push_back(true);
+    }else{
+      data.isPolyClosed.push_back(false);
+    }
+  }
+
+  return true;
+}
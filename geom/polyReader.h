@@ -0,0 +1,68 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef POLY_READER_H
+#define POLY_READER_H
+
+// Fast readers for the text polygon formats. The file is mapped into
+// memory and parsed in place, in parallel if OpenMP is enabled. The
+// results are the same as reading the file one line at a time.
+
+#include <vector>
+#include <string>
+#include <geomUtils.h>
+
+namespace utils{
+
+  // The contents of a polygon file, in the form kept by dPoly
+  struct polyFileData{
+    std::vector<double>      xv, yv;
+    std::vector<int>         numVerts;
+    std::vector<char>        isPolyClosed;
+    std::vector<int>         colorIds, layerIds;
+    namePalette              colorPalette, layerPalette;
+    std::vector<anno>        annotations;
+    bool                     hasColorInFile;
+    polyFileData(): hasColorInFile(false){}
+  };
+
+  // Read a file in the .xg format. The file is split into chunks
+  // ending with a "NEXT" line, and the chunks are parsed at the same
+  // time. Return false if the file could not be opened.
+  bool readXgFile(// inputs
+                  std::string const& filename,
+                  bool isPointCloud, // each vertex is its own polygon
+                  std::string const& defaultColor,
+                  // output
+                  polyFileData & data);
+
+  // Read a file in the .pol or .cnt format. These formats give the
+  // number of vertices before each polygon, so they are read in
+  // order. Return false if the file is not in the given format.
+  bool readPolOrCntFile(// inputs
+                        std::string const& filename,
+                        std::string const& type,
+                        // output
+                        polyFileData & data);
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <polySnapshot.h>
+#include <dPoly.h>
+
+using namespace std;
+using namespace utils;
+
+uint64_t utils::elemHash(std::string const& s){
+  return mixHash(std::hash<std::string>()(s));
+}
+
+uint64_t utils::elemHash(anno const& A){
+  return mixHash(elemHash(A.x) ^ (elemHash(A.y) << 1) ^ elemHash(A.label));
+}
+
+void snapshotPool::add(polySnapshot const& S){
+  doubles.add(S.xv);
+  doubles.add(S.yv);
+  ints.add(S.numVerts);
+  chars.add(S.isPolyClosed);
+  ints.add(S.colorIds);
+  ints.add(S.layerIds);
+  annos.add(S.annotations);
+  annos.add(S.angleAnno);
+}
+
+void utils::takeSnapshots(// inputs
+                          std::vector<dPoly> const& polyVec,
+                          std::vector<polySnapshot> const * prev,
+                          // output
+                          std::vector<polySnapshot> & snapshots){
+
+  int numPolys = polyVec.size();
+  int numPrev  = (prev != NULL) ? prev->size() : 0;
+  snapshots.clear();
+  snapshots.resize(numPolys);
+
+  // Reuse the snapshots of the polygons which did not change, so the
+  // time taken grows with what changed only
+  vector<char> isReused(numPolys, 0), isPrevReused(numPrev, 0);
+  unordered_map<unsigned long long, int> prevById;
+  for (int s = 0; s < numPrev; s++)
+    prevById[(*prev)[s].changeId] = s;
+  for (int p = 0; p < numPolys && numPrev > 0; p++) {
+    unordered_map<unsigned long long, int>::const_iterator it
+      = prevById.find(polyVec[p].get_changeId());
+    if (it == prevById.end()) continue;
+    snapshots[p]     = (*prev)[it->second];
+    snapshots[p].img = polyVec[p].img;
+    isReused[p] = 1;
+    isPrevReused[it->second] = 1;
+  }
+
+  // Look up the chunks of the other polygons of the previous snapshot,
+  // as polygons may have been reordered, removed, or merged since then.
+  snapshotPool pool;
+  for (int s = 0; s < numPrev; s++) {
+    if (!isPrevReused[s]) pool.add((*prev)[s]);
+  }
+
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int p = 0; p < numPolys; p++) {
+    if (isReused[p]) continue;
+    polySnapshot const * prevSnap = NULL;
+    if (p < numPrev) prevSnap = &(*prev)[p];
+    polyVec[p].saveSnapshot(prevSnap, pool, snapshots[p]);
+  }
+}
+
+void utils::restoreSnapshots(std::vector<polySnapshot> const& snapshots,
+                             std::vector<dPoly> & polyVec){
+
+  // Move into place the polygons which are as in some snapshot
+  int numPolys = snapshots.size();
+  vector<dPoly> prevPolys;
+  prevPolys.swap(polyVec);
+  polyVec.resize(numPolys);
+  unordered_map<unsigned long long, int> prevById;
+  for (int s = 0; s < (int)prevPolys.size(); s++)
+    prevById[prevPolys[s].get_changeId()] = s;
+
+  vector<char> isMoved(numPolys, 0);
+  for (int p = 0; p < numPolys; p++) {
+    unordered_map<unsigned long long, int>::iterator it
+      = prevById.find(snapshots[p].changeId);
+    if (it == prevById.end()) continue;
+    std::swap(polyVec[p], prevPolys[it->second]);
+    polyVec[p].img = snapshots[p].img;
+    isMoved[p] = 1;
+    prevById.erase(it); // each can be moved only once
+  }
+
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int p = 0; p < numPolys; p++) {
+    if (!isMoved[p]) polyVec[p].restoreSnapshot(snapshots[p]);
+  }
+}
@@ -0,0 +1,227 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef POLY_SNAPSHOT_H
+#define POLY_SNAPSHOT_H
+
+// Snapshots of dPoly for undo. The arrays of a snapshot are cut into
+// chunks whose boundaries depend on the data itself, so an edit in one
+// place leaves the chunks elsewhere the same, even if vertices were
+// inserted or erased. A new snapshot reuses the unchanged chunks of the
+// previous one instead of copying them, so memory per snapshot grows
+// with what changed rather than with the size of the data.
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <geomUtils.h>
+
+namespace utils{
+
+  class dPoly;
+
+  // Hash of one array element
+  inline uint64_t mixHash(uint64_t h){
+    // The finalizer of splitmix64
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+  }
+  inline uint64_t elemHash(double v){
+    uint64_t h; memcpy(&h, &v, sizeof(h)); return mixHash(h);
+  }
+  inline uint64_t elemHash(int v) { return mixHash((uint64_t)(uint32_t)v); }
+  inline uint64_t elemHash(char v){ return mixHash((uint64_t)(unsigned char)v); }
+  uint64_t elemHash(std::string const& s);
+  uint64_t elemHash(anno const& A);
+
+  // A piece of an array, never modified once made, and shared by all
+  // snapshots holding the same values at some place.
+  template<class T>
+  struct sharedChunk{
+    std::shared_ptr<const std::vector<T>> data;
+    uint64_t                              hash;
+  };
+
+  template<class T>
+  struct chunkedArray{
+    std::vector<sharedChunk<T>> chunks;
+    size_t                      size;
+    chunkedArray(): size(0){}
+  };
+
+  // The chunks of earlier snapshots, looked up by their contents
+  template<class T>
+  class chunkPool{
+  public:
+    void add(chunkedArray<T> const& A){
+      for (size_t c = 0; c < A.chunks.size(); c++)
+        m_chunks[A.chunks[c].hash] = A.chunks[c].data;
+    }
+
+    // Return the stored chunk with these values, or NULL
+    std::shared_ptr<const std::vector<T>> find(uint64_t hash,
+                                               const T * beg, const T * end) const{
+      typename std::unordered_map<uint64_t,
+        std::shared_ptr<const std::vector<T>>>::const_iterator it = m_chunks.find(hash);
+      if (it == m_chunks.end()) return std::shared_ptr<const std::vector<T>>();
+      std::vector<T> const& V = *(it->second);
+      if (V.size() != (size_t)(end - beg) || !std::equal(beg, end, V.begin()))
+        return std::shared_ptr<const std::vector<T>>();
+      return it->second;
+    }
+
+  private:
+    std::unordered_map<uint64_t, std::shared_ptr<const std::vector<T>>> m_chunks;
+  };
+
+  // Find where the chunk of 'vec' starting at 'beg' ends, and its hash.
+  // A chunk ends where the rolling hash of its last 64 elements has the
+  // top 11 bits zero, so on average every 2048 elements. Each step
+  // shifts the rolling hash left by one, so an element is gone from it
+  // after 64 steps, and only the top bits have seen all 64. This is
+  // decided by the values alone, so the same data is cut the same way
+  // wherever it is in the array.
+  template<class T>
+  size_t findChunkEnd(std::vector<T> const& vec, size_t beg, uint64_t & hash){
+
+    const size_t   minChunk = 256, maxChunk = 16384;
+    const uint64_t mask     = 2047ULL << 53;
+
+    uint64_t roll = 0;
+    hash = 0;
+    size_t i = beg;
+    while (i < vec.size()){
+      uint64_t h = elemHash(vec[i]);
+      roll = (roll << 1) + h;
+      hash = mixHash(hash ^ h);
+      i++;
+      size_t len = i - beg;
+      if (len >= maxChunk || (len >= minChunk && (roll & mask) == 0)) break;
+    }
+    return i;
+  }
+
+  // Cut 'vec' into chunks, taking from 'pool' those which already
+  // exist. If 'prev' is the same array at an earlier time, its chunks
+  // are first compared in place, which is faster than hashing. The
+  // comparison is picked up again past any changed part.
+  template<class T>
+  void splitIntoChunks(std::vector<T> const& vec, chunkedArray<T> const* prev,
+                       chunkPool<T> const& pool, chunkedArray<T> & A){
+
+    A.chunks.clear();
+    A.size = vec.size();
+
+    std::unordered_map<const std::vector<T>*, size_t> prevIndex;
+    size_t pc = 0; // the next chunk of 'prev' to compare with
+    size_t beg = 0;
+    while (beg < vec.size()){
+
+      if (prev != NULL && pc < prev->chunks.size()){
+        std::vector<T> const& C = *prev->chunks[pc].data;
+        if (beg + C.size() <= vec.size() &&
+            std::equal(C.begin(), C.end(), vec.begin() + beg)){
+          A.chunks.push_back(prev->chunks[pc]);
+          beg += C.size();
+          pc++;
+          continue;
+        }
+      }
+
+      sharedChunk<T> C;
+      size_t end = findChunkEnd(vec, beg, C.hash);
+      C.data = pool.find(C.hash, &vec[0] + beg, &vec[0] + end);
+      if (!C.data) {
+        C.data = std::make_shared<const std::vector<T>>(vec.begin() + beg,
+                                                        vec.begin() + end);
+      }else if (prev != NULL){
+        // Continue comparing in place after this chunk
+        if (prevIndex.empty()) {
+          for (size_t c = 0; c < prev->chunks.size(); c++)
+            prevIndex[prev->chunks[c].data.get()] = c;
+        }
+        typename std::unordered_map<const std::vector<T>*, size_t>::const_iterator
+          it = prevIndex.find(C.data.get());
+        if (it != prevIndex.end()) pc = it->second + 1;
+      }
+      A.chunks.push_back(C);
+      beg = end;
+    }
+  }
+
+  template<class T>
+  void joinChunks(chunkedArray<T> const& A, std::vector<T> & vec){
+    vec.clear();
+    vec.reserve(A.size);
+    for (size_t c = 0; c < A.chunks.size(); c++)
+      vec.insert(vec.end(), A.chunks[c].data->begin(), A.chunks[c].data->end());
+  }
+
+  // Everything needed to bring back a dPoly as it was. The cached
+  // search trees are not kept, they are rebuilt when needed, so a
+  // dPoly which is still as in its snapshot is not restored at all.
+  struct polySnapshot{
+    unsigned long long        changeId; // see dPoly::get_changeId()
+    bool                      isPointCloud, hasColorInFile;
+    void                    * img;
+    chunkedArray<double>      xv, yv;
+    chunkedArray<int>         numVerts;
+    chunkedArray<char>        isPolyClosed;
+    chunkedArray<int>         colorIds, layerIds;
+    namePalette               colorPalette, layerPalette;
+    chunkedArray<anno>        annotations, angleAnno;
+    std::vector<std::shared_ptr<dPoly>> lodLevels;
+
+    polySnapshot(): changeId(0), isPointCloud(false), hasColorInFile(false), img(NULL){}
+  };
+
+  // The chunks of a set of snapshots, to be shared by the next one
+  struct snapshotPool{
+    chunkPool<double>      doubles;
+    chunkPool<int>         ints;
+    chunkPool<char>        chars;
+    chunkPool<anno>        annos;
+
+    void add(polySnapshot const& S);
+  };
+
+  // Snapshots of a set of dPoly, sharing what did not change since
+  // 'prev', which may be NULL. A dPoly not changed since then, wherever
+  // it is now in the list, keeps its snapshot as is. The others are
+  // compared with the snapshot at the same index.
+  void takeSnapshots(// inputs
+                     std::vector<dPoly> const& polyVec,
+                     std::vector<polySnapshot> const * prev,
+                     // output
+                     std::vector<polySnapshot> & snapshots);
+
+  // Bring back a set of dPoly. Those which are still as in some
+  // snapshot are moved to its place, keeping their search trees.
+  void restoreSnapshots(std::vector<polySnapshot> const& snapshots,
+                        std::vector<dPoly> & polyVec);
+}
+
+#endif // POLY_SNAPSHOT_H
@@ -31,6 +31,7 @@
 #include <cstring>
 #include <cassert>
 #include <algorithm>
+#include <cstdint>
 #include <edgeUtils.h>
 #include <dPoly.h>
 #include <polyUtils.h>
@@ -351,47 +352,42 @@ void utils::findDistanceFromPointsToPoly(const std::vector<dPoint>  &points,
   distVec.clear();
   if (points.empty() || poly2.get_totalNumVerts() == 0) return; // no vertices
 
-  // Put the edges of the second polygon in a tree for fast access
-  const kdTree *pt_tree = nullptr;
-  const edgeTree *T = nullptr;
-  bool point_cloud = poly2.isPointCloud();
-
-  if (point_cloud){// If point cloud use existing point tree for performance
-    pt_tree = poly2.getPointTree() ;
-  } else {
-    T = poly2.getEdgeTree();
+  // The closest vertex or edge of the second polygon to each point,
+  // found on all threads if built with OpenMP
+  int numPts = points.size();
+  std::vector<double> xv(numPts), yv(numPts);
+  for (int t = 0; t < numPts; t++) {
+    xv[t] = points[t].x;
+    yv[t] = points[t].y;
   }
 
-  std::vector<segDist> distVec_temp(points.size());
-
-
-#ifdef POLYVIEW_USE_OPENMP
-    #pragma omp parallel for
-#endif
-
-  for (unsigned t = 0; t < points.size(); t++) {
-
-    double x = points[t].x, y = points[t].y;
-    double closestX, closestY, closestDist;
-
-    if (point_cloud){
-      utils::PointWithId closestVertex;
-      pt_tree->findClosestVertexToPoint(x, y, closestVertex, closestDist);
-      closestX = closestVertex.x;
-      closestY = closestVertex.y;
-    } else {
-      seg closestEdge;
-      T->findClosestEdgeToPoint(x, y,                                        // inputs
-                               closestEdge, closestDist, closestX, closestY // outputs
-      );
-    }
-    if (closestDist > 0){
-      distVec_temp[t] = segDist(x, y, closestX, closestY, closestDist);
+  std::vector<double> closestDists;
+  std::vector<dPoint> closestPts(numPts);
+  if (poly2.isPointCloud()){ // If point cloud use existing point tree for performance
+    std::vector<utils::PointWithId> closestVertices;
+    poly2.getPointTree()->findKNearestVertices(numPts, vecPtr(xv), vecPtr(yv), 1, // inputs
+                                               closestVertices, closestDists      // outputs
+                                               );
+    for (int t = 0; t < numPts; t++)
+      closestPts[t] = dPoint(closestVertices[t].x, closestVertices[t].y);
+  } else {
+    std::vector<segWidthId> closestEdges;
+    poly2.getEdgeTree()->findKNearestEdges(numPts, vecPtr(xv), vecPtr(yv), 1, // inputs
+                                           closestEdges, closestDists         // outputs
+                                           );
+    for (int t = 0; t < numPts; t++) {
+      // The location on the closest edge where the distance is achieved
+      double distSq;
+      minDistSqFromPtToSeg(xv[t], yv[t], closestEdges[t],            // inputs
+                           closestPts[t].x, closestPts[t].y, distSq  // outputs
+                           );
     }
   }
 
-  for (auto &seg: distVec_temp){
-    if (seg.dist > 0) distVec.push_back(seg);
+  for (int t = 0; t < numPts; t++) {
+    if (closestDists[t] > 0 && closestDists[t] < DBL_MAX)
+      distVec.push_back(segDist(xv[t], yv[t], closestPts[t].x, closestPts[t].y,
+                                closestDists[t]));
   }
 
 }
@@ -450,6 +446,122 @@ void utils::putPolyInMultiSet(const dPoly & P, std::multiset<dPoint> & mP) {
   return;
 }
 
+namespace polyUtils_local_functions{
+
+  // A point as a pair of integers ordered the same way as the point,
+  // by x then by y. For a double d, flipping the sign bit if d >= 0,
+  // or all bits if d < 0, gives an integer with the order of d. Minus
+  // zero is made plain zero first, as the two compare equal.
+  struct ptKey{
+    uint64_t x, y;
+  };
+
+  inline uint64_t toKey(double d){
+    d += 0.0; // -0.0 becomes 0.0
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    const uint64_t sign = uint64_t(1) << 63;
+    return (u & sign) ? ~u : (u | sign);
+  }
+
+  inline double fromKey(uint64_t u){
+    const uint64_t sign = uint64_t(1) << 63;
+    u = (u & sign) ? (u & ~sign) : ~u;
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+  }
+
+  inline bool operator==(ptKey a, ptKey b){ return a.x == b.x && a.y == b.y; }
+  inline bool operator< (ptKey a, ptKey b){ return a.x < b.x || (a.x == b.x && a.y < b.y); }
+
+  // Sort the keys by radix, a byte at a time, y before x. Each thread
+  // counts the bytes in its part of the keys, then moves them to where
+  // the counts say. A byte which is the same in all keys, as are the
+  // high bytes of coordinates of similar size, is skipped.
+  void radixSort(std::vector<ptKey> & keys, std::vector<ptKey> & buf){
+
+    size_t num = keys.size();
+    buf.resize(num);
+
+    int numThreads = 1;
+#ifdef POLYVIEW_USE_OPENMP
+    if (num >= 65536) numThreads = omp_get_max_threads();
+#endif
+    std::vector<size_t> counts((size_t)numThreads*256);
+
+    for (int pass = 0; pass < 16; pass++){
+
+      int shift = 8*(pass % 8);
+      bool isX  = (pass >= 8);
+      auto digit = [shift, isX](ptKey const& k){
+        return (int)(((isX ? k.x : k.y) >> shift) & 255);
+      };
+
+      std::fill(counts.begin(), counts.end(), 0);
+#ifdef POLYVIEW_USE_OPENMP
+      #pragma omp parallel num_threads(numThreads)
+#endif
+      {
+        int t = 0;
+#ifdef POLYVIEW_USE_OPENMP
+        t = omp_get_thread_num();
+#endif
+        size_t beg = num*t/numThreads, end = num*(t + 1)/numThreads;
+        size_t * count = &counts[256*t];
+        for (size_t s = beg; s < end; s++) count[digit(keys[s])]++;
+      }
+
+      // Where each thread puts the keys with each byte
+      size_t total = 0;
+      bool isSame = false;
+      for (int d = 0; d < 256; d++){
+        size_t numWithDigit = 0;
+        for (int t = 0; t < numThreads; t++){
+          size_t c = counts[256*t + d];
+          counts[256*t + d] = total;
+          total += c;
+          numWithDigit += c;
+        }
+        if (numWithDigit == num) isSame = true;
+      }
+      if (isSame) continue;
+
+#ifdef POLYVIEW_USE_OPENMP
+      #pragma omp parallel num_threads(numThreads)
+#endif
+      {
+        int t = 0;
+#ifdef POLYVIEW_USE_OPENMP
+        t = omp_get_thread_num();
+#endif
+        size_t beg = num*t/numThreads, end = num*(t + 1)/numThreads;
+        size_t * pos = &counts[256*t];
+        for (size_t s = beg; s < end; s++) buf[pos[digit(keys[s])]++] = keys[s];
+      }
+      keys.swap(buf);
+    }
+  }
+
+  void sortedKeys(const dPoly & P, std::vector<ptKey> & keys, std::vector<ptKey> & buf){
+
+    const double * x  = P.get_xv();
+    const double * y  = P.get_yv();
+    int totalNumVerts = P.get_totalNumVerts();
+
+    keys.resize(totalNumVerts);
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp parallel for if (totalNumVerts >= 65536)
+#endif
+    for (int v = 0; v < totalNumVerts; v++) {
+      keys[v].x = toKey(x[v]);
+      keys[v].y = toKey(y[v]);
+    }
+
+    radixSort(keys, buf);
+  }
+}
+
 void utils::findPolyDiff(const dPoly & P, const dPoly & Q, // inputs
                          std::vector<dPoint> & vP, std::vector<dPoint> & vQ // outputs
                          ) {
@@ -462,42 +574,31 @@ void utils::findPolyDiff(const dPoly & P, const dPoly & Q, // inputs
   // This utility will not be able to detect when two polygons are
   // different but contain exactly the same points.
 
-  multiset<dPoint> mP; putPolyInMultiSet(P, mP);
-  multiset<dPoint> mQ; putPolyInMultiSet(Q, mQ);
-
-  // If a point is in mP, and also in mQ, mark it as being in mP and wipe it from mQ
-  vector<dPoint> shared;
-  shared.clear();
-  multiset<dPoint>::iterator ip, iq;
-  for (ip = mP.begin(); ip != mP.end(); ip++) {
-    iq = mQ.find(*ip);
-    if ( iq != mQ.end() ) {
-      shared.push_back(*ip);
-      mQ.erase(iq); // Erase just the current instance of the given value
-    }
-  }
-
-  // Wipe it from mP as well
-  for (int s = 0; s < (int)shared.size(); s++) {
-    ip = mP.find(shared[s]);
-    if ( ip != mP.end() ) {
-      mP.erase(ip); // Erase just the current instance of the given value
+  // Sort the points of both polygons, then walk through them in step.
+  // A point found in both is shared, as many times as it is in both.
+  // The rest make up the differences, sorted by x, then by y.
+  using namespace polyUtils_local_functions;
+
+  std::vector<ptKey> kP, kQ, buf;
+  sortedKeys(P, kP, buf);
+  sortedKeys(Q, kQ, buf);
+
+  size_t numP = kP.size(), numQ = kQ.size();
+  size_t numOnlyP = 0, numOnlyQ = 0, ip = 0, iq = 0;
+  while (ip < numP || iq < numQ) {
+    if (iq == numQ || (ip < numP && kP[ip] < kQ[iq])) {
+      kP[numOnlyP++] = kP[ip++];
+    }else if (ip == numP || kQ[iq] < kP[ip]) {
+      kQ[numOnlyQ++] = kQ[iq++];
+    }else{
+      ip++; iq++; // shared
     }
   }
 
-  vP.clear(); vQ.clear();
-  for (ip = mP.begin(); ip != mP.end(); ip++) {
-    dPoint p;
-    p.x = ip->x;
-    p.y = ip->y;
-    vP.push_back(p);
-  }
-  for (iq = mQ.begin(); iq != mQ.end(); iq++) {
-    dPoint q;
-    q.x = iq->x;
-    q.y = iq->y;
-    vQ.push_back(q);
-  }
+  vP.resize(numOnlyP);
+  for (size_t s = 0; s < numOnlyP; s++) vP[s] = dPoint(fromKey(kP[s].x), fromKey(kP[s].y));
+  vQ.resize(numOnlyQ);
+  for (size_t s = 0; s < numOnlyQ; s++) vQ[s] = dPoint(fromKey(kQ[s].x), fromKey(kQ[s].y));
 
   return;
 }
@@ -26,9 +26,15 @@
 #include <cassert>
 #include <limits>
 #include <ctime>
+#include <algorithm>
 #include <dTree.h>
 #include <dPoly.h>
 
+// Put random boxes in a boxTree and compare searches in it with
+// searching all boxes one by one. This is done for trees of all
+// depths, for a tree formed again from its packed boxes, and after
+// removing, inserting and renumbering boxes.
+
 using namespace std;
 using namespace utils;
 
@@ -37,7 +43,7 @@ double rand_ab(double a, double b){
   return a + rand()%max(int(b - a), 1);
 }
 
-void saveBoxes(std::vector<dRect> & Boxes, std::string file, std::string color){
+void saveBoxes(std::vector<dRectWithId> & Boxes, std::string file, std::string color){
   cout << "Writing " << file << endl;
   ofstream of(file.c_str());
   of << "color = " << color << endl;
@@ -53,117 +59,214 @@ void saveBoxes(std::vector<dRect> & Boxes, std::string file, std::string color){
   return;
 }
 
+inline bool idLessThan(const dRectWithId & A, const dRectWithId & B){
+  return A.id < B.id;
+}
+
+bool sameBoxes(vector<dRectWithId> A, vector<dRectWithId> B){
+  if (A.size() != B.size()) return false;
+  sort(A.begin(), A.end(), idLessThan);
+  sort(B.begin(), B.end(), idLessThan);
+  for (int s = 0; s < (int)A.size(); s++){
+    if ( !(A[s] == B[s]) || A[s].id != B[s].id ) return false;
+  }
+  return true;
+}
+
+// The bounds of each node must hold those of its children
+bool areNodesRight(const boxTree<dRectWithId> & T){
+  for (int l = 1; l < T.getNumLevels(); l++){
+    int numChildren = T.getNumNodes(l - 1);
+    for (int k = 0; k < T.getNumNodes(l); k++){
+      dRect N = T.getNodeBox(l, k);
+      for (int c = boxTreeFanout*k; c < min(boxTreeFanout*(k + 1), numChildren); c++){
+        if (!N.contains(T.getNodeBox(l - 1, c))) return false;
+      }
+    }
+  }
+  return T.getNumLevels() == 0 || T.getNumNodes(T.getNumLevels() - 1) == 1;
+}
+
+// Search the tree every way it can be searched and compare with
+// going through all the boxes
+bool isSearchRight(const boxTree<dRectWithId> & T, const vector<dRectWithId> & Boxes,
+                   double xl, double yl, double xh, double yh){
+
+  vector<dRectWithId> outBoxes, outBoxes2, visited;
+  T.getBoxesInRegion(xl, yl, xh, yh, outBoxes);
+  T.visitBoxesInRegion(xl, yl, xh, yh,
+                       [&visited](dRectWithId const& B){ visited.push_back(B); });
+  vector<int> ids;
+  T.getIdsInRegion(xl, yl, xh, yh, ids);
+
+  for (int s = 0; s < (int)Boxes.size(); s++){
+    const dRectWithId & B = Boxes[s];
+    if (boxesIntersect(B.xl, B.yl, B.xh, B.yh, xl, yl, xh, yh)){
+      outBoxes2.push_back(B);
+    }
+  }
+
+  vector<int> ids2;
+  for (int s = 0; s < (int)outBoxes2.size(); s++) ids2.push_back(outBoxes2[s].id);
+  sort(ids.begin(), ids.end());
+  sort(ids2.begin(), ids2.end());
+
+  if (sameBoxes(outBoxes, outBoxes2) && sameBoxes(visited, outBoxes2) && ids == ids2)
+    return true;
+
+  cerr << "Have a problem!" << endl;
+  cout << "In:   " << Boxes.size()     << endl;
+  cout << "Out:  " << outBoxes.size()  << endl;
+  cout << "Out2: " << outBoxes2.size() << endl;
+
+  vector<dRectWithId> W, all = Boxes;
+  W.push_back(dRectWithId(xl, yl, xh, yh));
+  saveBoxes( all,       "all.xg",       "blue"   );
+  saveBoxes( W,         "window.xg",    "green"  );
+  saveBoxes( outBoxes,  "outBoxes.xg",  "white"  );
+  saveBoxes( outBoxes2, "outBoxes2.xg", "yellow" );
+  return false;
+}
 
 int main(int argc, char** argv){
 
- srand(time(NULL));
+ unsigned int seed = (argc > 1) ? atoi(argv[1]) : time(NULL);
+ srand(seed);
+ cout << "Seed: " << seed << endl;
 
- int numBoxes   = 1000;
  int L          = 100, w = 10; // To determine region size and box width 
  int numRepeats = 1;           // How many times to repeat each experiment
- int numRuns    = 10000;       // How many experiments
+ int numRuns    = 2000;        // How many experiments
+ int numQueries = 5;           // Searches per experiment and per tree state
  bool doTiming  = false; 
 
  if (doTiming){
    numRuns = 1;
+   numQueries = 1;
    numRepeats = 100000;
  }
- 
- vector<dRect> Boxes;
+
+ // Tree sizes around those where a level is added
+ int sizes[] = {0, 1, 2, boxTreeFanout - 1, boxTreeFanout, boxTreeFanout + 1,
+                boxTreeFanout*boxTreeFanout, boxTreeFanout*boxTreeFanout + 1, 1000};
+ int numSizes = sizeof(sizes)/sizeof(sizes[0]);
+
+ vector<dRectWithId> Boxes;
 
  for (int q = 0; q < numRuns; q++){
-   
-    Boxes.clear();
 
+   int numBoxes = (q < numSizes) ? sizes[q] : rand()%3000;
+   Boxes.clear();
    for (int s = 0; s < numBoxes; s++){
      double xl = rand_ab(-L, L), xh = xl + rand_ab(0, w);
      double yl = rand_ab(-L, L), yh = yl + rand_ab(0, w);
-     Boxes.push_back(dRect(xl, yl, xh, yh));
+     Boxes.push_back(dRectWithId(xl, yl, xh, yh, s));
    }
- 
-   boxTree<dRect> T;
-   // Boxes will be reordered but otherwise unchanged inside of this function.
-   // Do not modify this vector afterward.
+
+   boxTree<dRectWithId> T;
    T.formTreeOfBoxes(Boxes); 
 
-   double L2 = 2*L;
-   double xl = rand_ab(-L2, L2), xh = xl + rand_ab(0, L2);
-   double yl = rand_ab(-L2, L2), yh = yl + rand_ab(0, L2);
-
-   time_t Start_t = 0, End_t = 0;
-   double time_task;
-   
-   vector<dRect> outBoxes;
-   if(doTiming) Start_t = time(NULL);    //record time that task 1 begins
-   for (int v = 0; v < numRepeats; v++){
-     T.getBoxesInRegion(xl, yl, xh, yh, outBoxes);
-   }
-   if(doTiming){
-     End_t = time(NULL);  
-     time_task = difftime(End_t, Start_t);
-     cout << "Tree search time: " << time_task << endl;
+   if (!areNodesRight(T)){
+     cerr << "Node bounds do not hold their boxes in run " << q
+          << " with seed " << seed << endl;
+     return 1;
    }
 
-   sort(outBoxes.begin(), outBoxes.end(), lexLessThan<dRect>);
- 
-   vector<dRect> outBoxes2; // Must be different than Boxes
-   outBoxes2.resize(numBoxes);
-   
-   if(doTiming) Start_t = time(NULL);
-   for (int v = 0; v < numRepeats; v++){
-     outBoxes2.clear();
-     for (int s = 0; s < (int)Boxes.size(); s++){
-       const dRect & B = Boxes[s];
-       if (boxesIntersect(B.xl, B.yl, B.xh, B.yh, xl, yl, xh, yh)){
-         outBoxes2.push_back(B);
+   // The same tree, formed from its packed boxes as when read from disk
+   boxTree<dRectWithId> T2;
+   const vector<dRectWithId> & packed = T.getPackedBoxes();
+   T2.setFormedTree(vecPtr(packed), packed.size());
+
+   double L2 = 2*L;
+   for (int v = 0; v < numQueries; v++){
+     double xl = rand_ab(-L2, L2), xh = xl + rand_ab(0, L2);
+     double yl = rand_ab(-L2, L2), yh = yl + rand_ab(0, L2);
+
+     if(doTiming){
+       vector<dRectWithId> outBoxes;
+       time_t Start_t = time(NULL);
+       for (int r = 0; r < numRepeats; r++) T.getBoxesInRegion(xl, yl, xh, yh, outBoxes);
+       cout << "Tree search time: " << difftime(time(NULL), Start_t) << endl;
+       Start_t = time(NULL);
+       for (int r = 0; r < numRepeats; r++){
+         outBoxes.clear();
+         for (int s = 0; s < (int)Boxes.size(); s++){
+           const dRect & B = Boxes[s];
+           if (boxesIntersect(B.xl, B.yl, B.xh, B.yh, xl, yl, xh, yh))
+             outBoxes.push_back(Boxes[s]);
+         }
        }
+       cout << "Brute force search time: " << difftime(time(NULL), Start_t) << endl;
+     }
+
+     if (!isSearchRight(T, Boxes, xl, yl, xh, yh) ||
+         !isSearchRight(T2, Boxes, xl, yl, xh, yh)){
+       cerr << "In run " << q << " with seed " << seed << endl;
+       return 1;
      }
    }
-   if(doTiming){
-     End_t = time(NULL);
-     time_task = difftime(End_t, Start_t);
-     cout << "Brute force search time: " << time_task << endl;
+
+   // Remove some boxes and insert others, then renumber them all,
+   // removing some more. Do the same to the list of boxes.
+   int nextId = numBoxes;
+   int numChanges = rand()%(numBoxes + 2);
+   for (int c = 0; c < numChanges; c++){
+     if (rand()%2 == 0 && !Boxes.empty()){
+       int s = rand()%Boxes.size();
+       T.removeBox(Boxes[s].id);
+       Boxes[s] = Boxes.back();
+       Boxes.pop_back();
+     }else{
+       double xl = rand_ab(-L, L), xh = xl + rand_ab(0, w);
+       double yl = rand_ab(-L, L), yh = yl + rand_ab(0, w);
+       dRectWithId B(xl, yl, xh, yh, nextId++);
+       T.insertBox(B);
+       Boxes.push_back(B);
+     }
    }
 
-   sort(outBoxes2.begin(), outBoxes2.end(), lexLessThan<dRect>);
-
-   bool haveProblem = false;
- 
-   int len = outBoxes.size();
-   if ( len != (int)outBoxes2.size() ){
-     haveProblem = true;
-   }else{
-     for (int s = 0; s < len; s++){
-       if ( outBoxes[s] != outBoxes2[s] ){
-         haveProblem = true;
-       }
+   for (int v = 0; v < numQueries; v++){
+     double xl = rand_ab(-L2, L2), xh = xl + rand_ab(0, L2);
+     double yl = rand_ab(-L2, L2), yh = yl + rand_ab(0, L2);
+     if (!isSearchRight(T, Boxes, xl, yl, xh, yh)){
+       cerr << "After " << numChanges << " changes in run " << q
+            << " with seed " << seed << endl;
+       return 1;
      }
    }
 
-   if (haveProblem){
-     cerr << "Have a problem!" << endl;
-
-     cout << "In:   " << Boxes.size()     << endl;
-     cout << "Out:  " << outBoxes.size()  << endl;
-     cout << "Out2: " << outBoxes2.size() << endl;
-     
-     vector<dRect> W;
-     W.push_back(dRect(xl, yl, xh, yh));
-   
-     saveBoxes( Boxes,    "all.xg",       "blue"   );
-     saveBoxes( W,        "window.xg",    "green"  );
-     saveBoxes( outBoxes, "outBoxes.xg",  "white"  );
-     saveBoxes( outBoxes, "outBoxes2.xg", "yellow" );
-     exit(1);
+   vector<int> newIds(nextId);
+   for (int s = 0; s < nextId; s++) newIds[s] = (rand()%8 == 0) ? -1 : nextId - 1 - s;
+   T.remapIds(newIds);
+   int numKept = 0;
+   for (int s = 0; s < (int)Boxes.size(); s++){
+     Boxes[s].id = newIds[Boxes[s].id];
+     if (Boxes[s].id >= 0) Boxes[numKept++] = Boxes[s];
    }
+   Boxes.resize(numKept);
 
-   if (q%1000 == 0){
-     cout << "In:   " << Boxes.size()     << endl;
-     cout << "Out:  " << outBoxes.size()  << endl;
-     cout << "Out2: " << outBoxes2.size() << endl;
+   if (T.size() != Boxes.size()){
+     cerr << "The tree has " << T.size() << " boxes instead of " << Boxes.size()
+          << " in run " << q << " with seed " << seed << endl;
+     return 1;
+   }
+
+   for (int v = 0; v < numQueries; v++){
+     double xl = rand_ab(-L2, L2), xh = xl + rand_ab(0, L2);
+     double yl = rand_ab(-L2, L2), yh = yl + rand_ab(0, L2);
+     if (!isSearchRight(T, Boxes, xl, yl, xh, yh)){
+       cerr << "After renumbering in run " << q << " with seed " << seed << endl;
+       return 1;
+     }
    }
-   
+
+   if (q%500 == 0){
+     cout << "Boxes: " << Boxes.size() << endl;
+   }
+
  }
 
+ cout << "Compared " << numRuns << " trees" << endl;
+
  return 0;
 }
@@ -0,0 +1,335 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <ctime>
+#include <vector>
+#include <dPoly.h>
+#include <cutPoly.h>
+
+// Cut random polygons with random boxes and compare with the earlier
+// cutPoly(), which cut all the polygons by each of the four sides of
+// the box in turn. The results must be the same, vertex for vertex.
+// Likewise for polygonal lines, which were cut as polygons going
+// forward and then back along the line. Where a line crosses a side
+// of the box twice at the same point that trick could join two runs,
+// reverse one or lose one, so there the runs are instead checked
+// against the edges of the line cut one at a time.
+// Coordinates are often integers, so that many vertices and edges
+// fall on the sides of the box.
+
+using namespace std;
+using namespace utils;
+
+double rand_ab(double a, double b){
+  assert(a <= b);
+  return a + rand()%max(int(b - a), 1);
+}
+
+double rand_coord(double a, double b){
+  if (rand()%2 == 0) return rand_ab(a, b);
+  return a + (b - a)*(rand()/(double)RAND_MAX);
+}
+
+void refCutPoly(int numPolys, const int * numVerts,
+                const double * xv, const double * yv,
+                double xll, double yll, double xur, double yur,
+                vector<double> & cutX, vector<double> & cutY,
+                vector<int> & cutNumPolys){
+
+  double cutParams[] = {
+   -1,  0, xll, //  -- left cut
+    1,  0, xur, //  -- right cut
+    0, -1, yll, //  -- bottom cut
+    0,  1, yur  //  -- top cut
+  };
+
+  int totalNumVerts = 0;
+  for (int s = 0; s < numPolys; s++) totalNumVerts += numVerts[s];
+
+  vector<double> Xin(xv, xv + totalNumVerts);
+  vector<double> Yin(yv, yv + totalNumVerts);
+  vector<int>    Pin(numVerts, numVerts + numPolys);
+
+  vector<double> cutHalfX, cutHalfY, Xout, Yout;
+  vector<int>    cutHalfP, Pout;
+
+  for (int c = 0; c < 4; c++){
+
+    Pout.clear(); Xout.clear(); Yout.clear();
+
+    double nx   = cutParams[3*c + 0];
+    double ny   = cutParams[3*c + 1];
+    double H    = cutParams[3*c + 2];
+    double dotH = (nx + ny)*H;
+
+    int start = 0;
+    for (int pIter = 0; pIter < (int)Pin.size(); pIter++){
+
+      if (pIter > 0) start += Pin[pIter - 1];
+
+      int numV = Pin[pIter];
+      if (numV == 0) continue;
+
+      cutToHalfSpace(nx, ny, dotH,
+                     numV, vecPtr(Xin) + start, vecPtr(Yin) + start,
+                     cutHalfX, cutHalfY, cutHalfP);
+
+      for (int pIterCut = 0; pIterCut < (int)cutHalfP.size(); pIterCut++){
+        if (cutHalfP[pIterCut] > 0) Pout.push_back( cutHalfP[pIterCut] );
+      }
+      for (int vIter = 0; vIter < (int)cutHalfX.size(); vIter++){
+        Xout.push_back( cutHalfX[vIter] );
+        Yout.push_back( cutHalfY[vIter] );
+      }
+    }
+
+    Pin = Pout; Xin = Xout; Yin = Yout;
+  }
+
+  cutNumPolys = Pout; cutX = Xout; cutY = Yout;
+}
+
+void refCutPolyLine(int numVerts, const double * xv, const double * yv,
+                    double xll, double yll, double xur, double yur,
+                    vector<double> & cutX, vector<double> & cutY,
+                    vector<int> & cutNumPolys){
+
+  vector<double> lXv, lYv, lCutX, lCutY;
+  vector<int> lCutNumPolys;
+  for (int s = 0; s < numVerts; s++){
+    lXv.push_back(xv[s]);
+    lYv.push_back(yv[s]);
+  }
+  for (int s = numVerts - 1; s >= 0; s--){
+    lXv.push_back(xv[s]);
+    lYv.push_back(yv[s]);
+  }
+  int lNumVerts = lXv.size();
+
+  refCutPoly(1, &lNumVerts, vecPtr(lXv), vecPtr(lYv),
+             xll, yll, xur, yur, lCutX, lCutY, lCutNumPolys);
+
+  cutX.clear(); cutY.clear(); cutNumPolys.clear();
+  int start = 0;
+  for (int pIter = 0; pIter < (int)lCutNumPolys.size(); pIter++){
+    if (pIter > 0) start += lCutNumPolys[pIter - 1];
+    int half = lCutNumPolys[pIter]/2;
+    cutNumPolys.push_back(half);
+    for (int vIter = 0; vIter < half; vIter++){
+      cutX.push_back(lCutX[start + vIter]);
+      cutY.push_back(lCutY[start + vIter]);
+    }
+  }
+}
+
+void printCut(string name, const vector<double> & X, const vector<double> & Y,
+              const vector<int> & P){
+  cout << name << ":" << endl;
+  int start = 0;
+  for (int p = 0; p < (int)P.size(); p++){
+    for (int v = 0; v < P[p]; v++) cout << X[start + v] << ' ' << Y[start + v] << endl;
+    cout << "NEXT" << endl;
+    start += P[p];
+  }
+}
+
+bool sameCut(const vector<double> & X1, const vector<double> & Y1, const vector<int> & P1,
+             const vector<double> & X2, const vector<double> & Y2, const vector<int> & P2){
+  return X1 == X2 && Y1 == Y2 && P1 == P2;
+}
+
+// The edges of the runs, leaving out those of zero length
+void drawnEdges(const vector<double> & X, const vector<double> & Y,
+                const vector<int> & P, vector<seg> & edges){
+  edges.clear();
+  int start = 0;
+  for (int p = 0; p < (int)P.size(); p++){
+    for (int v = start; v + 1 < start + P[p]; v++){
+      if (X[v] == X[v + 1] && Y[v] == Y[v + 1]) continue;
+      edges.push_back(seg(X[v], Y[v], X[v + 1], Y[v + 1]));
+    }
+    start += P[p];
+  }
+}
+
+// Clip the segment to the box, by brute force. Return false if
+// nothing of it of positive length is left.
+bool clipSeg(double xll, double yll, double xur, double yur, seg & S){
+  double t0 = 0, t1 = 1;
+  double dx = S.endx - S.begx, dy = S.endy - S.begy;
+  double p[] = {-dx, dx, -dy, dy};
+  double q[] = {S.begx - xll, xur - S.begx, S.begy - yll, yur - S.begy};
+  for (int c = 0; c < 4; c++){
+    if (p[c] == 0){
+      if (q[c] < 0) return false;
+      continue;
+    }
+    double t = q[c]/p[c];
+    if (p[c] < 0) t0 = max(t0, t);
+    else          t1 = min(t1, t);
+  }
+  if (t0 >= t1) return false;
+  S = seg(S.begx + t0*dx, S.begy + t0*dy, S.begx + t1*dx, S.begy + t1*dy);
+  return true;
+}
+
+bool sameEdge(const seg & a, const seg & b, double tol){
+  bool same = abs(a.begx - b.begx) <= tol && abs(a.begy - b.begy) <= tol &&
+    abs(a.endx - b.endx) <= tol && abs(a.endy - b.endy) <= tol;
+  bool rev  = abs(a.begx - b.endx) <= tol && abs(a.begy - b.endy) <= tol &&
+    abs(a.endx - b.begx) <= tol && abs(a.endy - b.begy) <= tol;
+  return same || rev;
+}
+
+// An edge along a side of the box, or one of about zero length at a
+// corner, may or may not be kept
+bool isOptional(double xll, double yll, double xur, double yur, const seg & S,
+                double tol){
+  return S.length() <= tol || (S.begx == xll && S.endx == xll) || (S.begx == xur && S.endx == xur) ||
+    (S.begy == yll && S.endy == yll) || (S.begy == yur && S.endy == yur);
+}
+
+// Check that the runs of a cut line are made of the pieces of its
+// edges inside the box, each used once
+bool isLineCutRight(int numVerts, const double * xv, const double * yv,
+                    double xll, double yll, double xur, double yur,
+                    const vector<double> & cutX, const vector<double> & cutY,
+                    const vector<int> & cutP){
+
+  vector<seg> expected, got;
+  for (int v = 0; v + 1 < numVerts; v++){
+    seg S(xv[v], yv[v], xv[v + 1], yv[v + 1]);
+    if (clipSeg(xll, yll, xur, yur, S)) expected.push_back(S);
+  }
+  drawnEdges(cutX, cutY, cutP, got);
+
+  double tol = 1e-10*(1.0 + abs(xll) + abs(yll) + abs(xur) + abs(yur));
+  vector<bool> used(expected.size(), false);
+  for (int g = 0; g < (int)got.size(); g++){
+    bool found = false;
+    for (int e = 0; e < (int)expected.size() && !found; e++){
+      if (used[e] || !sameEdge(got[g], expected[e], tol)) continue;
+      used[e] = found = true;
+    }
+    if (!found && !isOptional(xll, yll, xur, yur, got[g], tol)) return false;
+  }
+  for (int e = 0; e < (int)expected.size(); e++){
+    if (!used[e] && !isOptional(xll, yll, xur, yur, expected[e], tol)) return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv){
+
+  unsigned int seed = (argc > 1) ? atoi(argv[1]) : time(NULL);
+  srand(seed);
+  cout << "Seed: " << seed << endl;
+
+  int numRuns = 20000;
+  int L = 20; // the region size
+
+  cutPolyBuffers buf; // reused across runs, as in dPoly::clipPolygons
+  int numCut = 0, numCutLines = 0, numLinesRejoined = 0;
+
+  for (int q = 0; q < numRuns; q++){
+
+    vector<double> xv, yv;
+    vector<int> numVerts;
+    int numPolys = 1 + rand()%4;
+    for (int p = 0; p < numPolys; p++){
+      int numV = 1 + rand()%12;
+      numVerts.push_back(numV);
+      for (int v = 0; v < numV; v++){
+        xv.push_back(rand_coord(-L, L));
+        yv.push_back(rand_coord(-L, L));
+      }
+    }
+
+    double xll = rand_coord(-L, L), xur = xll + rand_coord(0, L);
+    double yll = rand_coord(-L, L), yur = yll + rand_coord(0, L);
+
+    vector<double> cutX1, cutY1, cutX2, cutY2, cutX3, cutY3;
+    vector<int> cutP1, cutP2, cutP3;
+    refCutPoly(numPolys, vecPtr(numVerts), vecPtr(xv), vecPtr(yv),
+               xll, yll, xur, yur, cutX1, cutY1, cutP1);
+    cutPoly(numPolys, vecPtr(numVerts), vecPtr(xv), vecPtr(yv),
+            xll, yll, xur, yur, cutX2, cutY2, cutP2);
+    cutPoly(numPolys, vecPtr(numVerts), vecPtr(xv), vecPtr(yv),
+            xll, yll, xur, yur, cutX3, cutY3, cutP3, buf);
+
+    if (!sameCut(cutX1, cutY1, cutP1, cutX2, cutY2, cutP2) ||
+        !sameCut(cutX1, cutY1, cutP1, cutX3, cutY3, cutP3)){
+      cerr << "Have a problem in run " << q << " with seed " << seed << endl;
+      cout.precision(17);
+      cout << "Box: " << xll << ' ' << yll << ' ' << xur << ' ' << yur << endl;
+      int start = 0;
+      for (int p = 0; p < numPolys; p++){
+        for (int v = 0; v < numVerts[p]; v++)
+          cout << xv[start + v] << ' ' << yv[start + v] << endl;
+        cout << "NEXT" << endl;
+        start += numVerts[p];
+      }
+      printCut("Expected", cutX1, cutY1, cutP1);
+      printCut("Got", cutX2, cutY2, cutP2);
+      printCut("Got with buffers", cutX3, cutY3, cutP3);
+      return 1;
+    }
+
+    if (!cutP1.empty()) numCut++;
+
+    // The first polygon, as a polygonal line
+    refCutPolyLine(numVerts[0], vecPtr(xv), vecPtr(yv),
+                   xll, yll, xur, yur, cutX1, cutY1, cutP1);
+    cutPolyLine(numVerts[0], vecPtr(xv), vecPtr(yv),
+                xll, yll, xur, yur, cutX2, cutY2, cutP2);
+    cutPolyLine(numVerts[0], vecPtr(xv), vecPtr(yv),
+                xll, yll, xur, yur, cutX3, cutY3, cutP3, buf);
+
+    bool sameLine = sameCut(cutX2, cutY2, cutP2, cutX3, cutY3, cutP3);
+    if (sameLine && !sameCut(cutX1, cutY1, cutP1, cutX2, cutY2, cutP2)){
+      sameLine = isLineCutRight(numVerts[0], vecPtr(xv), vecPtr(yv),
+                                xll, yll, xur, yur, cutX2, cutY2, cutP2);
+      numLinesRejoined++;
+    }
+    if (!sameLine){
+      cerr << "Have a problem with a line in run " << q << " with seed " << seed << endl;
+      cout.precision(17);
+      cout << "Box: " << xll << ' ' << yll << ' ' << xur << ' ' << yur << endl;
+      for (int v = 0; v < numVerts[0]; v++) cout << xv[v] << ' ' << yv[v] << endl;
+      printCut("Expected", cutX1, cutY1, cutP1);
+      printCut("Got", cutX2, cutY2, cutP2);
+      printCut("Got with buffers", cutX3, cutY3, cutP3);
+      return 1;
+    }
+
+    if (!cutP1.empty()) numCutLines++;
+  }
+
+  cout << "Compared " << numRuns << " cuts, " << numCut << " of them not empty" << endl;
+  cout << "Compared " << numRuns << " line cuts, " << numCutLines << " of them not empty, "
+       << numLinesRejoined << " with runs joined differently" << endl;
+
+  return 0;
+}
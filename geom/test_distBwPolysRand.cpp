@@ -0,0 +1,208 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <cfloat>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <dPoly.h>
+#include <dTree.h>
+#include <kdTree.h>
+#include <polyUtils.h>
+#include <geomUtils.h>
+
+// Compare findDistanceBwPolys with the earlier search, which looked
+// for the closest edge to each vertex on its own, and with
+// findDistanceBwPolysBruteForce, which goes through all edges. The
+// second set of polygons is often the first one with a few vertices
+// moved, as when comparing two versions of a layout, so that most
+// distances are zero.
+
+using namespace std;
+using namespace utils;
+
+double rand_ab(double a, double b){
+  assert(a <= b);
+  return a + rand()%max(int(b - a), 1);
+}
+
+void randomPolys(int L, dPoly & poly){
+  poly.reset();
+  int numPolys = rand()%40;
+  for (int p = 0; p < numPolys; p++){
+    int numV = 1 + rand()%10;
+    vector<double> xv, yv;
+    for (int v = 0; v < numV; v++){
+      xv.push_back(rand_ab(-L, L));
+      yv.push_back(rand_ab(-L, L));
+    }
+    poly.appendPolygon(numV, vecPtr(xv), vecPtr(yv), rand()%2 == 0, "yellow", "");
+  }
+}
+
+// The same polygons, with a few vertices moved and a few polygons
+// left out
+void perturbPolys(int L, const dPoly & poly, dPoly & poly2){
+  poly2.reset();
+  const double * xv = poly.get_xv();
+  const double * yv = poly.get_yv();
+  const int * numVerts = poly.get_numVerts();
+  int start = 0;
+  for (int p = 0; p < poly.get_numPolys(); p++){
+    int numV = numVerts[p];
+    vector<double> x(xv + start, xv + start + numV), y(yv + start, yv + start + numV);
+    start += numV;
+    if (rand()%10 == 0) continue;
+    for (int v = 0; v < numV; v++){
+      if (rand()%20 != 0) continue;
+      x[v] += rand_ab(-L/10, L/10);
+      y[v] += rand_ab(-L/10, L/10);
+    }
+    poly2.appendPolygon(numV, vecPtr(x), vecPtr(y), poly.get_isPolyClosed()[p] != 0,
+                        "red", "");
+  }
+}
+
+void asPointCloud(const dPoly & poly, dPoly & cloud){
+  vector<dPoint> P;
+  for (int v = 0; v < poly.get_totalNumVerts(); v++)
+    P.push_back(dPoint(poly.get_xv()[v], poly.get_yv()[v]));
+  cloud.reset();
+  cloud.set_pointCloud(P, "green", "");
+}
+
+// What findDistanceFromPoly1ToPoly2 did before the search for the
+// closest edges was done for blocks of points at once
+void refDistanceFromPoly1ToPoly2(const dPoly & poly1, const dPoly & poly2,
+                                 vector<segDist> & distVec){
+  distVec.clear();
+  if (poly1.get_totalNumVerts() == 0 || poly2.get_totalNumVerts() == 0) return;
+  for (int t = 0; t < poly1.get_totalNumVerts(); t++){
+    double x = poly1.get_xv()[t], y = poly1.get_yv()[t];
+    double closestX, closestY, closestDist;
+    if (poly2.isPointCloud()){
+      PointWithId closestVertex;
+      poly2.getPointTree()->findClosestVertexToPoint(x, y, closestVertex, closestDist);
+      closestX = closestVertex.x;
+      closestY = closestVertex.y;
+    }else{
+      seg closestEdge;
+      poly2.getEdgeTree()->findClosestEdgeToPoint(x, y, closestEdge, closestDist,
+                                                  closestX, closestY);
+    }
+    if (closestDist > 0) distVec.push_back(segDist(x, y, closestX, closestY, closestDist));
+  }
+}
+
+void refDistanceBwPolys(const dPoly & poly1, const dPoly & poly2,
+                        vector<segDist> & distVec){
+  vector<segDist> l_distVec;
+  refDistanceFromPoly1ToPoly2(poly1, poly2, distVec);
+  refDistanceFromPoly1ToPoly2(poly2, poly1, l_distVec);
+  distVec.insert(distVec.end(), l_distVec.begin(), l_distVec.end());
+  sort(distVec.begin(), distVec.end(), segDistGreaterThan);
+}
+
+// The same distances from the same points. Where two edges are equally
+// close either may be found, so the closest points need only be at
+// the right distance.
+bool sameDistances(const vector<segDist> & A, const vector<segDist> & B, double tol){
+  if (A.size() != B.size()) return false;
+  for (int s = 0; s < (int)A.size(); s++){
+    if (abs(A[s].dist - B[s].dist) > tol || A[s].begx != B[s].begx ||
+        A[s].begy != B[s].begy) return false;
+    if (abs(A[s].length() - A[s].dist) > tol) return false;
+  }
+  return true;
+}
+
+// By the point the distance is from. The distances of the brute
+// force search may differ in the last bits, so they are not sorted by
+// distance.
+bool begLessThan(const segDist & s, const segDist & t){
+  if (s.begx != t.begx) return s.begx < t.begx;
+  if (s.begy != t.begy) return s.begy < t.begy;
+  return s.dist < t.dist;
+}
+
+int main(int argc, char** argv){
+
+  unsigned int seed = (argc > 1) ? atoi(argv[1]) : time(NULL);
+  srand(seed);
+  cout << "Seed: " << seed << endl;
+
+  int numRuns = 2000;
+  int L       = 50; // the region size
+  double tol  = 1e-10*L;
+
+  int numDists = 0;
+  for (int q = 0; q < numRuns; q++){
+
+    dPoly poly1, poly2, cloud;
+    randomPolys(L, poly1);
+    if (rand()%2 == 0) perturbPolys(L, poly1, poly2);
+    else               randomPolys(L, poly2);
+    if (rand()%8 == 0){
+      asPointCloud(poly2, cloud);
+      poly2 = cloud;
+    }
+
+    vector<segDist> distVec, refVec, bruteVec, brute2Vec;
+    findDistanceBwPolys(poly1, poly2, distVec);
+    refDistanceBwPolys(poly1, poly2, refVec);
+
+    if (!sameDistances(distVec, refVec, 0.0)){
+      cerr << "Have a problem against the earlier search in run " << q
+           << " with seed " << seed << endl;
+      cout << "Got " << distVec.size() << " distances, expected "
+           << refVec.size() << endl;
+      return 1;
+    }
+
+    // The brute force search goes one way and keeps the zero distances
+    if (!poly2.isPointCloud()){
+      findDistanceFromPoly1ToPoly2(poly1, poly2, distVec);
+      findDistanceBwPolysBruteForce(poly1, poly2, brute2Vec);
+      for (int s = 0; s < (int)brute2Vec.size(); s++)
+        if (brute2Vec[s].dist > 0) bruteVec.push_back(brute2Vec[s]);
+      sort(distVec.begin(), distVec.end(), begLessThan);
+      sort(bruteVec.begin(), bruteVec.end(), begLessThan);
+      if (!sameDistances(distVec, bruteVec, tol)){
+        cerr << "Have a problem against brute force in run " << q
+             << " with seed " << seed << endl;
+        cout << "Got " << distVec.size() << " distances, expected "
+             << bruteVec.size() << endl;
+        return 1;
+      }
+    }
+
+    numDists += refVec.size();
+  }
+
+  cout << "Compared " << numRuns << " pairs of polygons, with " << numDists
+       << " distances" << endl;
+
+  return 0;
+}
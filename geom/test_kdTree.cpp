@@ -79,8 +79,8 @@ int main(int argc, char** argv){
   }
 
   assert(outPts.size() == outPts2.size());
-  sort(outPts.begin(),  outPts.end(),  lexLessThan);
-  sort(outPts2.begin(), outPts2.end(), lexLessThan);
+  sort(outPts.begin(),  outPts.end(),  utils::lexLessThan);
+  sort(outPts2.begin(), outPts2.end(), utils::lexLessThan);
   
   for (int s = 0; s < (int)outPts.size(); s++){
     const PointWithId & P  = outPts[s];
@@ -0,0 +1,275 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <cfloat>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <kdTree.h>
+#include <dTree.h>
+#include <dPoly.h>
+
+// Compare the k-nearest, radius and batch searches of kdTree and
+// edgeTree with going through all the vertices or edges. Coordinates
+// are small integers, so there are many ties and many points exactly
+// at the search radius. Where there are ties any of the tied vertices
+// or edges may be found, so the distances are compared, and the ids
+// are checked to be distinct and at those distances.
+
+using namespace std;
+using namespace utils;
+
+double rand_ab(double a, double b){
+  assert(a <= b);
+  return a + rand()%max(int(b - a), 1);
+}
+
+double distSqToVertex(double x0, double y0, const PointWithId & P){
+  return (x0 - P.x)*(x0 - P.x) + (y0 - P.y)*(y0 - P.y);
+}
+
+double distSqToEdge(double x0, double y0, const seg & S){
+  double xval, yval, distSq = DBL_MAX;
+  minDistSqFromPtToSeg(x0, y0, S, xval, yval, distSq);
+  return distSq;
+}
+
+// The distances which the k nearest found must have
+vector<double> kSmallest(vector<double> distsSq, int k){
+  sort(distsSq.begin(), distsSq.end());
+  if ((int)distsSq.size() > k) distsSq.resize(k);
+  for (int s = 0; s < (int)distsSq.size(); s++) distsSq[s] = sqrt(distsSq[s]);
+  return distsSq;
+}
+
+bool areIdsDistinct(vector<int> ids){
+  sort(ids.begin(), ids.end());
+  return adjacent_find(ids.begin(), ids.end()) == ids.end();
+}
+
+bool checkVertices(const vector<PointWithId> & Pts, const kdTree & T,
+                   double x0, double y0, int k, double r){
+
+  vector<double> allDistsSq;
+  vector<int> inRadius;
+  for (int s = 0; s < (int)Pts.size(); s++){
+    double d = distSqToVertex(x0, y0, Pts[s]);
+    allDistsSq.push_back(d);
+    if (d <= r*r) inRadius.push_back(Pts[s].id);
+  }
+  vector<double> expected = kSmallest(allDistsSq, k);
+
+  // The k nearest
+  vector<PointWithId> vertices;
+  vector<double> dists;
+  T.findKNearestVertices(x0, y0, k, vertices, dists);
+  if (dists != expected) return false;
+  vector<int> ids;
+  for (int s = 0; s < (int)vertices.size(); s++){
+    if (sqrt(distSqToVertex(x0, y0, vertices[s])) != dists[s]) return false;
+    ids.push_back(vertices[s].id);
+  }
+  if (!areIdsDistinct(ids)) return false;
+
+  // The closest one
+  PointWithId closest;
+  double closestDist;
+  T.findClosestVertexToPoint(x0, y0, closest, closestDist);
+  if (expected.empty() ? closestDist != DBL_MAX : closestDist != expected[0]) return false;
+
+  // Those within the radius
+  T.findVerticesWithinRadius(x0, y0, r, vertices);
+  ids.clear();
+  for (int s = 0; s < (int)vertices.size(); s++) ids.push_back(vertices[s].id);
+  sort(ids.begin(), ids.end());
+  sort(inRadius.begin(), inRadius.end());
+  return ids == inRadius;
+}
+
+bool checkEdges(const vector<segWidthId> & Edges, const edgeTree & T,
+                double x0, double y0, int k, double r){
+
+  vector<double> allDistsSq;
+  vector<int> inRadius;
+  for (int s = 0; s < (int)Edges.size(); s++){
+    double d = distSqToEdge(x0, y0, Edges[s]);
+    allDistsSq.push_back(d);
+    if (d <= r*r) inRadius.push_back(Edges[s].id);
+  }
+  vector<double> expected = kSmallest(allDistsSq, k);
+
+  // The k nearest
+  vector<segWidthId> edges;
+  vector<double> dists;
+  T.findKNearestEdges(x0, y0, k, edges, dists);
+  if (dists != expected) return false;
+  vector<int> ids;
+  for (int s = 0; s < (int)edges.size(); s++){
+    if (sqrt(distSqToEdge(x0, y0, edges[s])) != dists[s]) return false;
+    ids.push_back(edges[s].id);
+  }
+  if (!areIdsDistinct(ids)) return false;
+
+  // The closest one
+  seg closest;
+  double closestDist, closestX, closestY;
+  T.findClosestEdgeToPoint(x0, y0, closest, closestDist, closestX, closestY);
+  if (expected.empty() ? closestDist != DBL_MAX : closestDist != expected[0]) return false;
+
+  // Those within the radius
+  T.findEdgesWithinRadius(x0, y0, r, edges);
+  ids.clear();
+  for (int s = 0; s < (int)edges.size(); s++) ids.push_back(edges[s].id);
+  sort(ids.begin(), ids.end());
+  sort(inRadius.begin(), inRadius.end());
+  return ids == inRadius;
+}
+
+int main(int argc, char** argv){
+
+  unsigned int seed = (argc > 1) ? atoi(argv[1]) : time(NULL);
+  srand(seed);
+  cout << "Seed: " << seed << endl;
+
+  int numRuns    = 500;
+  int numQueries = 50;
+  int L          = 50; // the region size
+
+  for (int q = 0; q < numRuns; q++){
+
+    // Random polygons and polygonal lines. Their vertices go in the
+    // kdTree and their edges in the edgeTree.
+    dPoly poly;
+    int numPolys = rand()%30;
+    for (int p = 0; p < numPolys; p++){
+      int numV = 1 + rand()%10;
+      vector<double> xv, yv;
+      for (int v = 0; v < numV; v++){
+        xv.push_back(rand_ab(-L, L));
+        yv.push_back(rand_ab(-L, L));
+      }
+      bool isPolyClosed = (rand()%2 == 0);
+      poly.appendPolygon(numV, vecPtr(xv), vecPtr(yv), isPolyClosed, "yellow", "");
+    }
+
+    int numVerts             = poly.get_totalNumVerts();
+    const double * xv        = poly.get_xv();
+    const double * yv        = poly.get_yv();
+    const int * numPolyVerts = poly.get_numVerts();
+    const vector<char> & isClosed = poly.get_isPolyClosed();
+
+    vector<PointWithId> Pts;
+    for (int s = 0; s < numVerts; s++) Pts.push_back(PointWithId(xv[s], yv[s], s));
+    vector<PointWithId> treePts = Pts; // reordered by the tree
+    kdTree VT;
+    VT.formTreeOfPoints(treePts);
+
+    // An edge has the index of its first vertex as id
+    vector<segWidthId> Edges;
+    int start = 0;
+    for (int p = 0; p < poly.get_numPolys(); p++){
+      int numV = numPolyVerts[p];
+      for (int v = 0; v < numV; v++){
+        if (!isClosed[p] && numV > 1 && v == numV - 1) continue;
+        int v2 = (v + 1)%numV;
+        Edges.push_back(segWidthId(xv[start + v], yv[start + v],
+                                   xv[start + v2], yv[start + v2], start + v));
+      }
+      start += numV;
+    }
+    edgeTree ET;
+    ET.putPolyEdgesInTree(poly);
+
+    // Query points, some of them at vertices
+    vector<double> qx, qy;
+    for (int v = 0; v < numQueries; v++){
+      if (numVerts > 0 && rand()%4 == 0){
+        int s = rand()%numVerts;
+        qx.push_back(xv[s]); qy.push_back(yv[s]);
+      }else{
+        qx.push_back(rand_ab(-2*L, 2*L)); qy.push_back(rand_ab(-2*L, 2*L));
+      }
+    }
+
+    int k = 1 + rand()%8;
+    for (int v = 0; v < numQueries; v++){
+      double r = rand_ab(0, L/2);
+      if (!checkVertices(Pts, VT, qx[v], qy[v], k, r)){
+        cerr << "Have a problem with vertices near " << qx[v] << ' ' << qy[v]
+             << " for k = " << k << " and r = " << r
+             << " in run " << q << " with seed " << seed << endl;
+        return 1;
+      }
+      if (!checkEdges(Edges, ET, qx[v], qy[v], k, r)){
+        cerr << "Have a problem with edges near " << qx[v] << ' ' << qy[v]
+             << " for k = " << k << " and r = " << r
+             << " in run " << q << " with seed " << seed << endl;
+        return 1;
+      }
+    }
+
+    // The batch searches must agree with searching one point at a
+    // time. For k = 1 the edges are searched for by blocks of points.
+    int batchK[] = {1, k};
+    for (int b = 0; b < (k > 1 ? 2 : 1); b++){
+      int kb = batchK[b];
+      vector<PointWithId> vertices, vertices1;
+      vector<segWidthId> edges, edges1;
+      vector<double> dists, dists1;
+      VT.findKNearestVertices(numQueries, vecPtr(qx), vecPtr(qy), kb, vertices, dists);
+      ET.findKNearestEdges(numQueries, vecPtr(qx), vecPtr(qy), kb, edges, dists1);
+      for (int v = 0; v < numQueries; v++){
+        vector<double> vd, ed;
+        VT.findKNearestVertices(qx[v], qy[v], kb, vertices1, vd);
+        ET.findKNearestEdges(qx[v], qy[v], kb, edges1, ed);
+        vd.resize(kb, DBL_MAX);
+        ed.resize(kb, DBL_MAX);
+        if (!equal(vd.begin(), vd.end(), dists.begin() + kb*v) ||
+            !equal(ed.begin(), ed.end(), dists1.begin() + kb*v)){
+          cerr << "Have a problem with the batch search for k = " << kb
+               << " near " << qx[v] << ' ' << qy[v]
+               << " in run " << q << " with seed " << seed << endl;
+          return 1;
+        }
+        for (int t = 0; t < kb; t++){
+          int vid = vertices[kb*v + t].id, eid = edges[kb*v + t].id;
+          if ((vid < 0) != (vd[t] == DBL_MAX) || (eid < 0) != (ed[t] == DBL_MAX) ||
+              (vid >= 0 && sqrt(distSqToVertex(qx[v], qy[v], Pts[vid])) != vd[t])){
+            cerr << "Have a problem with the batch ids for k = " << kb
+                 << " near " << qx[v] << ' ' << qy[v]
+                 << " in run " << q << " with seed " << seed << endl;
+            return 1;
+          }
+        }
+      }
+    }
+
+    if (q%100 == 0) cout << "Vertices: " << numVerts << ", edges: " << Edges.size() << endl;
+  }
+
+  cout << "Compared " << numRuns*numQueries << " searches" << endl;
+
+  return 0;
+}
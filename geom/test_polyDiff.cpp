@@ -0,0 +1,142 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <ctime>
+#include <limits>
+#include <vector>
+#include <set>
+#include <dPoly.h>
+#include <geomUtils.h>
+#include <polyUtils.h>
+
+// Compare findPolyDiff with the earlier way of finding the points in
+// one polygon and not the other, by putting the points in multisets.
+// The points are drawn from a small pool, so many are repeated a
+// different number of times in the two polygons. The pool has
+// negative and positive zero, infinities, and numbers of very
+// different sizes. Some runs have polygons large enough to be sorted
+// on all threads.
+
+using namespace std;
+using namespace utils;
+
+void refPolyDiff(const dPoly & P, const dPoly & Q,
+                 vector<dPoint> & vP, vector<dPoint> & vQ){
+
+  multiset<dPoint> mP; putPolyInMultiSet(P, mP);
+  multiset<dPoint> mQ; putPolyInMultiSet(Q, mQ);
+
+  // If a point is in mP, and also in mQ, mark it as being in mP and wipe it from mQ
+  vector<dPoint> shared;
+  multiset<dPoint>::iterator ip, iq;
+  for (ip = mP.begin(); ip != mP.end(); ip++) {
+    iq = mQ.find(*ip);
+    if ( iq != mQ.end() ) {
+      shared.push_back(*ip);
+      mQ.erase(iq);
+    }
+  }
+  for (int s = 0; s < (int)shared.size(); s++) {
+    ip = mP.find(shared[s]);
+    if ( ip != mP.end() ) mP.erase(ip);
+  }
+
+  vP.assign(mP.begin(), mP.end());
+  vQ.assign(mQ.begin(), mQ.end());
+}
+
+bool samePoints(const vector<dPoint> & A, const vector<dPoint> & B){
+  if (A.size() != B.size()) return false;
+  for (int s = 0; s < (int)A.size(); s++){
+    if (A[s].x != B[s].x || A[s].y != B[s].y) return false;
+  }
+  return true;
+}
+
+void randomPoly(const vector<double> & pool, int numPolys, dPoly & poly){
+  poly.reset();
+  for (int p = 0; p < numPolys; p++){
+    int numV = 1 + rand()%10;
+    vector<double> xv, yv;
+    for (int v = 0; v < numV; v++){
+      xv.push_back(pool[rand()%pool.size()]);
+      yv.push_back(pool[rand()%pool.size()]);
+    }
+    poly.appendPolygon(numV, vecPtr(xv), vecPtr(yv), rand()%2 == 0, "yellow", "");
+  }
+}
+
+int main(int argc, char** argv){
+
+  unsigned int seed = (argc > 1) ? atoi(argv[1]) : time(NULL);
+  srand(seed);
+  cout << "Seed: " << seed << endl;
+
+  int numRuns = 20000;
+
+  double inf = numeric_limits<double>::infinity();
+  double special[] = {0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 1e-300, -1e-300, 1e300, -1e300,
+                      numeric_limits<double>::denorm_min(), -numeric_limits<double>::max(),
+                      inf, -inf};
+  int numSpecial = sizeof(special)/sizeof(special[0]);
+
+  int numDiff = 0;
+  for (int q = 0; q < numRuns; q++){
+
+    // A pool of a few values, so that points repeat. A large polygon
+    // gets more of them, of all sizes.
+    bool isLarge = (q%2000 == 0);
+    vector<double> pool;
+    int poolSize = isLarge ? 300 : 1 + rand()%6;
+    for (int s = 0; s < poolSize; s++){
+      if (rand()%3 == 0) pool.push_back(special[rand()%numSpecial]);
+      else if (isLarge)  pool.push_back((rand()%2 ? 1 : -1)*ldexp(rand()/(double)RAND_MAX,
+                                                                  rand()%200 - 100));
+      else               pool.push_back(rand()%21 - 10 + (rand()%4)/4.0);
+    }
+
+    dPoly P, Q;
+    randomPoly(pool, isLarge ? 20000 : rand()%20, P);
+    randomPoly(pool, isLarge ? 20000 : rand()%20, Q);
+
+    vector<dPoint> vP, vQ, refP, refQ;
+    findPolyDiff(P, Q, vP, vQ);
+    refPolyDiff(P, Q, refP, refQ);
+
+    if (!samePoints(vP, refP) || !samePoints(vQ, refQ)){
+      cerr << "Have a problem in run " << q << " with seed " << seed << endl;
+      cout << "Got " << vP.size() << " and " << vQ.size() << " points, expected "
+           << refP.size() << " and " << refQ.size() << endl;
+      return 1;
+    }
+
+    numDiff += vP.size() + vQ.size();
+  }
+
+  cout << "Compared " << numRuns << " diffs, with " << numDiff << " points differing"
+       << endl;
+
+  return 0;
+}
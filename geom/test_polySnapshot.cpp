@@ -0,0 +1,250 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <ctime>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <dPoly.h>
+#include <polySnapshot.h>
+
+// Make random edits to a set of polygons, taking snapshots of them as
+// for undo, and bring back random earlier snapshots, continuing to
+// edit from there. What is brought back is compared with a copy of the
+// polygons made when the snapshot was taken: the arrays, the palettes
+// and the annotations. Polygons not edited since the previous snapshot
+// must keep their snapshots and change ids, and a small edit to a large
+// polygon must leave most of its chunks shared with that snapshot.
+
+using namespace std;
+using namespace utils;
+
+double rand_ab(double a, double b){
+  assert(a <= b);
+  return a + rand()%max(int(b - a), 1);
+}
+
+const char * colors[] = {"red", "green", "blue", "yellow", "white"};
+const char * layers[] = {"", "1:0", "2:0", "17:3"};
+
+void randPoly(int L, dPoly & poly){
+  poly.reset();
+  int numPolys = 1 + rand()%10;
+  for (int p = 0; p < numPolys; p++){
+    // Some are large enough to be cut into several chunks
+    int numV = (rand()%4 == 0) ? 1 + rand()%20000 : 1 + rand()%10;
+    vector<double> xv, yv;
+    for (int v = 0; v < numV; v++){
+      xv.push_back(rand_ab(-L, L));
+      yv.push_back(rand_ab(-L, L));
+    }
+    poly.appendPolygon(numV, vecPtr(xv), vecPtr(yv), rand()%2 == 0,
+                       colors[rand()%5], layers[rand()%4]);
+  }
+  vector<anno> annotations;
+  int numAnno = rand()%5;
+  for (int a = 0; a < numAnno; a++)
+    annotations.push_back(anno(rand_ab(-L, L), rand_ab(-L, L), colors[rand()%5]));
+  poly.set_annotations(annotations);
+}
+
+void randEdit(int L, dPoly & poly){
+
+  if (poly.get_numPolys() == 0){
+    randPoly(L, poly);
+    return;
+  }
+
+  int numP = poly.get_numPolys();
+  int p    = rand()%numP;
+  int numV = poly.get_numVerts()[p];
+  int v    = rand()%max(numV, 1);
+  double x = rand_ab(-L, L), y = rand_ab(-L, L);
+
+  int edit = rand()%8;
+  if (edit == 0){
+    poly.insertVertex(p, rand()%(numV + 1), x, y);
+  }else if (edit == 1 && numV > 1){
+    poly.eraseVertex(p, v);
+  }else if (edit == 2 && numV > 0){
+    poly.changeVertexValue(p, v, x, y);
+  }else if (edit == 3){
+    poly.shiftOnePoly(p, x, y);
+  }else if (edit == 4){
+    vector<int> mark(numP, 0);
+    mark[p] = 1;
+    poly.eraseMarkedPolys(mark);
+  }else if (edit == 5){
+    poly.set_color(colors[rand()%5]);
+  }else if (edit == 6){
+    poly.get_annotations().push_back(anno(x, y, layers[rand()%4]));
+  }else{
+    poly.get_angleAnno().push_back(anno(x, y, "90"));
+  }
+}
+
+bool samePolys(const dPoly & A, const dPoly & B){
+  int numV = A.get_totalNumVerts(), numP = A.get_numPolys();
+  if (numV != B.get_totalNumVerts() || numP != B.get_numPolys()) return false;
+  return
+    equal(A.get_xv(), A.get_xv() + numV, B.get_xv())                     &&
+    equal(A.get_yv(), A.get_yv() + numV, B.get_yv())                     &&
+    equal(A.get_numVerts(), A.get_numVerts() + numP, B.get_numVerts())   &&
+    A.get_isPolyClosed()              == B.get_isPolyClosed()            &&
+    A.get_colorIds()                  == B.get_colorIds()                &&
+    A.get_layerIds()                  == B.get_layerIds()                &&
+    A.get_colorPalette().names()      == B.get_colorPalette().names()    &&
+    A.get_layerPalette().names()      == B.get_layerPalette().names()    &&
+    A.get_annotations()               == B.get_annotations()             &&
+    A.get_angleAnno()                 == B.get_angleAnno()               &&
+    A.isPointCloud()                  == B.isPointCloud()                &&
+    A.get_changeId()                  == B.get_changeId();
+}
+
+// The chunks of S not found in 'prev'
+int numNewChunks(const chunkedArray<double> & S, const chunkedArray<double> & prev){
+  set<const vector<double>*> prevChunks;
+  for (size_t c = 0; c < prev.chunks.size(); c++) prevChunks.insert(prev.chunks[c].data.get());
+  int count = 0;
+  for (size_t c = 0; c < S.chunks.size(); c++)
+    count += (prevChunks.count(S.chunks[c].data.get()) == 0);
+  return count;
+}
+
+int main(int argc, char** argv){
+
+  unsigned int seed = (argc > 1) ? atoi(argv[1]) : time(NULL);
+  srand(seed);
+  cout << "Seed: " << seed << endl;
+
+  int numRuns  = 20;
+  int numSteps = 40;
+  int L        = 1000; // the region size
+  int numRestored = 0;
+
+  for (int q = 0; q < numRuns; q++){
+
+    vector<dPoly> polyVec(1 + rand()%5);
+    for (int s = 0; s < (int)polyVec.size(); s++) randPoly(L, polyVec[s]);
+
+    // The undo stack, and what it must bring back
+    vector<vector<polySnapshot>> snapStack;
+    vector<vector<dPoly>> polyStack;
+
+    for (int t = 0; t < numSteps; t++){
+
+      // Edit some of the polygons, and maybe add, remove or move one
+      int numEdits = rand()%3;
+      for (int e = 0; e < numEdits; e++) randEdit(L, polyVec[rand()%polyVec.size()]);
+      int change = rand()%8;
+      if (change == 0){
+        polyVec.push_back(dPoly());
+        randPoly(L, polyVec.back());
+      }else if (change == 1 && polyVec.size() > 1){
+        polyVec.erase(polyVec.begin() + rand()%polyVec.size());
+      }else if (change == 2){
+        swap(polyVec[rand()%polyVec.size()], polyVec[rand()%polyVec.size()]);
+      }
+
+      // One small edit to a large polygon. An inserted vertex shifts
+      // what follows it, yet that must be cut into the same chunks.
+      int big = -1, bigP = -1;
+      if (rand()%2 == 0){
+        for (int s = 0; s < (int)polyVec.size() && big < 0; s++){
+          for (int p = 0; p < polyVec[s].get_numPolys(); p++){
+            if (polyVec[s].get_numVerts()[p] < 10000) continue;
+            big = s; bigP = p;
+            break;
+          }
+        }
+      }
+      unsigned long long bigIdBefore = (big >= 0) ? polyVec[big].get_changeId() : 0;
+      if (big >= 0){
+        int numV = polyVec[big].get_numVerts()[bigP];
+        double x = rand_ab(-L, L), y = rand_ab(-L, L);
+        if (rand()%2 == 0) polyVec[big].changeVertexValue(bigP, rand()%numV, x, y);
+        else               polyVec[big].insertVertex(bigP, rand()%(numV + 1), x, y);
+      }
+
+      vector<polySnapshot> const * prev = snapStack.empty() ? NULL : &snapStack.back();
+      vector<polySnapshot> snaps;
+      takeSnapshots(polyVec, prev, snaps);
+
+      bool good = (snaps.size() == polyVec.size());
+      for (int s = 0; s < (int)snaps.size() && good; s++){
+        good = (snaps[s].changeId == polyVec[s].get_changeId());
+
+        // The snapshot of a polygon which did not change is reused
+        for (int r = 0; prev != NULL && r < (int)prev->size() && good; r++){
+          polySnapshot const& P = (*prev)[r];
+          if (P.changeId == snaps[s].changeId)
+            good = (P.xv.chunks.size() == snaps[s].xv.chunks.size() &&
+                    (P.xv.chunks.empty() ||
+                     P.xv.chunks[0].data == snaps[s].xv.chunks[0].data));
+        }
+      }
+
+      // The edit to the large polygon is in few chunks. Those of its
+      // x coordinates are compared with the snapshot it had before.
+      if (good && big >= 0 && prev != NULL){
+        for (int r = 0; r < (int)prev->size(); r++){
+          if ((*prev)[r].changeId != bigIdBefore) continue;
+          good = (numNewChunks(snaps[big].xv, (*prev)[r].xv) <= 3);
+        }
+      }
+
+      if (!good){
+        cerr << "Have a problem with taking snapshots in step " << t
+             << " of run " << q << " with seed " << seed << endl;
+        return 1;
+      }
+
+      snapStack.push_back(snaps);
+      polyStack.push_back(polyVec);
+
+      // Undo to an earlier state, and go on from there
+      if (rand()%4 == 0){
+        int pos = rand()%snapStack.size();
+        snapStack.resize(pos + 1);
+        polyStack.resize(pos + 1);
+        restoreSnapshots(snapStack[pos], polyVec);
+
+        good = (polyVec.size() == polyStack[pos].size());
+        for (int s = 0; s < (int)polyVec.size() && good; s++)
+          good = samePolys(polyVec[s], polyStack[pos][s]);
+        if (!good){
+          cerr << "Have a problem with restoring snapshot " << pos << " in step " << t
+               << " of run " << q << " with seed " << seed << endl;
+          return 1;
+        }
+        numRestored++;
+      }
+    }
+  }
+
+  cout << "Compared " << numRestored << " restored snapshots" << endl;
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <cfloat>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <kdTree.h>
+#include <dTree.h>
+#include <dPoly.h>
+
+// Make random edits to polygons and polygonal lines, some with only
+// one or two vertices, after their search trees are formed. The edits
+// update the trees in place. After each edit compare searches for the
+// nearest vertex and edge and for what is in a box with those in trees
+// formed from scratch, and check that each vertex, edge and box found
+// has the id of the one it came from.
+
+using namespace std;
+using namespace utils;
+
+double rand_ab(double a, double b){
+  assert(a <= b);
+  return a + rand()%max(int(b - a), 1);
+}
+
+// The same polygons, with no trees formed yet
+void copyPolys(const dPoly & poly, dPoly & fresh){
+  fresh.reset();
+  const double * xv             = poly.get_xv();
+  const double * yv             = poly.get_yv();
+  const int * numVerts          = poly.get_numVerts();
+  const vector<char> & isClosed = poly.get_isPolyClosed();
+  int start = 0;
+  for (int p = 0; p < poly.get_numPolys(); p++){
+    fresh.appendPolygon(numVerts[p], xv + start, yv + start, isClosed[p], "yellow", "");
+    start += numVerts[p];
+  }
+}
+
+// The edge with the given id, which is the index of its first vertex
+bool getEdge(const dPoly & poly, int id, seg & edge){
+  const double * xv             = poly.get_xv();
+  const double * yv             = poly.get_yv();
+  const int * numVerts          = poly.get_numVerts();
+  const vector<char> & isClosed = poly.get_isPolyClosed();
+  int start = 0;
+  for (int p = 0; p < poly.get_numPolys(); p++){
+    int numV = numVerts[p];
+    if (id < start + numV){
+      int v = id - start;
+      if (!isClosed[p] && numV > 1 && v == numV - 1) return false;
+      int v2 = (v + 1)%numV;
+      edge = seg(xv[start + v], yv[start + v], xv[start + v2], yv[start + v2]);
+      return true;
+    }
+    start += numV;
+  }
+  return false;
+}
+
+bool sameIds(vector<int> A, vector<int> B){
+  sort(A.begin(), A.end());
+  sort(B.begin(), B.end());
+  return A == B;
+}
+
+bool checkVertices(const dPoly & poly, const dPoly & fresh,
+                   double x0, double y0, int k, const dRect & box){
+
+  const kdTree & T = *poly.getPointTree();
+  const kdTree & F = *fresh.getPointTree();
+  const double * xv = poly.get_xv();
+  const double * yv = poly.get_yv();
+  int numVerts = poly.get_totalNumVerts();
+
+  // The closest one
+  int polyIndex, vertIndex, polyIndex1, vertIndex1;
+  double minX, minY, minDist, minX1, minY1, minDist1;
+  poly.findClosestPolyVertex(x0, y0, polyIndex, vertIndex, minX, minY, minDist);
+  fresh.findClosestPolyVertex(x0, y0, polyIndex1, vertIndex1, minX1, minY1, minDist1);
+  if (minDist != minDist1) return false;
+  if (numVerts > 0){
+    int id = vertIndex;
+    for (int p = 0; p < polyIndex; p++) id += poly.get_numVerts()[p];
+    if (xv[id] != minX || yv[id] != minY) return false;
+  }
+
+  // The k nearest
+  vector<PointWithId> vertices, vertices1;
+  vector<double> dists, dists1;
+  T.findKNearestVertices(x0, y0, k, vertices, dists);
+  F.findKNearestVertices(x0, y0, k, vertices1, dists1);
+  if (dists != dists1) return false;
+  for (int s = 0; s < (int)vertices.size(); s++){
+    int id = vertices[s].id;
+    if (id < 0 || id >= numVerts || xv[id] != vertices[s].x || yv[id] != vertices[s].y)
+      return false;
+  }
+
+  // Those in the box
+  T.getPointsInBox(box.xl, box.yl, box.xh, box.yh, vertices);
+  F.getPointsInBox(box.xl, box.yl, box.xh, box.yh, vertices1);
+  vector<int> ids, ids1;
+  for (int s = 0; s < (int)vertices.size(); s++){
+    int id = vertices[s].id;
+    if (id < 0 || id >= numVerts || xv[id] != vertices[s].x || yv[id] != vertices[s].y)
+      return false;
+    ids.push_back(id);
+  }
+  for (int s = 0; s < (int)vertices1.size(); s++) ids1.push_back(vertices1[s].id);
+
+  return sameIds(ids, ids1);
+}
+
+bool checkEdges(const dPoly & poly, const dPoly & fresh,
+                double x0, double y0, int k, const dRect & box){
+
+  const edgeTree & T = *poly.getEdgeTree();
+  const edgeTree & F = *fresh.getEdgeTree();
+
+  // The closest one
+  double minDist, minDist1;
+  poly.getClosestPolyEdge(x0, y0, minDist);
+  fresh.getClosestPolyEdge(x0, y0, minDist1);
+  if (minDist != minDist1) return false;
+
+  // The k nearest
+  vector<segWidthId> edges, edges1;
+  vector<double> dists, dists1;
+  T.findKNearestEdges(x0, y0, k, edges, dists);
+  F.findKNearestEdges(x0, y0, k, edges1, dists1);
+  if (dists != dists1) return false;
+  for (int s = 0; s < (int)edges.size(); s++){
+    seg edge;
+    if (!getEdge(poly, edges[s].id, edge)) return false;
+    if (edge.begx != edges[s].begx || edge.begy != edges[s].begy ||
+        edge.endx != edges[s].endx || edge.endy != edges[s].endy)
+      return false;
+  }
+
+  // Those in the box
+  T.findPolyEdgesInBox(box.xl, box.yl, box.xh, box.yh, edges);
+  F.findPolyEdgesInBox(box.xl, box.yl, box.xh, box.yh, edges1);
+  vector<int> ids, ids1;
+  for (int s = 0; s < (int)edges.size(); s++){
+    seg edge;
+    if (!getEdge(poly, edges[s].id, edge)) return false;
+    ids.push_back(edges[s].id);
+  }
+  for (int s = 0; s < (int)edges1.size(); s++) ids1.push_back(edges1[s].id);
+
+  return sameIds(ids, ids1);
+}
+
+bool checkBoxes(const dPoly & poly, const dPoly & fresh, const dRect & box){
+
+  const boxTree<dRectWithId> & T = *poly.getBoundingBoxTree();
+  const boxTree<dRectWithId> & F = *fresh.getBoundingBoxTree();
+
+  vector<dRectWithId> boxes, boxes1;
+  T.getBoxesInRegion(box.xl, box.yl, box.xh, box.yh, boxes);
+  F.getBoxesInRegion(box.xl, box.yl, box.xh, box.yh, boxes1);
+  if (boxes.size() != boxes1.size()) return false;
+
+  // The box of each polygon, found in the fresh tree
+  vector<dRectWithId> bounds(poly.get_numPolys());
+  vector<int> ids, ids1;
+  for (int s = 0; s < (int)boxes1.size(); s++){
+    int id = boxes1[s].id;
+    if (id < 0 || id >= (int)bounds.size()) return false;
+    bounds[id] = boxes1[s];
+    ids1.push_back(id);
+  }
+  for (int s = 0; s < (int)boxes.size(); s++){
+    int id = boxes[s].id;
+    if (id < 0 || id >= (int)bounds.size() || !(boxes[s] == bounds[id])) return false;
+    ids.push_back(id);
+  }
+
+  return sameIds(ids, ids1) && sameIds(poly.getPolyIdsInBox(box), ids1);
+}
+
+int main(int argc, char** argv){
+
+  unsigned int seed = (argc > 1) ? atoi(argv[1]) : time(NULL);
+  srand(seed);
+  cout << "Seed: " << seed << endl;
+
+  int numRuns    = 200;
+  int numEdits   = 40;
+  int numQueries = 10;
+  int L          = 50; // the region size
+  int numLocal   = 0;  // searches done in trees with local updates
+
+  for (int q = 0; q < numRuns; q++){
+
+    dPoly poly;
+    int numPolys = 1 + rand()%15;
+    for (int p = 0; p < numPolys; p++){
+      int numV = 1 + rand()%6;
+      vector<double> xv, yv;
+      for (int v = 0; v < numV; v++){
+        xv.push_back(rand_ab(-L, L));
+        yv.push_back(rand_ab(-L, L));
+      }
+      bool isPolyClosed = (rand()%2 == 0);
+      poly.appendPolygon(numV, vecPtr(xv), vecPtr(yv), isPolyClosed, "yellow", "");
+    }
+
+    // The edits below update these in place
+    poly.getBoundingBoxTree();
+    poly.getPointTree();
+    poly.getEdgeTree();
+
+    for (int e = 0; e < numEdits && poly.get_numPolys() > 0; e++){
+
+      int numP  = poly.get_numPolys();
+      int p     = rand()%numP;
+      int numV  = poly.get_numVerts()[p];
+      double dx = rand_ab(-L/4, L/4), dy = rand_ab(-L/4, L/4);
+
+      int edit = rand()%6;
+      if (edit == 0){
+        poly.insertVertex(p, rand()%(numV + 1), rand_ab(-L, L), rand_ab(-L, L));
+      }else if (edit == 1 && numV > 1){
+        poly.eraseVertex(p, rand()%numV);
+      }else if (edit == 2 && numV > 0){
+        poly.changeVertexValue(p, rand()%numV, rand_ab(-L, L), rand_ab(-L, L));
+      }else if (edit == 3 && numV > 0){
+        poly.shiftEdge(p, rand()%numV, dx, dy);
+      }else if (edit == 4){
+        poly.shiftOnePoly(p, dx, dy);
+      }else if (edit == 5){
+        vector<int> mark(numP, 0);
+        for (int s = 0; s < numP; s++) mark[s] = (rand()%5 == 0);
+        poly.eraseMarkedPolys(mark);
+      }
+
+      bool isLocal = (poly.getPointTree()->hasLocalUpdates() ||
+                      poly.getEdgeTree()->hasLocalUpdates()  ||
+                      poly.getBoundingBoxTree()->hasLocalUpdates());
+
+      dPoly fresh;
+      copyPolys(poly, fresh);
+
+      for (int t = 0; t < numQueries; t++){
+
+        double x0 = rand_ab(-L, L), y0 = rand_ab(-L, L);
+        int k = 1 + rand()%5;
+        double xl = rand_ab(-L, L), yl = rand_ab(-L, L);
+        dRect box(xl, yl, xl + rand_ab(0, L), yl + rand_ab(0, L));
+
+        bool goodVerts = checkVertices(poly, fresh, x0, y0, k, box);
+        bool goodEdges = checkEdges(poly, fresh, x0, y0, k, box);
+        bool goodBoxes = checkBoxes(poly, fresh, box);
+        if (!goodVerts || !goodEdges || !goodBoxes){
+          cerr << "Have a problem with the "
+               << (!goodVerts ? "vertices" : (!goodEdges ? "edges" : "boxes"))
+               << " after edit " << edit << " (number " << e << ")"
+               << " in run " << q << " with seed " << seed << endl;
+          return 1;
+        }
+        if (isLocal) numLocal++;
+      }
+    }
+
+  }
+
+  cout << "Compared " << numLocal << " searches in trees updated in place" << endl;
+
+  return 0;
+}
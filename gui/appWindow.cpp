@@ -32,6 +32,7 @@
 #include <QTextEdit>
 #include <QTableWidget>
 #include <QSplitter>
+#include <QProgressBar>
 #include <QUrl>
 #include <QStyledItemDelegate>
 #include <cstdlib>
@@ -72,7 +73,8 @@ private:
 appWindow::appWindow(QWidget* parent, std::string progName,
                      const cmdLineOptions & options,
                      int windowWidX, int windowWidY):
-  QMainWindow(parent, Qt::Window), m_chooseFiles(NULL), m_poly(NULL), m_cmdLine(NULL){
+  QMainWindow(parent, Qt::Window), m_chooseFiles(NULL), m_poly(NULL), m_cmdLine(NULL),
+  m_loadProgress(NULL){
   
   installEventFilter(this);
 
@@ -100,6 +102,14 @@ appWindow::appWindow(QWidget* parent, std::string progName,
   QRect Rp = status->rect();
   m_cmdLine->setGeometry(Rp);
   status->addWidget(m_cmdLine, 1);
+
+  // Progress of reading the files, shown only while that is going on
+  m_loadProgress = new QProgressBar(this);
+  m_loadProgress->setMaximumWidth(200);
+  m_loadProgress->setFormat("Loading %v/%m");
+  m_loadProgress->hide();
+  status->addPermanentWidget(m_loadProgress);
+  connect(m_poly, SIGNAL(loadProgress(int, int)), this, SLOT(showLoadProgress(int, int)));
   m_cmdHist.clear();
   m_histPos = 0;
 
@@ -114,6 +124,20 @@ void appWindow::forceQuit(){
   exit(0); // A fix for an older buggy version of Qt
 }
 
+void appWindow::showLoadProgress(int numLoaded, int numFiles){
+
+  if (m_loadProgress == NULL) return;
+
+  if (numLoaded >= numFiles) {
+    m_loadProgress->hide();
+    return;
+  }
+
+  m_loadProgress->setRange(0, numFiles);
+  m_loadProgress->setValue(numLoaded);
+  m_loadProgress->show();
+}
+
 bool appWindow::eventFilter(QObject *obj, QEvent *event){
 
   // If the alt or control key is hit, and the focus is on the command
@@ -33,6 +33,7 @@ class polyView;
 class QCloseEvent;
 struct cmdLineOptions;
 class QTextEdit;
+class QProgressBar;
 class chooseFilesDlg;
 
 class cmdLine : public QLineEdit {
@@ -74,6 +75,7 @@ private slots:
   void shiftUp();
   void shiftDown();
   void forceQuit();
+  void showLoadProgress(int numLoaded, int numFiles);
 
 private:
   void resizeEvent(QResizeEvent *);
@@ -83,6 +85,7 @@ private:
   chooseFilesDlg * m_chooseFiles;
   polyView       * m_poly;
   cmdLine        * m_cmdLine;
+  QProgressBar   * m_loadProgress;
   std::string      m_progName;
   std::vector<std::string> m_cmdHist;
   int m_histPos;
@@ -0,0 +1,201 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <gui/polyLoader.h>
+
+using namespace std;
+using namespace utils;
+
+bool utils::readPolyOrImageFile(// inputs
+                                loadRequest const& request,
+                                // outputs
+                                dPoly           & poly,
+                                bool            & isImage,
+                                PositionedImage & image,
+                                bool            & needsXgFallback) {
+
+  poly.reset();
+  isImage = false;
+  needsXgFallback = false;
+
+  std::string const& filename = request.filename;
+  string type = getFilenameExtension(filename);
+
+  // Binary files are recognized by their contents, whatever their extension
+  bool isBinary = dPoly::isBinPolyFile(filename);
+
+  if (!isBinary && utils::isImage(filename)) {
+
+    // Read the image and its positioning info
+    if (!ifstream(filename.c_str()).good())
+      return false;
+
+    std::string base = utils::removeExtension(filename);
+    std::string posFile = base + ".txt";
+    if (!readImagePosition(posFile, image.pos))
+      return false;
+
+    // QImage is reentrant, so this is fine on a worker thread
+    image.qimg = QImage(filename.c_str());
+    isImage = true;
+    return true;
+  }
+
+  if (!isBinary && !request.readAsXg && (type == "pol" || type == "cnt")) {
+    if (poly.read_pol_or_cnt_format(filename, type, request.plotPointsOnly))
+      return true;
+    string msg = string("Invalid .") + type + " format for " + filename
+      + ". Trying to read it in .xg format.";
+    cerr << msg << endl;
+    if (request.deferXgFallback) {
+      poly.reset();
+      needsXgFallback = true;
+      return false;
+    }
+  }
+
+  if (isBinary) {
+    if (!poly.readBinPoly(filename, request.plotPointsOnly))
+      return false;
+  } else if (!poly.readPoly(filename, request.plotPointsOnly, request.defaultColor)) {
+    return false; // Will be false only if the file does not exist
+  }
+
+  bool isClosed;
+  if (request.isPolyClosed == forceClosedPoly) {
+    isClosed = true;
+    poly.set_isPolyClosed(isClosed);
+  }else if (request.isPolyClosed == forceNonClosedPoly) {
+    isClosed = false;
+    poly.set_isPolyClosed(isClosed);
+  } // else use the isClosed info from file
+
+  return true;
+}
+
+namespace {
+
+  // Read one file of a batch
+  class loadJob: public QRunnable {
+  public:
+    loadJob(polyLoader                        * loader,
+            std::shared_ptr<utils::loadBatch>   batch,
+            std::shared_ptr<std::atomic<int>>   currBatch,
+            utils::loadRequest          const & request,
+            int requestIndex):
+      m_loader(loader), m_batch(batch), m_currBatch(currBatch),
+      m_request(request), m_requestIndex(requestIndex){}
+
+    void run();
+
+  private:
+    bool isStale() const { return m_currBatch->load() != m_batch->batchId; }
+
+    polyLoader                        * m_loader;
+    std::shared_ptr<utils::loadBatch>   m_batch;
+    std::shared_ptr<std::atomic<int>>   m_currBatch;
+    utils::loadRequest                  m_request;
+    int                                 m_requestIndex;
+  };
+
+  void loadJob::run(){
+
+    if (isStale()) return;
+
+    std::shared_ptr<loadedFile> F(new loadedFile);
+    F->request = m_request;
+    F->success = readPolyOrImageFile(m_request, F->poly, F->isImage, F->image,
+                                     F->needsXgFallback);
+
+    // Prepare what the GUI thread will need for drawing, so that it
+    // does not have to do it when the file arrives.
+    if (F->success && !F->isImage) F->poly.buildClippingData();
+
+    if (isStale()) return;
+
+    // Each job writes only its own slot
+    m_batch->files[m_requestIndex] = F;
+    emit m_loader->fileLoaded(m_batch->batchId, m_requestIndex);
+  }
+
+}
+
+polyLoader::polyLoader(QObject * parent):
+  QObject(parent), m_currBatch(new std::atomic<int>(0)){
+
+  // Leave a core for the GUI thread. Reading of large .xg files is
+  // itself parallel with OpenMP, if enabled.
+  m_pool.setMaxThreadCount(max(1, QThread::idealThreadCount() - 1));
+}
+
+polyLoader::~polyLoader(){
+  cancel();
+  m_pool.waitForDone();
+}
+
+int polyLoader::startBatch(std::vector<utils::loadRequest> const& requests){
+
+  // A new batch makes any files still queued for the previous one stale
+  m_pool.clear();
+  int batchId = ++(*m_currBatch);
+
+  m_batch = std::shared_ptr<loadBatch>(new loadBatch);
+  m_batch->batchId = batchId;
+  m_batch->files.resize(requests.size());
+
+  for (size_t r = 0; r < requests.size(); r++)
+    m_pool.start(new loadJob(this, m_batch, m_currBatch, requests[r], r));
+
+  return batchId;
+}
+
+void polyLoader::requeue(int batchId, int requestIndex,
+                         utils::loadRequest const& request){
+
+  if (!isCurrentBatch(batchId) || !m_batch || m_batch->batchId != batchId)
+    return;
+  if (requestIndex < 0 || requestIndex >= (int)m_batch->files.size())
+    return;
+
+  m_pool.start(new loadJob(this, m_batch, m_currBatch, request, requestIndex));
+}
+
+void polyLoader::cancel(){
+  m_pool.clear();
+  ++(*m_currBatch);
+}
+
+std::shared_ptr<utils::loadedFile> polyLoader::takeFile(int batchId, int requestIndex){
+
+  std::shared_ptr<loadedFile> F;
+  if (!isCurrentBatch(batchId) || !m_batch || m_batch->batchId != batchId)
+    return F;
+  if (requestIndex < 0 || requestIndex >= (int)m_batch->files.size())
+    return F;
+
+  F.swap(m_batch->files[requestIndex]);
+  return F;
+}
@@ -0,0 +1,131 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+// 
+// Copyright (C) 2011 by Oleg Alexandrov
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef POLY_LOADER_H
+#define POLY_LOADER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <geom/dPoly.h>
+#include <utils.h>
+
+namespace utils{
+
+  // What to read from one file
+  struct loadRequest {
+    int            fileIndex; // index in polyView's list of files
+    std::string    filename;
+    bool           plotPointsOnly;
+    closedPolyInfo isPolyClosed;
+    // The color of .xg polygons having none in the file. It should be
+    // set before the request is queued, as the colors taken from
+    // getCurrentDefaultColor() on the workers depend on timing.
+    std::string    defaultColor;
+    // A .pol or .cnt file which fails to parse is read as .xg, and so
+    // takes a default color. If this is set, it is not read then, but
+    // handed back with needsXgFallback set, for the GUI thread to give
+    // it its color in the order of the requests and to queue it again
+    // with readAsXg set.
+    bool           deferXgFallback;
+    bool           readAsXg;
+
+    loadRequest(): fileIndex(0), plotPointsOnly(false),
+                   isPolyClosed(readClosedPolyInfoFromFile),
+                   deferXgFallback(false), readAsXg(false){}
+  };
+
+  // The result of reading one file. If it is an image, 'poly' is
+  // empty and the image is in 'image'.
+  struct loadedFile {
+    loadRequest     request;
+    bool            success;
+    bool            isImage;
+    bool            needsXgFallback; // see loadRequest::deferXgFallback
+    dPoly           poly;
+    PositionedImage image;
+
+    loadedFile(): success(false), isImage(false), needsXgFallback(false){}
+  };
+
+  // The results of a batch of requests. A worker fills in the slot of
+  // a request before announcing that it is read, and only the GUI
+  // thread looks at it afterwards.
+  struct loadBatch {
+    int                                      batchId;
+    std::vector<std::shared_ptr<loadedFile>> files;
+  };
+
+  // Read a polygon file, or an image and its position file. This does
+  // not touch any GUI state, so it is safe to call on several threads
+  // at once. Return false if the file could not be read, or if it
+  // must be read again as .xg, see loadRequest::deferXgFallback.
+  bool readPolyOrImageFile(// inputs
+                           loadRequest const& request,
+                           // outputs
+                           dPoly           & poly,
+                           bool            & isImage,
+                           PositionedImage & image,
+                           bool            & needsXgFallback);
+}
+
+// Read a set of files on a pool of worker threads. Each file is handed
+// to the GUI thread with the fileLoaded() signal as soon as it is
+// read, and can then be picked up with takeFile(). Starting a new batch
+// makes the previous one stale; its files which were not read yet are
+// skipped.
+class polyLoader: public QObject{
+  Q_OBJECT
+
+public:
+  polyLoader(QObject * parent = NULL);
+  ~polyLoader();
+
+  // Start reading the given files. Return the batch id, which is
+  // passed back with each of its files.
+  int startBatch(std::vector<utils::loadRequest> const& requests);
+
+  // Read a request of the current batch again, with the given options.
+  // The file is announced with fileLoaded() as before.
+  void requeue(int batchId, int requestIndex, utils::loadRequest const& request);
+
+  // Make the current batch stale
+  void cancel();
+
+  bool isCurrentBatch(int batchId) const { return batchId == m_currBatch->load(); }
+
+  // Get the result of a request of the given batch. Return NULL if the
+  // batch is stale or the file was already taken.
+  std::shared_ptr<utils::loadedFile> takeFile(int batchId, int requestIndex);
+
+signals:
+  void fileLoaded(int batchId, int requestIndex);
+
+private:
+  QThreadPool                       m_pool;
+  std::shared_ptr<std::atomic<int>> m_currBatch;
+  std::shared_ptr<utils::loadBatch> m_batch;
+};
+
+#endif // POLY_LOADER_H
@@ -37,6 +37,7 @@
 #include <cmath>
 #include <cstdlib>
 #include <vector>
+#include <fstream>
 #include <iomanip>   // required for use of setw()
 #include <iostream>
 #include <algorithm>
@@ -117,6 +118,9 @@ polyView::polyView(QWidget *parent, chooseFilesDlg * chooseFiles,
   m_viewChanged          = false;
 
   m_zoomFactor = 1.0;
+  m_pixelSize  = 0.0;
+  m_dragging   = false; m_dragMoved = false; m_dragBaseNow = false;
+  m_dragX      = 0.0;   m_dragY     = 0.0;
   m_mousePrsX = 0; m_mousePrsY = 0;
   m_mouseRelX = 0; m_mouseRelY = 0;
 
@@ -155,6 +159,24 @@ polyView::polyView(QWidget *parent, chooseFilesDlg * chooseFiles,
   // Align mode
   m_alignMode = false;
 
+  // Draw in tiles on worker threads when there are this many vertices
+  // or more. Smaller scenes are faster to draw directly.
+  m_tileRenderer = new tileRenderer(this);
+  m_frameId      = -1;
+  m_minVertsToRenderInTiles = 100000;
+  connect(m_tileRenderer, SIGNAL(tileReady(int, QRect, QImage)),
+          this, SLOT(compositeTile(int, QRect, QImage)));
+
+  // Read the files on worker threads
+  m_polyLoader      = new polyLoader(this);
+  m_loadBatchId     = -1;
+  m_numLoaded       = 0;
+  m_numMissing      = 0;
+  m_nextXgFallback  = 0;
+  m_resetViewOnLoad = false;
+  connect(m_polyLoader, SIGNAL(fileLoaded(int, int)),
+          this, SLOT(addLoadedFile(int, int)));
+
   // Right-click context menu
   m_ContextMenu = new QMenu();
 
@@ -300,6 +322,11 @@ void polyView::setupViewingWindow() {
   //cout << "geom is: " << m_screenXll << ' ' << m_screenYll << ' '
   //     << m_screenWidX << ' ' << m_screenWidY << endl;
 
+  // Once the user picks a view, files which are still being read must
+  // not reset it.
+  if ((m_zoomToMouseSelection || m_viewChanged) && !m_resetView)
+    m_resetViewOnLoad = false;
+
   if (m_resetView) {
     // Find the bounding box of images
     double big = DBL_MAX;
@@ -334,9 +361,16 @@ void polyView::setupViewingWindow() {
 
   }else if (m_viewChanged) {
 
-    // Modify the view for given shift or zoom
-    xll  = m_viewXll + m_viewWidX*((1 - m_zoomFactor)/2.0 + m_shiftX);
-    yll  = m_viewYll + m_viewWidY*((1 - m_zoomFactor)/2.0 + m_shiftY);
+    // Modify the view for given shift or zoom. Pan by a whole number
+    // of pixels, then what is on screen just moves, and the polygons
+    // already moved to pixels can be used again. See plotDPoly().
+    double shiftX = m_viewWidX*m_shiftX, shiftY = m_viewWidY*m_shiftY;
+    if (m_zoomFactor == 1.0 && m_pixelSize > 0.0) {
+      shiftX = m_pixelSize*round(shiftX/m_pixelSize);
+      shiftY = m_pixelSize*round(shiftY/m_pixelSize);
+    }
+    xll  = m_viewXll + m_viewWidX*(1 - m_zoomFactor)/2.0 + shiftX;
+    yll  = m_viewYll + m_viewWidY*(1 - m_zoomFactor)/2.0 + shiftY;
     widx = m_viewWidX*m_zoomFactor;
     widy = m_viewWidY*m_zoomFactor;
 
@@ -464,12 +498,20 @@ bool polyView::hasSelectedPolygons() const{
 }
 // Plot the current data. See worldToPixelCoords() for how to convert
 // from world to screen coordinates.
-void polyView::displayData(QPainter *paint, int pol_id) {
+void polyView::displayData(QPainter *paint, int pol_id, QPainter * basePaint) {
 
   m_topAnno.clear();
   //utils::Timer my_clock("polyView::displayData");
   setupViewingWindow(); // Must happen before anything else
 
+  // Find which of the polygons moved to pixels are still drawn
+  for (auto it = m_screenGeomCache.begin(); it != m_screenGeomCache.end(); it++)
+    it->second.used = false;
+
+  // When drawing in tiles the geometry is only recorded here
+  bool deferGeometry = (basePaint != NULL);
+  QPainter * bgPaint = deferGeometry ? basePaint : paint;
+
   // This vector is used for sparsing out text on screen
   vector<vector<int>> textOnScreenGrid;
   std::vector<double> colorScale;
@@ -489,7 +531,7 @@ void polyView::displayData(QPainter *paint, int pol_id) {
                    m_viewYll + m_viewWidY,
                    m_prefs.gridSize, m_prefs.gridColor);
     plotDPoly(plotPoints, plotEdges, plotFilled, showAnno, false, m_prefs.gridWidth, 1.0,
-              point_shape, 1, colorScale, textOnScreenGrid, paint, grid);
+              point_shape, 1, colorScale, textOnScreenGrid, bgPaint, grid);
   }
 
 
@@ -525,7 +567,7 @@ void polyView::displayData(QPainter *paint, int pol_id) {
 
     // Plot the image component
     if (m_polyVec[vecIter].img != NULL){
-      polyView::plotImage(paint, m_polyVec[vecIter], m_polyOptionsVec[vecIter].useColorMap,
+      polyView::plotImage(bgPaint, m_polyVec[vecIter], m_polyOptionsVec[vecIter].useColorMap,
                           m_polyOptionsVec[vecIter].colorScale);
       continue;
     }
@@ -555,13 +597,27 @@ void polyView::displayData(QPainter *paint, int pol_id) {
 
     bool has_selected = !plotFilled && !m_selectedPolyIndices[vecIter].empty();
 
+    // The polygon being dragged is drawn on its own, see drawDraggedPoly()
+    bool hide_dragged = (m_dragBaseNow && vecIter == m_polyVecIndex);
+
     // Mark un-selected polygons and plot un-selected ones before selected ones
-    std::vector<int> un_selected;
-    if (has_selected){
+    std::vector<int> un_selected, selected_but_dragged;
+    const std::vector<int> * selected = &m_selectedPolyIndices[vecIter];
+    if (has_selected || hide_dragged){
       int Np = m_polyVec[vecIter].get_numPolys();
-      un_selected.assign(Np, 0);
-      for (int i = 0; i < Np; i++) {
-        if (!(m_selectedPolyIndices[vecIter][i])) un_selected[i] = 1;
+      un_selected.assign(Np, 1);
+      if (has_selected) {
+        for (int i = 0; i < Np; i++) {
+          if ((*selected)[i]) un_selected[i] = 0;
+        }
+      }
+      if (hide_dragged) {
+        un_selected[m_polyIndexInCurrPoly] = 0;
+        if (has_selected) {
+          selected_but_dragged = *selected;
+          selected_but_dragged[m_polyIndexInCurrPoly] = 0;
+          selected = &selected_but_dragged;
+        }
       }
     }
 
@@ -591,18 +647,34 @@ void polyView::displayData(QPainter *paint, int pol_id) {
     double transparency = m_polyOptionsVec[vecIter].transparency;
     if ( transparency == 0.0) transparency = default_transparency;
 
+    if (hide_dragged) {
+      // Draw the dragged polygon the same way later
+      bool isSelected = has_selected && m_selectedPolyIndices[vecIter][m_polyIndexInCurrPoly];
+      m_dragOptions.plotPoints    = plotPoints;
+      m_dragOptions.plotEdges     = plotEdges;
+      m_dragOptions.plotFilled    = plotFilled;
+      m_dragOptions.lineWidth     = lineWidth;
+      m_dragOptions.transparency  = transparency;
+      m_dragOptions.pointShape    = point_shape;
+      m_dragOptions.pointSize     = point_size;
+      m_dragOptions.lighterDarker = isSelected ? -lighter_darker : lighter_darker;
+      m_dragOptions.colorScale    = m_polyOptionsVec[vecIter].colorScale;
+    }
+
     // Plot all or un-selected ones if there are selected ones
     plotDPoly(plotPoints, plotEdges, plotFilled, showAnno, scatter_anno, lineWidth, transparency,
               point_shape, point_size, m_polyOptionsVec[vecIter].colorScale, textOnScreenGrid, paint, m_polyVec[vecIter],
-              has_selected ? &un_selected : nullptr,
-                  lighter_darker // plot un-selected polygons darker
+              (has_selected || hide_dragged) ? &un_selected : nullptr,
+              lighter_darker, // plot un-selected polygons darker
+              deferGeometry
     );
 
     if (has_selected) {
       plotDPoly(plotPoints, plotEdges, plotFilled, showAnno, scatter_anno, lineWidth, transparency,
                 point_shape, point_size, m_polyOptionsVec[vecIter].colorScale, textOnScreenGrid, paint,
-                m_polyVec[vecIter], &m_selectedPolyIndices[vecIter],
-                -lighter_darker // plot selected polygons lighter
+                m_polyVec[vecIter], selected,
+                -lighter_darker, // plot selected polygons lighter
+                deferGeometry
       );
     }
 
@@ -631,7 +703,10 @@ void polyView::displayData(QPainter *paint, int pol_id) {
 
   QFont F; F.setPointSize(13); F.setBold(true);
   paint->setFont(F);
-  drawAnnotation(m_topAnno, textOnScreenGrid, 2, "yellow", paint);
+  std::vector<annoView> topAnno(m_topAnno.size());
+  for (size_t a = 0; a < m_topAnno.size(); a++)
+    topAnno[a] = annoView{m_topAnno[a].x, m_topAnno[a].y, m_topAnno[a].label.c_str(), (int)a};
+  drawAnnotation(topAnno, textOnScreenGrid, 2, "yellow", paint);
 
   // Plot Label
   if (!m_Label.empty()){
@@ -650,6 +725,12 @@ void polyView::displayData(QPainter *paint, int pol_id) {
   m_nonSnappedPoints.clear();
   m_ruler_edges.clear();
 
+  // Forget the polygons which are gone or no longer shown
+  for (auto it = m_screenGeomCache.begin(); it != m_screenGeomCache.end(); ) {
+    if (it->second.used) it++;
+    else                 it = m_screenGeomCache.erase(it);
+  }
+
   return;
 }
 
@@ -682,25 +763,10 @@ void polyView::plotDPoly(bool plotPoints, bool plotEdges,
                          QPainter *paint,
                          dPoly &currPoly,
                          const std::vector<int> *selected,
-                         int lighter_darker) {
+                         int lighter_darker,
+                         bool deferGeometry) {
 
   //utils::Timer my_clock("polyView::plotDPoly");
-  // Note: Having annotations at vertices can make the display
-  // slow for large polygons.
-  // The operations below must happen before cutting,
-  // as cutting will inherit the result computed here.
-  if (m_showVertOrPolyIndexAnno == 1) {
-    currPoly.compVertIndexAnno();
-  } else if (m_showVertOrPolyIndexAnno == 2) {
-    currPoly.compPolyIndexAnno();
-
-  } else if (m_showVertOrPolyIndexAnno == 3) {
-    currPoly.compVertFullIndexAnno();
-
-  } else if (m_showLayerAnno) {
-    currPoly.compLayerAnno();
-  }
-
 
   // Clip the polygon a bit beyond the viewing window, as to not see
   // the edges where the cut took place. It is a bit tricky to
@@ -709,177 +775,149 @@ void polyView::plotDPoly(bool plotPoints, bool plotEdges,
   double extra  = 2*m_pixelSize*lineWidth;
   double extraX = extra + tol*max(abs(m_viewXll), abs(m_viewXll + m_viewWidX));
   double extraY = extra + tol*max(abs(m_viewYll), abs(m_viewYll + m_viewWidY));
-  dPoly clippedPoly;
-  currPoly.clipAll(//inputs
-      m_viewXll - extraX,
-      m_viewYll - extraY,
-      m_viewXll + m_viewWidX + extraX,
-      m_viewYll + m_viewWidY + extraY,
-      // output
-      clippedPoly,
-      selected);
-
-  //utils::Timer my_clock2("polyView::Paint");
-  const double * xv               = clippedPoly.get_xv();
-  const double * yv               = clippedPoly.get_yv();
-  const int    * numVerts         = clippedPoly.get_numVerts();
-  int numPolys                    = clippedPoly.get_numPolys();
-  const vector<char> isPolyClosed = clippedPoly.get_isPolyClosed();
-  const vector<string> colors     = clippedPoly.get_colors();
-  //int numVerts                  = clippedPoly.get_totalNumVerts();
-
-  vector<anno> annotations;
+  dRect clipBox(m_viewXll - extraX,
+                m_viewYll - extraY,
+                m_viewXll + m_viewWidX + extraX,
+                m_viewYll + m_viewWidY + extraY);
+
+  utils::polyStyle style;
+  style.plotPoints    = plotPoints;
+  style.plotEdges     = plotEdges;
+  style.plotFilled    = plotFilled;
+  style.lineWidth     = lineWidth;
+  style.transparency  = transparency;
+  style.pointShape    = point_shape;
+  style.pointSize     = point_size;
+  style.lighterDarker = lighter_darker;
+  style.counter_cc    = m_counter_cc;
+
+  // With more vertices in view than pixels the shapes of single
+  // vertices are lost, so show how many fall on each pixel instead.
+  // That is for point clouds and polygons drawn as just points. A
+  // selection of polygons does not say which vertices to count.
+  int numPixels = m_screenWidX*m_screenWidY;
+  if ((currPoly.isPointCloud() || (plotPoints && !plotEdges && selected == nullptr)) &&
+      currPoly.get_totalNumVerts() > numPixels &&
+      currPoly.getPointCloud().numPointsInBox(clipBox) > numPixels) {
+    style.plotDensity = true;
+    if (colorScale.size() == 2) {
+      style.densityMin = colorScale[0];
+      style.densityMax = colorScale[1];
+    } else {
+      // Up to the count of a pixel in the denser parts
+      double density = currPoly.getPointCloud().typicalDensity();
+      style.densityMin = 1.0;
+      style.densityMax = std::max(2.0, density*m_pixelSize*m_pixelSize);
+    }
+  }
+
+  // When zoomed out draw a simplified version of the polygons, with
+  // no more detail than the pixels can show. Point clouds lose points
+  // when simplified, so then the selection would not apply, and
+  // neither would the counts of points per pixel.
+  dPoly & geomPoly = (style.plotDensity || (selected != nullptr && currPoly.isPointCloud())) ?
+    currPoly : currPoly.getLodLevel(m_pixelSize);
+
+  screenGeom * G = NULL;
+  QPoint offset(0, 0);
+  if (deferGeometry) {
+    // The tile renderer will clip and draw the geometry. Here
+    // only the annotations are needed.
+    addLayerToPendingFrame(geomPoly, style, clipBox, selected);
+  } else if (style.plotDensity || geomPoly.isPointCloud()) {
+    // Point clouds are written straight into pixels below, which is
+    // about as fast as moving what was cached for a pan.
+    style.numVertsInView = std::max(geomPoly.getPointCloud().numPointsInBox(clipBox), 1);
+  } else {
+    // If the polygons did not change and the view only moved by whole
+    // pixels, what was moved to pixels before is still good, just
+    // moved by an offset.
+    utils::viewTransform T = currentViewTransform();
+    G = &m_screenGeomCache[std::make_pair((const dPoly*)&currPoly, lighter_darker)];
+    bool reuse = (G->changeId     == currPoly.get_changeId()     &&
+                  G->plotFilled   == plotFilled                  &&
+                  G->counter_cc   == m_counter_cc                &&
+                  G->useSelection == (selected != nullptr)       &&
+                  (selected == nullptr || G->selection == *selected) &&
+                  G->geom.region.contains(clipBox)               &&
+                  G->geom.T.offsetTo(T, offset));
+    if (!reuse) {
+      // Clip half a view beyond each side, so that the next few pans
+      // are covered too.
+      dRect region(clipBox.xl - m_viewWidX/2.0, clipBox.yl - m_viewWidY/2.0,
+                   clipBox.xh + m_viewWidX/2.0, clipBox.yh + m_viewWidY/2.0);
+      dPoly regionPoly;
+      geomPoly.clipAll(//inputs
+                       region.xl, region.yl, region.xh, region.yh,
+                       // output
+                       regionPoly,
+                       selected);
+      utils::projectClippedPoly(regionPoly, style, T, region, G->geom);
+      G->changeId     = currPoly.get_changeId();
+      G->plotFilled   = plotFilled;
+      G->counter_cc   = m_counter_cc;
+      G->useSelection = (selected != nullptr);
+      if (selected != nullptr) G->selection = *selected;
+      else                     G->selection.clear();
+      offset = QPoint(0, 0);
+    }
+    G->used = true;
+
+    // Thin the lines based on what is in view, as when clipping to it
+    QRect viewRect = QRect(0, 0, m_screenWidX, m_screenWidY).adjusted(-1, -1, 1, 1);
+    style.numVertsInView = std::max(G->geom.numVertsInRect(viewRect, offset), 1);
+  }
+  // The annotations in view are found with their search tree, and
+  // point to the labels kept there rather than copying them. Those
+  // with indices or layers are made here, just for what is in view.
+  vector<annoView> annotations;
+  annoBatch madeAnnos;
 
   if (showAnno) {
     if (m_showVertOrPolyIndexAnno == 1 || m_showVertOrPolyIndexAnno == 3) {
-      annotations = clippedPoly.get_vertIndexAnno();
+      currPoly.getVertIndexAnnosInBox(clipBox, m_showVertOrPolyIndexAnno == 3, madeAnnos);
+      annotations = madeAnnos.annos();
     } else if (m_showVertOrPolyIndexAnno == 2) {
-      annotations = clippedPoly.get_polyIndexAnno();
+      currPoly.getPolyIndexAnnosInBox(clipBox, madeAnnos);
+      annotations = madeAnnos.annos();
     } else if (m_showLayerAnno) {
-      annotations = clippedPoly.get_layerAnno();
+      currPoly.getLayerAnnosInBox(clipBox, madeAnnos);
+      annotations = madeAnnos.annos();
     }else if (m_showAnnotations) {
-      annotations = clippedPoly.get_annotations();
+      currPoly.getAnnosInBox(fileAnno, clipBox, annotations);
     }
   }
 
-  const auto &angle_anno = clippedPoly.get_angleAnno();
-  for (const auto &ang: angle_anno) m_topAnno.push_back(ang);
-
-  // When polys are filled, plot largest polys first
-  if (plotFilled)
-    clippedPoly.sortBySizeAndMaybeAddBigContainingRect(m_viewXll,  m_viewYll,
-                                                       m_viewXll + m_viewWidX,
-                                                       m_viewYll + m_viewWidY,
-                                                       m_counter_cc);
-
-  // length/size of point shapes
-  if (point_size == 0){
-    point_size = (point_shape <= 1) ? 4 : (2*point_shape+2);
-    point_size = min(point_size, 8); // limit how big this can get
-  }
-  // This is done for performance
-  // when too many polygons/points are drawn in a large area we don't need
-  // to use larger lineWidth; we cannot tell them apart anyways.
-  // When we zoom in, fewer polygons are in the view and it uses
-  // user setting for lineWidth.
-  // The following settings are experimentally decided
-  if (clippedPoly.get_totalNumVerts() >= 400000){
-    lineWidth = 0.5;
-    point_size = 1;
-  } else if (clippedPoly.get_totalNumVerts() >= 200000){
-    lineWidth = 1.0;
-    point_size = 2;
-  }else if (clippedPoly.get_totalNumVerts() >= 100000){
-    lineWidth = 1.0;
-  }
+  // These are drawn after all polygons, which may be temporary, so
+  // keep copies
+  vector<annoView> angles;
+  currPoly.getAnnosInBox(angleAnno, clipBox, angles);
+  for (const auto &ang: angles) m_topAnno.push_back(anno(ang.x, ang.y, ang.label));
 
   //my_clock.tock("CLIP");
 
-  auto set_lighter_darker = [lighter_darker](QColor &color)->void {
-    if (lighter_darker == 1) {
-      color = color.darker(150); // 50% darker
-    } else if (lighter_darker == -1){
-      color = color.lighter(130); // 30% lighter
+  if (!deferGeometry) {
+    //utils::Timer my_clock2("polyView::Paint");
+    if (style.plotDensity || geomPoly.isPointCloud()) {
+      QImage points(m_screenWidX, m_screenWidY, QImage::Format_ARGB32_Premultiplied);
+      points.fill(Qt::transparent);
+      if (style.plotDensity)
+        utils::drawPointDensity(geomPoly, style, currentViewTransform(), selected,
+                                QPoint(0, 0), points);
+      else
+        utils::drawPointCloud(geomPoly, style, currentViewTransform(), selected,
+                              QPoint(0, 0), points);
+      paint->drawImage(0, 0, points);
+    } else {
+      utils::drawProjectedPoly(G->geom, style, offset, paint);
     }
-  };
-
-  QVector<QLine> lines;
-
-  QColor prev_color = (numPolys > 0) ? QColor(colors[0].c_str()) : QColor("") ;
-  set_lighter_darker(prev_color);
-
-  int start = 0;
-  for (int pIter = 0; pIter < numPolys; pIter++) {
-
-    if (pIter > 0) start += numVerts[pIter - 1];
-
-    QColor color = QColor(colors[pIter].c_str());
-    set_lighter_darker(color);
-
-    if (plotPoints && color != prev_color) {
-      // new color, draw previous color and clear lines
-      drawPointShapes(lines, prev_color, point_shape, lineWidth, paint);
-      prev_color = color;
-      lines.clear();
-    }
-
-    int pSize = numVerts[pIter];
-    if (pSize == 0) continue;
-    // Determine the orientation of polygons
-    bool isHole = false;
-    if (plotFilled && isPolyClosed[pIter]) {
-      isHole = (signedPolyArea(pSize, xv + start, yv + start, m_counter_cc) < 0);
-    }
-
-    // Scale the polygon to screen (pixel) coordinates
-    // For closed polygons add the first point to the end so that all edges are drawn
-    QPolygon pa(isPolyClosed[pIter] ? pSize+1: pSize);
-    int x0, y0;
-    for (int vIter = 0; vIter < pSize; vIter++) {
-
-
-      worldToPixelCoords(xv[start + vIter], yv[start + vIter], // inputs
-                         x0, y0);                              // outputs
-      pa[vIter] = QPoint(x0, y0);
-
-      // Qt's built in points are too small. Instead of drawing a point
-      // draw a small shape.
-      if (plotPoints) {
-        getOnePointShape(x0, y0, point_size, point_shape, lines);
-      }
-
-    }
-    if (isPolyClosed[pIter]){
-      worldToPixelCoords(xv[start], yv[start], // inputs
-                         x0, y0);                              // outputs
-      pa[pSize] = QPoint(x0, y0);
-    }
-
-    if (pa.size() <= 0) continue;
-
-    if (plotEdges) {
-
-      if (plotFilled && isPolyClosed[pIter]) {
-
-        if (isHole){
-          auto color2 = QColor(m_prefs.bgColor.c_str());
-          color2.setAlphaF(transparency);
-          paint->setBrush(color2);
-        } else {
-          color.setAlphaF(transparency);
-          paint->setBrush(color);
-        }
-
-      }else {
-        paint->setBrush(Qt::NoBrush);
-      }
-      color.setAlphaF(1.0);
-      paint->setPen(QPen(color, lineWidth));
-
-      if (isPolyZeroDim(pa)) {
-        // Treat the case of polygons which are made up of just one point
-        paint->setBrush(color);
-        paint->drawRect(x0 - 1, y0 - 1, 2, 2);
-
-      }else {
-
-        if (plotFilled) {
-          paint->drawPolygon(pa);
-        }
-        paint->setBrush(Qt::NoBrush);
-        paint->drawPolyline(pa); // don't join the last vertex to the first
-
-      }
-    }
-  }
-
-  if (plotPoints) { // draw remaining points of the last color (if any)
-    drawPointShapes(lines, prev_color, point_shape, lineWidth, paint);
   }
 
   // Plot the annotations
   if (scatter_annotation){
-    plotAnnotationScattered(clippedPoly.get_annotations(), colorScale, paint);
+    vector<annoView> fileAnnos;
+    currPoly.getAnnosInBox(fileAnno, clipBox, fileAnnos);
+    plotAnnotationScattered(fileAnnos, colorScale, paint);
   }
 
   drawAnnotation(annotations, textOnScreenGrid, lineWidth, "gold", paint);
@@ -889,32 +927,39 @@ void polyView::plotDPoly(bool plotPoints, bool plotEdges,
   return;
 }
 
-void polyView::drawAnnotation(const vector<anno> &annotations,
+void polyView::drawAnnotation(const vector<annoView> &annotations,
                               std::vector< std::vector<int> > & textOnScreenGrid,
                               double lineWidth,
                               const std::string &color,
                               QPainter *paint){
+  // Decide which labels fit before drawing any, then draw those with
+  // the images of labels drawn before
+  std::vector<QPoint>       points;
+  std::vector<const char *> labels;
   int numAnno = annotations.size();
   for (int aIter = 0; aIter < numAnno; aIter++) {
-    const anno & A = annotations[aIter];
+    const annoView & A = annotations[aIter];
     int x0, y0;
     worldToPixelCoords(A.x, A.y, // inputs
                        x0, y0    // outputs
     );
 
     if (isClosestGridPtFree(textOnScreenGrid, x0, y0)) {
-      paint->setPen(QPen(QColor(color.c_str()), lineWidth));
-      paint->drawText(x0, y0, (A.label).c_str());
+      points.push_back(QPoint(x0, y0));
+      labels.push_back(A.label);
     }
   }
+  if (points.empty()) return;
+
+  paint->setPen(QPen(QColor(color.c_str()), lineWidth));
+  m_sprites.drawLabels(points, labels, QColor(color.c_str()), paint);
 }
 
-void polyView::plotAnnotationScattered(const vector<anno> &annotations,
+void polyView::plotAnnotationScattered(const vector<annoView> &annotations,
                                        const std::vector<double> &colorScale,// min max values for color scale
                                        QPainter *paint){
 
   // Plot annotations as filled colorful circles
-  const QBrush &orig_brush = paint->brush();
 
   int numAnno = annotations.size();
   std::vector<double> vals(numAnno, FLT_MAX);
@@ -922,7 +967,7 @@ void polyView::plotAnnotationScattered(const vector<anno> &annotations,
   float maxval = -FLT_MAX;
   bool has_non_number_anno = false;
   for (int aIter = 0; aIter < numAnno; aIter++) {
-    const anno & A = annotations[aIter];
+    const annoView & A = annotations[aIter];
     float val = 0;
     try {
       val = std::stof(A.label);
@@ -941,9 +986,11 @@ void polyView::plotAnnotationScattered(const vector<anno> &annotations,
     minval = colorScale[0];
     maxval = colorScale[1];
   }
+  std::vector<QPoint> points;
+  std::vector<QColor> colors;
   for (int aIter = 0; aIter < numAnno; aIter++) {
     if (vals[aIter] == FLT_MAX) continue;
-    const anno & A = annotations[aIter];
+    const annoView & A = annotations[aIter];
     int x0, y0;
     worldToPixelCoords(A.x, A.y, x0, y0);
 
@@ -952,12 +999,11 @@ void polyView::plotAnnotationScattered(const vector<anno> &annotations,
     getRGBColor(val, minval, maxval, r, g, b);
     QColor color;
     color.setRgbF(r, g, b);
-    paint->setPen(QPen(color, 1));
-    paint->setBrush(color);
-    paint->drawEllipse(x0 - 4, y0 - 4, 8, 8);
-
+    points.push_back(QPoint(x0, y0));
+    colors.push_back(color);
   }
-  paint->setBrush(orig_brush);// reset brush
+  // Circles of the same color are the same image
+  m_sprites.drawDots(points, colors, 8, paint);
 
 }
 
@@ -1092,6 +1138,12 @@ void polyView::mousePressEvent(QMouseEvent *E) {
 
   m_rubberBand = m_emptyRubberBand;
 
+  // In case the release of a previous drag was missed
+  if (m_dragging) {
+    finishDrag();
+    saveDataForUndo(false);
+  }
+
   // This must happen before m_movingVertsOrEdgesOrPolysNow is declared.
   m_deletingPolyNow = ((E->modifiers() & Qt::AltModifier  ) &&
                        (E->modifiers() & Qt::ShiftModifier)
@@ -1138,9 +1190,10 @@ void polyView::mousePressEvent(QMouseEvent *E) {
                           m_polyIndexInCurrPoly,
                           m_vertIndexInCurrPoly,
                           min_x, min_y, min_dist);
-      if (m_polyVecIndex >= 0) m_polyBeforeShift = m_polyVec[m_polyVecIndex];
     }
 
+    if (!m_movingPolysInHlts) startDrag();
+
     return;
   }
 
@@ -1178,26 +1231,23 @@ void polyView::mouseMoveEvent(QMouseEvent *E) {
 
   if (m_movingVertsOrEdgesOrPolysNow) {
 
-    if (m_polyVecIndex        < 0 ||
-        m_polyIndexInCurrPoly < 0 ||
-        m_vertIndexInCurrPoly < 0) return;
+    if (!m_dragging) return;
 
+    // Only the dragged polygon changes while dragging. The polygons
+    // are edited once the mouse is released.
+    m_dragPoly = m_dragPolyBefore;
     if (m_moveVertices->isChecked()) {
-      m_polyVec[m_polyVecIndex].changeVertexValue(m_polyIndexInCurrPoly,
-                                                  m_vertIndexInCurrPoly,
-                                                  wx, wy);
-    }else if ((m_moveEdges->isChecked() || m_movePolys->isChecked()) && m_polyVecIndex >= 0) {
-      m_polyVec[m_polyVecIndex] = m_polyBeforeShift;
-      if (m_moveEdges->isChecked()) {
-        m_polyVec[m_polyVecIndex].shiftEdge(m_polyIndexInCurrPoly,
-                                            m_vertIndexInCurrPoly,
-                                            shift_x, shift_y);
-      }else if (m_movePolys->isChecked()) {
-        m_polyVec[m_polyVecIndex].shiftOnePoly(m_polyIndexInCurrPoly,
-                                               shift_x, shift_y);
-      }
+      m_dragPoly.changeVertexValue(0, m_vertIndexInCurrPoly, wx, wy);
+    }else if (m_moveEdges->isChecked()) {
+      m_dragPoly.shiftEdge(0, m_vertIndexInCurrPoly, shift_x, shift_y);
+    }else if (m_movePolys->isChecked()) {
+      m_dragPoly.shiftOnePoly(0, shift_x, shift_y);
     }
-    refreshPixmap(); // To do: Need to update just a small region, not the whole screen
+    m_dragX     = wx;
+    m_dragY     = wy;
+    m_dragMoved = true;
+
+    drawDraggedPoly();
     return;
   }
 
@@ -1236,6 +1286,8 @@ void polyView::mouseReleaseEvent (QMouseEvent * E) {
     m_totalT = composeTransforms(m_T, m_totalT);
   }
 
+  if (m_movingVertsOrEdgesOrPolysNow) finishDrag();
+
   if (m_aligningPolysNow || m_movingVertsOrEdgesOrPolysNow) {
     saveDataForUndo(false);
     refreshPixmap();
@@ -1297,6 +1349,122 @@ void polyView::mouseReleaseEvent (QMouseEvent * E) {
   return;
 }
 
+void polyView::startDrag() {
+
+  m_dragging  = false;
+  m_dragMoved = false;
+  if (m_polyVecIndex        < 0 ||
+      m_polyIndexInCurrPoly < 0 ||
+      m_vertIndexInCurrPoly < 0) return;
+
+  const dPoly & P = m_polyVec[m_polyVecIndex];
+  P.extractOnePoly(m_polyIndexInCurrPoly, m_dragPolyBefore);
+  m_dragPolyBefore.set_isPointCloud(P.isPointCloud());
+  m_dragPoly = m_dragPolyBefore;
+  m_dragging = true;
+
+  renderDragBase();
+  m_dragRect = QRect();
+  m_pixmap   = QPixmap();
+  drawDraggedPoly();
+
+  return;
+}
+
+void polyView::renderDragBase() {
+
+  // Draw everything but the dragged polygon. Do it at once rather
+  // than in tiles, as this picture is used for the whole drag.
+  stopTileRendering();
+
+  m_dragBase = QPixmap(size());
+  m_dragBase.fill(QColor(m_prefs.bgColor.c_str()));
+
+  QPainter paint(&m_dragBase);
+  paint.initFrom(this);
+  QFont F;
+  F.setPointSize(m_prefs.fontSize);
+  paint.setFont(F);
+
+  m_dragBaseNow = true;
+  displayData(&paint);
+  m_dragBaseNow = false;
+
+  return;
+}
+
+void polyView::drawDraggedPoly() {
+
+  // Start over if the screen changed size
+  QRect screenRect(QPoint(0, 0), m_dragBase.size());
+  QRect dirty = m_dragRect;
+  if (m_pixmap.size() != m_dragBase.size()) {
+    m_pixmap = QPixmap(m_dragBase.size());
+    dirty    = screenRect;
+  }
+
+  // Where the dragged polygon is on screen now, with room for thick
+  // lines and point shapes. Keep away from huge pixel values.
+  double xll, yll, xur, yur;
+  m_dragPoly.bdBox(xll, yll, xur, yur);
+  xll = max(xll, m_viewXll - m_viewWidX); xur = min(xur, m_viewXll + 2*m_viewWidX);
+  yll = max(yll, m_viewYll - m_viewWidY); yur = min(yur, m_viewYll + 2*m_viewWidY);
+  QRect polyRect;
+  if (xll <= xur && yll <= yur) {
+    int x0, y0, x1, y1;
+    worldToPixelCoords(xll, yll, x0, y0);
+    worldToPixelCoords(xur, yur, x1, y1);
+    int margin = (int)ceil(2*m_dragOptions.lineWidth)
+      + 2*max(m_dragOptions.pointSize, 8) + 4;
+    polyRect = QRect(QPoint(min(x0, x1), min(y0, y1)),
+                     QPoint(max(x0, x1), max(y0, y1)));
+    polyRect = polyRect.adjusted(-margin, -margin, margin, margin) & screenRect;
+  }
+
+  // Redraw where the polygon was and where it is now
+  dirty |= polyRect;
+  m_dragRect = polyRect;
+  if (dirty.isEmpty()) return;
+
+  QPainter paint(&m_pixmap);
+  paint.initFrom(this);
+  paint.drawPixmap(dirty, m_dragBase, dirty);
+  paint.setClipRect(dirty);
+
+  bool showAnno = false;
+  vector<vector<int>> textOnScreenGrid;
+  const dragOptions & O = m_dragOptions;
+  plotDPoly(O.plotPoints, O.plotEdges, O.plotFilled, showAnno, false, O.lineWidth,
+            O.transparency, O.pointShape, O.pointSize, O.colorScale, textOnScreenGrid,
+            &paint, m_dragPoly, nullptr, O.lighterDarker);
+  paint.end();
+
+  update(dirty);
+  return;
+}
+
+void polyView::finishDrag() {
+
+  if (!m_dragging) return;
+  m_dragging = false;
+  m_dragBase = QPixmap();
+  if (!m_dragMoved) return;
+
+  // Make the edit that was shown while dragging
+  double shift_x = m_dragX - m_mousePressWorldX;
+  double shift_y = m_dragY - m_mousePressWorldY;
+  dPoly & P = m_polyVec[m_polyVecIndex];
+  if (m_moveVertices->isChecked()) {
+    P.changeVertexValue(m_polyIndexInCurrPoly, m_vertIndexInCurrPoly, m_dragX, m_dragY);
+  }else if (m_moveEdges->isChecked()) {
+    P.shiftEdge(m_polyIndexInCurrPoly, m_vertIndexInCurrPoly, shift_x, shift_y);
+  }else if (m_movePolys->isChecked()) {
+    P.shiftOnePoly(m_polyIndexInCurrPoly, shift_x, shift_y);
+  }
+
+  return;
+}
+
 bool polyView::isShiftLeftMouse(QMouseEvent * E) {
   // This does not work in mouseReleaseEvent.
   return (E->buttons() & Qt::LeftButton ) && (E->modifiers() & Qt::ShiftModifier);
@@ -1685,6 +1853,21 @@ void polyView::refreshPixmap() {
   // directly. Later we'll display the pixmap without redrawing
   // whenever possible for reasons of speed.
     m_movie_frame_id = -1;
+
+    if (m_dragging) {
+      renderDragBase();
+      m_dragRect = QRect();
+      m_pixmap   = QPixmap();
+      drawDraggedPoly();
+      return;
+    }
+
+    if (useTileRenderer()) {
+      renderInTiles();
+      return;
+    }
+
+    stopTileRendering();
     m_pixmap = QPixmap(size());
     m_pixmap.fill(QColor(m_prefs.bgColor.c_str()));
 
@@ -1702,6 +1885,215 @@ void polyView::refreshPixmap() {
   return;
 }
 
+bool polyView::useTileRenderer() {
+
+  // Not worth the overhead for small scenes
+  int numVerts = 0;
+  for (int vi = 0; vi < (int)m_polyVec.size(); vi++) {
+    if (m_filesToHide.find(m_polyOptionsVec[vi].polyFileName) != m_filesToHide.end())
+      continue;
+    numVerts += m_polyVec[vi].get_totalNumVerts();
+  }
+
+  return numVerts >= m_minVertsToRenderInTiles;
+}
+
+void polyView::stopTileRendering() {
+
+  // Tiles which are still on their way will be ignored
+  if (m_frameId >= 0) m_tileRenderer->cancel();
+  m_frameId = -1;
+  m_lastFrame.reset();
+  m_tilesDone    = QRegion();
+  m_baseLayer    = QPixmap();
+  m_tileLayer    = QImage();
+  m_overlayLayer = QImage();
+}
+
+void polyView::renderInTiles() {
+
+  // Draw the background and what goes on top of the polygons right
+  // away, as that is fast. Record the polygons in m_pendingFrame
+  // and draw them in tiles on worker threads. See compositeTile().
+
+  QSize S = size();
+  m_baseLayer = QPixmap(S);
+  m_baseLayer.fill(QColor(m_prefs.bgColor.c_str()));
+  m_overlayLayer = QImage(S, QImage::Format_ARGB32_Premultiplied);
+  m_overlayLayer.fill(Qt::transparent);
+
+  m_pendingFrame = std::make_shared<utils::renderFrame>();
+  m_pendingFramePolys.clear();
+  {
+    QPainter basePaint(&m_baseLayer);
+    basePaint.initFrom(this);
+    QPainter paint(&m_overlayLayer);
+    paint.initFrom(this);
+
+    QFont F;
+    F.setPointSize(m_prefs.fontSize);
+    basePaint.setFont(F);
+    paint.setFont(F);
+
+    displayData(&paint, -1, &basePaint);
+  }
+  m_pendingFrame->T = currentViewTransform(); // displayData() sets up the view
+
+  // If the view did not change, keep showing the current polygons
+  // until the new tiles replace them. Otherwise, keep the old
+  // picture where the new tiles did not arrive yet, as that looks
+  // better than a blank screen.
+  QRect screenRect(QPoint(0, 0), S);
+  bool sameView = (m_tileLayer.size() == S && m_tileLayerT == m_pendingFrame->T);
+
+  // If the polygons are drawn the same way as before, the tiles drawn
+  // so far are still good. When panning they just move, and then only
+  // the newly exposed parts of the screen need drawing.
+  QPoint offset(0, 0);
+  bool samePolys = (m_tileLayer.size() == S && m_lastFrame &&
+                    m_pendingFrame->sameLook(*m_lastFrame));
+  bool panned = (samePolys && !sameView && m_tileLayerT.offsetTo(m_pendingFrame->T, offset));
+
+  if (panned) {
+    QImage moved(S, QImage::Format_ARGB32_Premultiplied);
+    moved.fill(Qt::transparent);
+    QPainter paint(&moved);
+    paint.setCompositionMode(QPainter::CompositionMode_Source);
+    paint.drawImage(offset, m_tileLayer);
+    paint.end();
+    m_tileLayer  = moved;
+    m_tilesDone  = m_tilesDone.translated(offset) & screenRect;
+    m_tileLayerT = m_pendingFrame->T;
+  } else if (!sameView) {
+    m_tileLayer = QImage(S, QImage::Format_ARGB32_Premultiplied);
+    m_tileLayer.fill(Qt::transparent);
+    m_tileLayerT = m_pendingFrame->T;
+  }
+  bool reuseTiles = samePolys && (sameView || panned);
+  if (!reuseTiles) m_tilesDone = QRegion();
+
+  m_frameId = m_tileRenderer->startFrame(m_pendingFrame, S, QRegion(screenRect) - m_tilesDone);
+  m_lastFrame = m_pendingFrame;
+  m_pendingFrame.reset();
+  m_pendingFramePolys.clear();
+
+  if (sameView || panned || m_pixmap.size() != S) {
+    m_pixmap = QPixmap(S);
+    compositeLayers(QRect(QPoint(0, 0), S));
+  }
+
+  update();
+  return;
+}
+
+void polyView::addLayerToPendingFrame(utils::dPoly & poly,
+                                      utils::polyStyle const& style,
+                                      utils::dRect const& clipBox,
+                                      const std::vector<int> * selected) {
+
+  // Snapshot the polygons, the workers must not see later edits. The
+  // same dPoly may be drawn twice, for its un-selected and selected parts.
+  int polyIndex;
+  auto it = m_pendingFramePolys.find(&poly);
+  if (it != m_pendingFramePolys.end()) {
+    polyIndex = it->second;
+  } else {
+    // Use the snapshot of the previous frame if the polygons did not
+    // change since, as copying them is slow.
+    std::shared_ptr<utils::dPoly> P;
+    if (m_lastFrame) {
+      for (size_t i = 0; i < m_lastFrame->polys.size(); i++) {
+        if (m_lastFrame->changeIds[i] == poly.get_changeId()) {
+          P = m_lastFrame->polys[i];
+          break;
+        }
+      }
+    }
+
+    if (!P) {
+      // Build the clipping data on this copy so it is carried to later frames
+      poly.buildClippingData();
+      P = std::make_shared<utils::dPoly>(poly);
+
+      // The annotations are drawn on this thread. The copy keeps the
+      // change id, so the workers find its clipping data up to date
+      // and do not build it again, each on its own, at the same time.
+      P->clearAnnotationsKeepId();
+    }
+
+    // The workers count the vertices per pixel with the grid of all of
+    // them, which polygons do not need otherwise
+    if (style.plotDensity) P->getPointCloud();
+
+    polyIndex = m_pendingFrame->polys.size();
+    m_pendingFrame->polys.push_back(P);
+    m_pendingFrame->changeIds.push_back(poly.get_changeId());
+    m_pendingFramePolys[&poly] = polyIndex;
+  }
+
+  utils::renderLayer L;
+  L.polyIndex = polyIndex;
+  L.style     = style;
+  if (selected != NULL) {
+    L.useSelection = true;
+    L.selection    = *selected;
+  }
+
+  // The tiles must draw lines as thin as if the whole view was
+  // drawn at once, so count the vertices in view.
+  int numVertsInView = 0;
+  if (poly.isPointCloud()) {
+    numVertsInView = poly.getPointCloud().numPointsInBox(clipBox);
+  } else {
+    const int * numVerts = poly.get_numVerts();
+    std::vector<int> ids = poly.getPolyIdsInBox(clipBox);
+    for (size_t i = 0; i < ids.size(); i++) numVertsInView += numVerts[ids[i]];
+  }
+  L.style.numVertsInView = std::max(numVertsInView, 1);
+
+  m_pendingFrame->layers.push_back(L);
+
+  return;
+}
+
+void polyView::compositeTile(int frameId, QRect tileRect, QImage tile) {
+
+  // Skip the tiles of a frame which is no longer current
+  if (frameId != m_frameId || !m_tileRenderer->isCurrentFrame(frameId)) return;
+
+  QPainter paint(&m_tileLayer);
+  paint.setCompositionMode(QPainter::CompositionMode_Source);
+  paint.drawImage(tileRect.topLeft(), tile);
+  paint.end();
+  m_tilesDone += tileRect;
+
+  compositeLayers(tileRect);
+  update(tileRect);
+}
+
+void polyView::compositeLayers(QRect const& rect) {
+
+  if (m_pixmap.size() != m_baseLayer.size()) return;
+
+  QPainter paint(&m_pixmap);
+  paint.drawPixmap(rect, m_baseLayer, rect);
+  paint.drawImage(rect, m_tileLayer, rect);
+  paint.drawImage(rect, m_overlayLayer, rect);
+}
+
+utils::viewTransform polyView::currentViewTransform() const {
+
+  utils::viewTransform T;
+  T.viewXll    = m_viewXll;
+  T.viewYll    = m_viewYll;
+  T.viewWidX   = m_viewWidX;
+  T.viewWidY   = m_viewWidY;
+  T.pixelSize  = m_pixelSize;
+  T.screenWidY = m_screenWidY;
+
+  return T;
+}
+
 void polyView::paintEvent(QPaintEvent *) {
 
   // Note that we draw from the cached pixmap, instead of redrawing
@@ -2221,10 +2613,8 @@ void polyView::addPolyVert(int px, int py) {
                       );
   string color, layer;
   if (minVecIndex >= 0 && minPolyIndex >= 0) {
-    const vector<string> & layers = m_polyVec[minVecIndex].get_layers();
-    const vector<string> & colors = m_polyVec[minVecIndex].get_colors();
-    color = colors.at(minPolyIndex);
-    layer = layers.at(minPolyIndex);
+    color = m_polyVec[minVecIndex].get_color(minPolyIndex);
+    layer = m_polyVec[minVecIndex].get_layer(minPolyIndex);
   }else{
     // No other polygons to borrow layer and color info from. Just use
     // some defaults then.
@@ -2446,99 +2836,6 @@ void polyView::worldToPixelCoords(double wx, double wy,
   py = m_screenWidY - py;
 
 }
-void polyView::drawPointShapes(const QVector<QLine> &lines,
-                               const QColor &color,
-                               int shape_type, // see polyView::getOnePointShape
-                               double lineWidth,
-                               QPainter *paint){
-  if (lines.empty()) return;
-
-  paint->setPen(QPen(color, lineWidth));
-  paint->setBrush(Qt::NoBrush);
-
-  if (shape_type == PT_SQ){
-    QVector<QRect> rects(lines.size());
-    rects.resize(lines.size());
-
-#ifdef POLYVIEW_USE_OPENMP
-    #pragma omp parallel for
-#endif
-    for (int i = 0; i < (int)lines.size(); i++) {
-      const auto &line = lines[i];
-      rects[i] = QRect(line.p1().x(), line.p1().y(), line.p2().x(), line.p2().y());
-    }
-    paint->drawRects(rects);
-
-  } else if (shape_type == PT_CIRC){
-    for (const auto &line : lines) {
-      paint->drawEllipse(line.p1().x(), line.p1().y(), line.p2().x(), line.p2().y());
-    }
-  } else {
-    paint->drawLines(lines);
-  }
-
-}
-void polyView::getOnePointShape(int x0, int y0,
-                                int len, // marker edge length/size
-                                int shape_type,
-                                QVector<QLine> &lines) {
-  // Return each shape as a line segment or a set of line segments.
-  // Later based on shape_type we will draw actual shape.
-
-  // len: size of the shape
-  // x0,y0: center of the shape
-
-  int xl = x0 - len;
-  int xr = x0 + len;
-  int yl = y0 - len;
-  int yr = y0 + len;
-
-
-  if (shape_type == PT_X) {
-    // Draw an X
-
-    lines.push_back(QLine(xl, yl, xr, yr));
-    lines.push_back(QLine(xl, yr, xr,   yl));
-
-  }else if (shape_type == PT_PLUS) {
-    // Draw an plus
-
-    lines.push_back(QLine(xl, y0, xr, y0));
-    lines.push_back(QLine(x0, yl, x0,   yr));
-
-  }else if (shape_type == PT_SQ) {
-    // Draw an empty square
-    lines.push_back(QLine(xl, yl, 2*len, 2*len));
-
-  } else if (shape_type == PT_CIRC) {
-    // Draw a small empty ellipse
-    lines.push_back(QLine(xl, yl, 2*len, 2*len));
-
-  } else if (shape_type == PT_TR) {
-    // Draw an empty triangle
-
-    lines.push_back(QLine(xl, yl, xr, yl));
-    lines.push_back(QLine(xl, yl, x0,   yr));
-    lines.push_back(QLine(xr, yl, x0,   yr));
-
-
-  } else if (shape_type == PT_DMND){
-     // Diamond
-     lines.push_back(QLine(xl, y0, x0, yr));
-     lines.push_back(QLine(x0, yr, xr,  y0));
-     lines.push_back(QLine(xr,  y0, x0,   yl));
-     lines.push_back(QLine(x0,  yl, xl,   y0));
-
-   } else {
-     // Draw an empty reversed triangle
-
-      lines.push_back(QLine(xl, yr, xr, yr));
-      lines.push_back(QLine(xl, yr, x0,   yl));
-      lines.push_back(QLine(xr, yr, x0,   yl));
-    }
-
-}
-
 void polyView::drawMark(int x0, int y0, QColor color, int lineWidth,
                         QPainter * paint) {
 
@@ -2562,6 +2859,7 @@ void polyView::sequentialDisplay(){
       m_movie_frame_id = -1;
     }
 
+    stopTileRendering();
     m_pixmap = QPixmap(size());
     m_pixmap.fill(QColor(m_prefs.bgColor.c_str()));
 
@@ -3150,6 +3448,11 @@ void polyView::updateMarks(bool need_to_refresh){
     QPainter paint(&m_pixmap);
 
     drawMarks(&paint);
+    // Tiles still on their way would paint over the marks otherwise
+    if (!m_overlayLayer.isNull()) {
+      QPainter overlay(&m_overlayLayer);
+      drawMarks(&overlay);
+    }
     update();
   }
 }
@@ -3303,6 +3606,11 @@ void polyView::plotMark(double x, double y) {
     QPainter paint(&m_pixmap);
 
     drawMarks(&paint);
+    // Tiles still on their way would paint over the marks otherwise
+    if (!m_overlayLayer.isNull()) {
+      QPainter overlay(&m_overlayLayer);
+      drawMarks(&overlay);
+    }
     update();
   }
 
@@ -3415,18 +3723,27 @@ void polyView::saveDataForUndo(bool resetViewOnUndo) {
   // The functions saveDataForUndo and restoreDataAtUndoPos
   // are very intimately related.
 
+  // While a batch of files is being read, the polygons of the files
+  // not yet in are empty, and undoing to such a state would wipe them.
+  // The state saved once all files are in has the edits made meanwhile.
+  if (m_numLoaded < (int)m_loadRequests.size()) return;
+
   m_posInUndoStack++;
   assert(m_posInUndoStack >= 0);
 
+  // Share with the previous state whatever did not change since then
+  std::vector<polySnapshot> polySnaps, hltSnaps;
   m_polyVecStack.resize(m_posInUndoStack);
-  m_polyVecStack.push_back(m_polyVec);
+  m_highlightsStack.resize(m_posInUndoStack);
+  bool hasPrev = (m_posInUndoStack > 0);
+  takeSnapshots(m_polyVec, hasPrev ? &m_polyVecStack.back() : NULL, polySnaps);
+  takeSnapshots(m_highlights, hasPrev ? &m_highlightsStack.back() : NULL, hltSnaps);
+  m_polyVecStack.push_back(std::move(polySnaps));
+  m_highlightsStack.push_back(std::move(hltSnaps));
 
   m_polyOptionsVecStack.resize(m_posInUndoStack);
   m_polyOptionsVecStack.push_back(m_polyOptionsVec);
 
-  m_highlightsStack.resize(m_posInUndoStack);
-  m_highlightsStack.push_back(m_highlights);
-
   m_resetViewStack.resize(m_posInUndoStack);
   m_resetViewStack.push_back(resetViewOnUndo);
 
@@ -3441,9 +3758,9 @@ void polyView::restoreDataAtUndoPos() {
   assert(m_posInUndoStack >= 0  &&
          m_posInUndoStack < (int)m_polyVecStack.size());
 
-  m_polyVec        = m_polyVecStack[m_posInUndoStack];
+  restoreSnapshots(m_polyVecStack[m_posInUndoStack], m_polyVec);
+  restoreSnapshots(m_highlightsStack[m_posInUndoStack], m_highlights);
   m_polyOptionsVec = m_polyOptionsVecStack[m_posInUndoStack];
-  m_highlights     = m_highlightsStack[m_posInUndoStack];
   markPolysInHlts(m_polyVec, m_highlights, // Inputs
                   m_selectedPolyIndices, m_selectedAnnoIndices);  // Outputs
   return;
@@ -3494,10 +3811,19 @@ void polyView::readAllPolys() {
 
   int numFiles = m_polyOptionsVec.size();
   m_polyVec.resize(numFiles);
-  m_images.clear();
-  
-  string missingFiles = "";
-  int numMissing = 0;
+
+  // The images are not wiped, as the polygons shown until the new
+  // files arrive point to them. An image read again replaces the
+  // old one in place.
+
+  m_loadRequests.clear();
+  m_loadChangeIds.clear();
+  m_xgFallback.clear();
+  m_nextXgFallback = 0;
+  m_missingFiles = "";
+  m_editedFiles  = "";
+  m_numMissing   = 0;
+  m_numLoaded    = 0;
 
   for (int fileIter = 0; fileIter < numFiles; fileIter++) {
 
@@ -3506,34 +3832,140 @@ void polyView::readAllPolys() {
     // TODO(oalexan1): This may cause book-keeping problems.
     if (!m_polyOptionsVec[fileIter].readPolyFromDisk) continue;
 
-    bool success = readPolyOrImage(// inputs
-                                   m_polyOptionsVec[fileIter].polyFileName,
-                                   m_polyOptionsVec[fileIter].plotAsPoints,
-                                   m_polyOptionsVec[fileIter].isPolyClosed,
-                                   // output
-                                   m_polyVec[fileIter]);
-    if (!success) {
-      missingFiles += " " + m_polyOptionsVec[fileIter].polyFileName;
-      numMissing++;
+    loadRequest R;
+    R.fileIndex      = fileIter;
+    R.filename       = m_polyOptionsVec[fileIter].polyFileName;
+    R.plotPointsOnly = m_polyOptionsVec[fileIter].plotAsPoints;
+    R.isPolyClosed   = m_polyOptionsVec[fileIter].isPolyClosed;
+
+    // The files are read in any order, yet each must get the same
+    // default color as if they were read one after another. That is
+    // taken by each file read as .xg, images included. A .pol or .cnt
+    // file takes one only if it fails to parse, see addLoadedFile().
+    char fallback = fallbackNone;
+    if (!dPoly::isBinPolyFile(R.filename) && ifstream(R.filename.c_str()).good()) {
+      string type = getFilenameExtension(R.filename);
+      if (type == "pol" || type == "cnt") {
+        R.deferXgFallback = true;
+        fallback = fallbackPending;
+      } else {
+        R.defaultColor = getCurrentDefaultColor();
+      }
+    }
+
+    m_loadRequests.push_back(R);
+    m_xgFallback.push_back(fallback);
+    m_loadChangeIds.push_back(m_polyVec[fileIter].get_changeId());
+  }
+
+  // Reset the view as files arrive if it would be reset for all of them
+  m_resetViewOnLoad = m_resetView;
+  m_loadBatchId = m_polyLoader->startBatch(m_loadRequests);
+
+  emit loadProgress(m_numLoaded, m_loadRequests.size());
+  if (m_loadRequests.empty()) saveDataForUndo(false);
+
+  return;
+}
+
+void polyView::addLoadedFile(int batchId, int requestIndex) {
+
+  if (batchId != m_loadBatchId) return;
+  std::shared_ptr<loadedFile> F = m_polyLoader->takeFile(batchId, requestIndex);
+  if (!F) return;
+
+  // A .pol or .cnt file which must be read again as .xg
+  if (F->needsXgFallback) {
+    m_xgFallback[requestIndex] = fallbackNeeded;
+    queueXgFallbacks();
+    return;
+  }
+  if (m_xgFallback[requestIndex] == fallbackPending) {
+    m_xgFallback[requestIndex] = fallbackNone;
+    queueXgFallbacks();
+  }
+
+  m_numLoaded++;
+
+  // The user may have removed files meanwhile
+  int fileIter = F->request.fileIndex;
+  bool isValid = (fileIter < (int)m_polyVec.size() &&
+                  fileIter < (int)m_polyOptionsVec.size() &&
+                  m_polyOptionsVec[fileIter].polyFileName == F->request.filename);
+
+  if (!F->success) {
+    m_missingFiles += " " + F->request.filename;
+    m_numMissing++;
+  }
+
+  // Do not overwrite what the user edited while the file was being read
+  if (isValid && m_polyVec[fileIter].get_changeId() != m_loadChangeIds[requestIndex]) {
+    m_editedFiles += " " + F->request.filename;
+    isValid = false;
+  }
+
+  if (isValid) {
+
+    dPoly & poly = m_polyVec[fileIter];
+    std::swap(poly, F->poly);
+
+    if (F->success && F->isImage) {
+      PositionedImage & img = m_images[F->request.filename];
+      std::swap(img, F->image);
+      // Keep the pointer here. It ensures the poly and its background image
+      // are always handled together.
+      poly.img = (void*)(&img);
     }
 
     if (m_polyOptionsVec[fileIter].useCmdLineColor) {
-      m_polyVec[fileIter].set_color(m_polyOptionsVec[fileIter].cmdLineColor);
+      poly.set_color(m_polyOptionsVec[fileIter].cmdLineColor);
     }
 
+    if (m_resetViewOnLoad) m_resetView = true;
+    refreshPixmap();
   }
 
+  emit loadProgress(m_numLoaded, m_loadRequests.size());
 
-  if (numMissing >= 1) {
-    string suffix = ""; if (numMissing > 1) suffix = "s";
-    popUp("Warning: Could not read file" + suffix + ":" + missingFiles + ".");
+  if (m_numLoaded < (int)m_loadRequests.size()) return;
+
+  // All files are in
+  if (m_numMissing >= 1) {
+    string suffix = ""; if (m_numMissing > 1) suffix = "s";
+    popUp("Warning: Could not read file" + suffix + ":" + m_missingFiles + ".");
+  }
+  if (!m_editedFiles.empty()) {
+    popUp("Warning: Kept the edits made while reading, rather than the files"
+          " from disk, for:" + m_editedFiles + ".");
   }
 
+  m_resetViewOnLoad = false;
   saveDataForUndo(false);
 
   return;
 }
 
+void polyView::queueXgFallbacks() {
+
+  // Give the .pol and .cnt files to read as .xg their default colors,
+  // in the order of the requests, as far as it is known which files
+  // these are
+  while (m_nextXgFallback < m_xgFallback.size() &&
+         m_xgFallback[m_nextXgFallback] != fallbackPending) {
+    if (m_xgFallback[m_nextXgFallback] == fallbackNeeded) {
+      loadRequest R = m_loadRequests[m_nextXgFallback];
+      R.defaultColor    = getCurrentDefaultColor();
+      R.deferXgFallback = false;
+      R.readAsXg        = true;
+      m_polyLoader->requeue(m_loadBatchId, m_nextXgFallback, R);
+      m_xgFallback[m_nextXgFallback] = fallbackNone;
+    }
+    m_nextXgFallback++;
+  }
+
+  return;
+}
+
 void polyView::showFilesChosenByUser(/*int rowClicked, int columnClicked*/){
 
   QTableWidget * filesTable = m_chooseFiles->getFilesTable();
@@ -3560,7 +3992,7 @@ void polyView::openPoly() {
   QString s = QFileDialog::getOpenFileName(this,
                                            "Open file dialog; choose a file",
                                            QDir::currentPath(),
-                                           tr("(*.xg *.ly* *.pol)"));
+                                           tr("(*.xg *.ly* *.pol *.pvb)"));
 
   if (s.length() == 0) return;
 
@@ -3603,48 +4035,23 @@ bool polyView::readPolyOrImage(// inputs
                                closedPolyInfo     isPolyClosed,
                                // output
                                dPoly            & poly) {
-  
-  poly.reset();
-
-  string type = getFilenameExtension(filename);
 
-  if (type == "pol" || type == "cnt") {
-    if (poly.read_pol_or_cnt_format(filename, type, plotPointsOnly)) return true;
-    string msg = string("Invalid .") + type + " format for " + filename
-      + ". Trying to read it in .xg format.";
-    cerr << msg << endl;
-  }
+  loadRequest R;
+  R.filename       = filename;
+  R.plotPointsOnly = plotPointsOnly;
+  R.isPolyClosed   = isPolyClosed;
 
-  // Read the poly (may be empty if the file is an image)
-  if (!poly.readPoly(filename, plotPointsOnly))
-    return false; // Will be false only if the file does not exist
-  
-  if (utils::isImage(filename)) {
+  bool isImage = false, needsXgFallback = false;
+  PositionedImage image;
+  if (!readPolyOrImageFile(R, poly, isImage, image, needsXgFallback))
+    return false;
 
-    // Read the image and its positioning info
-    poly.reset();
-    
-    std::string base = utils::removeExtension(filename);
-    std::string posFile = base + ".txt";
-    std::vector<double> pos;
-    if (!readImagePosition(posFile, pos))
-        return false;
-    
-    m_images[filename].qimg = QImage(filename.c_str());
-    m_images[filename].pos = pos;
+  if (isImage) {
+    m_images[filename] = image;
     // Keep the pointer here. It ensures the poly and its background image
     // are always handled together.
     poly.img = (void*)(&m_images[filename]);
   }
-  
-  bool isClosed;
-  if (isPolyClosed == forceClosedPoly) {
-    isClosed = true;
-    poly.set_isPolyClosed(isClosed);
-  }else if (isPolyClosed == forceNonClosedPoly) {
-    isClosed = false;
-    poly.set_isPolyClosed(isClosed);
-  } // else use the isClosed info from file
 
   return true;
 }
@@ -3652,7 +4059,7 @@ bool polyView::readPolyOrImage(// inputs
 
 void polyView::saveOnePoly() {
 
-  QString s = QFileDialog::getSaveFileName(this,  "Save as one file", "savedPoly.xg", "(*.xg)"
+  QString s = QFileDialog::getSaveFileName(this,  "Save as one file", "savedPoly.xg", "(*.xg *.pvb)"
                                            );
   if (s.length() == 0) return;
 
@@ -3664,7 +4071,7 @@ void polyView::saveOnePoly() {
     poly.appendPolygons(m_polyVec[polyIter]);
   }
 
-  poly.writePoly(fileName);
+  if (!poly.writePoly(fileName)) return;
   cout << " Polygons saved to " << fileName << endl;
 
   return;
@@ -3695,11 +4102,11 @@ void polyView::writeMultiplePolys(bool overwrite) {
       fileName = base + ".xg";
     }
     
-    poly.writePoly(fileName.c_str());
+    if (!poly.writePoly(fileName.c_str())) continue;
     allFiles += " " + fileName;
   }
 
-  if ((int)m_polyVec.size() > 0) {
+  if (!allFiles.empty()) {
     cout << " Polygons saved to" << allFiles << endl;
   }
 
@@ -3720,16 +4127,6 @@ void polyView::changeOrder() {
 
 }
 
-bool polyView::isPolyZeroDim(const QPolygon & pa) {
-
-  int numPts = pa.size();
-  for (int s = 1; s < numPts; s++) {
-    if (pa[0] != pa[s]) return false;
-  }
-
-  return true;
-}
-
 void polyView::initTextOnScreenGrid(std::vector< std::vector<int> > & Grid) {
 
   // Split the screen into numGridPts x numGridPts rectangles.  For
@@ -34,7 +34,11 @@
 #include <QWidget>
 #include <vector>
 #include <map>
+#include <memory>
 #include <utils.h>
+#include <tileRenderer.h>
+#include <polyLoader.h>
+#include <geom/polySnapshot.h>
 #include <chooseFilesDlg.h>
 #include <complex>
 
@@ -184,10 +188,27 @@ protected:
 public slots:
   void showFilesChosenByUser (/*int rowClicked, int columnClicked*/);
   
+signals:
+  // Emitted as the files given on the command line are read
+  void loadProgress(int numLoaded, int numFiles);
+
+private slots:
+  void compositeTile(int frameId, QRect tileRect, QImage tile);
+  void addLoadedFile(int batchId, int requestIndex);
+
 private:
   void setupViewingWindow();
   void readAllPolys();
   void refreshPixmap();
+  bool useTileRenderer();
+  void renderInTiles();
+  void stopTileRendering();
+  void compositeLayers(QRect const& rect);
+  void addLayerToPendingFrame(utils::dPoly & poly,
+                              utils::polyStyle const& style,
+                              utils::dRect const& clipBox,
+                              const std::vector<int> * selected);
+  utils::viewTransform currentViewTransform() const;
   void printCmd(std::string cmd, const std::vector<double> & vals);
   void printCmd(std::string cmd, double xll, double yll,
                 double widX, double widY);
@@ -232,23 +253,21 @@ private:
   bool isClosestGridPtFree(std::vector<std::vector<int>> & Grid,
                            int x, int y);
   void initTextOnScreenGrid(std::vector<std::vector<int>> & Grid);
-  bool isPolyZeroDim(const QPolygon & pa);
   void centerViewAtPoint(double x, double y);
-  void drawPointShapes(const QVector<QLine> &lines,
-                       const QColor &color,
-                       int shape_type, // see polyView::getOnePointShape
-                       double lineWidth,
-                       QPainter *paint);
-  void getOnePointShape(int x0, int y0,
-                        int len, // marker edge length/size
-                        int shape_type,
-                        QVector<QLine> &lines);
 
   void updateRubberBand(QRect & R);
 
+  void startDrag();
+  void renderDragBase();
+  void drawDraggedPoly();
+  void finishDrag();
+
   bool hasSelectedPolygons() const;
 
-  void displayData( QPainter *paint, int i = -1 );
+  // If basePaint is provided, the background (grid and images) is
+  // drawn with it, the polygon geometry goes to m_pendingFrame, and
+  // the rest is drawn with 'paint'.
+  void displayData( QPainter *paint, int i = -1, QPainter * basePaint = NULL );
   void drawMarks(QPainter *paint);
 
   void plotDPoly(bool plotPoints, bool plotEdges,
@@ -265,15 +284,16 @@ private:
                  utils::dPoly &currPoly,
                  // optional input, if provided only clip selected polygons
                  const std::vector<int> *selected = nullptr,
-                 int lighter_darker = 0 // draw color as  0: normal, 1: darker, -1: lighter
-
+                 int lighter_darker = 0, // draw color as  0: normal, 1: darker, -1: lighter
+                 // record the geometry in m_pendingFrame instead of drawing it
+                 bool deferGeometry = false
                  );
 
-  void plotAnnotationScattered(const std::vector<anno> &annotations,
+  void plotAnnotationScattered(const std::vector<utils::annoView> &annotations,
                                const std::vector<double> &colorScale,
                                QPainter *paint);
 
-  void drawAnnotation(const std::vector<anno> &annotations,
+  void drawAnnotation(const std::vector<utils::annoView> &annotations,
                       std::vector< std::vector<int> > & textOnScreenGrid,
                       double lineWidth,
                       const std::string &color,
@@ -307,6 +327,7 @@ private:
   void plotDistBwPolyClips( QPainter *paint );
 
   void saveDataForUndo(bool resetViewOnUndo);
+  void queueXgFallbacks();
   void restoreDataAtUndoPos();
   double calcGrid(double widx, double widy);
 
@@ -332,10 +353,30 @@ private:
 
   // Used for undo
   int m_posInUndoStack;
-  std::vector<std::vector<utils::dPoly>> m_polyVecStack;
-  std::vector<std::vector<polyOptions>>  m_polyOptionsVecStack;
-  std::vector<std::vector<utils::dPoly>> m_highlightsStack;
-  std::vector<char>                      m_resetViewStack;
+  // Consecutive snapshots share the data which did not change
+  std::vector<std::vector<utils::polySnapshot>> m_polyVecStack;
+  std::vector<std::vector<polyOptions>>         m_polyOptionsVecStack;
+  std::vector<std::vector<utils::polySnapshot>> m_highlightsStack;
+  std::vector<char>                             m_resetViewStack;
+
+  // The files are read on worker threads, and each is shown as soon
+  // as it arrives. Until the user changes the view, it is reset to
+  // fit everything read so far.
+  polyLoader                          * m_polyLoader;
+  int                                   m_loadBatchId;
+  std::vector<utils::loadRequest>       m_loadRequests;
+  // The change id of each requested file when it was requested. A file
+  // edited since then is not replaced when it arrives.
+  std::vector<unsigned long long>       m_loadChangeIds;
+  // A .pol or .cnt file which fails to parse gets its default color
+  // only then, and these are handed out in the order of the requests.
+  // m_nextXgFallback is the first request which may still need one.
+  enum xgFallbackState {fallbackNone, fallbackPending, fallbackNeeded};
+  std::vector<char>                     m_xgFallback;
+  size_t                                m_nextXgFallback;
+  int                                   m_numLoaded, m_numMissing;
+  std::string                           m_missingFiles, m_editedFiles;
+  bool                                  m_resetViewOnLoad;
 
   bool m_resetView;
   bool m_prevClickExists;
@@ -345,6 +386,34 @@ private:
   // if really necessary, and display it when paintEvent is called.
   QPixmap m_pixmap;
 
+  // Large scenes are drawn in tiles on worker threads. Then m_pixmap
+  // is composed of the background (grid and images), the tiles with
+  // the polygons, and what goes on top (annotations, highlights, etc).
+  tileRenderer                        * m_tileRenderer;
+  int                                   m_frameId;
+  int                                   m_minVertsToRenderInTiles;
+  std::shared_ptr<utils::renderFrame>   m_pendingFrame, m_lastFrame;
+  std::map<const utils::dPoly*, int>    m_pendingFramePolys;
+  QPixmap                               m_baseLayer;
+  QImage                                m_tileLayer, m_overlayLayer;
+  utils::viewTransform                  m_tileLayerT;
+  QRegion                               m_tilesDone; // in m_tileLayer
+
+  // The polygons of each dPoly, drawn in a given way, clipped to a
+  // bit more than the view and moved to pixels. Panning only moves
+  // these, so they are made again only on zoom or edits. Keyed by the
+  // dPoly and how light or dark it is drawn. See plotDPoly().
+  struct screenGeom {
+    unsigned long long   changeId; // see dPoly::get_changeId()
+    bool                 plotFilled, counter_cc, useSelection;
+    std::vector<int>     selection;
+    bool                 used; // in the latest displayData()
+    utils::projectedPoly geom;
+    screenGeom(): changeId(0), plotFilled(false), counter_cc(false),
+                  useSelection(false), used(false){}
+  };
+  std::map<std::pair<const utils::dPoly*, int>, screenGeom> m_screenGeomCache;
+
   std::vector<QPoint> m_snappedPoints, m_nonSnappedPoints;
   std::vector<utils::seg> m_ruler_edges;
 
@@ -416,6 +485,7 @@ private:
   std::vector<polyOptions>    m_polyOptionsVecBk;
 
   std::vector<anno>           m_topAnno; // Annotations that needs to be plotted on top
+  utils::spriteCache          m_sprites; // images of the annotations drawn before
   std::vector<double>         m_segX, m_segY;  // segment to plot
   int                         m_indexOfDistToPlot;
 
@@ -436,6 +506,27 @@ private:
   int    m_vertIndexInCurrPoly;
   double m_mousePressWorldX, m_mousePressWorldY;
   utils::dPoly m_polyBeforeShift;
+
+  // Dragging a vertex, edge, or polygon. The rest of the scene is
+  // drawn once, to m_dragBase. On each mouse move only the dragged
+  // polygon changes, and only the screen rectangle around its old and
+  // new place is drawn again. The edit itself is made on release.
+  struct dragOptions {
+    bool   plotPoints, plotEdges, plotFilled;
+    double lineWidth, transparency;
+    int    pointShape, pointSize, lighterDarker;
+    std::vector<double> colorScale;
+    dragOptions(): plotPoints(false), plotEdges(true), plotFilled(false),
+                   lineWidth(1.0), transparency(1.0), pointShape(0),
+                   pointSize(1), lighterDarker(0){}
+  };
+  bool         m_dragging, m_dragMoved;
+  bool         m_dragBaseNow; // if drawing m_dragBase now
+  utils::dPoly m_dragPolyBefore, m_dragPoly;
+  double       m_dragX, m_dragY; // where the mouse was last
+  QPixmap      m_dragBase;
+  QRect        m_dragRect;       // around m_dragPoly on screen
+  dragOptions  m_dragOptions;
   std::map<int, std::vector<int>> m_selectedPolyIndices;
   std::map<int, std::vector<int>> m_selectedAnnoIndices;
 
@@ -0,0 +1,1083 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+//
+// Copyright (C) 2011 by Oleg Alexandrov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#include <QFontMetrics>
+#include <QPainter>
+#include <QPolygon>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <gui/tileRenderer.h>
+#include <gui/utils.h>
+
+using namespace std;
+using namespace utils;
+
+void viewTransform::worldToPixelCoords(double wx, double wy,
+                                       int & px,  int & py) const {
+
+  px = iround((wx - viewXll)/pixelSize);
+  py = iround((wy - viewYll)/pixelSize);
+
+  // Compensate for the Qt's origin being in the upper-left corner
+  // instead of the lower-left corner.
+  py = screenWidY - py;
+}
+
+dRect viewTransform::pixelRectToWorldBox(QRect const& rect) const {
+
+  // Pixel rows go down while world y goes up
+  return dRect(viewXll + pixelSize*rect.left(),
+               viewYll + pixelSize*(screenWidY - rect.bottom() - 1),
+               viewXll + pixelSize*(rect.right() + 1),
+               viewYll + pixelSize*(screenWidY - rect.top()));
+}
+
+bool viewTransform::operator==(viewTransform const& T) const {
+  return viewXll  == T.viewXll  && viewYll  == T.viewYll   &&
+         viewWidX == T.viewWidX && viewWidY == T.viewWidY  &&
+         pixelSize == T.pixelSize && screenWidY == T.screenWidY;
+}
+
+bool viewTransform::offsetTo(viewTransform const& S, QPoint & offset) const {
+
+  // Keeping the aspect ratio of the view may perturb the pixel size
+  // a tiny bit, which does not change any pixel.
+  double tol = 1e-6;
+  if (std::abs(S.pixelSize - pixelSize) > 1e-9*pixelSize) return false;
+
+  // The view origins must be a whole number of pixels apart. Then
+  // rounding to pixels commutes with the shift.
+  double dx = (viewXll - S.viewXll)/S.pixelSize;
+  double dy = (viewYll - S.viewYll)/S.pixelSize;
+  int ix = iround(dx), iy = iround(dy);
+  if (std::abs(dx - ix) > tol || std::abs(dy - iy) > tol) return false;
+
+  // Pixel rows go down while world y goes up
+  offset = QPoint(ix, (S.screenWidY - screenWidY) - iy);
+  return true;
+}
+
+bool renderFrame::sameLook(renderFrame const& F) const {
+
+  if (layers.size() != F.layers.size()) return false;
+
+  for (size_t layerIter = 0; layerIter < layers.size(); layerIter++) {
+    const renderLayer & A = layers[layerIter];
+    const renderLayer & B = F.layers[layerIter];
+    if (changeIds[A.polyIndex] != F.changeIds[B.polyIndex])
+      return false;
+    if (A.useSelection != B.useSelection || A.selection != B.selection)
+      return false;
+
+    // Lines are thinned based on what is in view, which changes as
+    // the view moves. That only matters if they end up thinned differently.
+    const polyStyle & a = A.style, & b = B.style;
+    if (a.plotPoints    != b.plotPoints    || a.plotEdges    != b.plotEdges    ||
+        a.plotFilled    != b.plotFilled    || a.lineWidth    != b.lineWidth    ||
+        a.transparency  != b.transparency  || a.pointShape   != b.pointShape   ||
+        a.pointSize     != b.pointSize     || a.lighterDarker != b.lighterDarker ||
+        a.counter_cc    != b.counter_cc    ||
+        thinningLevel(a.numVertsInView) != thinningLevel(b.numVertsInView))
+      return false;
+    if (a.plotDensity != b.plotDensity ||
+        (a.plotDensity && (a.densityMin != b.densityMin || a.densityMax != b.densityMax)))
+      return false;
+  }
+
+  return true;
+}
+
+int utils::thinningLevel(int numVertsInView){
+  // The following settings are experimentally decided
+  if (numVertsInView >= 400000) return 3;
+  if (numVertsInView >= 200000) return 2;
+  if (numVertsInView >= 100000) return 1;
+  return 0;
+}
+
+int projectedPoly::numVertsInRect(QRect const& rect, QPoint const& offset) const {
+
+  QRect R = rect.translated(-offset);
+  int count = 0;
+  for (size_t pIter = 0; pIter < polys.size(); pIter++) {
+    const QPolygon & pa = polys[pIter];
+    int pSize = pa.size() - (isClosed[pIter] ? 1 : 0);
+    for (int vIter = 0; vIter < pSize; vIter++)
+      if (R.contains(pa[vIter])) count++;
+  }
+
+  return count;
+}
+
+void utils::projectClippedPoly(dPoly               & clippedPoly,
+                               polyStyle     const & style,
+                               viewTransform const & T,
+                               dRect         const & region,
+                               projectedPoly       & P){
+
+  const double * xv               = clippedPoly.get_xv();
+  const double * yv               = clippedPoly.get_yv();
+  const int    * numVerts         = clippedPoly.get_numVerts();
+  int numPolys                    = clippedPoly.get_numPolys();
+  const vector<char> isPolyClosed = clippedPoly.get_isPolyClosed();
+  const namePalette & colors      = clippedPoly.get_colorPalette();
+
+  P.T        = T;
+  P.region   = region;
+  P.numVerts = clippedPoly.get_totalNumVerts();
+  P.polys.assign(numPolys, QPolygon());
+  P.colorIds = clippedPoly.get_colorIds();
+  P.isClosed.assign(isPolyClosed.begin(), isPolyClosed.end());
+  P.isHole.assign(numPolys, 0);
+
+  vector<int> starts(numPolys, 0);
+  for (int pIter = 1; pIter < numPolys; pIter++)
+    starts[pIter] = starts[pIter - 1] + numVerts[pIter - 1];
+
+  // Looking up colors by name is slow, do it once per palette entry
+  P.palette.resize(colors.size());
+  for (int c = 0; c < colors.size(); c++)
+    P.palette[c] = QColor(colors.name(c).c_str());
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int pIter = 0; pIter < numPolys; pIter++) {
+
+    int start = starts[pIter];
+    int pSize = numVerts[pIter];
+    if (pSize == 0) continue;
+
+    // Determine the orientation of polygons
+    if (style.plotFilled && isPolyClosed[pIter]) {
+      P.isHole[pIter] = (signedPolyArea(pSize, xv + start, yv + start, style.counter_cc) < 0);
+    }
+
+    // Scale the polygon to screen (pixel) coordinates
+    // For closed polygons add the first point to the end so that all edges are drawn
+    QPolygon & pa = P.polys[pIter];
+    pa.resize(isPolyClosed[pIter] ? pSize+1: pSize);
+    int x0, y0;
+    for (int vIter = 0; vIter < pSize; vIter++) {
+      T.worldToPixelCoords(xv[start + vIter], yv[start + vIter], // inputs
+                           x0, y0);                              // outputs
+      pa[vIter] = QPoint(x0, y0);
+    }
+    if (isPolyClosed[pIter]) pa[pSize] = pa[0];
+  }
+
+  return;
+}
+
+namespace {
+
+  // The line width and point size to draw with. When many vertices
+  // are in view they are drawn thinner.
+  void thinnedSizes(polyStyle const& style, int numVertsInView,
+                    double & lineWidth, int & pointSize){
+
+    lineWidth = style.lineWidth;
+    pointSize = style.pointSize;
+
+    // length/size of point shapes
+    if (pointSize == 0){
+      pointSize = (style.pointShape <= 1) ? 4 : (2*style.pointShape+2);
+      pointSize = min(pointSize, 8); // limit how big this can get
+    }
+    // This is done for performance
+    // when too many polygons/points are drawn in a large area we don't need
+    // to use larger lineWidth; we cannot tell them apart anyways.
+    // When we zoom in, fewer polygons are in the view and it uses
+    // user setting for lineWidth.
+    int thinning = thinningLevel(numVertsInView);
+    if (thinning == 3){
+      lineWidth = 0.5;
+      pointSize = 1;
+    } else if (thinning == 2){
+      lineWidth = 1.0;
+      pointSize = 2;
+    }else if (thinning == 1){
+      lineWidth = 1.0;
+    }
+  }
+
+  void setLighterDarker(int lighterDarker, QColor & color){
+    if (lighterDarker == 1) {
+      color = color.darker(150); // 50% darker
+    } else if (lighterDarker == -1){
+      color = color.lighter(130); // 30% lighter
+    }
+  }
+
+  // The pixels drawProjectedPoly() covers when drawing a polygon made
+  // of one point, as offsets from that point.
+  void getPointStamp(polyStyle const& style, double lineWidth, int pointSize,
+                     std::vector<QPoint> & stamp){
+
+    stamp.clear();
+    if (!style.plotPoints && !style.plotEdges) return;
+
+    int r = pointSize + (int)ceil(lineWidth) + 2;
+    QImage img(2*r + 1, 2*r + 1, QImage::Format_ARGB32_Premultiplied);
+    img.fill(Qt::transparent);
+
+    QColor color(Qt::white);
+    QPainter paint(&img);
+    if (style.plotEdges) {
+      paint.setPen(QPen(color, lineWidth));
+      paint.setBrush(color);
+      paint.drawRect(r - 1, r - 1, 2, 2);
+    }
+    if (style.plotPoints) {
+      QVector<QLine> lines;
+      getOnePointShape(r, r, pointSize, style.pointShape, lines);
+      drawPointShapes(lines, color, style.pointShape, lineWidth, &paint);
+    }
+    paint.end();
+
+    for (int y = 0; y < img.height(); y++) {
+      for (int x = 0; x < img.width(); x++) {
+        if (qAlpha(img.pixel(x, y)) >= 128) stamp.push_back(QPoint(x - r, y - r));
+      }
+    }
+  }
+
+  // An edge of a filled polygon, as the rows of pixels whose centers
+  // it crosses, where it crosses the first of them, and its slope.
+  struct fillEdge {
+    int    rowBeg, rowEnd, polyIndex;
+    double x, dxdy;
+  };
+
+  // Fill the closed polygons of 'P' into 'image', whose top-left pixel
+  // is at 'origin' in the pixels of 'P'. Each row is scanned across
+  // the edges of all polygons at once, and each pixel gets the color
+  // of the smallest polygon it is in, or stays empty if that polygon
+  // is a hole. So holes show what is under them, and the polygons
+  // need not be sorted by size. If the largest polygon is a hole,
+  // what is outside of it is filled, as if it were in a big box.
+  // Bands of rows are filled on several threads, as in drawPointCloud().
+  void fillProjectedPoly(projectedPoly const& P, polyStyle const& style,
+                         QPoint const& origin, QImage & image){
+
+    int width = image.width(), height = image.height();
+    int numPolys = P.polys.size();
+    if (width <= 0 || height <= 0) return;
+
+    vector<QRgb> colors(P.palette.size());
+    for (size_t c = 0; c < colors.size(); c++) {
+      QColor color = P.palette[c];
+      setLighterDarker(style.lighterDarker, color);
+      color.setAlphaF(style.transparency);
+      colors[c] = qPremultiply(color.rgba());
+    }
+
+    // Put each edge in the bands of rows it crosses, and find the
+    // areas in pixels which decide which polygon is on top
+    const int bandHeight = 64;
+    int numBands = (height + bandHeight - 1)/bandHeight;
+    vector< vector<fillEdge> > bandEdges(numBands);
+    vector<double> areas(numPolys, 0.0);
+    int largest = -1;
+    for (int pIter = 0; pIter < numPolys; pIter++) {
+
+      const QPolygon & pa = P.polys[pIter];
+      if (!P.isClosed[pIter] || pa.size() < 3) continue;
+
+      double area = 0.0;
+      for (int vIter = 0; vIter + 1 < pa.size(); vIter++) {
+
+        QPoint a = pa[vIter] - origin, b = pa[vIter + 1] - origin;
+        area += double(a.x())*b.y() - double(b.x())*a.y();
+
+        if (a.y() == b.y()) continue;
+        if (a.y() > b.y()) std::swap(a, b);
+        fillEdge E;
+        E.rowBeg    = max(a.y(), 0);
+        E.rowEnd    = min(b.y(), height);
+        E.polyIndex = pIter;
+        if (E.rowBeg >= E.rowEnd) continue;
+        E.dxdy      = double(b.x() - a.x())/(b.y() - a.y());
+        E.x         = a.x() + (E.rowBeg + 0.5 - a.y())*E.dxdy;
+
+        for (int band = E.rowBeg/bandHeight; band <= (E.rowEnd - 1)/bandHeight; band++)
+          bandEdges[band].push_back(E);
+      }
+
+      areas[pIter] = abs(area)/2.0;
+      if (largest < 0 || areas[pIter] > areas[largest]) largest = pIter;
+    }
+
+    bool fillOutside  = (largest >= 0 && P.isHole[largest]);
+    QRgb outsideColor = fillOutside ? colors[P.colorIds[largest]] : 0;
+
+    uchar * bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic) if (numBands > 4)
+#endif
+    for (int band = 0; band < numBands; band++) {
+
+      int rowBeg = band*bandHeight, rowEnd = min(height, rowBeg + bandHeight);
+
+      // Each band is only seen by its own thread
+      vector<fillEdge> & edges = bandEdges[band];
+      sort(edges.begin(), edges.end(), [](fillEdge const& a, fillEdge const& b){
+          return a.rowBeg < b.rowBeg;
+        });
+
+      // The crossings of a row are bucketed by the pixel they are in,
+      // as the order of the crossings within a pixel does not matter
+      vector<int> active;      // the edges crossing this row
+      vector<int> crossPixels; // where each crossing of the row is
+      vector<int> starts(width + 2), polysAt; // polygons crossed, by pixel
+      vector<int> inside;      // the polygons a span is in
+      size_t next = 0;
+      for (int y = rowBeg; y < rowEnd; y++) {
+
+        while (next < edges.size() && edges[next].rowBeg <= y) active.push_back(next++);
+        size_t numActive = 0;
+        crossPixels.clear();
+        std::fill(starts.begin(), starts.end(), 0);
+        for (size_t k = 0; k < active.size(); k++) {
+          const fillEdge & E = edges[active[k]];
+          if (E.rowEnd <= y) continue;
+          active[numActive++] = active[k];
+          double x = E.x + (y - E.rowBeg)*E.dxdy;
+          int px = (int)max(0.0, min(ceil(x - 0.5), double(width)));
+          crossPixels.push_back(px);
+          starts[px + 1]++;
+        }
+        active.resize(numActive);
+        for (int px = 0; px <= width; px++) starts[px + 1] += starts[px];
+        polysAt.resize(numActive);
+        for (size_t k = 0; k < numActive; k++)
+          polysAt[starts[crossPixels[k]]++] = edges[active[k]].polyIndex;
+        for (int px = width; px > 0; px--) starts[px] = starts[px - 1];
+        starts[0] = 0;
+
+        // Fill the span before each pixel with crossings, then step in
+        // or out of the polygons crossed there
+        QRgb * pixels = (QRgb*)(bits + (size_t)y*bytesPerLine);
+        inside.clear();
+        int spanBeg = 0;
+        for (int px = 0; px <= width; px++) {
+
+          if (px < width && starts[px] == starts[px + 1]) continue;
+
+          if (px > spanBeg) {
+            int top = -1;
+            for (size_t k = 0; k < inside.size(); k++) {
+              int p = inside[k];
+              if (top < 0 || areas[p] < areas[top] || (areas[p] == areas[top] && p > top))
+                top = p;
+            }
+            if (top < 0 && fillOutside)
+              std::fill(pixels + spanBeg, pixels + px, outsideColor);
+            else if (top >= 0 && !P.isHole[top])
+              std::fill(pixels + spanBeg, pixels + px, colors[P.colorIds[top]]);
+            spanBeg = px;
+          }
+
+          for (int k = starts[px]; k < starts[px + 1]; k++) {
+            vector<int>::iterator it = find(inside.begin(), inside.end(), polysAt[k]);
+            if (it == inside.end()) {
+              inside.push_back(polysAt[k]);
+            } else {
+              *it = inside.back();
+              inside.pop_back();
+            }
+          }
+        }
+      }
+    }
+
+    return;
+  }
+
+}
+
+void utils::drawProjectedPoly(projectedPoly const & P,
+                              polyStyle     const & style,
+                              QPoint        const & offset,
+                              QPainter            * paint){
+
+  int numPolys = P.polys.size();
+
+  int point_shape  = style.pointShape;
+  double lineWidth;
+  int point_size;
+  int numVertsInView = style.numVertsInView;
+  if (numVertsInView <= 0) numVertsInView = P.numVerts;
+  thinnedSizes(style, numVertsInView, lineWidth, point_size);
+
+  int lighter_darker = style.lighterDarker;
+  auto set_lighter_darker = [lighter_darker](QColor &color)->void {
+    setLighterDarker(lighter_darker, color);
+  };
+
+  // Move all the pixels at once
+  bool moved = (offset != QPoint(0, 0));
+  if (moved) {
+    paint->save();
+    paint->translate(offset);
+  }
+
+  // The fills go under all the edges. Only what can show on the
+  // device is filled.
+  if (style.plotEdges && style.plotFilled) {
+    QPaintDevice * device = paint->device();
+    QRect target = paint->transform().inverted().mapRect(QRect(0, 0, device->width(),
+                                                               device->height()));
+    if (paint->hasClipping()) target &= paint->clipBoundingRect().toAlignedRect();
+    if (!target.isEmpty()) {
+      QImage fill(target.size(), QImage::Format_ARGB32_Premultiplied);
+      fill.fill(Qt::transparent);
+      fillProjectedPoly(P, style, target.topLeft(), fill);
+      paint->drawImage(target.topLeft(), fill);
+    }
+  }
+
+  QVector<QLine> lines;
+
+  QColor prev_color = (numPolys > 0) ? P.palette[P.colorIds[0]] : QColor("") ;
+  set_lighter_darker(prev_color);
+
+  for (int pIter = 0; pIter < numPolys; pIter++) {
+
+    QColor color = P.palette[P.colorIds[pIter]];
+    set_lighter_darker(color);
+
+    if (style.plotPoints && color != prev_color) {
+      // new color, draw previous color and clear lines
+      drawPointShapes(lines, prev_color, point_shape, lineWidth, paint);
+      prev_color = color;
+      lines.clear();
+    }
+
+    const QPolygon & pa = P.polys[pIter];
+    if (pa.size() <= 0) continue;
+
+    // Qt's built in points are too small. Instead of drawing a point
+    // draw a small shape.
+    if (style.plotPoints) {
+      int pSize = pa.size() - (P.isClosed[pIter] ? 1 : 0);
+      for (int vIter = 0; vIter < pSize; vIter++)
+        getOnePointShape(pa[vIter].x(), pa[vIter].y(), point_size, point_shape, lines);
+    }
+
+    if (style.plotEdges) {
+
+      color.setAlphaF(1.0);
+      paint->setPen(QPen(color, lineWidth));
+
+      if (isPolyZeroDim(pa)) {
+        // Treat the case of polygons which are made up of just one point
+        int x0 = pa[0].x(), y0 = pa[0].y();
+        paint->setBrush(color);
+        paint->drawRect(x0 - 1, y0 - 1, 2, 2);
+
+      }else {
+        paint->setBrush(Qt::NoBrush);
+        paint->drawPolyline(pa); // don't join the last vertex to the first
+
+      }
+    }
+  }
+
+  if (style.plotPoints) { // draw remaining points of the last color (if any)
+    drawPointShapes(lines, prev_color, point_shape, lineWidth, paint);
+  }
+
+  if (moved) paint->restore();
+
+  return;
+}
+
+void utils::drawClippedPoly(dPoly               & clippedPoly,
+                            polyStyle     const & style,
+                            viewTransform const & T,
+                            dRect         const & region,
+                            QPainter            * paint){
+
+  projectedPoly P;
+  projectClippedPoly(clippedPoly, style, T, region, P);
+  drawProjectedPoly(P, style, QPoint(0, 0), paint);
+
+  return;
+}
+
+void utils::drawPointCloud(dPoly                  const & poly,
+                           polyStyle              const & style,
+                           viewTransform          const & T,
+                           const std::vector<int>       * selected,
+                           QPoint                 const & origin,
+                           QImage                       & image){
+
+  const pointCloud & C = poly.getPointCloud();
+  int width = image.width(), height = image.height();
+  if (C.size() == 0 || width <= 0 || height <= 0) return;
+
+  double lineWidth;
+  int pointSize;
+  int numVertsInView = style.numVertsInView;
+  if (numVertsInView <= 0)
+    numVertsInView = C.numPointsInBox(T.pixelRectToWorldBox(QRect(origin, image.size())));
+  thinnedSizes(style, numVertsInView, lineWidth, pointSize);
+
+  vector<QPoint> stamp;
+  getPointStamp(style, lineWidth, pointSize, stamp);
+  if (stamp.empty()) return;
+  int r = 0;
+  for (size_t s = 0; s < stamp.size(); s++)
+    r = max(r, max(abs(stamp[s].x()), abs(stamp[s].y())));
+
+  // Look up each color by name once
+  const namePalette & names = poly.get_colorPalette();
+  if (names.size() == 0) return;
+  vector<QRgb> colors(names.size());
+  for (int c = 0; c < names.size(); c++) {
+    QColor color(names.name(c).c_str());
+    setLighterDarker(style.lighterDarker, color);
+    colors[c] = qPremultiply(color.rgba());
+  }
+
+  // Each band of rows is drawn by one thread, from the points close
+  // enough to it, so no two threads write the same pixel. Tiles are
+  // drawn on several threads already, so only larger images are split.
+  uchar * bits = image.bits();
+  int bytesPerLine = image.bytesPerLine();
+  const int bandHeight = 64;
+  int numBands = (height + bandHeight - 1)/bandHeight;
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic) if (numBands > 4)
+#endif
+  for (int band = 0; band < numBands; band++) {
+
+    int rowBeg = band*bandHeight, rowEnd = min(height, rowBeg + bandHeight);
+    dRect box = T.pixelRectToWorldBox(QRect(origin.x() - r, origin.y() + rowBeg - r,
+                                            width + 2*r, rowEnd - rowBeg + 2*r));
+
+    C.visitCellsInBox(box, [&](int beg, int end, double x0, double y0){
+        for (int i = beg; i < end; i++) {
+
+          if (selected != NULL && !(*selected)[C.id(i)]) continue;
+
+          int px, py;
+          T.worldToPixelCoords(x0 + C.dx(i), y0 + C.dy(i), px, py);
+          px -= origin.x();
+          py -= origin.y();
+          if (px < -r || px >= width + r || py < rowBeg - r || py >= rowEnd + r) continue;
+
+          QRgb color = colors[C.colorId(i)];
+          for (size_t s = 0; s < stamp.size(); s++) {
+            int x = px + stamp[s].x(), y = py + stamp[s].y();
+            if (x < 0 || x >= width || y < rowBeg || y >= rowEnd) continue;
+            ((QRgb*)(bits + (size_t)y*bytesPerLine))[x] = color;
+          }
+        }
+      });
+  }
+
+  return;
+}
+
+void utils::drawPointDensity(dPoly                  const & poly,
+                             polyStyle              const & style,
+                             viewTransform          const & T,
+                             const std::vector<int>       * selected,
+                             QPoint                 const & origin,
+                             QImage                       & image){
+
+  const pointCloud & C = poly.getPointCloud();
+  int width = image.width(), height = image.height();
+  if (C.size() == 0 || width <= 0 || height <= 0) return;
+
+  // The colors of the counts, in as many steps as the eye can tell apart
+  const int numSteps = 256;
+  vector<QRgb> colors(numSteps);
+  for (int k = 0; k < numSteps; k++) {
+    double v = style.densityMin + (style.densityMax - style.densityMin)*k/(numSteps - 1.0);
+    double r, g, b;
+    getRGBColor(v, style.densityMin, style.densityMax, r, g, b);
+    QColor color;
+    color.setRgbF(r, g, b);
+    setLighterDarker(style.lighterDarker, color);
+    colors[k] = qPremultiply(color.rgba());
+  }
+  double stepsPerCount = 0.0;
+  if (style.densityMax > style.densityMin)
+    stepsPerCount = (numSteps - 1.0)/(style.densityMax - style.densityMin);
+
+  vector<int> counts((size_t)width*height, 0);
+  uchar * bits = image.bits();
+  int bytesPerLine = image.bytesPerLine();
+  const int bandHeight = 64;
+  int numBands = (height + bandHeight - 1)/bandHeight;
+
+#ifdef POLYVIEW_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic) if (numBands > 4)
+#endif
+  for (int band = 0; band < numBands; band++) {
+
+    // Pixel centers are on the corners of the pixel rectangles of
+    // pixelRectToWorldBox(), so look a pixel further
+    int rowBeg = band*bandHeight, rowEnd = min(height, rowBeg + bandHeight);
+    dRect box = T.pixelRectToWorldBox(QRect(origin.x() - 1, origin.y() + rowBeg - 1,
+                                            width + 2, rowEnd - rowBeg + 2));
+
+    C.visitCellsInBox(box, [&](int beg, int end, double x0, double y0){
+        for (int i = beg; i < end; i++) {
+          if (selected != NULL && !(*selected)[C.id(i)]) continue;
+          int px, py;
+          T.worldToPixelCoords(x0 + C.dx(i), y0 + C.dy(i), px, py);
+          px -= origin.x();
+          py -= origin.y();
+          if (px < 0 || px >= width || py < rowBeg || py >= rowEnd) continue;
+          counts[(size_t)py*width + px]++;
+        }
+      });
+
+    for (int y = rowBeg; y < rowEnd; y++) {
+      const int * row = &counts[(size_t)y*width];
+      QRgb * pixels = (QRgb*)(bits + (size_t)y*bytesPerLine);
+      for (int x = 0; x < width; x++) {
+        if (row[x] == 0) continue;
+        double step = (row[x] - style.densityMin)*stepsPerCount;
+        int k = (int)std::max(0.0, std::min(step, numSteps - 1.0));
+        pixels[x] = colors[k];
+      }
+    }
+  }
+
+  return;
+}
+
+void utils::drawPointShapes(const QVector<QLine> &lines,
+                            const QColor &color,
+                            int shape_type, // see getOnePointShape()
+                            double lineWidth,
+                            QPainter *paint){
+  if (lines.empty()) return;
+
+  paint->setPen(QPen(color, lineWidth));
+  paint->setBrush(Qt::NoBrush);
+
+  if (shape_type == PT_SQ){
+    QVector<QRect> rects(lines.size());
+    rects.resize(lines.size());
+
+#ifdef POLYVIEW_USE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < (int)lines.size(); i++) {
+      const auto &line = lines[i];
+      rects[i] = QRect(line.p1().x(), line.p1().y(), line.p2().x(), line.p2().y());
+    }
+    paint->drawRects(rects);
+
+  } else if (shape_type == PT_CIRC){
+    for (const auto &line : lines) {
+      paint->drawEllipse(line.p1().x(), line.p1().y(), line.p2().x(), line.p2().y());
+    }
+  } else {
+    paint->drawLines(lines);
+  }
+
+}
+
+void utils::getOnePointShape(int x0, int y0,
+                             int len, // marker edge length/size
+                             int shape_type,
+                             QVector<QLine> &lines) {
+  // Return each shape as a line segment or a set of line segments.
+  // Later based on shape_type we will draw actual shape.
+
+  // len: size of the shape
+  // x0,y0: center of the shape
+
+  int xl = x0 - len;
+  int xr = x0 + len;
+  int yl = y0 - len;
+  int yr = y0 + len;
+
+
+  if (shape_type == PT_X) {
+    // Draw an X
+
+    lines.push_back(QLine(xl, yl, xr, yr));
+    lines.push_back(QLine(xl, yr, xr,   yl));
+
+  }else if (shape_type == PT_PLUS) {
+    // Draw an plus
+
+    lines.push_back(QLine(xl, y0, xr, y0));
+    lines.push_back(QLine(x0, yl, x0,   yr));
+
+  }else if (shape_type == PT_SQ) {
+    // Draw an empty square
+    lines.push_back(QLine(xl, yl, 2*len, 2*len));
+
+  } else if (shape_type == PT_CIRC) {
+    // Draw a small empty ellipse
+    lines.push_back(QLine(xl, yl, 2*len, 2*len));
+
+  } else if (shape_type == PT_TR) {
+    // Draw an empty triangle
+
+    lines.push_back(QLine(xl, yl, xr, yl));
+    lines.push_back(QLine(xl, yl, x0,   yr));
+    lines.push_back(QLine(xr, yl, x0,   yr));
+
+
+  } else if (shape_type == PT_DMND){
+     // Diamond
+     lines.push_back(QLine(xl, y0, x0, yr));
+     lines.push_back(QLine(x0, yr, xr,  y0));
+     lines.push_back(QLine(xr,  y0, x0,   yl));
+     lines.push_back(QLine(x0,  yl, xl,   y0));
+
+   } else {
+     // Draw an empty reversed triangle
+
+      lines.push_back(QLine(xl, yr, xr, yr));
+      lines.push_back(QLine(xl, yr, x0,   yl));
+      lines.push_back(QLine(xr, yr, x0,   yl));
+    }
+
+}
+
+bool utils::isPolyZeroDim(const QPolygon & pa) {
+
+  int numPts = pa.size();
+  for (int s = 1; s < numPts; s++) {
+    if (pa[0] != pa[s]) return false;
+  }
+
+  return true;
+}
+
+namespace {
+  // The pages of sprites are this big, unless a sprite does not fit
+  const int spritePageSize = 1024;
+  // Clear the cache before drawing if it has more pages than this
+  const int maxSpritePages = 4;
+
+  // What makes sprites of the same label differ
+  std::string spriteStyleKey(char kind, QFont const& font, QPainter * paint,
+                             QColor const& color){
+    return std::string(1, kind) + font.key().toStdString() + '|'
+      + std::to_string((int)paint->renderHints()) + '|'
+      + std::to_string((unsigned)color.rgba()) + '|';
+  }
+}
+
+spriteCache::spriteCache(): m_shelfX(0), m_shelfY(0), m_shelfHeight(0){}
+
+void spriteCache::clear(){
+  m_spriteIds.clear();
+  m_sprites.clear();
+  m_pages.clear();
+  m_pixmaps.clear();
+  m_pageChanged.clear();
+  m_shelfX = m_shelfY = m_shelfHeight = 0;
+}
+
+int spriteCache::addSprite(std::string const& key, QSize const& size, QPoint const& corner,
+                           std::function<void(QPainter &)> const& draw){
+
+  // Put the sprites on shelves from left to right, and those from top
+  // to bottom, starting a new page when the last one is full
+  int w = size.width(), h = size.height();
+  if (!m_pages.empty() && m_shelfX + w > m_pages.back().width()) {
+    m_shelfY      += m_shelfHeight;
+    m_shelfX       = 0;
+    m_shelfHeight  = 0;
+  }
+  if (m_pages.empty() || m_shelfX + w > m_pages.back().width() ||
+      m_shelfY + h > m_pages.back().height()) {
+    QImage page(std::max(w, spritePageSize), std::max(h, spritePageSize),
+                QImage::Format_ARGB32_Premultiplied);
+    page.fill(Qt::transparent);
+    m_pages.push_back(page);
+    m_pixmaps.push_back(QPixmap());
+    m_pageChanged.push_back(1);
+    m_shelfX = m_shelfY = m_shelfHeight = 0;
+  }
+
+  sprite S;
+  S.page   = (int)m_pages.size() - 1;
+  S.source = QRect(m_shelfX, m_shelfY, w, h);
+  S.corner = corner;
+  m_shelfX      += w;
+  m_shelfHeight  = std::max(m_shelfHeight, h);
+
+  QPainter spritePaint(&m_pages[S.page]);
+  spritePaint.translate(S.source.topLeft());
+  spritePaint.setClipRect(0, 0, w, h);
+  draw(spritePaint);
+  spritePaint.end();
+  m_pageChanged[S.page] = 1;
+
+  m_sprites.push_back(S);
+  m_spriteIds[key] = (int)m_sprites.size() - 1;
+  return m_spriteIds[key];
+}
+
+void spriteCache::drawSprites(std::vector<QPoint> const& points,
+                              std::vector<int> const& spriteIds,
+                              QPainter * paint){
+
+  // One call per page, in the order given within each
+  std::vector<std::vector<QPainter::PixmapFragment>> fragments(m_pages.size());
+  for (size_t s = 0; s < points.size(); s++) {
+    sprite const& S = m_sprites[spriteIds[s]]; // alias
+    QPointF center = QPointF(points[s] + S.corner) +
+      QPointF(S.source.width()/2.0, S.source.height()/2.0);
+    fragments[S.page].push_back(QPainter::PixmapFragment::create(center, S.source));
+  }
+
+  for (size_t page = 0; page < fragments.size(); page++) {
+    if (fragments[page].empty()) continue;
+    if (m_pageChanged[page]) {
+      m_pixmaps[page]     = QPixmap::fromImage(m_pages[page]);
+      m_pageChanged[page] = 0;
+    }
+    paint->drawPixmapFragments(fragments[page].data(), (int)fragments[page].size(),
+                               m_pixmaps[page]);
+  }
+}
+
+void spriteCache::drawLabels(std::vector<QPoint>       const & points,
+                             std::vector<const char *> const & labels,
+                             QColor                    const & color,
+                             QPainter                        * paint){
+
+  if ((int)m_pages.size() > maxSpritePages) clear();
+
+  // The font sized in pixels of the screen, as the pages have a
+  // resolution of their own
+  QFont font = paint->font();
+  if (font.pixelSize() <= 0)
+    font.setPixelSize(std::max(1, qRound(font.pointSizeF()*paint->device()->logicalDpiY()/72.0)));
+  QFontMetrics metrics(font);
+
+  std::string styleKey = spriteStyleKey('t', font, paint, color), key;
+  QPainter::RenderHints hints = paint->renderHints();
+
+  std::vector<int> spriteIds(points.size());
+  for (size_t s = 0; s < points.size(); s++) {
+    key = styleKey;
+    key += labels[s];
+    auto it = m_spriteIds.find(key);
+    if (it != m_spriteIds.end()) {
+      spriteIds[s] = it->second;
+      continue;
+    }
+
+    // The box of the text relative to the left end of its baseline,
+    // with a margin for the antialiased edges
+    QString text = QString::fromUtf8(labels[s]);
+    QRect   box  = metrics.boundingRect(text).adjusted(-2, -2, 2, 2);
+    spriteIds[s] = addSprite(key, box.size(), box.topLeft(), [&](QPainter & p){
+        p.setRenderHints(hints);
+        p.setFont(font);
+        p.setPen(color);
+        p.drawText(-box.left(), -box.top(), text);
+      });
+  }
+
+  drawSprites(points, spriteIds, paint);
+}
+
+void spriteCache::drawDots(std::vector<QPoint> const & points,
+                           std::vector<QColor> const & colors,
+                           int                         diameter,
+                           QPainter                  * paint){
+
+  if ((int)m_pages.size() > maxSpritePages) clear();
+
+  std::string styleKey = spriteStyleKey('d', QFont(), paint, QColor()) + std::to_string(diameter) + '|';
+  std::string key;
+  QPainter::RenderHints hints = paint->renderHints();
+
+  // The circle with its outline, as drawn by drawEllipse() with a pen
+  // of width 1, and a margin
+  int r = diameter/2;
+  QSize  size(diameter + 3, diameter + 3);
+  QPoint corner(-r - 1, -r - 1);
+
+  std::vector<int> spriteIds(points.size());
+  for (size_t s = 0; s < points.size(); s++) {
+    key = styleKey + std::to_string((unsigned)colors[s].rgba());
+    auto it = m_spriteIds.find(key);
+    if (it != m_spriteIds.end()) {
+      spriteIds[s] = it->second;
+      continue;
+    }
+
+    QColor color = colors[s];
+    spriteIds[s] = addSprite(key, size, corner, [&](QPainter & p){
+        p.setRenderHints(hints);
+        p.setPen(QPen(color, 1));
+        p.setBrush(color);
+        p.drawEllipse(1, 1, diameter, diameter);
+      });
+  }
+
+  drawSprites(points, spriteIds, paint);
+}
+
+namespace {
+
+  // Draw the geometry of one screen tile of a frame
+  class tileJob: public QRunnable {
+  public:
+    tileJob(tileRenderer                       * renderer,
+            std::shared_ptr<utils::renderFrame>  frame,
+            std::shared_ptr<std::atomic<int>>    currFrame,
+            int frameId, QRect const& tileRect):
+      m_renderer(renderer), m_frame(frame), m_currFrame(currFrame),
+      m_frameId(frameId), m_tileRect(tileRect){}
+
+    void run();
+
+  private:
+    bool isStale() const { return m_currFrame->load() != m_frameId; }
+
+    tileRenderer                      * m_renderer;
+    std::shared_ptr<utils::renderFrame> m_frame;
+    std::shared_ptr<std::atomic<int>>   m_currFrame;
+    int                                 m_frameId;
+    QRect                               m_tileRect;
+  };
+
+  void tileJob::run(){
+
+    if (isStale()) return;
+
+    QImage tile(m_tileRect.size(), QImage::Format_ARGB32_Premultiplied);
+    tile.fill(Qt::transparent);
+
+    QPainter paint(&tile);
+    // Draw in screen coordinates, the painter will shift to the tile
+    paint.translate(-m_tileRect.left(), -m_tileRect.top());
+
+    const viewTransform & T = m_frame->T;
+    for (size_t layerIter = 0; layerIter < m_frame->layers.size(); layerIter++) {
+
+      // Check often, the view may have changed meanwhile
+      if (isStale()) return;
+
+      const renderLayer & L = m_frame->layers[layerIter];
+      dPoly & poly = *m_frame->polys[L.polyIndex];
+
+      if (L.style.plotDensity || poly.isPointCloud()) {
+        // The points are written straight into the pixels
+        paint.end();
+        if (L.style.plotDensity)
+          drawPointDensity(poly, L.style, T, L.useSelection ? &L.selection : NULL,
+                           m_tileRect.topLeft(), tile);
+        else
+          drawPointCloud(poly, L.style, T, L.useSelection ? &L.selection : NULL,
+                         m_tileRect.topLeft(), tile);
+        paint.begin(&tile);
+        paint.translate(-m_tileRect.left(), -m_tileRect.top());
+        continue;
+      }
+
+      // Clip a bit beyond the tile so that thick lines and point
+      // shapes which straddle the tile boundary are drawn fully.
+      int margin = (int)ceil(2*L.style.lineWidth) + max(L.style.pointSize, 8) + 2;
+      dRect region = T.pixelRectToWorldBox(m_tileRect.adjusted(-margin, -margin,
+                                                               margin, margin));
+
+      // The caller must have called buildClippingData() for this
+      // to be safe to do from several threads.
+      dPoly clippedPoly;
+      poly.clipAll(region.xl, region.yl, region.xh, region.yh,
+                   clippedPoly, // output
+                   L.useSelection ? &L.selection : NULL);
+
+      drawClippedPoly(clippedPoly, L.style, T, region, &paint);
+    }
+    paint.end();
+
+    if (isStale()) return;
+    emit m_renderer->tileReady(m_frameId, m_tileRect, tile);
+  }
+
+}
+
+tileRenderer::tileRenderer(QObject * parent, int tileSize):
+  QObject(parent), m_currFrame(new std::atomic<int>(0)), m_tileSize(tileSize){
+
+  // Leave a core for the GUI thread
+  m_pool.setMaxThreadCount(max(1, QThread::idealThreadCount() - 1));
+}
+
+tileRenderer::~tileRenderer(){
+  cancel();
+  m_pool.waitForDone();
+}
+
+int tileRenderer::startFrame(std::shared_ptr<utils::renderFrame> frame,
+                             QSize const& screenSize,
+                             QRegion const& region){
+
+  // A new frame makes any tiles still queued for the previous one stale
+  m_pool.clear();
+  int frameId = ++(*m_currFrame);
+
+  // Start from the tiles at the center of the screen, as that is
+  // where the user is most likely looking.
+  vector<QRect> tiles;
+  for (int y = 0; y < screenSize.height(); y += m_tileSize) {
+    for (int x = 0; x < screenSize.width(); x += m_tileSize) {
+      QRect tile(x, y,
+                 min(m_tileSize, screenSize.width()  - x),
+                 min(m_tileSize, screenSize.height() - y));
+      if (region.intersects(tile)) tiles.push_back(tile);
+    }
+  }
+  QPoint center(screenSize.width()/2, screenSize.height()/2);
+  std::stable_sort(tiles.begin(), tiles.end(),
+                   [center](QRect const& a, QRect const& b){
+                     return (a.center() - center).manhattanLength()
+                       < (b.center() - center).manhattanLength();
+                   });
+
+  for (size_t t = 0; t < tiles.size(); t++)
+    m_pool.start(new tileJob(this, frame, m_currFrame, frameId, tiles[t]));
+
+  return frameId;
+}
+
+void tileRenderer::cancel(){
+  m_pool.clear();
+  ++(*m_currFrame);
+}
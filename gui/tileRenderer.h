@@ -0,0 +1,287 @@
+// MIT License Terms (http://en.wikipedia.org/wiki/MIT_License)
+//
+// Copyright (C) 2011 by Oleg Alexandrov
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef TILE_RENDERER_H
+#define TILE_RENDERER_H
+
+#include <QColor>
+#include <QImage>
+#include <QLine>
+#include <QObject>
+#include <QPixmap>
+#include <QPolygon>
+#include <QRect>
+#include <QRegion>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <geom/dPoly.h>
+
+class QPainter;
+
+namespace utils{
+
+  // The map from world to screen coordinates of one frame. Each
+  // render job gets its own copy, so that it does not read the view
+  // of polyView, which changes as soon as the user pans or zooms.
+  struct viewTransform {
+    double viewXll, viewYll, viewWidX, viewWidY;
+    double pixelSize;
+    int    screenWidY;
+
+    viewTransform(): viewXll(0.0), viewYll(0.0), viewWidX(0.0), viewWidY(0.0),
+                     pixelSize(1.0), screenWidY(0){}
+
+    void worldToPixelCoords(double wx, double wy, int & px, int & py) const;
+
+    // The world box seen by the given rectangle of screen pixels
+    dRect pixelRectToWorldBox(QRect const& rect) const;
+
+    bool operator==(viewTransform const& T) const;
+
+    // The offset which moves the pixels of this view to those of the
+    // view S, if the two differ only by a whole number of pixels, as
+    // when panning.
+    bool offsetTo(viewTransform const& S, QPoint & offset) const;
+  };
+
+  // How to draw one dPoly. See polyView::plotDPoly() for the meaning
+  // of these options.
+  struct polyStyle {
+    bool   plotPoints, plotEdges, plotFilled;
+    double lineWidth, transparency;
+    int    pointShape, pointSize;
+    int    lighterDarker; // draw color as 0: normal, 1: darker, -1: lighter
+    bool   counter_cc;
+
+    // If positive, decide how thin to draw based on this many vertices
+    // rather than on the number of vertices being drawn. This keeps the
+    // look of a layer the same across screen tiles.
+    int    numVertsInView;
+
+    // Instead of the above, draw how many vertices fall on each pixel,
+    // in the colors of getRGBColor() from densityMin to densityMax.
+    // See drawPointDensity().
+    bool   plotDensity;
+    double densityMin, densityMax;
+
+    polyStyle(): plotPoints(false), plotEdges(true), plotFilled(false),
+                 lineWidth(1.0), transparency(1.0), pointShape(0), pointSize(1),
+                 lighterDarker(0), counter_cc(true), numVertsInView(0),
+                 plotDensity(false), densityMin(0.0), densityMax(1.0){}
+  };
+
+  // How much to thin lines and points when this many vertices are in
+  // view, from 0 (not at all) to 3.
+  int thinningLevel(int numVertsInView);
+
+  // Clipped polygons in screen pixels for a given view. When the view
+  // only moves by a whole number of pixels, so do all pixels, so these
+  // can be drawn again without going back to world coordinates.
+  struct projectedPoly {
+    viewTransform         T;      // the view the pixels are for
+    dRect                 region; // what was clipped, in world coordinates
+    std::vector<QPolygon> polys;  // closed ones end with their first vertex
+    std::vector<QColor>   palette;  // the colors of the palette of the polygons
+    std::vector<int>      colorIds; // the color of each polygon in 'palette'
+    std::vector<char>     isClosed, isHole;
+    int                   numVerts;
+
+    projectedPoly(): numVerts(0){}
+
+    // The number of vertices in the given screen rectangle, with
+    // these pixels moved by the given offset.
+    int numVertsInRect(QRect const& rect, QPoint const& offset) const;
+  };
+
+  // Move to screen pixels polygons which were already clipped to
+  // 'region' (in world coordinates).
+  void projectClippedPoly(dPoly               & clippedPoly,
+                          polyStyle     const & style,
+                          viewTransform const & T,
+                          dRect         const & region,
+                          projectedPoly       & P);
+
+  // Draw projected polygons, moved by the given offset. The
+  // annotations are not drawn here.
+  void drawProjectedPoly(projectedPoly const & P,
+                         polyStyle     const & style,
+                         QPoint        const & offset,
+                         QPainter            * paint);
+
+  // Draw polygons which were already clipped to 'region' (in world
+  // coordinates). The annotations are not drawn here.
+  void drawClippedPoly(dPoly               & clippedPoly,
+                       polyStyle     const & style,
+                       viewTransform const & T,
+                       dRect         const & region,
+                       QPainter            * paint);
+
+  // Draw the points of a point cloud by writing them straight into the
+  // pixels of 'image', whose top-left pixel is at 'origin' on the
+  // screen. Each point is a stamp of the pixels which drawing it as a
+  // polygon of one vertex would cover, found once. Large images are
+  // drawn in bands of rows on several threads. 'image' must be in the
+  // format QImage::Format_ARGB32_Premultiplied.
+  void drawPointCloud(dPoly                  const & poly,
+                      polyStyle              const & style,
+                      viewTransform          const & T,
+                      const std::vector<int>       * selected,
+                      QPoint                 const & origin,
+                      QImage                       & image);
+
+  // Draw how many vertices fall on each pixel of 'image', for views
+  // with more vertices than pixels, as then the shapes of single
+  // vertices are lost anyway. The vertices are counted in bands of
+  // rows as in drawPointCloud(). For polygons, 'selected' must be NULL.
+  void drawPointDensity(dPoly                  const & poly,
+                        polyStyle              const & style,
+                        viewTransform          const & T,
+                        const std::vector<int>       * selected,
+                        QPoint                 const & origin,
+                        QImage                       & image);
+
+  void drawPointShapes(const QVector<QLine> &lines,
+                       const QColor &color,
+                       int shape_type, // see getOnePointShape()
+                       double lineWidth,
+                       QPainter *paint);
+
+  void getOnePointShape(int x0, int y0,
+                        int len, // marker edge length/size
+                        int shape_type,
+                        QVector<QLine> &lines);
+
+  bool isPolyZeroDim(const QPolygon & pa);
+
+  // Labels and markers drawn before, kept as images packed into a few
+  // large pixmaps. Drawing one again copies its pixels rather than
+  // laying out and rasterizing the text, and all those on the same
+  // pixmap are drawn with one call. Once the pixmaps take too much
+  // memory they are cleared. Only for the GUI thread, as are pixmaps.
+  class spriteCache {
+  public:
+    spriteCache();
+
+    // Draw each label with the left end of its baseline at the given
+    // point, in the font and render hints of the painter, as
+    // QPainter::drawText() would.
+    void drawLabels(std::vector<QPoint>       const & points,
+                    std::vector<const char *> const & labels,
+                    QColor                    const & color,
+                    QPainter                        * paint);
+
+    // Draw filled circles of the given diameter centered at the points
+    void drawDots(std::vector<QPoint> const & points,
+                  std::vector<QColor> const & colors,
+                  int                         diameter,
+                  QPainter                  * paint);
+
+    void clear();
+
+  private:
+    struct sprite {
+      int    page;
+      QRect  source; // in the image of the page
+      QPoint corner; // of the sprite, relative to where it is drawn
+    };
+
+    // Make room for a sprite of the given size and draw it with
+    // 'draw', which gets a painter with the origin at its top-left
+    // corner. Return its index in m_sprites.
+    int addSprite(std::string const& key, QSize const& size, QPoint const& corner,
+                  std::function<void(QPainter &)> const& draw);
+    void drawSprites(std::vector<QPoint> const& points, std::vector<int> const& spriteIds,
+                     QPainter * paint);
+
+    std::unordered_map<std::string, int> m_spriteIds;
+    std::vector<sprite>                  m_sprites;
+    std::vector<QImage>                  m_pages;
+    std::vector<QPixmap>                 m_pixmaps; // of the pages, made again when they change
+    std::vector<char>                    m_pageChanged;
+    int                                  m_shelfX, m_shelfY, m_shelfHeight; // on the last page
+  };
+
+  // One dPoly of a frame to be drawn, with its style. If useSelection
+  // is true, only the polygons flagged in 'selection' are drawn.
+  struct renderLayer {
+    int              polyIndex; // index in renderFrame::polys
+    polyStyle        style;
+    bool             useSelection;
+    std::vector<int> selection;
+    renderLayer(): polyIndex(0), useSelection(false){}
+  };
+
+  // Everything the workers need to draw the geometry of one frame. The
+  // polygons are a snapshot, as the GUI may edit its own copy while
+  // the frame is being drawn. Frames share the snapshots of polygons
+  // which did not change.
+  struct renderFrame {
+    viewTransform                       T;
+    std::vector<std::shared_ptr<dPoly>> polys;
+    // The change ids of the polygons those were copied from. The
+    // copies lose their annotations, so their own ids differ.
+    std::vector<unsigned long long>     changeIds;
+    std::vector<renderLayer>            layers;
+
+    // If this frame draws the same as F, up to the view
+    bool sameLook(renderFrame const& F) const;
+  };
+
+}
+
+// Draw the geometry of a frame in screen tiles on a pool of worker
+// threads. Each finished tile is sent to the GUI thread with the
+// tileReady() signal. Starting a new frame makes the tiles of the
+// previous one stale; those which were not drawn yet are skipped.
+class tileRenderer: public QObject{
+  Q_OBJECT
+
+public:
+  tileRenderer(QObject * parent = NULL, int tileSize = 256);
+  ~tileRenderer();
+
+  // Start drawing the tiles of the given frame which intersect the
+  // given region of a screen of given size. Return the frame id, which
+  // is passed back with each of its tiles.
+  int startFrame(std::shared_ptr<utils::renderFrame> frame, QSize const& screenSize,
+                 QRegion const& region);
+
+  // Make the current frame stale
+  void cancel();
+
+  bool isCurrentFrame(int frameId) const { return frameId == m_currFrame->load(); }
+
+signals:
+  void tileReady(int frameId, QRect tileRect, QImage tile);
+
+private:
+  QThreadPool                       m_pool;
+  std::shared_ptr<std::atomic<int>> m_currFrame;
+  int                               m_tileSize;
+};
+
+#endif // TILE_RENDERER_H
@@ -51,6 +51,7 @@ void utils::printUsage(std::string progName){
   cout <<"     -gridWidth 1 "<<endl;
   cout <<"     -gridColor green "<<endl;
   cout <<"     -panelRatio 0.2  ([0-1] defines the ratio of the menu size to the display size)"<<endl;
+  cout <<"     -convert in.xg out.pvb  (convert between the .xg and binary .pvb formats and quit)"<<endl;
 #ifdef POLYVIEW_USE_OPENMP
   cout <<"     -nt  | -numThreads    number of threads to use for openmp loops"<<endl;
 #endif
@@ -188,6 +189,18 @@ void utils::parseCmdOptions(//inputs
       exit(0);
     }
 
+    if (strcasecmp(currArg, "-convert") == 0) {
+      if (argIter >= argc - 2) {
+        cerr << "Error: Expecting an input and an output file after -convert." << endl;
+        exit(1);
+      }
+      // The output format is given by the extension of the output file
+      dPoly poly;
+      if (!poly.readPoly(argv[argIter + 1], opt.plotAsPoints)) exit(1);
+      if (!poly.writePoly(argv[argIter + 2])) exit(1);
+      exit(0);
+    }
+
     if ( strcasecmp(currArg, "-p") == 0 || strcasecmp(currArg, "-points") == 0 ){
       opt.plotAsPoints = !opt.plotAsPoints;
       continue;
@@ -20,8 +20,8 @@ polyview_use_openmp {
 }
 
 
-SOURCES = gui/mainProg.cpp gui/polyView.cpp gui/appWindow.cpp gui/chooseFilesDlg.cpp gui/utils.cpp gui/documentation.cpp geom/dPoly.cpp geom/cutPoly.cpp geom/geomUtils.cpp geom/polyUtils.cpp geom/edgeUtils.cpp geom/dTree.cpp geom/kdTree.cpp
-HEADERS = gui/polyView.h gui/appWindow.h gui/chooseFilesDlg.h gui/utils.h geom/dPoly.h geom/cutPoly.h  geom/geomUtils.h geom/polyUtils.h geom/edgeUtils.h geom/dTree.h geom/kdTree.h geom/baseUtils.h
+SOURCES = gui/mainProg.cpp gui/polyView.cpp gui/appWindow.cpp gui/chooseFilesDlg.cpp gui/utils.cpp gui/documentation.cpp gui/tileRenderer.cpp gui/polyLoader.cpp geom/dPoly.cpp geom/cutPoly.cpp geom/geomUtils.cpp geom/polyUtils.cpp geom/edgeUtils.cpp geom/dTree.cpp geom/kdTree.cpp geom/pointCloud.cpp geom/annoTree.cpp geom/mappedFile.cpp geom/polyReader.cpp geom/polySnapshot.cpp geom/polyIndexFile.cpp
+HEADERS = gui/polyView.h gui/tileRenderer.h gui/polyLoader.h gui/appWindow.h gui/chooseFilesDlg.h gui/utils.h geom/dPoly.h geom/cutPoly.h  geom/geomUtils.h geom/polyUtils.h geom/edgeUtils.h geom/dTree.h geom/kdTree.h geom/pointCloud.h geom/annoTree.h geom/baseUtils.h geom/mappedFile.h geom/polyReader.h geom/polySnapshot.h geom/polyIndexFile.h
 
 # Install the executable 
 polyview.path = $$(INSTALL_DIR)/bin # install directory